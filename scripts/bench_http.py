@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""
+TinkLink-USB HTTP Backend Benchmark
+
+Measures requests/sec and latency for /api/status and static assets, plus
+the device's internal RAM, so the ESPAsyncWebServer build and the
+esp_http_server build (env:esp32s3_idfhttpd) can be compared on the same
+hardware. The backend is read from the tinklink_http_backend_info metric.
+
+For each endpoint, C client threads each send requests back to back for
+the given duration. Requests shed with 503 by admission control are
+counted separately and left out of the latency figures. Admission control
+limits each client IP to 10 requests/s, so build both firmwares with the
+limit raised for a throughput run:
+
+    PLATFORMIO_BUILD_FLAGS="-DTINKLINK_CLIENT_RATE=10000 -DTINKLINK_CLIENT_BURST=10000"
+
+Usage:
+    bench_http.py                             # 10 s per endpoint, 4 clients
+    bench_http.py -c 8 -d 30                  # 8 clients, 30 s per endpoint
+    bench_http.py --save async.json           # Save results for later
+    bench_http.py --compare async.json idf.json
+
+Typical comparison:
+    pio run -e esp32s3 -t upload && bench_http.py --save async.json
+    pio run -e esp32s3_idfhttpd -t upload && bench_http.py --save idf.json
+    bench_http.py --compare async.json idf.json
+
+Environment:
+    TINKLINK_HOST   Device hostname/IP (default: tinklink.local)
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+import threading
+import time
+import urllib.request
+import urllib.error
+
+ENDPOINTS = ['/api/status', '/style.css', '/']
+
+def get_host():
+    """Get device hostname from environment or default."""
+    return os.environ.get('TINKLINK_HOST', 'tinklink.local')
+
+def percentile(values, p):
+    """Nearest-rank percentile of a non-empty list."""
+    ordered = sorted(values)
+    index = max(0, min(len(ordered) - 1, int(round(p / 100 * len(ordered))) - 1))
+    return ordered[index]
+
+def read_metrics(host):
+    """Return backend name and heap gauges from /metrics."""
+    with urllib.request.urlopen(f"http://{host}/metrics", timeout=10) as response:
+        text = response.read().decode()
+
+    def gauge(pattern):
+        match = re.search(pattern + r' (\d+)', text)
+        return int(match.group(1)) if match else None
+
+    backend = re.search(r'tinklink_http_backend_info\{backend="([^"]+)"\}', text)
+    return {
+        'backend': backend.group(1) if backend else 'unknown',
+        'heap_free': gauge(r'tinklink_heap_free_bytes\{type="internal"\}'),
+        'heap_largest': gauge(r'tinklink_heap_largest_free_block_bytes\{type="internal"\}'),
+        'heap_min_free': gauge(r'tinklink_heap_min_free_bytes'),
+    }
+
+def client(host, path, deadline, results, lock):
+    """Send requests until the deadline; record latencies in ms."""
+    latencies, shed, errors = [], 0, 0
+    url = f"http://{host}{path}"
+    while time.perf_counter() < deadline:
+        start = time.perf_counter()
+        try:
+            with urllib.request.urlopen(url, timeout=5) as response:
+                response.read()
+            latencies.append((time.perf_counter() - start) * 1000)
+        except urllib.error.HTTPError as e:
+            if e.code == 503:
+                shed += 1
+            else:
+                errors += 1
+        except (urllib.error.URLError, OSError):
+            errors += 1
+    with lock:
+        results['latencies'].extend(latencies)
+        results['shed'] += shed
+        results['errors'] += errors
+
+def bench(host, path, clients, duration):
+    """Load one endpoint and summarize."""
+    results = {'latencies': [], 'shed': 0, 'errors': 0}
+    lock = threading.Lock()
+    deadline = time.perf_counter() + duration
+    threads = [threading.Thread(target=client, args=(host, path, deadline, results, lock))
+               for _ in range(clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    latencies = results['latencies']
+    return {
+        'requests': len(latencies),
+        'rps': len(latencies) / duration,
+        'p50': percentile(latencies, 50) if latencies else None,
+        'p99': percentile(latencies, 99) if latencies else None,
+        'shed': results['shed'],
+        'errors': results['errors'],
+    }
+
+def fmt_ms(value):
+    return f"{value:8.1f}" if value is not None else "       -"
+
+def fmt_bytes(value):
+    return f"{value:>10,}" if value is not None else "         -"
+
+def print_run(run):
+    """Print one saved or fresh run."""
+    print(f"Backend: {run['backend']}  ({run['clients']} clients, {run['duration']} s per endpoint)")
+    print(f"{'Endpoint':<16} {'req/s':>8} {'p50 ms':>8} {'p99 ms':>8} {'shed':>6} {'errors':>6}")
+    for path, r in run['endpoints'].items():
+        print(f"{path:<16} {r['rps']:8.1f} {fmt_ms(r['p50'])} {fmt_ms(r['p99'])} "
+              f"{r['shed']:6d} {r['errors']:6d}")
+    print(f"Internal heap idle:  free {fmt_bytes(run['idle']['heap_free'])}  "
+          f"largest block {fmt_bytes(run['idle']['heap_largest'])}")
+    print(f"Internal heap after: free {fmt_bytes(run['after']['heap_free'])}  "
+          f"min ever {fmt_bytes(run['after']['heap_min_free'])}")
+
+def compare(paths):
+    """Print saved runs side by side."""
+    runs = []
+    for path in paths:
+        with open(path) as f:
+            runs.append(json.load(f))
+
+    names = [run['backend'] for run in runs]
+    print(f"{'':<26}" + "".join(f"{name:>12}" for name in names))
+
+    def row(label, values, fmt):
+        print(f"{label:<26}" + "".join(fmt(v) for v in values))
+
+    num = lambda v: f"{v:12.1f}" if v is not None else f"{'-':>12}"
+    size = lambda v: f"{v:12,}" if v is not None else f"{'-':>12}"
+
+    row('heap free (idle)', [r['idle']['heap_free'] for r in runs], size)
+    row('largest block (idle)', [r['idle']['heap_largest'] for r in runs], size)
+    row('heap min ever', [r['after']['heap_min_free'] for r in runs], size)
+    for path in runs[0]['endpoints']:
+        endpoint = [r['endpoints'].get(path, {}) for r in runs]
+        row(f"{path} req/s", [e.get('rps') for e in endpoint], num)
+        row(f"{path} p50 ms", [e.get('p50') for e in endpoint], num)
+        row(f"{path} p99 ms", [e.get('p99') for e in endpoint], num)
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the TinkLink-USB HTTP server')
+    parser.add_argument('--host', default=get_host(), help='Device hostname/IP')
+    parser.add_argument('-c', '--clients', type=int, default=4, help='Concurrent clients')
+    parser.add_argument('-d', '--duration', type=float, default=10, help='Seconds per endpoint')
+    parser.add_argument('--save', metavar='FILE', help='Write results as JSON')
+    parser.add_argument('--compare', nargs='+', metavar='FILE', help='Compare saved results')
+    args = parser.parse_args()
+
+    if args.compare:
+        compare(args.compare)
+        return
+
+    if args.clients < 1 or args.duration <= 0:
+        print("Error: clients and duration must be positive", file=sys.stderr)
+        sys.exit(1)
+
+    try:
+        idle = read_metrics(args.host)
+    except (urllib.error.URLError, OSError) as e:
+        print(f"Error: Cannot reach {args.host}: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    run = {
+        'backend': idle['backend'],
+        'clients': args.clients,
+        'duration': args.duration,
+        'idle': idle,
+        'endpoints': {},
+    }
+    for path in ENDPOINTS:
+        print(f"Loading {path} ...", file=sys.stderr)
+        run['endpoints'][path] = bench(args.host, path, args.clients, args.duration)
+        time.sleep(1)  # Let admission control's token buckets refill
+    run['after'] = read_metrics(args.host)
+
+    print_run(run)
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(run, f, indent=2)
+        print(f"Saved to {args.save}")
+
+if __name__ == '__main__':
+    main()
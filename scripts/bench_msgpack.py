@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""
+TinkLink-USB MessagePack Benchmark
+
+Compare JSON and MessagePack responses from a TinkLink-USB device.
+For each endpoint, fetches the response N times in each format and
+reports payload size, round-trip time and the device-side encode time
+from the Server-Timing header (where the endpoint provides it).
+
+Usage:
+    bench_msgpack.py                      # 20 iterations per endpoint/format
+    bench_msgpack.py -n 100               # 100 iterations
+    bench_msgpack.py --host 192.168.1.100 # Use specific IP instead of mDNS
+
+Environment:
+    TINKLINK_HOST   Device hostname/IP (default: tinklink.local)
+"""
+
+import argparse
+import os
+import re
+import statistics
+import sys
+import time
+import urllib.request
+import urllib.error
+
+ENDPOINTS = ['/api/status', '/api/logs?count=100']
+
+FORMATS = [
+    ('json', 'application/json'),
+    ('msgpack', 'application/msgpack'),
+]
+
+def get_host():
+    """Get device hostname from environment or default."""
+    return os.environ.get('TINKLINK_HOST', 'tinklink.local')
+
+def parse_server_timing(header):
+    """Return the 'ser' duration in ms from a Server-Timing header, or None."""
+    if not header:
+        return None
+    match = re.search(r'ser;dur=([0-9.]+)', header)
+    return float(match.group(1)) if match else None
+
+def fetch(host, path, accept, timeout=5):
+    """Fetch one response. Returns (size, wall_ms, ser_ms)."""
+    url = f"http://{host}{path}"
+    req = urllib.request.Request(url, method='GET', headers={'Accept': accept})
+    start = time.perf_counter()
+    with urllib.request.urlopen(req, timeout=timeout) as response:
+        body = response.read()
+        timing = response.headers.get('Server-Timing')
+    wall_ms = (time.perf_counter() - start) * 1000
+    return len(body), wall_ms, parse_server_timing(timing)
+
+def bench(host, path, accept, iterations):
+    """Run one endpoint/format combination and summarize the results."""
+    sizes, walls, sers = [], [], []
+    for _ in range(iterations):
+        size, wall_ms, ser_ms = fetch(host, path, accept)
+        sizes.append(size)
+        walls.append(wall_ms)
+        if ser_ms is not None:
+            sers.append(ser_ms)
+    return {
+        'size': statistics.median(sizes),
+        'wall': statistics.median(walls),
+        'wall_p95': sorted(walls)[int(len(walls) * 0.95) - 1] if len(walls) > 1 else walls[0],
+        'ser': statistics.median(sers) if sers else None,
+    }
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare JSON and MessagePack API responses')
+    parser.add_argument('--host', default=get_host(), help='Device hostname/IP')
+    parser.add_argument('-n', '--iterations', type=int, default=20, help='Requests per endpoint and format')
+    args = parser.parse_args()
+
+    if args.iterations < 1:
+        print("Error: iterations must be at least 1", file=sys.stderr)
+        sys.exit(1)
+
+    print(f"Benchmarking {args.host} ({args.iterations} requests each)\n")
+    print(f"{'endpoint':<24} {'format':<8} {'bytes':>7} {'wall ms':>9} {'p95 ms':>8} {'ser ms':>8}")
+
+    for path in ENDPOINTS:
+        for name, accept in FORMATS:
+            try:
+                r = bench(args.host, path, accept, args.iterations)
+            except (urllib.error.URLError, OSError) as e:
+                print(f"Error: {path} ({name}): {e}", file=sys.stderr)
+                sys.exit(1)
+            ser = f"{r['ser']:.3f}" if r['ser'] is not None else '-'
+            print(f"{path:<24} {name:<8} {r['size']:>7.0f} {r['wall']:>9.1f} {r['wall_p95']:>8.1f} {ser:>8}")
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Pull OTA Manifest Builder for TinkLink-USB
+
+Prepares a directory that devices with pull OTA enabled can update from,
+and optionally serves it. Any static HTTP server that sends
+Content-Length works (nginx, `python -m http.server`, ...).
+
+Writes into the output directory:
+    firmware.bin.gz   gzip-compressed image (the device inflates it on the fly)
+    manifest.json     {"version", "firmware": {"url", "sha256", "size"}}
+
+The SHA-256 is of the uncompressed image, which the device verifies before
+committing the update. Point the device's "ota.manifestUrl" config at
+http://<server>:<port>/manifest.json.
+
+Usage:
+    python scripts/ota_manifest.py .pio/build/esp32s3/firmware.bin \\
+        --base-url http://192.168.1.10:8000 --out ota/
+    python scripts/ota_manifest.py .pio/build/esp32s3/firmware.bin \\
+        --base-url http://192.168.1.10:8000 --out ota/ --serve 8000
+
+The version defaults to TINKLINK_VERSION_STRING from src/version.h.
+"""
+
+import argparse
+import functools
+import gzip
+import hashlib
+import http.server
+import json
+import os
+import re
+import sys
+
+VERSION_HEADER = os.path.join(os.path.dirname(__file__), '..', 'src', 'version.h')
+
+
+def read_version() -> str | None:
+    """Read TINKLINK_VERSION_STRING from src/version.h."""
+    try:
+        with open(VERSION_HEADER) as f:
+            match = re.search(r'#define\s+TINKLINK_VERSION_STRING\s+"([^"]+)"', f.read())
+            return match.group(1) if match else None
+    except OSError:
+        return None
+
+
+def build(image_path: str, version: str, base_url: str, out_dir: str, compress: bool) -> dict:
+    """Write the image and manifest into out_dir and return the manifest."""
+    with open(image_path, 'rb') as f:
+        raw = f.read()
+
+    os.makedirs(out_dir, exist_ok=True)
+    name = 'firmware.bin.gz' if compress else 'firmware.bin'
+    payload = gzip.compress(raw, compresslevel=9, mtime=0) if compress else raw
+    with open(os.path.join(out_dir, name), 'wb') as f:
+        f.write(payload)
+
+    manifest = {
+        'version': version,
+        'firmware': {
+            'url': f"{base_url.rstrip('/')}/{name}",
+            'sha256': hashlib.sha256(raw).hexdigest(),
+            'size': len(payload),
+        },
+    }
+    with open(os.path.join(out_dir, 'manifest.json'), 'w') as f:
+        json.dump(manifest, f, indent=2)
+    return manifest
+
+
+def serve(out_dir: str, port: int) -> None:
+    """Serve out_dir over HTTP until interrupted."""
+    handler = functools.partial(http.server.SimpleHTTPRequestHandler, directory=out_dir)
+    with http.server.ThreadingHTTPServer(('', port), handler) as server:
+        print(f"Serving {out_dir} on port {port} (Ctrl+C to stop)")
+        try:
+            server.serve_forever()
+        except KeyboardInterrupt:
+            pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build a pull OTA manifest for TinkLink-USB')
+    parser.add_argument('image', help='Firmware image (.bin)')
+    parser.add_argument('--base-url', required=True,
+                        help='URL the output directory is served at, e.g. http://192.168.1.10:8000')
+    parser.add_argument('--out', default='ota', help='Output directory (default: ota)')
+    parser.add_argument('--version', dest='fw_version', default=None,
+                        help='Version to advertise (default: from src/version.h)')
+    parser.add_argument('--no-compress', action='store_true',
+                        help='Publish the raw image instead of gzip-compressing it')
+    parser.add_argument('--serve', type=int, metavar='PORT',
+                        help='Serve the output directory on this port after building')
+    args = parser.parse_args()
+
+    if not os.path.exists(args.image):
+        print(f"Error: File not found: {args.image}")
+        sys.exit(1)
+
+    version = args.fw_version or read_version()
+    if not version:
+        print("Error: Could not read version from src/version.h; pass --version")
+        sys.exit(1)
+
+    manifest = build(args.image, version, args.base_url, args.out, not args.no_compress)
+    print(f"Version:  {manifest['version']}")
+    print(f"Image:    {manifest['firmware']['url']} ({manifest['firmware']['size']:,} bytes)")
+    print(f"SHA-256:  {manifest['firmware']['sha256']}")
+
+    if args.serve:
+        serve(args.out, args.serve)
+
+
+if __name__ == '__main__':
+    main()
@@ -5,6 +5,11 @@ OTA Upload Script for TinkLink-USB
 Uploads firmware or filesystem to the device over WiFi.
 Can be run standalone or integrated with PlatformIO.
 
+Uploads use the device's resumable chunk protocol, so a WiFi drop only
+costs the chunk in flight. Images are gzip-compressed before upload (the device inflates them on the
+fly) and sent with the SHA-256 of the uncompressed image, which the device
+verifies before committing the update. Use --no-compress to send raw.
+
 Usage:
     python scripts/ota_upload.py firmware .pio/build/esp32s3/firmware.bin
     python scripts/ota_upload.py filesystem .pio/build/esp32s3/littlefs.bin
@@ -15,7 +20,11 @@ Environment variables:
 
 import sys
 import os
+import io
+import gzip
+import hashlib
 import time
+import zlib
 import argparse
 
 try:
@@ -57,7 +66,28 @@ def restore_config(host: str, backup: dict, retries: int = 5) -> bool:
     return False
 
 
-def upload_ota(host: str, filepath: str, mode: str, timeout: int = 120) -> bool:
+def prepare_image(filepath: str, compress: bool) -> tuple[bytes, str]:
+    """
+    Read an image and optionally gzip it.
+
+    Returns:
+        (payload bytes, hex SHA-256 of the uncompressed image)
+    """
+    with open(filepath, 'rb') as f:
+        raw = f.read()
+    digest = hashlib.sha256(raw).hexdigest()
+    if not compress:
+        return raw, digest
+
+    # mtime=0 keeps output reproducible for identical inputs
+    buf = io.BytesIO()
+    with gzip.GzipFile(fileobj=buf, mode='wb', compresslevel=9, mtime=0) as gz:
+        gz.write(raw)
+    return buf.getvalue(), digest
+
+
+def upload_ota(host: str, filepath: str, mode: str, timeout: int = 120,
+               compress: bool = True) -> bool:
     """
     Upload a binary file to the device via OTA.
 
@@ -66,12 +96,11 @@ def upload_ota(host: str, filepath: str, mode: str, timeout: int = 120) -> bool:
         filepath: Path to the .bin file
         mode: 'firmware' or 'fs' (filesystem)
         timeout: Upload timeout in seconds
+        compress: gzip the image before upload
 
     Returns:
         True if successful, False otherwise
     """
-    url = f"http://{host}/api/ota/upload"
-
     # Validate file exists
     if not os.path.exists(filepath):
         print(f"Error: File not found: {filepath}")
@@ -79,6 +108,9 @@ def upload_ota(host: str, filepath: str, mode: str, timeout: int = 120) -> bool:
 
     filesize = os.path.getsize(filepath)
     filename = os.path.basename(filepath)
+    payload, sha256 = prepare_image(filepath, compress)
+    if compress:
+        filename += '.gz'
 
     print(f"{'='*50}")
     print(f"OTA Upload")
@@ -87,6 +119,9 @@ def upload_ota(host: str, filepath: str, mode: str, timeout: int = 120) -> bool:
     print(f"File:     {filename}")
     print(f"Size:     {filesize:,} bytes ({filesize/1024:.1f} KB)")
     print(f"Mode:     {mode}")
+    if compress:
+        print(f"Upload:   {len(payload):,} bytes gzip ({len(payload)*100/filesize:.0f}%)")
+    print(f"SHA-256:  {sha256}")
     print(f"{'='*50}")
     print()
 
@@ -111,72 +146,72 @@ def upload_ota(host: str, filepath: str, mode: str, timeout: int = 120) -> bool:
     if mode == 'fs':
         print("Backing up device config...", end=" ", flush=True)
         config_backup = backup_config(host)
-        if config_backup:
+        if config_backup and config_backup.get("store") == "nvs":
+            # Settings live outside the filesystem and survive the upload
+            config_backup = None
+            print("SKIP (settings are kept in NVS)")
+        elif config_backup:
             print(f"OK ({len(config_backup)} sections)")
         else:
             print("SKIP (no config found or backup not supported)")
 
     # Upload file
     print(f"Uploading {filename}...")
+    start_time = time.time()
+
+    # Prefer the resumable chunked protocol; fall back to a single
+    # multipart upload for firmware that predates it
+    result = upload_resumable(host, payload, sha256, mode, timeout)
+    if result is None:
+        result = upload_multipart(host, filename, payload, sha256, mode, timeout)
+    if not result:
+        return False
 
-    try:
-        with open(filepath, 'rb') as f:
-            files = {'file': (filename, f, 'application/octet-stream')}
-            data = {'mode': mode}
-
-            start_time = time.time()
+    elapsed = time.time() - start_time
+    print(f"\nUpload complete! ({elapsed:.1f}s)")
+    print(f"Transfer rate: {len(payload)/elapsed/1024:.1f} KB/s")
+    print("\nDevice is rebooting...")
+
+    # Restore config after filesystem flash
+    if config_backup:
+        print("Waiting for device to come back online...", flush=True)
+        time.sleep(8)
+        print("Restoring config...", end=" ", flush=True)
+        if restore_config(host, config_backup):
+            print("OK")
+            print("Rebooting to apply restored config...")
+            try:
+                requests.post(f"http://{host}/api/system/reboot", timeout=5)
+            except Exception:
+                pass  # Connection drops on reboot
+        else:
+            print("FAILED")
+            print("WARNING: Could not restore config. You may need to reconfigure manually.")
+    else:
+        print("Wait a few seconds, then reconnect.")
+    return True
 
-            # Use a session for connection reuse
-            session = requests.Session()
 
-            resp = session.post(
-                url,
-                files=files,
-                data=data,
-                timeout=timeout
-            )
+def print_error_response(resp) -> None:
+    """Print the error carried by a failed device response."""
+    try:
+        result = resp.json()
+        print(f"Error: {result.get('error', resp.text)}")
+    except ValueError:
+        print(f"Response: {resp.text}")
 
-            elapsed = time.time() - start_time
 
-            if resp.status_code == 200:
-                print(f"\nUpload complete! ({elapsed:.1f}s)")
-                print(f"Transfer rate: {filesize/elapsed/1024:.1f} KB/s")
-
-                try:
-                    result = resp.json()
-                    print(f"Response: {result.get('message', 'OK')}")
-                except:
-                    pass
-
-                print("\nDevice is rebooting...")
-
-                # Restore config after filesystem flash
-                if config_backup:
-                    print("Waiting for device to come back online...", flush=True)
-                    time.sleep(8)
-                    print("Restoring config...", end=" ", flush=True)
-                    if restore_config(host, config_backup):
-                        print("OK")
-                        print("Rebooting to apply restored config...")
-                        try:
-                            requests.post(f"http://{host}/api/system/reboot", timeout=5)
-                        except Exception:
-                            pass  # Connection drops on reboot
-                    else:
-                        print("FAILED")
-                        print("WARNING: Could not restore config. You may need to reconfigure manually.")
-                else:
-                    print("Wait a few seconds, then reconnect.")
-                return True
-            else:
-                print(f"\nUpload failed! Status: {resp.status_code}")
-                try:
-                    result = resp.json()
-                    print(f"Error: {result.get('error', resp.text)}")
-                except:
-                    print(f"Response: {resp.text}")
-                return False
+def upload_multipart(host: str, filename: str, payload: bytes, sha256: str,
+                     mode: str, timeout: int) -> bool:
+    """Upload the whole image in one multipart request (/api/ota/upload)."""
+    url = f"http://{host}/api/ota/upload"
+    files = {'file': (filename, payload, 'application/octet-stream')}
+    # Form fields must precede the file part so the device sees them
+    # before the first chunk arrives
+    data = {'mode': mode, 'sha256': sha256}
 
+    try:
+        resp = requests.post(url, files=files, data=data, timeout=timeout)
     except requests.exceptions.Timeout:
         print("\nError: Upload timed out")
         print("The device may have rebooted during the update.")
@@ -186,6 +221,105 @@ def upload_ota(host: str, filepath: str, mode: str, timeout: int = 120) -> bool:
         print(f"\nError during upload: {e}")
         return False
 
+    if resp.status_code != 200:
+        print(f"\nUpload failed! Status: {resp.status_code}")
+        print_error_response(resp)
+        return False
+    return True
+
+
+def upload_resumable(host: str, payload: bytes, sha256: str, mode: str,
+                     timeout: int) -> bool | None:
+    """
+    Upload via the resumable chunk protocol (/api/ota/session + /api/ota/chunk).
+
+    Each chunk carries its offset and CRC32. On a dropped connection the
+    committed offset is re-queried and the upload continues from there, so
+    only the chunk in flight is re-sent. Gives up after `timeout` seconds
+    without progress.
+
+    Returns:
+        True/False for success/failure, or None if the device does not
+        support resumable uploads
+    """
+    base = f"http://{host}/api/ota"
+    session = requests.Session()
+    params = {'mode': mode, 'size': len(payload), 'sha256': sha256}
+
+    try:
+        resp = session.post(f"{base}/session", data=params, timeout=10)
+    except requests.exceptions.RequestException as e:
+        print(f"\nError starting upload session: {e}")
+        return False
+    if resp.status_code == 404:
+        return None
+    if resp.status_code != 200:
+        print(f"\nUpload session failed! Status: {resp.status_code}")
+        print_error_response(resp)
+        return False
+
+    info = resp.json()
+    chunk_size = int(info.get('chunkSize', 4096))
+    offset = int(info.get('offset', 0))
+    if offset > 0:
+        print(f"Resuming at offset {offset:,}")
+
+    last_progress = time.time()
+    last_percent = -1
+    while offset < len(payload):
+        chunk = payload[offset:offset + chunk_size]
+        crc = zlib.crc32(chunk) & 0xFFFFFFFF
+        try:
+            resp = session.post(
+                f"{base}/chunk",
+                params={'offset': offset, 'crc32': crc},
+                data=chunk,
+                headers={'Content-Type': 'application/octet-stream'},
+                timeout=15
+            )
+        except requests.exceptions.RequestException as e:
+            if time.time() - last_progress > timeout:
+                print(f"\nError: no progress for {timeout}s, giving up ({e})")
+                return False
+            print(f"\nConnection lost at {offset:,} bytes, retrying...", flush=True)
+            time.sleep(2)
+            session = requests.Session()
+            try:
+                # Re-open (resume) the session and pick up its committed offset
+                resp = session.post(f"{base}/session", data=params, timeout=10)
+                if resp.status_code == 200:
+                    offset = int(resp.json().get('offset', offset))
+            except requests.exceptions.RequestException:
+                pass
+            continue
+
+        if resp.status_code in (200, 409, 422):
+            # Server reports the committed offset in every chunk reply
+            new_offset = int(resp.json().get('offset', offset))
+            if new_offset > offset:
+                last_progress = time.time()
+            offset = new_offset
+        else:
+            print(f"\nUpload failed! Status: {resp.status_code}")
+            print_error_response(resp)
+            return False
+
+        percent = offset * 100 // len(payload)
+        if percent // 10 > last_percent // 10:
+            print(f"  {percent}%", flush=True)
+            last_percent = percent
+
+    try:
+        resp = session.post(f"{base}/finish", timeout=30)
+    except requests.exceptions.RequestException:
+        # The device reboots right after replying; a dropped reply is expected
+        return True
+    if resp.status_code != 200:
+        print(f"\nUpdate failed! Status: {resp.status_code}")
+        print_error_response(resp)
+        return False
+    return True
+
 
 def main():
     parser = argparse.ArgumentParser(
@@ -226,12 +360,19 @@ Environment:
         help='Upload timeout in seconds (default: 120)'
     )
 
+    parser.add_argument(
+        '--no-compress',
+        action='store_true',
+        help='Upload the raw image instead of gzip-compressing it'
+    )
+
     args = parser.parse_args()
 
     # Normalize mode
     mode = 'fs' if args.mode in ('fs', 'filesystem') else 'firmware'
 
-    success = upload_ota(args.host, args.file, mode, args.timeout)
+    success = upload_ota(args.host, args.file, mode, args.timeout,
+                         compress=not args.no_compress)
     sys.exit(0 if success else 1)
 
 
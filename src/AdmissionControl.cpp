@@ -0,0 +1,103 @@
+#include "AdmissionControl.h"
+#include <esp_heap_caps.h>
+
+/// Concurrency limit per class, indexed by AdmissionControl::Class (0 = unlimited)
+static const uint8_t CLASS_LIMITS[] = {0, 4, 6, 2};
+
+/// A request costs one token
+static const uint32_t TOKEN_COST = 1000;
+
+AdmissionControl::AdmissionControl() {
+    memset(_buckets, 0, sizeof(_buckets));
+    memset(_inFlight, 0, sizeof(_inFlight));
+}
+
+AdmissionControl::Class AdmissionControl::classify(const String& url,
+                                                   HttpMethod method) {
+    // Device commands - the reason the box exists
+    if (url == "/api/tink/send" || url == "/api/switcher/send" || url == "/api/avr/send") {
+        return Class::CONTROL;
+    }
+    if (url == "/api/batch" && method == HTTP_POST) return Class::CONTROL;
+
+    // An OTA in progress must not be cut off halfway, and reboot is tiny
+    if (url.startsWith("/api/ota/") && url != "/api/ota/status") return Class::CONTROL;
+    if (url == "/api/system/reboot") return Class::CONTROL;
+
+    // WiFi scans are served from WifiManager's cache, so they are light
+    if (url == "/metrics" || url == "/api/logs" || url == "/api/diagnostics" ||
+        url == "/api/avr/discover" ||
+        url.startsWith("/api/config/backup") || url.startsWith("/api/config/restore")) {
+        return Class::HEAVY;
+    }
+
+    if (url.startsWith("/api/")) return Class::LIGHT;
+    return Class::STATIC;
+}
+
+AdmissionControl::Verdict AdmissionControl::admit(Class cls, uint32_t clientIp,
+                                                  unsigned long now, uint32_t& retryAfter) {
+    retryAfter = 0;
+    int i = (int)cls;
+
+    if (cls == Class::CONTROL) {
+        _inFlight[i]++;
+        return Verdict::ADMIT;
+    }
+
+    if (cls == Class::STATIC || cls == Class::HEAVY) {
+        if (heap_caps_get_free_size(MALLOC_CAP_INTERNAL) < MIN_FREE_HEAP ||
+            heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL) < MIN_LARGEST_BLOCK) {
+            retryAfter = 2;
+            return Verdict::SHED_HEAP;
+        }
+    }
+
+    if (_inFlight[i] >= CLASS_LIMITS[i]) {
+        retryAfter = 1;
+        return Verdict::SHED_CONCURRENCY;
+    }
+
+    Bucket& bucket = bucketFor(clientIp, now);
+    if (bucket.milliTokens < TOKEN_COST) {
+        // Tokens refill at CLIENT_RATE_PER_SEC per second (milli-tokens per ms)
+        uint32_t waitMs = (TOKEN_COST - bucket.milliTokens) / CLIENT_RATE_PER_SEC;
+        retryAfter = waitMs / 1000 + 1;
+        return Verdict::SHED_RATE;
+    }
+    bucket.milliTokens -= TOKEN_COST;
+
+    _inFlight[i]++;
+    return Verdict::ADMIT;
+}
+
+void AdmissionControl::release(Class cls) {
+    int i = (int)cls;
+    if (_inFlight[i] > 0) _inFlight[i]--;
+}
+
+AdmissionControl::Bucket& AdmissionControl::bucketFor(uint32_t ip, unsigned long now) {
+    Bucket* oldest = &_buckets[0];
+    for (Bucket& b : _buckets) {
+        if (b.ip == ip && b.lastSeen != 0) {
+            uint32_t elapsed = now - b.lastSeen;
+            uint32_t max = CLIENT_BURST * TOKEN_COST;
+            uint32_t refill = elapsed * CLIENT_RATE_PER_SEC;
+            // Guard the multiply against long idle periods
+            if (elapsed > max / CLIENT_RATE_PER_SEC || b.milliTokens + refill > max) {
+                b.milliTokens = max;
+            } else {
+                b.milliTokens += refill;
+            }
+            b.lastSeen = now;
+            return b;
+        }
+        if (b.lastSeen < oldest->lastSeen) oldest = &b;
+    }
+
+    // New client (or recycled slot) starts with a full burst
+    oldest->ip = ip;
+    oldest->milliTokens = CLIENT_BURST * TOKEN_COST;
+    oldest->lastSeen = now ? now : 1;
+    return *oldest;
+}
@@ -0,0 +1,116 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <Arduino.h>
+#include "HttpServer.h"
+
+// Per-client rate limit defaults; a single-host benchmark (scripts/bench_http.py)
+// builds with these raised so it measures the server rather than the limiter
+#ifndef TINKLINK_CLIENT_RATE
+#define TINKLINK_CLIENT_RATE 10
+#endif
+#ifndef TINKLINK_CLIENT_BURST
+#define TINKLINK_CLIENT_BURST 30
+#endif
+
+/**
+ * Decides whether an incoming HTTP request is served or shed with 503.
+ *
+ * Requests are sorted into classes by endpoint. Each class has its own
+ * concurrency limit, and every client IP has a token bucket shared by all
+ * its requests. Expensive classes (static files, scans, logs, backups,
+ * metrics) are also shed while free heap or the largest free block is
+ * below a threshold, since those are what push the server into
+ * allocation failures. Device control requests are never shed, so
+ * switching stays responsive while the web UI is being hammered.
+ *
+ * All methods run on the HTTP server task (HttpServer's admission and
+ * finish hooks), so no locking is needed.
+ *
+ * Usage:
+ *   uint32_t retryAfter;
+ *   AdmissionControl::Class cls = AdmissionControl::classify(url, method);
+ *   if (admission.admit(cls, ip, millis(), retryAfter) == Verdict::ADMIT) {
+ *       ... serve, then admission.release(cls) when the connection closes
+ *   }
+ */
+class AdmissionControl {
+public:
+    /** Endpoint classes, cheapest first */
+    enum class Class : uint8_t {
+        CONTROL,  ///< Device commands, OTA, reboot - never shed
+        LIGHT,    ///< Small JSON reads and config writes
+        STATIC,   ///< Files from LittleFS (web UI)
+        HEAVY,    ///< Scans, discovery, logs, diagnostics, backup/restore, metrics
+        COUNT
+    };
+
+    /** Outcome of admit() */
+    enum class Verdict : uint8_t {
+        ADMIT,
+        SHED_CONCURRENCY,  ///< Too many requests of this class in flight
+        SHED_RATE,         ///< Client's token bucket is empty
+        SHED_HEAP          ///< Heap too low for an expensive request
+    };
+
+    // Heap thresholds (internal RAM) below which STATIC and HEAVY are shed
+    static const size_t MIN_FREE_HEAP = 24 * 1024;
+    static const size_t MIN_LARGEST_BLOCK = 12 * 1024;
+
+    // Per-client token bucket: sustained requests per second and burst size
+    static const uint32_t CLIENT_RATE_PER_SEC = TINKLINK_CLIENT_RATE;
+    static const uint32_t CLIENT_BURST = TINKLINK_CLIENT_BURST;
+
+    /** Distinct clients tracked; the least recently seen is recycled */
+    static const uint8_t MAX_CLIENTS = 8;
+
+    AdmissionControl();
+
+    /**
+     * Classify a request by path and method.
+     * @param url Request path
+     * @param method Request method
+     * @return Endpoint class
+     */
+    static Class classify(const String& url, HttpMethod method);
+
+    /**
+     * Decide whether to serve a request. An admitted request counts as in
+     * flight until release() is called for it.
+     * @param cls Endpoint class
+     * @param clientIp Client IPv4 address
+     * @param now Current millis()
+     * @param retryAfter Set to the suggested Retry-After in seconds when shed
+     * @return ADMIT or the reason the request is shed
+     */
+    Verdict admit(Class cls, uint32_t clientIp, unsigned long now, uint32_t& retryAfter);
+
+    /**
+     * Mark an admitted request as finished.
+     * @param cls Class the request was admitted under
+     */
+    void release(Class cls);
+
+    /**
+     * Get the number of admitted requests still in flight.
+     * @param cls Endpoint class
+     * @return Requests in flight
+     */
+    uint8_t getInFlight(Class cls) const { return _inFlight[(int)cls]; }
+
+private:
+    /** Token bucket for one client; tokens are in thousandths */
+    struct Bucket {
+        uint32_t ip;
+        uint32_t milliTokens;
+        unsigned long lastSeen;
+    };
+
+    Bucket _buckets[MAX_CLIENTS];
+    uint8_t _inFlight[(int)Class::COUNT];
+
+    /** Find or recycle the bucket for a client, refilled up to now. */
+    Bucket& bucketFor(uint32_t ip, unsigned long now);
+};
+
+#endif // ADMISSION_CONTROL_H
@@ -0,0 +1,101 @@
+#include "ApiResponse.h"
+#include <memory>
+
+const char* const ApiResponse::JSON_TYPE = "application/json";
+const char* const ApiResponse::MSGPACK_TYPE = "application/msgpack";
+
+/** Server-Timing value for an encode that took `us` microseconds. */
+static String serverTiming(unsigned long us) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "ser;dur=%.3f", us / 1000.0);
+    return String(buf);
+}
+
+void ApiResponse::send(HttpRequest* request, int code, const JsonDocument& doc) {
+    unsigned long start = micros();
+    HttpResponse* response;
+
+    if (wantsMsgPack(request)) {
+        HttpResponseStream* stream = request->beginResponseStream(MSGPACK_TYPE);
+        stream->setCode(code);
+        serializeMsgPack(doc, *stream);
+        response = stream;
+    } else {
+        String body;
+        serializeJson(doc, body);
+        response = request->beginResponse(code, JSON_TYPE, body);
+    }
+
+    response->addHeader("Server-Timing", serverTiming(micros() - start));
+    request->send(response);
+}
+
+void ApiResponse::send(HttpRequest* request, int code, const String& json) {
+    if (!wantsMsgPack(request)) {
+        request->send(code, JSON_TYPE, json);
+        return;
+    }
+
+    JsonDocument doc;
+    deserializeJson(doc, json);
+    send(request, code, doc);
+}
+
+bool ApiResponse::wantsMsgPack(HttpRequest* request) {
+    if (!request->hasHeader("Accept")) return false;
+    return request->getHeader("Accept")->value().indexOf(MSGPACK_TYPE) >= 0;
+}
+
+bool ApiResponse::isMsgPackBody(HttpRequest* request) {
+    return request->contentType().indexOf(MSGPACK_TYPE) >= 0;
+}
+
+void ApiResponse::appendMsgPack(JsonVariantConst doc, String& out) {
+    size_t len = measureMsgPack(doc);
+    std::unique_ptr<char[]> buf(new char[len]);
+    serializeMsgPack(doc, buf.get(), len);
+    out.concat(buf.get(), len);
+}
+
+/** Append a type byte followed by a big-endian 32-bit length. */
+static void appendMarker32(uint8_t type, uint32_t size, String& out) {
+    char buf[5] = {
+        (char)type,
+        (char)(size >> 24), (char)(size >> 16), (char)(size >> 8), (char)size
+    };
+    out.concat(buf, sizeof(buf));
+}
+
+void ApiResponse::appendMsgPackMap(uint32_t size, String& out) {
+    if (size < 16) {
+        char b = (char)(0x80 | size);  // fixmap
+        out.concat(&b, 1);
+    } else {
+        appendMarker32(0xdf, size, out);  // map32
+    }
+}
+
+void ApiResponse::appendMsgPackArray(uint32_t size, String& out) {
+    if (size < 16) {
+        char b = (char)(0x90 | size);  // fixarray
+        out.concat(&b, 1);
+    } else {
+        appendMarker32(0xdd, size, out);  // array32
+    }
+}
+
+void ApiResponse::appendMsgPackStr(const char* str, String& out) {
+    uint32_t len = strlen(str);
+    if (len < 32) {
+        char b = (char)(0xa0 | len);  // fixstr
+        out.concat(&b, 1);
+    } else {
+        appendMarker32(0xdb, len, out);  // str32
+    }
+    out.concat(str, len);
+}
+
+void ApiResponse::appendMsgPackNil(String& out) {
+    char b = (char)0xc0;
+    out.concat(&b, 1);
+}
@@ -0,0 +1,93 @@
+#ifndef API_RESPONSE_H
+#define API_RESPONSE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "HttpServer.h"
+
+/**
+ * Sends API responses as JSON or MessagePack.
+ *
+ * Clients that send "Accept: application/msgpack" get the same document
+ * encoded as MessagePack; everyone else gets JSON. Responses built from a
+ * document carry a Server-Timing header ("ser;dur=<ms>") with the time
+ * spent encoding, which scripts/bench_msgpack.py uses to compare formats.
+ *
+ * Streamed endpoints (logs, backup) use the append helpers to emit
+ * MessagePack piece by piece through ChunkedResponse.
+ *
+ * Usage:
+ *   JsonDocument doc;
+ *   doc["status"] = "ok";
+ *   ApiResponse::send(request, 200, doc);
+ *   ApiResponse::send(request, 400, "{\"error\":\"Missing parameter\"}");
+ */
+class ApiResponse {
+public:
+    /**
+     * Send a document in the format the client asked for.
+     * @param request The request being answered
+     * @param code HTTP status code
+     * @param doc Response document
+     */
+    static void send(HttpRequest* request, int code, const JsonDocument& doc);
+
+    /**
+     * Send a JSON text response, re-encoded as MessagePack if requested.
+     * @param request The request being answered
+     * @param code HTTP status code
+     * @param json JSON text
+     */
+    static void send(HttpRequest* request, int code, const String& json);
+    static void send(HttpRequest* request, int code, const char* json) {
+        send(request, code, String(json));
+    }
+
+    /**
+     * Check whether the client prefers MessagePack.
+     * @param request The request to inspect
+     * @return true if the Accept header lists application/msgpack
+     */
+    static bool wantsMsgPack(HttpRequest* request);
+
+    /**
+     * Check whether a request body is MessagePack.
+     * @param request The request to inspect
+     * @return true if Content-Type is application/msgpack
+     */
+    static bool isMsgPackBody(HttpRequest* request);
+
+    /**
+     * Append a document as MessagePack to a streamed response piece.
+     * @param doc Document (or element) to encode
+     * @param out String to append to (binary-safe)
+     */
+    static void appendMsgPack(JsonVariantConst doc, String& out);
+
+    /**
+     * Append MessagePack container headers for hand-streamed responses.
+     * The caller then appends exactly `size` elements (or key/value pairs).
+     * @param size Number of elements or pairs that follow
+     * @param out String to append to (binary-safe)
+     */
+    static void appendMsgPackMap(uint32_t size, String& out);
+    static void appendMsgPackArray(uint32_t size, String& out);
+
+    /**
+     * Append a string (typically a map key) as MessagePack.
+     * @param str String to encode
+     * @param out String to append to (binary-safe)
+     */
+    static void appendMsgPackStr(const char* str, String& out);
+
+    /**
+     * Append a MessagePack nil (placeholder for an element that went away).
+     * @param out String to append to
+     */
+    static void appendMsgPackNil(String& out);
+
+    static const char* const JSON_TYPE;
+    static const char* const MSGPACK_TYPE;
+};
+
+#endif // API_RESPONSE_H
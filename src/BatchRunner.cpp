@@ -0,0 +1,238 @@
+#include "BatchRunner.h"
+#include "Devices.h"
+#include "Switcher.h"
+#include "RetroTink.h"
+#include "DenonAvr.h"
+#include "Logger.h"
+
+BatchRunner::BatchRunner()
+    : _devices(nullptr)
+    , _batchStart(0)
+    , _stepStart(0)
+{
+    memset(&_status, 0, sizeof(_status));
+    memset(&_history, 0, sizeof(_history));
+}
+
+void BatchRunner::begin(Devices* devices) {
+    _devices = devices;
+}
+
+bool BatchRunner::parse(JsonArrayConst steps, std::vector<BatchStep>& out, String& error) {
+    out.clear();
+
+    if (steps.size() == 0) {
+        error = "Batch has no steps";
+        return false;
+    }
+    if (steps.size() > BatchStatus::MAX_STEPS) {
+        error = "Too many steps (max " + String(BatchStatus::MAX_STEPS) + ")";
+        return false;
+    }
+
+    for (JsonObjectConst obj : steps) {
+        BatchStep step;
+        step.value = 0;
+        step.ms = 0;
+        String prefix = "Step " + String(out.size() + 1) + ": ";
+
+        if (obj["device"].is<const char*>()) {
+            String device = obj["device"].as<const char*>();
+            step.text = obj["command"] | "";
+            if (step.text.length() == 0) {
+                error = prefix + "missing command";
+                return false;
+            }
+            if (device == "tink") {
+                step.type = BatchStep::Type::SEND_TINK;
+            } else if (device == "switcher") {
+                step.type = BatchStep::Type::SEND_SWITCHER;
+            } else if (device == "avr") {
+                step.type = BatchStep::Type::SEND_AVR;
+            } else {
+                error = prefix + "unknown device '" + device + "'";
+                return false;
+            }
+        } else if (obj["delay"].is<unsigned long>()) {
+            step.type = BatchStep::Type::DELAY;
+            step.ms = obj["delay"].as<unsigned long>();
+        } else if (obj["wait"].is<const char*>()) {
+            String wait = obj["wait"].as<const char*>();
+            step.ms = obj["timeout"] | (unsigned long)DEFAULT_WAIT_TIMEOUT_MS;
+            if (wait == "tink_on") {
+                step.type = BatchStep::Type::WAIT_TINK_ON;
+            } else if (wait == "tink_connected") {
+                step.type = BatchStep::Type::WAIT_TINK_CONNECTED;
+            } else if (wait == "avr_connected") {
+                step.type = BatchStep::Type::WAIT_AVR_CONNECTED;
+            } else if (wait == "avr_response") {
+                step.type = BatchStep::Type::WAIT_AVR_RESPONSE;
+                step.text = obj["value"] | "";
+                if (step.text.length() == 0) {
+                    error = prefix + "avr_response needs a value";
+                    return false;
+                }
+            } else if (wait == "switcher_input") {
+                step.type = BatchStep::Type::WAIT_SWITCHER_INPUT;
+                step.value = obj["value"] | 0;
+                if (step.value <= 0) {
+                    error = prefix + "switcher_input needs an input number";
+                    return false;
+                }
+            } else {
+                error = prefix + "unknown wait condition '" + wait + "'";
+                return false;
+            }
+        } else {
+            error = prefix + "expected device, delay or wait";
+            return false;
+        }
+
+        if (step.ms > MAX_STEP_MS) {
+            error = prefix + "delay/timeout exceeds " + String(MAX_STEP_MS) + " ms";
+            return false;
+        }
+
+        out.push_back(step);
+    }
+    return true;
+}
+
+void BatchRunner::start(uint32_t id, std::vector<BatchStep>&& steps) {
+    if (_status.state == BatchStatus::State::RUNNING) {
+        LOG_WARN("Batch: #%u aborted by batch #%u", _status.id, id);
+        _status.state = BatchStatus::State::FAILED;
+        snprintf(_status.error, sizeof(_status.error), "Aborted by batch #%u", id);
+        publish();
+    }
+
+    _steps = std::move(steps);
+    _batchStart = millis();
+    _stepStart = _batchStart;
+
+    memset(&_status, 0, sizeof(_status));
+    _status.id = id;
+    _status.state = BatchStatus::State::RUNNING;
+    _status.stepCount = _steps.size();
+    _status.steps[0].state = BatchStatus::StepState::RUNNING;
+
+    // New entry at the end, dropping the oldest when full
+    if (_history.count == BatchHistory::MAX_BATCHES) {
+        memmove(&_history.batches[0], &_history.batches[1],
+                sizeof(BatchStatus) * (BatchHistory::MAX_BATCHES - 1));
+        _history.count--;
+    }
+    _history.count++;
+    publish();
+
+    LOG_INFO("Batch: #%u started (%u steps)", id, _steps.size());
+}
+
+void BatchRunner::update() {
+    // Execute as many steps as are ready; stop on a pending delay or wait
+    while (_status.state == BatchStatus::State::RUNNING) {
+        const BatchStep& step = _steps[_status.currentStep];
+        unsigned long now = millis();
+
+        switch (step.type) {
+            case BatchStep::Type::SEND_TINK:
+            case BatchStep::Type::SEND_SWITCHER:
+            case BatchStep::Type::SEND_AVR:
+                if (runSend(step)) {
+                    finishStep(BatchStatus::StepState::OK);
+                } else {
+                    finishStep(BatchStatus::StepState::FAILED, "Command could not be sent");
+                }
+                break;
+
+            case BatchStep::Type::DELAY:
+                if (now - _stepStart < step.ms) return;
+                finishStep(BatchStatus::StepState::OK);
+                break;
+
+            default:
+                if (conditionMet(step)) {
+                    finishStep(BatchStatus::StepState::OK);
+                } else if (now - _stepStart >= step.ms) {
+                    finishStep(BatchStatus::StepState::TIMEOUT, "Wait timed out");
+                } else {
+                    return;
+                }
+                break;
+        }
+    }
+}
+
+bool BatchRunner::runSend(const BatchStep& step) {
+    Switcher* switcher = _devices->switcher();
+    DenonAvr* avr = _devices->avr();
+    switch (step.type) {
+        case BatchStep::Type::SEND_TINK:
+            _devices->tink()->sendRawCommand(step.text);
+            return true;
+
+        case BatchStep::Type::SEND_SWITCHER:
+            if (!switcher) return false;
+            switcher->sendCommand(step.text.c_str());
+            return true;
+
+        case BatchStep::Type::SEND_AVR:
+            return avr && avr->sendRawCommand(step.text);
+
+        default:
+            return false;
+    }
+}
+
+bool BatchRunner::conditionMet(const BatchStep& step) const {
+    RetroTink* tink = _devices->tink();
+    Switcher* switcher = _devices->switcher();
+    DenonAvr* avr = _devices->avr();
+    switch (step.type) {
+        case BatchStep::Type::WAIT_TINK_ON:
+            return tink->getPowerState() == RT4KPowerState::ON;
+        case BatchStep::Type::WAIT_TINK_CONNECTED:
+            return tink->isConnected();
+        case BatchStep::Type::WAIT_AVR_CONNECTED:
+            return avr && avr->isConnected();
+        case BatchStep::Type::WAIT_AVR_RESPONSE:
+            return avr && avr->getLastResponse().startsWith(step.text);
+        case BatchStep::Type::WAIT_SWITCHER_INPUT:
+            return switcher && switcher->getCurrentInput() == step.value;
+        default:
+            return true;
+    }
+}
+
+void BatchRunner::finishStep(BatchStatus::StepState result, const char* error) {
+    unsigned long now = millis();
+    uint8_t index = _status.currentStep;
+
+    _status.steps[index].state = result;
+    _status.steps[index].startedAt = _stepStart - _batchStart;
+    _status.steps[index].finishedAt = now - _batchStart;
+    _status.elapsed = now - _batchStart;
+
+    if (result != BatchStatus::StepState::OK) {
+        _status.state = BatchStatus::State::FAILED;
+        snprintf(_status.error, sizeof(_status.error), "Step %u: %s", index + 1, error);
+        LOG_WARN("Batch: #%u failed at step %u (%s)", _status.id, index + 1, error);
+    } else if (index + 1 >= _status.stepCount) {
+        _status.state = BatchStatus::State::DONE;
+        LOG_INFO("Batch: #%u done in %lu ms", _status.id, now - _batchStart);
+    } else {
+        _status.currentStep = index + 1;
+        _status.steps[index + 1].state = BatchStatus::StepState::RUNNING;
+        _stepStart = now;
+    }
+
+    if (_status.state != BatchStatus::State::RUNNING) {
+        _steps.clear();
+    }
+    publish();
+}
+
+void BatchRunner::publish() {
+    _history.batches[_history.count - 1] = _status;
+    _published.store(_history);
+}
@@ -0,0 +1,162 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <vector>
+#include "Seqlock.h"
+
+class Devices;
+
+/**
+ * One step of a command batch.
+ *
+ * JSON forms accepted by BatchRunner::parse():
+ * - {"device":"tink"|"switcher"|"avr", "command":"..."} - send a command
+ * - {"delay":ms}                                       - pause
+ * - {"wait":"tink_on"|"tink_connected"|"avr_connected"|"avr_response"|"switcher_input",
+ *    "value":..., "timeout":ms}                         - wait for a condition
+ */
+struct BatchStep {
+    enum class Type : uint8_t {
+        SEND_TINK,
+        SEND_SWITCHER,
+        SEND_AVR,
+        DELAY,
+        WAIT_TINK_ON,
+        WAIT_TINK_CONNECTED,
+        WAIT_AVR_CONNECTED,
+        WAIT_AVR_RESPONSE,     ///< Last AVR response starts with text
+        WAIT_SWITCHER_INPUT    ///< Switcher on input number
+    };
+
+    Type type;
+    String text;           ///< Command text, or response prefix for WAIT_AVR_RESPONSE
+    int value;             ///< Input number for WAIT_SWITCHER_INPUT
+    unsigned long ms;      ///< Delay length, or wait timeout
+};
+
+/**
+ * Progress of the current (or last) batch, published for the web API.
+ * Plain data so it can go through a Seqlock. Times are milliseconds
+ * relative to the start of the batch.
+ */
+struct BatchStatus {
+    static const size_t MAX_STEPS = 16;
+
+    enum class State : uint8_t { IDLE, RUNNING, DONE, FAILED };
+    enum class StepState : uint8_t { PENDING, RUNNING, OK, FAILED, TIMEOUT };
+
+    struct Step {
+        StepState state;
+        uint32_t startedAt;
+        uint32_t finishedAt;
+    };
+
+    uint32_t id;
+    State state;
+    uint8_t stepCount;
+    uint8_t currentStep;
+    uint32_t elapsed;       ///< Total run time so far
+    char error[48];
+    Step steps[MAX_STEPS];
+};
+
+/**
+ * Status of the last few batches, oldest first, so each can be looked up
+ * by id after a newer one has started. Plain data like BatchStatus.
+ */
+struct BatchHistory {
+    static const size_t MAX_BATCHES = 4;
+
+    uint8_t count;  ///< Entries in use
+    BatchStatus batches[MAX_BATCHES];
+
+    /** @return Status of batch `id`, or nullptr if it is not (or no longer) listed */
+    const BatchStatus* find(uint32_t id) const {
+        for (uint8_t i = 0; i < count; i++) {
+            if (batches[i].id == id) return &batches[i];
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * Runs batches of device commands on the loop task.
+ *
+ * A batch is an ordered list of sends, delays and waits. Steps are executed
+ * by update() without blocking: delays and waits simply hold the batch on
+ * their step until the time passes or the condition holds. Only one batch
+ * runs at a time; the web API refuses a new one while one is running.
+ *
+ * Progress, including per-step start/finish times, is published for the
+ * last MAX_BATCHES batches through a Seqlock so HTTP handlers can read it
+ * from the AsyncTCP task.
+ */
+class BatchRunner {
+public:
+    BatchRunner();
+
+    /**
+     * Set the devices the batch drives. Looked up on every step, so a
+     * switcher or AVR replaced by a config change is picked up.
+     * @param devices Device owner
+     */
+    void begin(Devices* devices);
+
+    /**
+     * Parse a JSON array of steps. Safe to call from any task.
+     * @param steps JSON array of step objects
+     * @param out Receives the parsed steps
+     * @param error Set to a description of the first invalid step
+     * @return true if all steps are valid
+     */
+    static bool parse(JsonArrayConst steps, std::vector<BatchStep>& out, String& error);
+
+    /**
+     * Start a batch (loop task only). Callers check that none is running;
+     * one that still is gets marked failed rather than dropped silently.
+     * @param id Batch id reported in the status
+     * @param steps Steps to run
+     */
+    void start(uint32_t id, std::vector<BatchStep>&& steps);
+
+    /** Advance the running batch. Must be called from loop(). */
+    void update();
+
+    /**
+     * Read the published status of the recent batches (any task).
+     * @param out Receives the history
+     */
+    void getHistory(BatchHistory& out) const { _published.load(out); }
+
+    /** Longest accepted delay or wait timeout */
+    static const unsigned long MAX_STEP_MS = 60000;
+
+    /** Wait timeout when a step does not give one */
+    static const unsigned long DEFAULT_WAIT_TIMEOUT_MS = 10000;
+
+private:
+    Devices* _devices;
+
+    std::vector<BatchStep> _steps;
+    BatchStatus _status;          ///< Running (or last) batch, also the newest history entry
+    BatchHistory _history;
+    Seqlock<BatchHistory> _published;
+    unsigned long _batchStart;
+    unsigned long _stepStart;
+
+    /** Execute a send step. @return false if the command could not be sent */
+    bool runSend(const BatchStep& step);
+
+    /** @return true if a wait step's condition holds */
+    bool conditionMet(const BatchStep& step) const;
+
+    /** Mark the current step finished and move on (or end the batch). */
+    void finishStep(BatchStatus::StepState result, const char* error = nullptr);
+
+    /** Copy _status into its history entry and publish the history. */
+    void publish();
+};
+
+#endif // BATCH_RUNNER_H
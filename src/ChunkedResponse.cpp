@@ -0,0 +1,55 @@
+#include "ChunkedResponse.h"
+#include <memory>
+
+namespace {
+
+/** Per-response streaming state, shared with the filler callback. */
+struct ChunkState {
+    ChunkGenerator generator;
+    String pending;      ///< Current piece not yet copied out
+    size_t pendingPos;   ///< Bytes of `pending` already sent
+    bool done;           ///< Generator reported end of body
+};
+
+}  // namespace
+
+HttpResponse* ChunkedResponse::create(HttpRequest* request,
+                                      const char* contentType,
+                                      ChunkGenerator generator) {
+    auto state = std::make_shared<ChunkState>();
+    state->generator = std::move(generator);
+    state->pendingPos = 0;
+    state->done = false;
+
+    return request->beginChunkedResponse(contentType,
+        [state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            size_t written = 0;
+
+            while (written < maxLen) {
+                if (state->pendingPos >= state->pending.length()) {
+                    if (state->done) break;
+
+                    // Current piece drained - ask the generator for the next one
+                    state->pending = "";
+                    state->pendingPos = 0;
+                    if (!state->generator(state->pending)) {
+                        state->done = true;
+                    }
+                    continue;
+                }
+
+                size_t n = state->pending.length() - state->pendingPos;
+                if (n > maxLen - written) n = maxLen - written;
+                memcpy(buffer + written, state->pending.c_str() + state->pendingPos, n);
+                state->pendingPos += n;
+                written += n;
+            }
+
+            // Release the last piece once fully sent
+            if (state->done && state->pendingPos >= state->pending.length()) {
+                state->pending = String();
+            }
+
+            return written;  // 0 ends the chunked response
+        });
+}
@@ -0,0 +1,48 @@
+#ifndef CHUNKED_RESPONSE_H
+#define CHUNKED_RESPONSE_H
+
+#include <Arduino.h>
+#include "HttpServer.h"
+#include <functional>
+
+/**
+ * Produces the next piece of a streamed response body.
+ * Append the piece to `out` (passed in empty) and return true, or return
+ * false when the body is complete. Called from the HTTP server task each
+ * time the outgoing chunk buffer has room.
+ */
+using ChunkGenerator = std::function<bool(String& out)>;
+
+/**
+ * Builds chunked (Transfer-Encoding: chunked) HttpServer responses
+ * from a piece-by-piece generator.
+ *
+ * Memory use is bounded by the largest single piece plus the TCP chunk
+ * buffer, regardless of total response size. Generators should emit one
+ * record at a time (e.g. one log entry, or a few hundred bytes of a file)
+ * rather than building the whole document.
+ *
+ * Usage:
+ *   int i = 0;
+ *   request->send(ChunkedResponse::create(request, "application/json",
+ *       [i](String& out) mutable {
+ *           if (i > 3) return false;
+ *           out = String(i++);
+ *           return true;
+ *       }));
+ */
+class ChunkedResponse {
+public:
+    /**
+     * Create a chunked response driven by a generator.
+     * @param request The request being answered
+     * @param contentType MIME type of the body
+     * @param generator Piece generator (owned by the response)
+     * @return Response ready for request->send()
+     */
+    static HttpResponse* create(HttpRequest* request,
+                                const char* contentType,
+                                ChunkGenerator generator);
+};
+
+#endif // CHUNKED_RESPONSE_H
@@ -0,0 +1,86 @@
+#ifndef COMMAND_MAILBOX_H
+#define COMMAND_MAILBOX_H
+
+#include <Arduino.h>
+#include <vector>
+#include "BatchRunner.h"
+#include "Devices.h"
+#include "RetroTink.h"
+#include "SpscQueue.h"
+#include "WifiManager.h"
+
+/**
+ * A device action requested by an HTTP handler, executed by loop().
+ *
+ * HTTP handlers run on the AsyncTCP task while loop() drives RetroTink,
+ * Switcher, DenonAvr and WifiManager. Rather than calling into those objects from the
+ * web task, handlers post a DeviceCommand and return immediately;
+ * WebServer::update() drains the mailbox on the loop task.
+ */
+struct DeviceCommand {
+    /** Action to perform */
+    enum class Type : uint8_t {
+        TINK_SEND,      ///< RetroTink::sendRawCommand(text)
+        SWITCHER_SEND,  ///< Switcher::sendCommand(text)
+        SWITCHER_CLEAR, ///< Switcher::clearRecentMessages()
+        AVR_SEND,       ///< DenonAvr::sendRawCommand(text)
+        AVR_DISCOVER,   ///< DenonAvr::startDiscovery()
+        SET_TRIGGERS,   ///< Replace RetroTink triggers with *triggers
+        RUN_BATCH,      ///< BatchRunner::start(batchId, *batch)
+        RECONFIGURE,    ///< Devices::apply(*config, configEpoch)
+        WIFI_CONNECT,   ///< WifiManager::connect(wifi->ssid, wifi->password)
+        WIFI_DISCONNECT,///< WifiManager::disconnect()
+        WIFI_PROBE,     ///< WifiManager::startProbe(probeCount, probeIntervalMs)
+        WIFI_NETWORKS   ///< WifiManager::setNetworks(*networks)
+    };
+
+    /** Longest command text carried inline */
+    static const size_t MAX_TEXT_LEN = 127;
+
+    // Every field has a default, so a poster sets only the ones its type
+    // uses and the consumer never deletes a stray pointer
+    Type type = Type::TINK_SEND;
+    char text[MAX_TEXT_LEN + 1] = {};  ///< Command text (NUL-terminated)
+
+    /**
+     * New trigger list for SET_TRIGGERS. Allocated by the poster; ownership
+     * passes to the consumer, which deletes it after applying.
+     */
+    std::vector<TriggerMapping>* triggers = nullptr;
+
+    /** Steps for RUN_BATCH (ownership passes to the consumer, like triggers) */
+    std::vector<BatchStep>* batch = nullptr;
+    uint32_t batchId = 0;
+
+    /** New device sections for RECONFIGURE (ownership passes to the consumer) */
+    DeviceConfigSet* config = nullptr;
+    uint32_t configEpoch = 0;
+
+    /** Network for WIFI_CONNECT (ownership passes to the consumer) */
+    WifiManager::Credentials* wifi = nullptr;
+
+    /** Saved networks for WIFI_NETWORKS (ownership passes to the consumer) */
+    std::vector<WifiManager::Credentials>* networks = nullptr;
+
+    /** Burst for WIFI_PROBE */
+    uint16_t probeCount = 0;
+    uint16_t probeIntervalMs = 0;
+
+    /**
+     * @param type Action to perform
+     * @return Command of that type with every other field at its default
+     */
+    static DeviceCommand make(Type type) {
+        DeviceCommand cmd;
+        cmd.type = type;
+        return cmd;
+    }
+};
+
+/**
+ * Mailbox from the AsyncTCP task (sole producer) to loop() (sole consumer).
+ * Holds up to 15 pending commands.
+ */
+using CommandMailbox = SpscQueue<DeviceCommand, 16>;
+
+#endif // COMMAND_MAILBOX_H
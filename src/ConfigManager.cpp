@@ -1,35 +1,51 @@
 #include "ConfigManager.h"
+#include "ConfigStore.h"
 #include "Logger.h"
 #include <LittleFS.h>
+#include <esp_system.h>
 
-ConfigManager::ConfigManager() {
-    // Default pin assignments for ESP32-S3-Zero (Waveshare)
-    // Switcher uses UART1 on GPIO43 (TX) / GPIO44 (RX)
-    _switcherType = "Extron SW VGA";
-    _switcherConfigDoc["type"] = "Extron SW VGA";
-    _switcherConfigDoc["uartId"] = 1;
-    _switcherConfigDoc["txPin"] = 43;
-    _switcherConfigDoc["rxPin"] = 44;
-    _switcherConfigDoc["autoSwitch"] = true;
-
-    // Hardware pins
-    _hardwareConfig.ledPin = 21;          // WS2812 LED data pin
-    _hardwareConfig.ledColorOrder = "GRB"; // Most WS2812 LEDs use GRB
-
-    // AVR defaults
-    _avrConfigDoc["type"] = "Denon X4300H";
-    _avrConfigDoc["enabled"] = false;
-    _avrConfigDoc["ip"] = "";
-    _avrConfigDoc["input"] = "GAME";
-
-    // RetroTink defaults
-    // Default to USB mode with full power management
-    _retrotinkConfigDoc["serialMode"] = "usb";
-    _retrotinkConfigDoc["powerManagementMode"] = "full";
-    _retrotinkConfigDoc["uartId"] = 2;
-    _retrotinkConfigDoc["txPin"] = 17;
-    _retrotinkConfigDoc["rxPin"] = 18;
+// NVS sections outside the typed schemas
+static const char* const WIFI_SECTION = "wifi";
+static const char* const TRIGGERS_SECTION = "triggers";
+static const char* const TRIGGERS_KEY = "list";
 
+/** WiFi network slot key: "ssid", "ssid1", ... (slot 0 keeps the original name) */
+static String networkKey(const char* base, uint8_t slot) {
+    return slot == 0 ? String(base) : String(base) + slot;
+}
+
+/** Append a network unless its SSID is empty, already listed, or the list is full. */
+static void appendNetwork(std::vector<ConfigManager::WifiNetwork>& networks,
+                          const String& ssid, const String& password) {
+    if (ssid.length() == 0 || networks.size() >= ConfigManager::MAX_WIFI_NETWORKS) return;
+    for (const auto& network : networks) {
+        if (network.ssid == ssid) return;
+    }
+    networks.push_back(ConfigManager::WifiNetwork{ssid, password});
+}
+
+/// Longest the restart hook waits for a write in progress
+static const TickType_t SHUTDOWN_WAIT = pdMS_TO_TICKS(2000);
+
+/// The manager flushed by the restart hook (esp_restart() hooks take no argument)
+static ConfigManager* s_instance = nullptr;
+
+// Files only earlier firmware wrote: save temp files and the binary
+// config.json snapshot. Removed once settings are in NVS.
+static const char* const LEGACY_FILES[] = {
+    "/config.json.new", "/wifi.json.new", "/config.bin", "/config.bin.new"
+};
+
+ConfigManager::ConfigManager()
+    : _firstSaveAt(0)
+    , _lastSaveAt(0)
+    , _saveLock(xSemaphoreCreateMutex())
+    , _writeLock(xSemaphoreCreateMutex())
+    , _migrated(false)
+    , _loadTimeUs(0)
+{
+    // Section defaults (ESP32-S3-Zero pin assignments) come from the
+    // schemas in ConfigTypes.cpp
     _wifiConfig.hostname = "tinklink";
 }
 
@@ -41,52 +57,118 @@ bool ConfigManager::begin() {
 
     LOG_DEBUG("ConfigManager: LittleFS mounted");
 
-    // Load configurations
+    uint32_t start = micros();
+    if (!ConfigStore::isInitialized()) {
+        _migrated = migrateFromFiles();
+    }
+
     loadConfig();
     loadWifiConfig();
+    _loadTimeUs = micros() - start;
+
+    LOG_INFO("ConfigManager: Loaded settings from NVS in %u us%s", _loadTimeUs,
+             _migrated ? " (imported from config.json)" : "");
 
+    s_instance = this;
+    esp_register_shutdown_handler(onShutdown);
     return true;
 }
 
-bool ConfigManager::loadConfig() {
+bool ConfigManager::migrateFromFiles() {
+    LOG_INFO("ConfigManager: No settings in NVS - importing from LittleFS");
+
+    JsonDocument doc;
     File file = LittleFS.open(CONFIG_PATH, "r");
-    if (!file) {
+    if (file) {
+        DeserializationError error = deserializeJson(doc, file);
+        file.close();
+        if (error) {
+            LOG_ERROR("ConfigManager: Failed to parse config.json: %s", error.c_str());
+            loadDefaultConfig();
+        } else {
+            importConfig(doc.as<JsonVariantConst>());
+        }
+    } else {
         LOG_WARN("ConfigManager: No config.json found, using defaults");
-        return loadDefaultConfig();
+        loadDefaultConfig();
     }
 
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, file);
-    file.close();
+    bool hadWifi = false;
+    file = LittleFS.open(WIFI_CONFIG_PATH, "r");
+    if (file) {
+        doc.clear();
+        DeserializationError error = deserializeJson(doc, file);
+        file.close();
+        if (error) {
+            LOG_ERROR("ConfigManager: Failed to parse wifi.json: %s", error.c_str());
+        } else {
+            importWifiConfig(doc.as<JsonVariantConst>());
+            hadWifi = true;
+        }
+    }
 
-    if (error) {
-        LOG_ERROR("ConfigManager: Failed to parse config.json: %s", error.c_str());
-        return loadDefaultConfig();
+    // Written straight away: nothing may be marked initialized before it is stored
+    if (!writeConfig(captureConfig()) || !writeWifiConfig(_wifiConfig) ||
+        !ConfigStore::markInitialized()) {
+        LOG_ERROR("ConfigManager: Failed to write settings to NVS - will retry next boot");
+        return false;
     }
 
-    // Parse switcher config (store raw JSON)
-    if (doc["switcher"].is<JsonObject>()) {
-        _switcherType = doc["switcher"]["type"] | "Extron SW VGA";
-        _switcherConfigDoc.clear();
-        _switcherConfigDoc.set(doc["switcher"]);
+    // Credentials now live only in NVS. config.json stays: it is part of
+    // the filesystem image and only read again if NVS is erased.
+    if (hadWifi) LittleFS.remove(WIFI_CONFIG_PATH);
+    for (const char* path : LEGACY_FILES) {
+        if (LittleFS.exists(path)) LittleFS.remove(path);
     }
 
-    // Parse hardware config
-    if (doc["hardware"].is<JsonObject>()) {
-        _hardwareConfig.ledPin = doc["hardware"]["ledPin"] | 21;
-        _hardwareConfig.ledColorOrder = doc["hardware"]["ledColorOrder"] | "GRB";
+    LOG_INFO("ConfigManager: Settings moved to NVS");
+    return true;
+}
+
+bool ConfigManager::loadConfig() {
+    // Stored values are validated like config.json: invalid fields fall
+    // back to their defaults and are reported
+    String error;
+    bool ok = ConfigStore::load(SwitcherConfig::SCHEMA, &_switcher, error);
+    ok &= ConfigStore::load(HardwareConfig::SCHEMA, &_hardwareConfig, error);
+    ok &= ConfigStore::load(AvrConfig::SCHEMA, &_avr, error);
+    ok &= ConfigStore::load(TinkConfig::SCHEMA, &_tink, error);
+    ok &= ConfigStore::load(OtaConfig::SCHEMA, &_ota, error);
+    ok &= ConfigStore::load(NetworkConfig::SCHEMA, &_network, error);
+    if (error.length() > 0) {
+        LOG_WARN("ConfigManager: Stored settings: %s", error.c_str());
     }
 
-    // Parse AVR config (store raw JSON)
-    if (doc["avr"].is<JsonObject>()) {
-        _avrConfigDoc.clear();
-        _avrConfigDoc.set(doc["avr"]);
+    // Triggers are one MessagePack value in the config.json "triggers" layout
+    std::vector<uint8_t> packed;
+    _triggers.clear();
+    if (ConfigStore::getBlob(TRIGGERS_SECTION, TRIGGERS_KEY, packed)) {
+        JsonDocument doc;
+        if (deserializeMsgPack(doc, packed.data(), packed.size())) {
+            LOG_ERROR("ConfigManager: Stored triggers are unreadable");
+            ok = false;
+        } else {
+            importTriggers(doc.as<JsonArrayConst>());
+        }
     }
 
-    // Parse RetroTink config (store raw JSON)
-    if (doc["tink"].is<JsonObject>()) {
-        _retrotinkConfigDoc.clear();
-        _retrotinkConfigDoc.set(doc["tink"]);
+    _stateVersion.bump();
+    LOG_DEBUG("ConfigManager: Loaded %d triggers", _triggers.size());
+    return ok;
+}
+
+void ConfigManager::importConfig(JsonVariantConst doc) {
+    // Sections are validated once here; invalid fields fall back to their
+    // defaults and are reported, so a typo can't silently change behavior
+    String error;
+    configRead(doc["switcher"], _switcher, error);
+    configRead(doc["hardware"], _hardwareConfig, error);
+    configRead(doc["avr"], _avr, error);
+    configRead(doc["tink"], _tink, error);
+    configRead(doc["ota"], _ota, error);
+    configRead(doc["network"], _network, error);
+    if (error.length() > 0) {
+        LOG_WARN("ConfigManager: config.json: %s", error.c_str());
     }
 
     // Parse hostname (from root or wirelessClient for backwards compatibility)
@@ -96,24 +178,35 @@ bool ConfigManager::loadConfig() {
         _wifiConfig.hostname = doc["wirelessClient"]["hostname"].as<String>();
     }
 
-    // Parse triggers
     _triggers.clear();
-    if (doc["triggers"].is<JsonArray>()) {
-        for (JsonObject triggerObj : doc["triggers"].as<JsonArray>()) {
-            TriggerMapping trigger;
-            trigger.switcherInput = triggerObj["input"] | 0;
-            trigger.profile = triggerObj["profile"] | 0;
-            trigger.name = triggerObj["name"] | "";
-            trigger.mode = parseProfileMode(triggerObj["mode"] | "SVS");
-
-            if (trigger.switcherInput > 0 && trigger.profile > 0) {
-                _triggers.push_back(trigger);
-            }
+    importTriggers(doc["triggers"].as<JsonArrayConst>());
+    _stateVersion.bump();
+
+    LOG_DEBUG("ConfigManager: Imported %d triggers", _triggers.size());
+}
+
+void ConfigManager::importTriggers(JsonArrayConst triggers) {
+    for (JsonObjectConst triggerObj : triggers) {
+        TriggerMapping trigger;
+        trigger.switcherInput = triggerObj["input"] | 0;
+        trigger.profile = triggerObj["profile"] | 0;
+        trigger.name = triggerObj["name"] | "";
+        trigger.mode = parseProfileMode(triggerObj["mode"] | "SVS");
+
+        if (trigger.switcherInput > 0 && trigger.profile > 0) {
+            _triggers.push_back(trigger);
         }
     }
+}
 
-    LOG_DEBUG("ConfigManager: Loaded %d triggers from config", _triggers.size());
-    return true;
+void ConfigManager::exportTriggers(JsonArray dst) const {
+    for (const auto& trigger : _triggers) {
+        JsonObject triggerObj = dst.add<JsonObject>();
+        triggerObj["input"] = trigger.switcherInput;
+        triggerObj["mode"] = profileModeToString(trigger.mode);
+        triggerObj["profile"] = trigger.profile;
+        triggerObj["name"] = trigger.name;
+    }
 }
 
 bool ConfigManager::loadDefaultConfig() {
@@ -127,134 +220,307 @@ bool ConfigManager::loadDefaultConfig() {
     return true;
 }
 
-bool ConfigManager::saveConfig() {
-    JsonDocument doc;
+ConfigManager::ConfigImage ConfigManager::captureConfig() const {
+    ConfigImage image;
+    image.switcher = _switcher;
+    image.hardware = _hardwareConfig;
+    image.avr = _avr;
+    image.tink = _tink;
+    image.ota = _ota;
+    image.network = _network;
+    image.hostname = _wifiConfig.hostname;
 
-    // Switcher config (write raw JSON)
-    doc["switcher"].set(_switcherConfigDoc);
+    JsonDocument doc;
+    exportTriggers(doc.to<JsonArray>());
+    image.triggers.resize(measureMsgPack(doc));
+    serializeMsgPack(doc, image.triggers.data(), image.triggers.size());
+    return image;
+}
 
-    // Hardware config
-    doc["hardware"]["ledPin"] = _hardwareConfig.ledPin;
-    doc["hardware"]["ledColorOrder"] = _hardwareConfig.ledColorOrder;
+bool ConfigManager::writeConfig(const ConfigImage& image) {
+    size_t written = 0;
+    bool ok = ConfigStore::save(SwitcherConfig::SCHEMA, &image.switcher, &written);
+    ok &= ConfigStore::save(HardwareConfig::SCHEMA, &image.hardware, &written);
+    ok &= ConfigStore::save(AvrConfig::SCHEMA, &image.avr, &written);
+    ok &= ConfigStore::save(TinkConfig::SCHEMA, &image.tink, &written);
+    ok &= ConfigStore::save(OtaConfig::SCHEMA, &image.ota, &written);
+    ok &= ConfigStore::save(NetworkConfig::SCHEMA, &image.network, &written);
+    ok &= ConfigStore::putString(WIFI_SECTION, "hostname", image.hostname);
+    ok &= ConfigStore::putBlob(TRIGGERS_SECTION, TRIGGERS_KEY, image.triggers);
+
+    LOG_DEBUG("ConfigManager: Configuration saved (%u setting(s) changed)", (unsigned)written);
+    return ok;
+}
 
-    // AVR config (write raw JSON)
-    doc["avr"].set(_avrConfigDoc);
+void ConfigManager::saveConfig() {
+    queueSave(std::unique_ptr<ConfigImage>(new ConfigImage(captureConfig())), nullptr);
+}
 
-    // RetroTink config (write raw JSON if not empty)
-    if (!_retrotinkConfigDoc.isNull()) {
-        doc["tink"].set(_retrotinkConfigDoc);
+void ConfigManager::queueSave(std::unique_ptr<ConfigImage> config, std::unique_ptr<WifiConfig> wifi) {
+    unsigned long now = millis();
+    xSemaphoreTake(_saveLock, portMAX_DELAY);
+    if (!_pendingConfig && !_pendingWifi) _firstSaveAt = now;
+    _lastSaveAt = now;
+    // An unwritten copy is superseded by the newer one. Both carry the
+    // hostname, so the other copy takes the latest too.
+    if (config) {
+        if (_pendingWifi) _pendingWifi->hostname = config->hostname;
+        _pendingConfig = std::move(config);
+    }
+    if (wifi) {
+        if (_pendingConfig) _pendingConfig->hostname = wifi->hostname;
+        _pendingWifi = std::move(wifi);
     }
+    xSemaphoreGive(_saveLock);
+}
 
-    // Hostname
-    doc["hostname"] = _wifiConfig.hostname;
+void ConfigManager::update() {
+    // A flush in progress on another task writes the same settings; don't wait for it
+    writePending(false, 0);
+}
 
-    // Triggers
-    JsonArray triggersArray = doc["triggers"].to<JsonArray>();
-    for (const auto& trigger : _triggers) {
-        JsonObject triggerObj = triggersArray.add<JsonObject>();
-        triggerObj["input"] = trigger.switcherInput;
-        triggerObj["mode"] = profileModeToString(trigger.mode);
-        triggerObj["profile"] = trigger.profile;
-        triggerObj["name"] = trigger.name;
-    }
+bool ConfigManager::flushSaves() {
+    return writePending(true, portMAX_DELAY);
+}
 
-    File file = LittleFS.open(CONFIG_PATH, "w");
-    if (!file) {
-        LOG_ERROR("ConfigManager: Failed to open config.json for writing");
-        return false;
+bool ConfigManager::writePending(bool force, TickType_t wait) {
+    if (xSemaphoreTake(_writeLock, wait) != pdTRUE) return false;
+
+    std::unique_ptr<ConfigImage> config;
+    std::unique_ptr<WifiConfig> wifi;
+    xSemaphoreTake(_saveLock, portMAX_DELAY);
+    unsigned long now = millis();
+    if ((_pendingConfig || _pendingWifi) &&
+        (force || now - _lastSaveAt >= SAVE_DEBOUNCE_MS || now - _firstSaveAt >= SAVE_MAX_DELAY_MS)) {
+        config = std::move(_pendingConfig);
+        wifi = std::move(_pendingWifi);
     }
+    xSemaphoreGive(_saveLock);
 
-    serializeJsonPretty(doc, file);
-    file.close();
+    // The queue is free again, so saves made during the write wait for the next one
+    bool ok = true;
+    if (config) ok &= writeConfig(*config);
+    if (wifi) ok &= writeWifiConfig(*wifi);
+    if (!ok) LOG_ERROR("ConfigManager: Failed to write settings to NVS");
 
-    LOG_INFO("ConfigManager: Configuration saved");
-    return true;
+    xSemaphoreGive(_writeLock);
+    return ok;
+}
+
+void ConfigManager::onShutdown() {
+    // Don't let a wedged write hold up the restart
+    if (s_instance) s_instance->writePending(true, SHUTDOWN_WAIT);
+}
+
+void ConfigManager::exportConfig(JsonObject dst) const {
+    configWrite(_switcher, dst["switcher"].to<JsonObject>());
+    configWrite(_hardwareConfig, dst["hardware"].to<JsonObject>());
+    configWrite(_avr, dst["avr"].to<JsonObject>());
+    configWrite(_tink, dst["tink"].to<JsonObject>());
+    configWrite(_ota, dst["ota"].to<JsonObject>());
+    configWrite(_network, dst["network"].to<JsonObject>());
+    dst["hostname"] = _wifiConfig.hostname;
+    exportTriggers(dst["triggers"].to<JsonArray>());
+}
+
+void ConfigManager::configFilter(JsonObject filter) {
+    // Sections are kept whole so configRead() still reports unknown keys
+    filter[SwitcherConfig::SCHEMA.section] = true;
+    filter[HardwareConfig::SCHEMA.section] = true;
+    filter[AvrConfig::SCHEMA.section] = true;
+    filter[TinkConfig::SCHEMA.section] = true;
+    filter[OtaConfig::SCHEMA.section] = true;
+    filter[NetworkConfig::SCHEMA.section] = true;
+    filter["hostname"] = true;
+    filter["wirelessClient"]["hostname"] = true;
+
+    JsonObject trigger = filter["triggers"].to<JsonArray>().add<JsonObject>();
+    trigger["input"] = true;
+    trigger["profile"] = true;
+    trigger["name"] = true;
+    trigger["mode"] = true;
 }
 
 bool ConfigManager::loadWifiConfig() {
-    File file = LittleFS.open(WIFI_CONFIG_PATH, "r");
-    if (!file) {
-        LOG_DEBUG("ConfigManager: No wifi.json found");
-        return false;
+    _wifiConfig.networks.clear();
+    for (uint8_t i = 0; i < MAX_WIFI_NETWORKS; i++) {
+        appendNetwork(_wifiConfig.networks,
+                      ConfigStore::getString(WIFI_SECTION, networkKey("ssid", i).c_str()),
+                      ConfigStore::getString(WIFI_SECTION, networkKey("password", i).c_str()));
+    }
+    _wifiConfig.hostname = ConfigStore::getString(WIFI_SECTION, "hostname", "tinklink");
+
+    String error;
+    if (!setStaticIp(ConfigStore::getString(WIFI_SECTION, "ip"),
+                     ConfigStore::getString(WIFI_SECTION, "gateway"),
+                     ConfigStore::getString(WIFI_SECTION, "subnet"),
+                     ConfigStore::getString(WIFI_SECTION, "dns"), error)) {
+        LOG_WARN("ConfigManager: Stored static IP ignored: %s", error.c_str());
+        setStaticIp("", "", "", "", error);
     }
 
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, file);
-    file.close();
+    LOG_DEBUG("ConfigManager: WiFi config loaded (%u network(s), first: %s)",
+              (unsigned)_wifiConfig.networks.size(),
+              hasWifiCredentials() ? _wifiConfig.networks[0].ssid.c_str() : "(none)");
+    return hasWifiCredentials();
+}
 
-    if (error) {
-        LOG_ERROR("ConfigManager: Failed to parse wifi.json: %s", error.c_str());
-        return false;
+void ConfigManager::importWifiConfig(JsonVariantConst doc) {
+    // "networks" lists every saved network; files written before it
+    // existed hold a single ssid/password
+    _wifiConfig.networks.clear();
+    JsonArrayConst networks = doc["networks"];
+    if (networks) {
+        for (JsonObjectConst network : networks) {
+            appendNetwork(_wifiConfig.networks, network["ssid"] | "", network["password"] | "");
+        }
+    } else {
+        appendNetwork(_wifiConfig.networks, doc["ssid"] | "", doc["password"] | "");
     }
 
-    _wifiConfig.ssid = doc["ssid"] | "";
-    _wifiConfig.password = doc["password"] | "";
-
     if (doc["hostname"].is<const char*>()) {
         _wifiConfig.hostname = doc["hostname"].as<String>();
     }
 
-    LOG_DEBUG("ConfigManager: WiFi config loaded (SSID: %s)",
-              _wifiConfig.ssid.length() > 0 ? _wifiConfig.ssid.c_str() : "(none)");
-    return true;
+    String error;
+    if (!setStaticIp(doc["ip"] | "", doc["gateway"] | "", doc["subnet"] | "", doc["dns"] | "", error)) {
+        LOG_WARN("ConfigManager: wifi.json: %s - using DHCP", error.c_str());
+        setStaticIp("", "", "", "", error);
+    }
 }
 
-bool ConfigManager::saveWifiConfig() {
-    JsonDocument doc;
-
-    doc["ssid"] = _wifiConfig.ssid;
-    doc["password"] = _wifiConfig.password;
-    doc["hostname"] = _wifiConfig.hostname;
+void ConfigManager::saveWifiConfig() {
+    queueSave(nullptr, std::unique_ptr<WifiConfig>(new WifiConfig(_wifiConfig)));
+}
 
-    File file = LittleFS.open(WIFI_CONFIG_PATH, "w");
-    if (!file) {
-        LOG_ERROR("ConfigManager: Failed to open wifi.json for writing");
-        return false;
+bool ConfigManager::writeWifiConfig(const WifiConfig& wifi) {
+    // Every slot is written, so a forgotten network leaves no stale entry
+    std::vector<ConfigStore::StringEntry> entries;
+    for (uint8_t i = 0; i < MAX_WIFI_NETWORKS; i++) {
+        bool used = i < wifi.networks.size();
+        entries.push_back({networkKey("ssid", i), used ? wifi.networks[i].ssid : String()});
+        entries.push_back({networkKey("password", i), used ? wifi.networks[i].password : String()});
     }
+    entries.push_back({"hostname", wifi.hostname});
+    entries.push_back({"ip", wifi.ip});
+    entries.push_back({"gateway", wifi.gateway});
+    entries.push_back({"subnet", wifi.subnet});
+    entries.push_back({"dns", wifi.dns});
+
+    bool ok = ConfigStore::putStrings(WIFI_SECTION, entries);
+    LOG_DEBUG("ConfigManager: WiFi configuration saved");
+    return ok;
+}
 
-    serializeJsonPretty(doc, file);
-    file.close();
-
-    LOG_INFO("ConfigManager: WiFi configuration saved");
-    return true;
+void ConfigManager::exportWifiConfig(JsonObject dst) const {
+    // ssid/password repeat the most preferred network for firmware that
+    // only reads those
+    const WifiNetwork* first = hasWifiCredentials() ? &_wifiConfig.networks[0] : nullptr;
+    dst["ssid"] = first ? first->ssid : String();
+    dst["password"] = first ? first->password : String();
+    JsonArray networks = dst["networks"].to<JsonArray>();
+    for (const auto& network : _wifiConfig.networks) {
+        JsonObject entry = networks.add<JsonObject>();
+        entry["ssid"] = network.ssid;
+        entry["password"] = network.password;
+    }
+    dst["hostname"] = _wifiConfig.hostname;
+    if (_wifiConfig.ip.length() > 0) {
+        dst["ip"] = _wifiConfig.ip;
+        dst["gateway"] = _wifiConfig.gateway;
+        dst["subnet"] = _wifiConfig.subnet;
+        dst["dns"] = _wifiConfig.dns;
+    }
 }
 
-void ConfigManager::setWifiCredentials(const String& ssid, const String& password) {
-    _wifiConfig.ssid = ssid;
-    _wifiConfig.password = password;
+void ConfigManager::wifiConfigFilter(JsonObject filter) {
+    JsonObject network = filter["networks"].to<JsonArray>().add<JsonObject>();
+    network["ssid"] = true;
+    network["password"] = true;
+    static const char* const KEYS[] = {"ssid", "password", "hostname", "ip", "gateway", "subnet", "dns"};
+    for (const char* key : KEYS) {
+        filter[key] = true;
+    }
 }
 
-void ConfigManager::setHostname(const String& hostname) {
-    _wifiConfig.hostname = hostname;
+void ConfigManager::addWifiNetwork(const String& ssid, const String& password) {
+    forgetWifiNetwork(ssid);
+    _wifiConfig.networks.insert(_wifiConfig.networks.begin(), WifiNetwork{ssid, password});
+    if (_wifiConfig.networks.size() > MAX_WIFI_NETWORKS) {
+        LOG_INFO("ConfigManager: Forgetting WiFi network '%s' (keeping %u)",
+                 _wifiConfig.networks.back().ssid.c_str(), MAX_WIFI_NETWORKS);
+        _wifiConfig.networks.resize(MAX_WIFI_NETWORKS);
+    }
 }
 
-void ConfigManager::setTriggers(const std::vector<TriggerMapping>& triggers) {
-    _triggers = triggers;
+bool ConfigManager::forgetWifiNetwork(const String& ssid) {
+    auto& networks = _wifiConfig.networks;
+    for (auto it = networks.begin(); it != networks.end(); ++it) {
+        if (it->ssid == ssid) {
+            networks.erase(it);
+            return true;
+        }
+    }
+    return false;
 }
 
-void ConfigManager::setAvrConfig(const JsonObject& config) {
-    _avrConfigDoc.clear();
-    _avrConfigDoc.set(config);
+bool ConfigManager::setStaticIp(const String& ip, const String& gateway, const String& subnet,
+                                const String& dns, String& error) {
+    if (ip.length() == 0) {
+        _wifiConfig.ip = "";
+        _wifiConfig.gateway = "";
+        _wifiConfig.subnet = "";
+        _wifiConfig.dns = "";
+        return true;
+    }
+
+    // Missing optional fields are filled in, so the stored set is complete
+    String mask = subnet.length() > 0 ? subnet : String("255.255.255.0");
+    String server = dns.length() > 0 ? dns : gateway;
+
+    IPAddress parsed;
+    const char* invalid = nullptr;
+    if (!parsed.fromString(ip)) {
+        invalid = "ip";
+    } else if (!parsed.fromString(gateway)) {
+        invalid = "gateway";
+    } else if (!parsed.fromString(mask)) {
+        invalid = "subnet";
+    } else if (!parsed.fromString(server)) {
+        invalid = "dns";
+    }
+    if (invalid) {
+        error = String(invalid) + ": expected an IPv4 address";
+        return false;
+    }
+
+    _wifiConfig.ip = ip;
+    _wifiConfig.gateway = gateway;
+    _wifiConfig.subnet = mask;
+    _wifiConfig.dns = server;
+    return true;
 }
 
-JsonObject ConfigManager::getSwitcherConfig() {
-    return _switcherConfigDoc.as<JsonObject>();
+void ConfigManager::setHostname(const String& hostname) {
+    _wifiConfig.hostname = hostname;
 }
 
-JsonObject ConfigManager::getAvrConfig() {
-    return _avrConfigDoc.as<JsonObject>();
+void ConfigManager::setTriggers(const std::vector<TriggerMapping>& triggers) {
+    _triggers = triggers;
+    _stateVersion.bump();
 }
 
-bool ConfigManager::isAvrEnabled() const {
-    return _avrConfigDoc["enabled"] | false;
+void ConfigManager::setAvrConfig(const AvrConfig& config) {
+    _avr = config;
+    _stateVersion.bump();
 }
 
-JsonObject ConfigManager::getRetroTinkConfig() {
-    return _retrotinkConfigDoc.as<JsonObject>();
+void ConfigManager::setNetworkConfig(const NetworkConfig& config) {
+    _network = config;
 }
 
 bool ConfigManager::hasWifiCredentials() const {
-    return _wifiConfig.ssid.length() > 0;
+    return !_wifiConfig.networks.empty();
 }
 
 TriggerMapping::Mode ConfigManager::parseProfileMode(const char* mode) {
@@ -3,78 +3,163 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <freertos/semphr.h>
+#include <memory>
 #include <vector>
+#include "StateVersion.h"
+#include "ConfigTypes.h"
 #include "RetroTink.h"
 
-/// Path to main configuration file in LittleFS
+/// First-boot defaults in the LittleFS image, migrated into NVS once
 #define CONFIG_PATH "/config.json"
-/// Path to WiFi credentials file in LittleFS
+/// WiFi credentials left by firmware that kept settings in LittleFS
 #define WIFI_CONFIG_PATH "/wifi.json"
 
 /**
- * Manages persistent configuration stored in LittleFS.
+ * Manages persistent configuration stored in NVS (see ConfigStore).
  *
- * Configuration is split into two files:
- * - config.json: Hardware settings, triggers, hostname
- * - wifi.json: WiFi credentials (separate for easier clearing)
+ * Settings live outside the LittleFS partition, so uploading a new web UI
+ * image keeps them. Each section is saved key by key and only changed
+ * keys are written. JSON is the import/export format: backups, restores
+ * and the diagnostics bundle use the config.json / wifi.json layout.
+ *
+ * saveConfig() and saveWifiConfig() only queue a copy of the settings
+ * and return at once. update() writes the queued copy from loop() once
+ * saves stop for SAVE_DEBOUNCE_MS (or SAVE_MAX_DELAY_MS after the first
+ * unwritten one), so a burst of UI edits costs one NVS commit per section
+ * and HTTP handlers never wait for flash. Queued saves are also written
+ * from an esp_restart() shutdown hook.
+ *
+ * On the first boot with an empty store, settings are imported from
+ * config.json (the image's defaults, or the files an older firmware
+ * wrote) and wifi.json, saved to NVS, and wifi.json is deleted.
  *
  * Usage:
  *   ConfigManager config;
- *   config.begin();  // Mounts LittleFS and loads config
+ *   config.begin();  // Mounts LittleFS, migrates if needed, loads config
  *   auto wifi = config.getWifiConfig();
+ *   // In loop():
+ *   config.update();  // Writes queued saves
  */
 class ConfigManager {
 public:
+    /** Credentials of a saved WiFi network */
+    struct WifiNetwork {
+        String ssid;
+        String password;
+    };
+
+    /** Most saved networks; saving another drops the least preferred */
+    static const uint8_t MAX_WIFI_NETWORKS = 5;
+
+    /** Quiet time after the last save before the settings are written */
+    static const unsigned long SAVE_DEBOUNCE_MS = 1000;
+
+    /** Longest a queued save waits, however often it is replaced */
+    static const unsigned long SAVE_MAX_DELAY_MS = 5000;
+
     /**
      * WiFi connection and network settings.
      */
     struct WifiConfig {
-        String ssid;       ///< Network SSID to connect to
-        String password;   ///< Network password
+        std::vector<WifiNetwork> networks;  ///< Saved networks, most preferred first
         String hostname;   ///< mDNS hostname (default: "tinklink")
+        String ip;         ///< Static IPv4 address (empty = DHCP)
+        String gateway;    ///< Static gateway (with ip)
+        String subnet;     ///< Static subnet mask (with ip; empty = 255.255.255.0)
+        String dns;        ///< Static DNS server (with ip; empty = gateway)
     };
 
 
-    /**
-     * Hardware pin configuration.
-     */
-    struct HardwareConfig {
-        uint8_t ledPin;        ///< WS2812 LED data pin (default: GPIO21)
-        String ledColorOrder;  ///< LED color order: "RGB" or "GRB" (default: "GRB")
-    };
-
     ConfigManager();
 
     /**
-     * Initialize LittleFS and load configuration files.
-     * Creates default config if files don't exist.
+     * Mount LittleFS, move settings from config.json/wifi.json into NVS
+     * if NVS holds none yet, then load them.
      * @return true if LittleFS mounted successfully
      */
     bool begin();
 
     /**
-     * Load main configuration from CONFIG_PATH.
-     * @return true if loaded successfully, false uses defaults
+     * Load main configuration from NVS.
+     * @return true if every stored value was valid (invalid ones use defaults)
      */
     bool loadConfig();
 
     /**
-     * Save main configuration to CONFIG_PATH.
-     * @return true if saved successfully
+     * Queue the main configuration (sections, triggers, hostname) for
+     * update() to write. A newer save replaces an unwritten one.
      */
-    bool saveConfig();
+    void saveConfig();
 
     /**
-     * Load WiFi credentials from WIFI_CONFIG_PATH.
-     * @return true if loaded successfully
+     * Load WiFi credentials and hostname from NVS.
+     * @return true if credentials are stored
      */
     bool loadWifiConfig();
 
     /**
-     * Save WiFi credentials to WIFI_CONFIG_PATH.
-     * @return true if saved successfully
+     * Queue the WiFi credentials and hostname for update() to write.
+     * A newer save replaces an unwritten one.
+     */
+    void saveWifiConfig();
+
+    /**
+     * Write queued saves whose debounce has expired. Only changed keys are
+     * written, one commit per section. Call from loop().
+     */
+    void update();
+
+    /**
+     * Write queued saves now, without waiting for the debounce. Blocks
+     * until a write already in progress finishes.
+     * @return false if NVS rejected a write
+     */
+    bool flushSaves();
+
+    /**
+     * Take settings from a document in config.json layout (not saved
+     * until saveConfig() called). Invalid values use defaults and are logged.
+     * @param doc Parsed config.json or backup "config" section
+     */
+    void importConfig(JsonVariantConst doc);
+
+    /**
+     * Take WiFi settings from a document in wifi.json layout (not saved
+     * until saveWifiConfig() called).
+     * @param doc Parsed wifi.json or backup "wifi" section
+     */
+    void importWifiConfig(JsonVariantConst doc);
+
+    /**
+     * Write the main configuration in config.json layout.
+     * @param dst Object to fill
+     */
+    void exportConfig(JsonObject dst) const;
+
+    /**
+     * Write the WiFi settings in wifi.json layout.
+     * @param dst Object to fill
+     */
+    void exportWifiConfig(JsonObject dst) const;
+
+    /**
+     * Build an ArduinoJson filter keeping only what importConfig() reads.
+     * @param filter Object to fill
      */
-    bool saveWifiConfig();
+    static void configFilter(JsonObject filter);
+
+    /**
+     * Build an ArduinoJson filter keeping only what importWifiConfig() reads.
+     * @param filter Object to fill
+     */
+    static void wifiConfigFilter(JsonObject filter);
+
+    /** @return true if this boot imported config.json/wifi.json into NVS */
+    bool isMigrated() const { return _migrated; }
+
+    /** @return Time the boot load (including any migration) took, in microseconds */
+    uint32_t getLoadTimeUs() const { return _loadTimeUs; }
 
     /** @return Current WiFi configuration */
     const WifiConfig& getWifiConfig() const { return _wifiConfig; }
@@ -83,32 +168,66 @@ public:
     const HardwareConfig& getHardwareConfig() const { return _hardwareConfig; }
 
     /** @return Switcher type name */
-    const String& getSwitcherType() const { return _switcherType; }
+    const char* getSwitcherType() const { return _switcher.type; }
 
-    /** @return Switcher configuration as JSON object */
-    JsonObject getSwitcherConfig();
+    /** @return Switcher settings */
+    const SwitcherConfig& getSwitcherConfig() const { return _switcher; }
 
-    /** @return AVR configuration as JSON object */
-    JsonObject getAvrConfig();
+    /** @return AVR settings */
+    const AvrConfig& getAvrConfig() const { return _avr; }
 
     /** @return true if AVR control is enabled */
-    bool isAvrEnabled() const;
+    bool isAvrEnabled() const { return _avr.enabled; }
+
+    /** @return RetroTink settings */
+    const TinkConfig& getRetroTinkConfig() const { return _tink; }
 
-    /** @return RetroTink configuration as JSON object */
-    JsonObject getRetroTinkConfig();
+    /** @return Pull OTA settings */
+    const OtaConfig& getOtaConfig() const { return _ota; }
+
+    /** @return WiFi power mode and latency probe settings */
+    const NetworkConfig& getNetworkConfig() const { return _network; }
 
     /** @return List of configured switcher input to RetroTINK profile triggers */
     const std::vector<TriggerMapping>& getTriggers() const { return _triggers; }
 
     /**
-     * Set WiFi credentials (not saved until saveWifiConfig() called).
+     * Get the version of the triggers and AVR settings reported in /api/status.
+     * @return StateVersion of the last change
+     */
+    uint32_t getStateVersion() const { return _stateVersion.get(); }
+
+    /**
+     * Save a network as the most preferred, or move a saved one to the
+     * front with a new password (not saved until saveWifiConfig() called).
+     * Beyond MAX_WIFI_NETWORKS, the least preferred network is dropped.
      * @param ssid Network SSID
      * @param password Network password
      */
-    void setWifiCredentials(const String& ssid, const String& password);
+    void addWifiNetwork(const String& ssid, const String& password);
+
+    /**
+     * Remove a saved network (not saved until saveWifiConfig() called).
+     * @param ssid Network SSID
+     * @return false if no network of that name is saved
+     */
+    bool forgetWifiNetwork(const String& ssid);
+
+    /**
+     * Set or clear the static IPv4 configuration (not saved until
+     * saveWifiConfig() called).
+     * @param ip Address, or empty for DHCP (the other fields are then ignored)
+     * @param gateway Gateway address (required with ip)
+     * @param subnet Subnet mask (empty = 255.255.255.0)
+     * @param dns DNS server (empty = gateway)
+     * @param error Receives the reason if a value is not a valid address
+     * @return false (nothing changed) if a value is invalid
+     */
+    bool setStaticIp(const String& ip, const String& gateway, const String& subnet,
+                     const String& dns, String& error);
 
     /**
-     * Set mDNS hostname (not saved until saveConfig() called).
+     * Set mDNS hostname (not saved until saveConfig() or saveWifiConfig() called).
      * @param hostname The hostname without .local suffix
      */
     void setHostname(const String& hostname);
@@ -121,13 +240,19 @@ public:
 
     /**
      * Set AVR configuration (not saved until saveConfig() called).
-     * @param config AVR configuration as JSON object
+     * @param config AVR settings, already validated (see configSet())
+     */
+    void setAvrConfig(const AvrConfig& config);
+
+    /**
+     * Set the WiFi power mode and probe settings (not saved until saveConfig() called).
+     * @param config Network settings, already validated (see configSet())
      */
-    void setAvrConfig(const JsonObject& config);
+    void setNetworkConfig(const NetworkConfig& config);
 
     /**
      * Check if WiFi credentials have been configured.
-     * @return true if SSID is non-empty
+     * @return true if at least one network is saved
      */
     bool hasWifiCredentials() const;
 
@@ -136,15 +261,65 @@ private:
     HardwareConfig _hardwareConfig;
     std::vector<TriggerMapping> _triggers;
 
-    // Raw JSON storage for device configurations
-    String _switcherType;
-    JsonDocument _switcherConfigDoc;
-    JsonDocument _avrConfigDoc;
-    JsonDocument _retrotinkConfigDoc;
+    SwitcherConfig _switcher;
+    AvrConfig _avr;
+    TinkConfig _tink;
+    OtaConfig _ota;
+    NetworkConfig _network;
+
+    StateVersion _stateVersion;
+
+    /** Everything saveConfig() stores, copied so loop() can write it while handlers edit */
+    struct ConfigImage {
+        SwitcherConfig switcher;
+        HardwareConfig hardware;
+        AvrConfig avr;
+        TinkConfig tink;
+        OtaConfig ota;
+        NetworkConfig network;
+        String hostname;
+        std::vector<uint8_t> triggers;  ///< MessagePack, config.json "triggers" layout
+    };
+
+    // Queued saves (nullptr when nothing is waiting), guarded by _saveLock
+    std::unique_ptr<ConfigImage> _pendingConfig;
+    std::unique_ptr<WifiConfig> _pendingWifi;
+    unsigned long _firstSaveAt;  ///< millis() of the first unwritten save
+    unsigned long _lastSaveAt;   ///< millis() of the latest save
+    SemaphoreHandle_t _saveLock;
+    /// Held across a whole write so flushSaves() can wait one out
+    SemaphoreHandle_t _writeLock;
+
+    bool _migrated;
+    uint32_t _loadTimeUs;
 
     bool loadDefaultConfig();
-    TriggerMapping::Mode parseProfileMode(const char* mode);
-    const char* profileModeToString(TriggerMapping::Mode mode);
+    ConfigImage captureConfig() const;
+    static bool writeConfig(const ConfigImage& image);
+    static bool writeWifiConfig(const WifiConfig& wifi);
+
+    /**
+     * Queue copies for writing; a null argument leaves that part alone.
+     * @param config New config image (ownership taken)
+     * @param wifi New WiFi settings (ownership taken)
+     */
+    void queueSave(std::unique_ptr<ConfigImage> config, std::unique_ptr<WifiConfig> wifi);
+
+    /**
+     * Write the queued saves that are due (all of them if `force`).
+     * @param force Ignore the debounce
+     * @param wait Longest to wait for a write in progress
+     * @return false if NVS rejected a write or the wait timed out
+     */
+    bool writePending(bool force, TickType_t wait);
+
+    static void onShutdown();
+    /** Import CONFIG_PATH and WIFI_CONFIG_PATH into NVS (empty store only). */
+    bool migrateFromFiles();
+    void importTriggers(JsonArrayConst triggers);
+    void exportTriggers(JsonArray dst) const;
+    static TriggerMapping::Mode parseProfileMode(const char* mode);
+    static const char* profileModeToString(TriggerMapping::Mode mode);
 };
 
 #endif // CONFIG_MANAGER_H
@@ -0,0 +1,489 @@
+#include "ConfigRestore.h"
+#include "ConfigManager.h"
+#include "Logger.h"
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+
+/// Temp files written during a restore, imported into the config store on success
+#define CONFIG_RESTORE_TMP_PATH "/config.json.tmp"
+#define WIFI_RESTORE_TMP_PATH "/wifi.json.tmp"
+
+ConfigRestore::ConfigRestore()
+    : _msgpack(false)
+    , _packBuf(nullptr)
+    , _packSize(0)
+{
+    reset();
+}
+
+ConfigRestore::~ConfigRestore() {
+    if (_file) _file.close();
+    free(_packBuf);
+}
+
+void ConfigRestore::reset() {
+    if (_file) _file.close();
+    free(_packBuf);
+    _packBuf = nullptr;
+    _packSize = 0;
+    _msgpack = false;
+    _state = State::EXPECT_ROOT;
+    _sink = Sink::NONE;
+    _hasConfig = false;
+    _hasWifi = false;
+    _received = 0;
+    _keyLen = 0;
+    _key[0] = '\0';
+    _versionLen = 0;
+    _version[0] = '\0';
+    _depth = 0;
+    _inString = false;
+    _escape = false;
+    _scalar = false;
+    _writeLen = 0;
+    _error = "";
+}
+
+bool ConfigRestore::begin(size_t total, bool msgpack) {
+    abort();
+
+    if (total > MAX_RESTORE_SIZE) {
+        fail("Backup too large (" + String(total) + " bytes, max " + String(MAX_RESTORE_SIZE) + ")");
+        return false;
+    }
+
+    if (msgpack) {
+        _packBuf = (uint8_t*)malloc(total > 0 ? total : 1);
+        if (!_packBuf) {
+            fail("Out of memory for backup");
+            return false;
+        }
+        _msgpack = true;
+    }
+    return true;
+}
+
+void ConfigRestore::abort() {
+    reset();
+    LittleFS.remove(CONFIG_RESTORE_TMP_PATH);
+    LittleFS.remove(WIFI_RESTORE_TMP_PATH);
+}
+
+void ConfigRestore::fail(const String& error) {
+    if (_state == State::ERROR) return;  // Keep the first error
+    if (_file) _file.close();
+    _state = State::ERROR;
+    _error = error;
+}
+
+bool ConfigRestore::feed(const uint8_t* data, size_t len) {
+    if (_state == State::ERROR) return false;
+
+    _received += len;
+    if (_received > MAX_RESTORE_SIZE) {
+        fail("Backup too large (max " + String(MAX_RESTORE_SIZE) + " bytes)");
+        return false;
+    }
+
+    if (_msgpack) {
+        uint8_t* grown = (uint8_t*)realloc(_packBuf, _received);
+        if (!grown) {
+            fail("Out of memory for backup");
+            return false;
+        }
+        _packBuf = grown;
+        memcpy(_packBuf + _packSize, data, len);
+        _packSize += len;
+        return true;
+    }
+
+    size_t i = 0;
+    while (i < len && _state != State::ERROR) {
+        char c = (char)data[i];
+
+        switch (_state) {
+            case State::EXPECT_ROOT:
+                if (c == '{') {
+                    _state = State::EXPECT_KEY;
+                } else if (!isSpace(c)) {
+                    fail("Invalid JSON: expected object");
+                }
+                break;
+
+            case State::EXPECT_KEY:
+                if (c == '"') {
+                    _keyLen = 0;
+                    _escape = false;
+                    _state = State::IN_KEY;
+                } else if (c == '}') {
+                    _state = State::DONE;
+                } else if (!isSpace(c)) {
+                    fail("Invalid JSON: expected key");
+                }
+                break;
+
+            case State::IN_KEY:
+                if (_escape) {
+                    _escape = false;
+                } else if (c == '\\') {
+                    _escape = true;
+                } else if (c == '"') {
+                    _key[_keyLen] = '\0';
+                    _state = State::EXPECT_COLON;
+                    break;
+                }
+                if (_keyLen < MAX_TOKEN_LEN) _key[_keyLen++] = c;
+                break;
+
+            case State::EXPECT_COLON:
+                if (c == ':') {
+                    _state = State::EXPECT_VALUE;
+                } else if (!isSpace(c)) {
+                    fail("Invalid JSON: expected ':'");
+                }
+                break;
+
+            case State::EXPECT_VALUE:
+                if (!isSpace(c)) {
+                    startValue(c);
+                }
+                break;
+
+            case State::IN_VALUE:
+                if (_scalar && (c == ',' || c == '}' || isSpace(c))) {
+                    // Scalars have no closing token - reprocess the delimiter
+                    if (endValue()) _state = State::AFTER_VALUE;
+                    continue;
+                }
+                processValueChar(c);
+                break;
+
+            case State::AFTER_VALUE:
+                if (c == ',') {
+                    _state = State::EXPECT_KEY;
+                } else if (c == '}') {
+                    _state = State::DONE;
+                } else if (!isSpace(c)) {
+                    fail("Invalid JSON: expected ',' or '}'");
+                }
+                break;
+
+            case State::DONE:
+                if (!isSpace(c)) {
+                    fail("Invalid JSON: trailing data");
+                }
+                break;
+
+            case State::ERROR:
+                break;
+        }
+        i++;
+    }
+
+    if (_state != State::ERROR && _writeLen > 0) flush();
+    return _state != State::ERROR;
+}
+
+void ConfigRestore::startValue(char c) {
+    _sink = Sink::NONE;
+    _depth = 0;
+    _inString = false;
+    _escape = false;
+    _scalar = false;
+
+    bool isObject = (c == '{');
+    if (strcmp(_key, "config") == 0 && isObject) {
+        _sink = Sink::CONFIG;
+        _file = LittleFS.open(CONFIG_RESTORE_TMP_PATH, "w");
+    } else if (strcmp(_key, "wifi") == 0 && isObject) {
+        _sink = Sink::WIFI;
+        _file = LittleFS.open(WIFI_RESTORE_TMP_PATH, "w");
+    } else if (strcmp(_key, "version") == 0 && c == '"') {
+        _sink = Sink::VERSION;
+        _versionLen = 0;
+    }
+
+    if ((_sink == Sink::CONFIG || _sink == Sink::WIFI) && !_file) {
+        fail("Failed to open temp file");
+        return;
+    }
+
+    _state = State::IN_VALUE;
+    if (c == '{' || c == '[') {
+        _depth = 1;
+    } else if (c == '"') {
+        _inString = true;
+    } else {
+        _scalar = true;
+    }
+
+    // The version's quotes are not part of the captured value
+    if (_sink != Sink::VERSION) emit(c);
+}
+
+void ConfigRestore::processValueChar(char c) {
+    bool closed = false;
+
+    if (_inString) {
+        if (_escape) {
+            _escape = false;
+        } else if (c == '\\') {
+            _escape = true;
+        } else if (c == '"') {
+            _inString = false;
+            closed = (_depth == 0);  // A top-level string value just ended
+        }
+    } else if (c == '"') {
+        _inString = true;
+    } else if (c == '{' || c == '[') {
+        _depth++;
+    } else if (c == '}' || c == ']') {
+        _depth--;
+        closed = (_depth == 0);
+    }
+
+    if (!(closed && _sink == Sink::VERSION)) emit(c);
+
+    if (closed && endValue()) {
+        _state = State::AFTER_VALUE;
+    }
+}
+
+bool ConfigRestore::endValue() {
+    if (_sink == Sink::CONFIG || _sink == Sink::WIFI) {
+        if (!flush()) return false;
+        _file.close();
+        if (_sink == Sink::CONFIG) _hasConfig = true;
+        if (_sink == Sink::WIFI) _hasWifi = true;
+    } else if (_sink == Sink::VERSION) {
+        _version[_versionLen] = '\0';
+    }
+    _sink = Sink::NONE;
+    return true;
+}
+
+void ConfigRestore::emit(char c) {
+    switch (_sink) {
+        case Sink::CONFIG:
+        case Sink::WIFI:
+            _writeBuf[_writeLen++] = (uint8_t)c;
+            if (_writeLen >= WRITE_BUFFER_SIZE) flush();
+            break;
+        case Sink::VERSION:
+            if (_versionLen < MAX_TOKEN_LEN) _version[_versionLen++] = c;
+            break;
+        case Sink::NONE:
+            break;
+    }
+}
+
+bool ConfigRestore::flush() {
+    if (_writeLen == 0) return true;
+    if (!_file || _file.write(_writeBuf, _writeLen) != _writeLen) {
+        fail("Failed to write temp file");
+        return false;
+    }
+    _writeLen = 0;
+    return true;
+}
+
+bool ConfigRestore::checkVersion() {
+    // Accept: missing version (legacy), same major version (any minor)
+    // Reject: unknown major version
+    if (_versionLen == 0) {
+        LOG_INFO("ConfigRestore: Restoring legacy backup (no version)");
+        return true;
+    }
+
+    String version(_version);
+    int dotIdx = version.indexOf('.');
+    int major = (dotIdx > 0) ? version.substring(0, dotIdx).toInt() : version.toInt();
+    if (major > 1) {
+        fail("Incompatible backup version " + version + " (expected 1.x)");
+        return false;
+    }
+    LOG_INFO("ConfigRestore: Restoring backup version %s", version.c_str());
+    return true;
+}
+
+namespace {
+
+/**
+ * Allocator that stops a document from growing past a fixed budget, so a
+ * section parses in bounded memory whatever the upload holds.
+ */
+class BudgetAllocator : public ArduinoJson::Allocator {
+public:
+    explicit BudgetAllocator(size_t budget) : _left(budget) {}
+
+    void* allocate(size_t size) override {
+        if (size > _left) return nullptr;
+        uint8_t* block = (uint8_t*)malloc(size + HEADER);
+        if (!block) return nullptr;
+        *(size_t*)block = size;
+        _left -= size;
+        return block + HEADER;
+    }
+
+    void deallocate(void* ptr) override {
+        if (!ptr) return;
+        uint8_t* block = (uint8_t*)ptr - HEADER;
+        _left += *(size_t*)block;
+        free(block);
+    }
+
+    void* reallocate(void* ptr, size_t size) override {
+        if (!ptr) return allocate(size);
+        uint8_t* block = (uint8_t*)ptr - HEADER;
+        size_t old = *(size_t*)block;
+        if (size > old && size - old > _left) return nullptr;
+        uint8_t* grown = (uint8_t*)realloc(block, size + HEADER);
+        if (!grown) return nullptr;
+        *(size_t*)grown = size;
+        _left = _left + old - size;
+        return grown + HEADER;
+    }
+
+private:
+    static const size_t HEADER = 8;  // Block size, padded to keep malloc's alignment
+    size_t _left;
+};
+
+}  // namespace
+
+void ConfigRestore::decodeMsgPack() {
+    // The whole map is decoded at once, so it gets the same budget as one JSON section
+    JsonDocument filter;
+    filter["version"] = true;
+    filter["config"] = true;
+    filter["wifi"] = true;
+    BudgetAllocator budget(MAX_SECTION_MEMORY);
+    JsonDocument doc(&budget);
+    DeserializationError err = deserializeMsgPack(doc, _packBuf, _packSize,
+                                                  DeserializationOption::Filter(filter));
+    free(_packBuf);
+    _packBuf = nullptr;
+    _packSize = 0;
+
+    if (err == DeserializationError::NoMemory) {
+        fail("The backup is too large");
+        return;
+    }
+    if (err || !doc.is<JsonObject>()) {
+        fail("Invalid MessagePack: expected map");
+        return;
+    }
+
+    const char* version = doc["version"];
+    if (version) {
+        strlcpy(_version, version, sizeof(_version));
+        _versionLen = strlen(_version);
+    }
+
+    // Same temp files as the JSON path, so validation and swap are shared
+    struct Section { const char* key; const char* path; bool* present; };
+    Section sections[] = {
+        {"config", CONFIG_RESTORE_TMP_PATH, &_hasConfig},
+        {"wifi", WIFI_RESTORE_TMP_PATH, &_hasWifi},
+    };
+    for (const Section& section : sections) {
+        JsonVariantConst value = doc[section.key];
+        if (value.isNull()) continue;
+
+        File file = LittleFS.open(section.path, "w");
+        if (!file) {
+            fail("Failed to open temp file");
+            return;
+        }
+        bool ok = serializeJson(value, file) > 0;
+        file.close();
+        if (!ok) {
+            fail("Failed to write temp file");
+            return;
+        }
+        *section.present = true;
+    }
+
+    _state = State::DONE;
+}
+
+bool ConfigRestore::importSection(ConfigManager& config, bool wifi) {
+    const String name = wifi ? "wifi" : "config";
+    File file = LittleFS.open(wifi ? WIFI_RESTORE_TMP_PATH : CONFIG_RESTORE_TMP_PATH, "r");
+    if (!file) {
+        fail("Failed to read temp file");
+        return false;
+    }
+
+    // Unknown top-level keys are never stored, and the rest must fit the budget
+    JsonDocument filter;
+    if (wifi) {
+        ConfigManager::wifiConfigFilter(filter.to<JsonObject>());
+    } else {
+        ConfigManager::configFilter(filter.to<JsonObject>());
+    }
+    BudgetAllocator budget(MAX_SECTION_MEMORY);
+    JsonDocument doc(&budget);
+    DeserializationError error = deserializeJson(doc, file, DeserializationOption::Filter(filter));
+    file.close();
+
+    if (error == DeserializationError::NoMemory) {
+        fail("The " + name + " section is too large");
+        return false;
+    }
+    if (error || !doc.is<JsonObject>()) {
+        fail("Invalid JSON in " + name + " section");
+        return false;
+    }
+
+    if (wifi) {
+        config.importWifiConfig(doc.as<JsonVariantConst>());
+    } else {
+        config.importConfig(doc.as<JsonVariantConst>());
+    }
+    return true;
+}
+
+bool ConfigRestore::finish(ConfigManager& config) {
+    if (_msgpack && _state != State::ERROR) {
+        decodeMsgPack();
+    }
+
+    if (_state != State::ERROR && _state != State::DONE) {
+        fail("Invalid JSON: incomplete document");
+    }
+
+    // Both sections are imported, one document at a time, before either
+    // is saved. Importing only changes the settings in memory, so a section
+    // that fails puts back the stored settings the other one replaced.
+    if (_state == State::DONE && checkVersion()) {
+        if (_hasConfig) importSection(config, false);
+        if (_state != State::ERROR && _hasWifi && !importSection(config, true) && _hasConfig) {
+            // Queued edits from before the restore are stored first, so
+            // the reload gets them back rather than dropping them
+            config.flushSaves();
+            config.loadConfig();
+            config.loadWifiConfig();
+        }
+    }
+
+    if (_state == State::ERROR) {
+        String error = _error;
+        abort();
+        _error = error;
+        return false;
+    }
+
+    // Queued like any other edit; loop() writes both sections together
+    if (_hasConfig) {
+        config.saveConfig();
+        LOG_INFO("ConfigRestore: Restored config section");
+    }
+    if (_hasWifi) {
+        config.saveWifiConfig();
+        LOG_INFO("ConfigRestore: Restored wifi section");
+    }
+
+    abort();
+    return true;
+}
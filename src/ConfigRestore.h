@@ -0,0 +1,151 @@
+#ifndef CONFIG_RESTORE_H
+#define CONFIG_RESTORE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+class ConfigManager;
+
+/**
+ * Incremental parser for config backup uploads (POST /api/config/restore).
+ *
+ * Consumes the backup JSON as body chunks arrive and streams the "config"
+ * and "wifi" sections byte-for-byte into temporary files in LittleFS. Only
+ * the top level of the document is tokenized here; the sections themselves
+ * are parsed from the temp files once the upload is complete, one at a
+ * time, keeping only the keys ConfigManager imports and within
+ * MAX_SECTION_MEMORY. Both sections are imported before either is saved;
+ * if one fails to parse, the stored settings are reloaded and nothing is
+ * saved. Otherwise both are queued with ConfigManager's other saves and
+ * written by loop(). The temp files are removed either way.
+ *
+ * While uploading, peak memory is a fixed-size write buffer plus a few
+ * bytes of parser state, regardless of upload size; finish() adds at most
+ * one section document of MAX_SECTION_MEMORY.
+ *
+ * MessagePack uploads (Content-Type: application/msgpack) cannot be
+ * tokenized this way; they are buffered whole (at most MAX_RESTORE_SIZE),
+ * decoded in finish() within MAX_SECTION_MEMORY, and each section is
+ * written to its temp file as JSON before the same validation and swap.
+ *
+ * Usage:
+ *   ConfigRestore restore;
+ *   restore.begin(total);
+ *   restore.feed(data, len);   // once per body chunk
+ *   if (!restore.finish(config)) LOG_ERROR("%s", restore.getError().c_str());
+ */
+class ConfigRestore {
+public:
+    ConfigRestore();
+    ~ConfigRestore();
+
+    /**
+     * Start a new restore, discarding any previous partial one.
+     * @param total Declared body size in bytes
+     * @param msgpack true if the body is MessagePack rather than JSON
+     * @return false if the upload is too large to accept
+     */
+    bool begin(size_t total, bool msgpack = false);
+
+    /**
+     * Parse the next chunk of the upload body.
+     * @param data Chunk data
+     * @param len Chunk length
+     * @return false once a parse or write error has occurred
+     */
+    bool feed(const uint8_t* data, size_t len);
+
+    /**
+     * Validate the uploaded sections, then import and save them.
+     * @param config Receives the restored settings
+     * @return true if the restore was applied
+     */
+    bool finish(ConfigManager& config);
+
+    /** Remove temp files and reset parser state. */
+    void abort();
+
+    /** @return Error message from the last failed call, empty if none */
+    const String& getError() const { return _error; }
+
+    /** Largest accepted restore body */
+    static const size_t MAX_RESTORE_SIZE = 16384;
+
+    /** Most heap one parsed section may use */
+    static const size_t MAX_SECTION_MEMORY = 16384;
+
+private:
+    /** Top-level tokenizer states */
+    enum class State {
+        EXPECT_ROOT,   ///< Waiting for the opening '{'
+        EXPECT_KEY,    ///< Waiting for a key or '}'
+        IN_KEY,        ///< Reading a key string
+        EXPECT_COLON,  ///< Waiting for ':' after a key
+        EXPECT_VALUE,  ///< Waiting for the first byte of a value
+        IN_VALUE,      ///< Copying / skipping a value
+        AFTER_VALUE,   ///< Waiting for ',' or '}'
+        DONE,          ///< Root object closed
+        ERROR          ///< Parse or write failure
+    };
+
+    /** Where the bytes of the current top-level value go */
+    enum class Sink {
+        NONE,     ///< Skipped
+        CONFIG,   ///< config.json temp file
+        WIFI,     ///< wifi.json temp file
+        VERSION   ///< Captured into _version
+    };
+
+    State _state;
+    Sink _sink;
+    File _file;
+    bool _hasConfig;
+    bool _hasWifi;
+    size_t _received;
+
+    // Key / version capture (bounded; longer values are truncated)
+    static const size_t MAX_TOKEN_LEN = 16;
+    char _key[MAX_TOKEN_LEN + 1];
+    size_t _keyLen;
+    char _version[MAX_TOKEN_LEN + 1];
+    size_t _versionLen;
+
+    // Value tokenizer state
+    int _depth;
+    bool _inString;
+    bool _escape;
+    bool _scalar;
+
+    // Write buffer for the active temp file
+    static const size_t WRITE_BUFFER_SIZE = 128;
+    uint8_t _writeBuf[WRITE_BUFFER_SIZE];
+    size_t _writeLen;
+
+    // MessagePack upload buffer (whole body)
+    bool _msgpack;
+    uint8_t* _packBuf;
+    size_t _packSize;
+
+    String _error;
+
+    void reset();
+
+    /** Decode a buffered MessagePack body into the temp files. */
+    void decodeMsgPack();
+
+    /**
+     * Parse a temp file (bounded, filtered) and import it, unsaved.
+     * @return false (after fail()) if the section can't be read
+     */
+    bool importSection(ConfigManager& config, bool wifi);
+    void fail(const String& error);
+    void startValue(char c);
+    void processValueChar(char c);
+    bool endValue();
+    void emit(char c);
+    bool flush();
+    bool checkVersion();
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+};
+
+#endif // CONFIG_RESTORE_H
@@ -0,0 +1,284 @@
+#include "ConfigSchema.h"
+#include <stdlib.h>
+
+// --- Raw field access ---
+
+static void* fieldPtr(void* obj, const ConfigField& field) {
+    return static_cast<uint8_t*>(obj) + field.offset;
+}
+
+static const void* fieldPtr(const void* obj, const ConfigField& field) {
+    return static_cast<const uint8_t*>(obj) + field.offset;
+}
+
+/** Store an integer in a field of 1, 2 or 4 bytes (range already checked). */
+static void storeInt(void* p, const ConfigField& field, int32_t value) {
+    switch (field.size) {
+        case 1: { uint8_t v = (uint8_t)value; memcpy(p, &v, 1); break; }
+        case 2: { uint16_t v = (uint16_t)value; memcpy(p, &v, 2); break; }
+        default: { uint32_t v = (uint32_t)value; memcpy(p, &v, 4); break; }
+    }
+}
+
+/** Load an integer; fields are signed exactly when their range is. */
+static int32_t loadInt(const void* p, const ConfigField& field) {
+    bool isSigned = field.min < 0;
+    switch (field.size) {
+        case 1: {
+            uint8_t v;
+            memcpy(&v, p, 1);
+            return isSigned ? (int32_t)(int8_t)v : (int32_t)v;
+        }
+        case 2: {
+            uint16_t v;
+            memcpy(&v, p, 2);
+            return isSigned ? (int32_t)(int16_t)v : (int32_t)v;
+        }
+        default: {
+            int32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+    }
+}
+
+static void storeDefault(void* obj, const ConfigField& field) {
+    void* p = fieldPtr(obj, field);
+    switch (field.type) {
+        case ConfigField::Type::BOOL: {
+            bool v = field.intDefault != 0;
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+        case ConfigField::Type::INT:
+        case ConfigField::Type::ENUM:
+            storeInt(p, field, field.intDefault);
+            break;
+        case ConfigField::Type::STRING:
+            strlcpy(static_cast<char*>(p), field.strDefault ? field.strDefault : "", field.size);
+            break;
+    }
+}
+
+// --- ConfigSchema ---
+
+void ConfigSchema::setDefaults(void* obj) const {
+    for (uint8_t i = 0; i < count; i++) {
+        storeDefault(obj, fields[i]);
+    }
+}
+
+const ConfigField* ConfigSchema::find(const char* key) const {
+    for (uint8_t i = 0; i < count; i++) {
+        if (strcmp(fields[i].key, key) == 0) return &fields[i];
+    }
+    return nullptr;
+}
+
+uint32_t ConfigSchema::diff(const void* a, const void* b) const {
+    uint32_t changed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        const ConfigField& field = fields[i];
+        const void* pa = fieldPtr(a, field);
+        const void* pb = fieldPtr(b, field);
+        // Strings compare up to the NUL; bytes after it are leftovers
+        bool same = field.type == ConfigField::Type::STRING
+                        ? strncmp(static_cast<const char*>(pa), static_cast<const char*>(pb), field.size) == 0
+                        : memcmp(pa, pb, field.size) == 0;
+        if (!same) changed |= 1UL << i;
+    }
+    return changed;
+}
+
+uint32_t ConfigSchema::bit(const char* key) const {
+    const ConfigField* field = find(key);
+    return field ? 1UL << (field - fields) : 0;
+}
+
+const char* ConfigSchema::enumName(const ConfigField& field, uint8_t value) {
+    if (field.type != ConfigField::Type::ENUM || value > field.max) return "";
+    return field.choices[value];
+}
+
+const char* ConfigSchema::enumName(const char* key, uint8_t value) const {
+    const ConfigField* field = find(key);
+    return field ? enumName(*field, value) : "";
+}
+
+void ConfigSchema::appendError(String& error, const ConfigField* field, const char* key,
+                               const char* what) const {
+    if (error.length() > 0) error += "; ";
+    error += section;
+    error += '.';
+    error += key;
+    error += ": ";
+    error += what;
+
+    if (!field) return;
+    char detail[48];
+    switch (field->type) {
+        case ConfigField::Type::INT:
+            snprintf(detail, sizeof(detail), " (%ld..%ld)", (long)field->min, (long)field->max);
+            error += detail;
+            break;
+        case ConfigField::Type::STRING:
+            snprintf(detail, sizeof(detail), " (max %u characters)", (unsigned)(field->size - 1));
+            error += detail;
+            break;
+        case ConfigField::Type::ENUM:
+            error += " (";
+            for (int32_t i = 0; i <= field->max; i++) {
+                if (i > 0) error += ", ";
+                error += field->choices[i];
+            }
+            error += ')';
+            break;
+        case ConfigField::Type::BOOL:
+            break;
+    }
+}
+
+bool ConfigSchema::readField(const ConfigField& field, JsonVariantConst value, void* obj,
+                             String& error) const {
+    void* p = fieldPtr(obj, field);
+    switch (field.type) {
+        case ConfigField::Type::BOOL: {
+            if (!value.is<bool>()) {
+                appendError(error, &field, field.key, "expected true or false");
+                return false;
+            }
+            bool v = value.as<bool>();
+            memcpy(p, &v, sizeof(v));
+            return true;
+        }
+
+        case ConfigField::Type::INT: {
+            if (!value.is<long>()) {
+                appendError(error, &field, field.key, "expected an integer");
+                return false;
+            }
+            long v = value.as<long>();
+            if (v < field.min || v > field.max) {
+                appendError(error, &field, field.key, "out of range");
+                return false;
+            }
+            storeInt(p, field, (int32_t)v);
+            return true;
+        }
+
+        case ConfigField::Type::STRING: {
+            if (!value.is<const char*>()) {
+                appendError(error, &field, field.key, "expected a string");
+                return false;
+            }
+            const char* v = value.as<const char*>();
+            if (strlen(v) >= field.size) {
+                appendError(error, &field, field.key, "too long");
+                return false;
+            }
+            strlcpy(static_cast<char*>(p), v, field.size);
+            return true;
+        }
+
+        case ConfigField::Type::ENUM: {
+            const char* v = value.is<const char*>() ? value.as<const char*>() : nullptr;
+            for (int32_t i = 0; v && i <= field.max; i++) {
+                if (strcmp(v, field.choices[i]) == 0) {
+                    storeInt(p, field, i);
+                    return true;
+                }
+            }
+            appendError(error, &field, field.key, "expected one of");
+            return false;
+        }
+    }
+    return false;
+}
+
+bool ConfigSchema::read(JsonVariantConst src, void* obj, String& error) const {
+    setDefaults(obj);
+    if (src.isNull()) return true;
+
+    if (!src.is<JsonObjectConst>()) {
+        if (error.length() > 0) error += "; ";
+        error += section;
+        error += ": expected an object";
+        return false;
+    }
+
+    bool ok = true;
+    JsonObjectConst object = src.as<JsonObjectConst>();
+    for (uint8_t i = 0; i < count; i++) {
+        JsonVariantConst value = object[fields[i].key];
+        if (value.isNull()) continue;
+        if (!readField(fields[i], value, obj, error)) {
+            storeDefault(obj, fields[i]);
+            ok = false;
+        }
+    }
+
+    // Keys the schema doesn't know are almost always typos
+    for (JsonPairConst pair : object) {
+        if (!find(pair.key().c_str())) {
+            appendError(error, nullptr, pair.key().c_str(), "unknown key");
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool ConfigSchema::set(void* obj, const char* key, const String& text, String& error) const {
+    const ConfigField* field = find(key);
+    if (!field) {
+        appendError(error, nullptr, key, "unknown key");
+        return false;
+    }
+
+    // Convert the text to the JSON type the field expects, then share readField()
+    JsonDocument doc;
+    switch (field->type) {
+        case ConfigField::Type::BOOL:
+            if (text == "true" || text == "1") doc.set(true);
+            else if (text == "false" || text == "0") doc.set(false);
+            else doc.set(text);  // Rejected below with the usual message
+            break;
+        case ConfigField::Type::INT: {
+            char* end = nullptr;
+            long v = strtol(text.c_str(), &end, 10);
+            if (text.length() > 0 && end && *end == '\0') doc.set(v);
+            else doc.set(text);
+            break;
+        }
+        case ConfigField::Type::STRING:
+        case ConfigField::Type::ENUM:
+            doc.set(text);
+            break;
+    }
+
+    // readField() only stores once a value has passed, so `obj` is untouched on failure
+    return readField(*field, doc.as<JsonVariantConst>(), obj, error);
+}
+
+void ConfigSchema::write(const void* obj, JsonObject dst) const {
+    for (uint8_t i = 0; i < count; i++) {
+        const ConfigField& field = fields[i];
+        const void* p = fieldPtr(obj, field);
+        switch (field.type) {
+            case ConfigField::Type::BOOL: {
+                bool v;
+                memcpy(&v, p, sizeof(v));
+                dst[field.key] = v;
+                break;
+            }
+            case ConfigField::Type::INT:
+                dst[field.key] = loadInt(p, field);
+                break;
+            case ConfigField::Type::STRING:
+                dst[field.key] = String(static_cast<const char*>(p));  // Copied into the document
+                break;
+            case ConfigField::Type::ENUM:
+                dst[field.key] = enumName(field, (uint8_t)loadInt(p, field));
+                break;
+        }
+    }
+}
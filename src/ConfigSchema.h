@@ -0,0 +1,146 @@
+#ifndef CONFIG_SCHEMA_H
+#define CONFIG_SCHEMA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <type_traits>
+
+/**
+ * One field of a typed config struct: JSON key, storage, default and the
+ * values it may take. Built with the CONFIG_* macros below so the key is
+ * always the member name and offset/size always match the member.
+ */
+struct ConfigField {
+    enum class Type : uint8_t {
+        BOOL,    ///< bool
+        INT,     ///< Signed or unsigned integer of `size` bytes, within [min, max]
+        STRING,  ///< char[size], at most size - 1 characters
+        ENUM     ///< uint8_t-based enum; JSON holds choices[value]
+    };
+
+    const char* key;
+    Type type;
+    uint16_t offset;
+    uint16_t size;
+    int32_t min;
+    int32_t max;                 ///< ENUM: index of the last choice
+    int32_t intDefault;          ///< BOOL, INT and ENUM default
+    const char* strDefault;      ///< STRING default
+    const char* const* choices;  ///< ENUM names, indexed by value
+};
+
+#define CONFIG_BOOL(S, f, def) \
+    { #f, ConfigField::Type::BOOL, offsetof(S, f), sizeof(S::f), 0, 1, (def) ? 1 : 0, nullptr, nullptr }
+#define CONFIG_INT(S, f, lo, hi, def) \
+    { #f, ConfigField::Type::INT, offsetof(S, f), sizeof(S::f), lo, hi, def, nullptr, nullptr }
+#define CONFIG_STRING(S, f, def) \
+    { #f, ConfigField::Type::STRING, offsetof(S, f), sizeof(S::f), 0, 0, 0, def, nullptr }
+#define CONFIG_ENUM(S, f, names, def) \
+    { #f, ConfigField::Type::ENUM, offsetof(S, f), sizeof(S::f), 0, \
+      (int32_t)(sizeof(names) / sizeof(names[0])) - 1, (int32_t)(def), nullptr, names }
+
+/**
+ * Table-driven reader/writer for a typed config struct.
+ *
+ * Each config struct (see ConfigTypes.h) declares `static const ConfigSchema
+ * SCHEMA` listing its fields. The same table fills in defaults, converts to
+ * and from the struct's JSON section, and validates: wrong types, values
+ * out of range, unknown enum names, strings too long for their buffer and
+ * unknown keys (typos) are all reported with the section and key.
+ *
+ * Validation runs once, when config.json is loaded or an API write arrives;
+ * consumers then read plain struct members. diff() tells which fields two
+ * copies disagree on, so a config change only touches what it affects.
+ * Schemas have at most 32 fields.
+ *
+ * Usage:
+ *   AvrConfig avr;                        // Schema defaults
+ *   String error;
+ *   if (!configRead(doc["avr"], avr, error)) LOG_WARN("%s", error.c_str());
+ *   configWrite(avr, out["avr"].to<JsonObject>());
+ */
+struct ConfigSchema {
+    const char* section;   ///< config.json key, used in messages
+    const ConfigField* fields;
+    uint8_t count;
+
+    /** Set every field to its default. */
+    void setDefaults(void* obj) const;
+
+    /**
+     * Read a JSON section. Missing fields get their default; invalid ones
+     * keep their default and are reported.
+     * @param src JSON object (null reads as all defaults)
+     * @param obj Struct to fill
+     * @param error Receives every problem found, "; "-separated
+     * @return true if the section was valid
+     */
+    bool read(JsonVariantConst src, void* obj, String& error) const;
+
+    /**
+     * Set one field from text (e.g. a form parameter), with the same checks.
+     * Booleans accept "true"/"false"/"1"/"0"; enums accept their names.
+     * @return false (and `obj` unchanged) if the key is unknown or the value invalid
+     */
+    bool set(void* obj, const char* key, const String& text, String& error) const;
+
+    /** Write every field into a JSON object. */
+    void write(const void* obj, JsonObject dst) const;
+
+    /**
+     * Compare two structs field by field.
+     * @return Bit i set when fields[i] differs (see bit())
+     */
+    uint32_t diff(const void* a, const void* b) const;
+
+    /** @return The diff() bit of field `key`, 0 if unknown */
+    uint32_t bit(const char* key) const;
+
+    /** @return The field named `key`, or nullptr */
+    const ConfigField* find(const char* key) const;
+
+    /** Name of an enum field's value ("" if out of range). */
+    static const char* enumName(const ConfigField& field, uint8_t value);
+
+    /** Name of the value of the enum field `key`, e.g. for log messages. */
+    const char* enumName(const char* key, uint8_t value) const;
+
+private:
+    bool readField(const ConfigField& field, JsonVariantConst value, void* obj, String& error) const;
+    void appendError(String& error, const ConfigField* field, const char* key, const char* what) const;
+};
+
+/** Fill `out` with schema defaults. */
+template <typename T>
+void configDefaults(T& out) {
+    static_assert(std::is_standard_layout<T>::value, "config structs must be standard layout");
+    T::SCHEMA.setDefaults(&out);
+}
+
+/** Read `out` from its JSON section; see ConfigSchema::read(). */
+template <typename T>
+bool configRead(JsonVariantConst src, T& out, String& error) {
+    static_assert(std::is_standard_layout<T>::value, "config structs must be standard layout");
+    return T::SCHEMA.read(src, &out, error);
+}
+
+/** Set one field of `out` from text; see ConfigSchema::set(). */
+template <typename T>
+bool configSet(T& out, const char* key, const String& text, String& error) {
+    return T::SCHEMA.set(&out, key, text, error);
+}
+
+/** Fields that differ between `a` and `b`; see ConfigSchema::diff(). */
+template <typename T>
+uint32_t configDiff(const T& a, const T& b) {
+    return T::SCHEMA.diff(&a, &b);
+}
+
+/** Write `in` as its JSON section. */
+template <typename T>
+void configWrite(const T& in, JsonObject dst) {
+    T::SCHEMA.write(&in, dst);
+}
+
+#endif // CONFIG_SCHEMA_H
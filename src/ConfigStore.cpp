@@ -0,0 +1,230 @@
+#include "ConfigStore.h"
+#include "Logger.h"
+#include <nvs.h>
+
+namespace {
+
+/** NVS limit for namespace and key names, without the NUL */
+const size_t NVS_NAME_LEN = 15;
+
+const char* const META_SECTION = "meta";
+const char* const FORMAT_KEY = "format";
+
+/** Open NVS handle for one section, closed on scope exit */
+class Section {
+public:
+    Section(const char* section, bool write) : _open(false) {
+        char name[NVS_NAME_LEN + 1];
+        snprintf(name, sizeof(name), "tl_%s", section);
+        // Read-only opens of a namespace never written fail with NOT_FOUND
+        _open = nvs_open(name, write ? NVS_READWRITE : NVS_READONLY, &_handle) == ESP_OK;
+    }
+    ~Section() {
+        if (_open) nvs_close(_handle);
+    }
+
+    bool isOpen() const { return _open; }
+    nvs_handle_t handle() const { return _handle; }
+
+private:
+    nvs_handle_t _handle;
+    bool _open;
+};
+
+/** Field key cut to the NVS key length */
+void nvsKey(const char* key, char (&out)[NVS_NAME_LEN + 1]) {
+    strlcpy(out, key, sizeof(out));
+}
+
+/**
+ * Check that no two fields of a section share an NVS key once cut. A
+ * collision would make them overwrite each other, so such a section is
+ * neither loaded nor saved.
+ */
+bool keysUnique(const ConfigSchema& schema) {
+    for (uint8_t i = 0; i < schema.count; i++) {
+        for (uint8_t j = i + 1; j < schema.count; j++) {
+            if (strncmp(schema.fields[i].key, schema.fields[j].key, NVS_NAME_LEN) == 0) {
+                LOG_ERROR("ConfigStore: %s.%s and %s.%s share the NVS key of their first %u characters",
+                          schema.section, schema.fields[i].key, schema.section, schema.fields[j].key,
+                          (unsigned)NVS_NAME_LEN);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool readString(nvs_handle_t handle, const char* key, String& out) {
+    size_t len = 0;
+    if (nvs_get_str(handle, key, nullptr, &len) != ESP_OK || len == 0) return false;
+    std::vector<char> buf(len);
+    if (nvs_get_str(handle, key, buf.data(), &len) != ESP_OK) return false;
+    out = buf.data();
+    return true;
+}
+
+bool writeString(nvs_handle_t handle, const char* key, const char* value, bool& changed) {
+    String stored;
+    if (readString(handle, key, stored) && stored == value) return true;
+    changed = true;
+    return nvs_set_str(handle, key, value) == ESP_OK;
+}
+
+}  // namespace
+
+bool ConfigStore::isInitialized() {
+    Section meta(META_SECTION, false);
+    uint8_t format = 0;
+    return meta.isOpen() && nvs_get_u8(meta.handle(), FORMAT_KEY, &format) == ESP_OK &&
+           format == FORMAT_VERSION;
+}
+
+bool ConfigStore::markInitialized() {
+    Section meta(META_SECTION, true);
+    return meta.isOpen() && nvs_set_u8(meta.handle(), FORMAT_KEY, FORMAT_VERSION) == ESP_OK &&
+           nvs_commit(meta.handle()) == ESP_OK;
+}
+
+bool ConfigStore::load(const ConfigSchema& schema, void* obj, String& error) {
+    // Stored values are gathered into a JSON object so the schema's
+    // validation applies to them exactly as to config.json
+    JsonDocument doc;
+    JsonObject values = doc.to<JsonObject>();
+    if (!keysUnique(schema)) {
+        error += String(error.length() > 0 ? "; " : "") + schema.section + ": NVS key collision";
+        schema.setDefaults(obj);
+        return false;
+    }
+
+    Section section(schema.section, false);
+    if (section.isOpen()) {
+        char key[NVS_NAME_LEN + 1];
+        for (uint8_t i = 0; i < schema.count; i++) {
+            const ConfigField& field = schema.fields[i];
+            nvsKey(field.key, key);
+            switch (field.type) {
+                case ConfigField::Type::BOOL: {
+                    uint8_t v;
+                    if (nvs_get_u8(section.handle(), key, &v) == ESP_OK) values[field.key] = v != 0;
+                    break;
+                }
+                case ConfigField::Type::INT: {
+                    int32_t v;
+                    if (nvs_get_i32(section.handle(), key, &v) == ESP_OK) values[field.key] = v;
+                    break;
+                }
+                case ConfigField::Type::STRING:
+                case ConfigField::Type::ENUM: {
+                    String v;
+                    if (readString(section.handle(), key, v)) values[field.key] = v;
+                    break;
+                }
+            }
+        }
+    }
+
+    return schema.read(doc.as<JsonVariantConst>(), obj, error);
+}
+
+bool ConfigStore::save(const ConfigSchema& schema, const void* obj, size_t* written) {
+    // The schema's JSON form gives each field as a plain value (enums by name)
+    if (!keysUnique(schema)) return false;
+
+    JsonDocument doc;
+    schema.write(obj, doc.to<JsonObject>());
+
+    Section section(schema.section, true);
+    if (!section.isOpen()) {
+        LOG_ERROR("ConfigStore: Cannot open NVS section %s", schema.section);
+        return false;
+    }
+
+    bool ok = true;
+    size_t count = 0;
+    char key[NVS_NAME_LEN + 1];
+    for (uint8_t i = 0; i < schema.count; i++) {
+        const ConfigField& field = schema.fields[i];
+        JsonVariantConst value = doc[field.key];
+        nvsKey(field.key, key);
+        bool changed = false;
+
+        switch (field.type) {
+            case ConfigField::Type::BOOL: {
+                uint8_t v = value.as<bool>() ? 1 : 0;
+                uint8_t stored;
+                if (nvs_get_u8(section.handle(), key, &stored) != ESP_OK || stored != v) {
+                    changed = true;
+                    ok &= nvs_set_u8(section.handle(), key, v) == ESP_OK;
+                }
+                break;
+            }
+            case ConfigField::Type::INT: {
+                int32_t v = value.as<int32_t>();
+                int32_t stored;
+                if (nvs_get_i32(section.handle(), key, &stored) != ESP_OK || stored != v) {
+                    changed = true;
+                    ok &= nvs_set_i32(section.handle(), key, v) == ESP_OK;
+                }
+                break;
+            }
+            case ConfigField::Type::STRING:
+            case ConfigField::Type::ENUM:
+                ok &= writeString(section.handle(), key, value.as<const char*>(), changed);
+                break;
+        }
+        if (changed) count++;
+    }
+
+    if (count > 0) {
+        ok &= nvs_commit(section.handle()) == ESP_OK;
+        LOG_DEBUG("ConfigStore: %s: %u key(s) written", schema.section, (unsigned)count);
+    }
+    if (written) *written += count;
+    if (!ok) LOG_ERROR("ConfigStore: Failed to write NVS section %s", schema.section);
+    return ok;
+}
+
+String ConfigStore::getString(const char* section, const char* key, const char* fallback) {
+    Section s(section, false);
+    String value;
+    if (!s.isOpen() || !readString(s.handle(), key, value)) return fallback;
+    return value;
+}
+
+bool ConfigStore::putString(const char* section, const char* key, const String& value) {
+    Section s(section, true);
+    if (!s.isOpen()) return false;
+    bool changed = false;
+    if (!writeString(s.handle(), key, value.c_str(), changed)) return false;
+    return !changed || nvs_commit(s.handle()) == ESP_OK;
+}
+
+bool ConfigStore::putStrings(const char* section, const std::vector<StringEntry>& entries) {
+    Section s(section, true);
+    if (!s.isOpen()) return false;
+    bool ok = true;
+    bool changed = false;
+    for (const StringEntry& entry : entries) {
+        ok &= writeString(s.handle(), entry.key.c_str(), entry.value.c_str(), changed);
+    }
+    if (changed) ok &= nvs_commit(s.handle()) == ESP_OK;
+    return ok;
+}
+
+bool ConfigStore::getBlob(const char* section, const char* key, std::vector<uint8_t>& out) {
+    Section s(section, false);
+    size_t len = 0;
+    if (!s.isOpen() || nvs_get_blob(s.handle(), key, nullptr, &len) != ESP_OK) return false;
+    out.resize(len);
+    return len == 0 || nvs_get_blob(s.handle(), key, out.data(), &len) == ESP_OK;
+}
+
+bool ConfigStore::putBlob(const char* section, const char* key, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> stored;
+    if (getBlob(section, key, stored) && stored == data) return true;
+
+    Section s(section, true);
+    return s.isOpen() && nvs_set_blob(s.handle(), key, data.data(), data.size()) == ESP_OK &&
+           nvs_commit(s.handle()) == ESP_OK;
+}
@@ -0,0 +1,108 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <vector>
+#include "ConfigSchema.h"
+
+/**
+ * Persistent settings in NVS, the ESP32's key-value flash partition.
+ *
+ * NVS sits outside the LittleFS partition, so a filesystem upload leaves
+ * settings alone. Each ConfigSchema section is one NVS namespace ("tl_"
+ * plus the section name) with one key per field, and save() only writes
+ * the fields whose stored value differs: changing one setting writes one
+ * small NVS entry instead of a whole file.
+ *
+ * Values are stored by type - bool as u8, integers as i32, strings and
+ * enums as text (enums by name, so reordering an enum can't change a
+ * setting). load() passes them back through the schema, so a value
+ * written by another firmware version is validated like config.json was.
+ *
+ * NVS keys are at most 15 characters. Field keys are cut to that length,
+ * so they must stay unique within a section in their first 15 characters;
+ * load() and save() check this and refuse a section where two collide.
+ *
+ * NVS does its own locking; any task may call these.
+ *
+ * Usage:
+ *   AvrConfig avr;
+ *   String error;
+ *   ConfigStore::load(AvrConfig::SCHEMA, &avr, error);
+ *   avr.enabled = true;
+ *   ConfigStore::save(AvrConfig::SCHEMA, &avr);  // Writes avr.enabled only
+ */
+class ConfigStore {
+public:
+    /** One string for putStrings() */
+    struct StringEntry {
+        String key;    ///< Key (at most 15 characters)
+        String value;  ///< Value to store
+    };
+
+    /** Layout of the stored settings; bumped on incompatible changes */
+    static const uint8_t FORMAT_VERSION = 1;
+
+    /**
+     * @return true once settings have been written to NVS (after the first
+     *         boot, or the migration from config.json/wifi.json)
+     */
+    static bool isInitialized();
+
+    /** Record that NVS holds the settings. */
+    static bool markInitialized();
+
+    /**
+     * Read a section. Missing keys get the schema default.
+     * @param schema Section schema
+     * @param obj Struct to fill
+     * @param error Receives problems with stored values, "; "-separated
+     * @return true if every stored value was valid
+     */
+    static bool load(const ConfigSchema& schema, void* obj, String& error);
+
+    /**
+     * Write the fields of a section that differ from what is stored.
+     * @param schema Section schema
+     * @param obj Struct to store
+     * @param written Incremented by the number of keys written (optional)
+     * @return false if NVS rejected a write
+     */
+    static bool save(const ConfigSchema& schema, const void* obj, size_t* written = nullptr);
+
+    /**
+     * Read a string outside any schema (e.g. WiFi credentials).
+     * @param section Section name (namespace "tl_" + section)
+     * @param key Key (at most 15 characters)
+     * @param fallback Returned if not stored
+     */
+    static String getString(const char* section, const char* key, const char* fallback = "");
+
+    /**
+     * Store a string if it differs from the stored value.
+     * @return false if NVS rejected the write
+     */
+    static bool putString(const char* section, const char* key, const String& value);
+
+    /**
+     * Store several strings of one section, writing only those that differ
+     * and committing once.
+     * @return false if NVS rejected a write
+     */
+    static bool putStrings(const char* section, const std::vector<StringEntry>& entries);
+
+    /**
+     * Read a binary value.
+     * @param out Receives the bytes
+     * @return false if not stored
+     */
+    static bool getBlob(const char* section, const char* key, std::vector<uint8_t>& out);
+
+    /**
+     * Store a binary value if it differs from the stored value.
+     * @return false if NVS rejected the write
+     */
+    static bool putBlob(const char* section, const char* key, const std::vector<uint8_t>& data);
+};
+
+#endif // CONFIG_STORE_H
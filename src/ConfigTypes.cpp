@@ -0,0 +1,85 @@
+#include "ConfigTypes.h"
+
+#define FIELD_COUNT(a) (uint8_t)(sizeof(a) / sizeof(a[0]))
+
+// Enum names, indexed by value
+static const char* const TINK_SERIAL_MODES[] = {"usb", "uart"};
+static const char* const POWER_MANAGEMENT_MODES[] = {"off", "simple", "full"};
+static const char* const LED_COLOR_ORDERS[] = {"GRB", "RGB"};
+static const char* const WIFI_POWER_MODES[] = {"performance", "balanced", "low_power"};
+
+// GPIO numbers up to the ESP32-S3's highest; UART ids up to UART2
+static const int32_t MAX_PIN = 48;
+static const int32_t MAX_UART = 2;
+
+// --- switcher ---
+
+static const ConfigField SWITCHER_FIELDS[] = {
+    CONFIG_STRING(SwitcherConfig, type, "Extron SW VGA"),
+    CONFIG_INT(SwitcherConfig, uartId, 0, MAX_UART, 1),
+    CONFIG_INT(SwitcherConfig, txPin, 0, MAX_PIN, 43),
+    CONFIG_INT(SwitcherConfig, rxPin, 0, MAX_PIN, 44),
+    CONFIG_BOOL(SwitcherConfig, autoSwitch, true),
+};
+const ConfigSchema SwitcherConfig::SCHEMA = {"switcher", SWITCHER_FIELDS, FIELD_COUNT(SWITCHER_FIELDS)};
+
+SwitcherConfig::SwitcherConfig() { configDefaults(*this); }
+
+// --- tink ---
+
+static const ConfigField TINK_FIELDS[] = {
+    CONFIG_ENUM(TinkConfig, serialMode, TINK_SERIAL_MODES, TinkSerialMode::USB),
+    CONFIG_ENUM(TinkConfig, powerManagementMode, POWER_MANAGEMENT_MODES, PowerManagementMode::FULL),
+    CONFIG_INT(TinkConfig, uartId, 0, MAX_UART, 2),
+    CONFIG_INT(TinkConfig, txPin, 0, MAX_PIN, 17),
+    CONFIG_INT(TinkConfig, rxPin, 0, MAX_PIN, 18),
+};
+const ConfigSchema TinkConfig::SCHEMA = {"tink", TINK_FIELDS, FIELD_COUNT(TINK_FIELDS)};
+
+TinkConfig::TinkConfig() { configDefaults(*this); }
+
+// --- avr ---
+
+static const ConfigField AVR_FIELDS[] = {
+    CONFIG_STRING(AvrConfig, type, "Denon X4300H"),
+    CONFIG_BOOL(AvrConfig, enabled, false),
+    CONFIG_STRING(AvrConfig, ip, ""),
+    CONFIG_STRING(AvrConfig, input, "GAME"),
+};
+const ConfigSchema AvrConfig::SCHEMA = {"avr", AVR_FIELDS, FIELD_COUNT(AVR_FIELDS)};
+
+AvrConfig::AvrConfig() { configDefaults(*this); }
+
+// --- ota ---
+
+static const ConfigField OTA_FIELDS[] = {
+    CONFIG_STRING(OtaConfig, manifestUrl, ""),
+    CONFIG_INT(OtaConfig, checkIntervalMin, 1, 7 * 24 * 60, 60),
+    CONFIG_INT(OtaConfig, windowStart, 0, 23, 3),
+    CONFIG_INT(OtaConfig, windowEnd, 0, 23, 5),
+    CONFIG_INT(OtaConfig, utcOffsetMin, -12 * 60, 14 * 60, 0),
+    CONFIG_INT(OtaConfig, maxKBps, 1, 10000, 64),
+};
+const ConfigSchema OtaConfig::SCHEMA = {"ota", OTA_FIELDS, FIELD_COUNT(OTA_FIELDS)};
+
+OtaConfig::OtaConfig() { configDefaults(*this); }
+
+// --- network ---
+
+static const ConfigField NETWORK_FIELDS[] = {
+    CONFIG_ENUM(NetworkConfig, powerMode, WIFI_POWER_MODES, WifiPowerMode::BALANCED),
+    CONFIG_INT(NetworkConfig, probeIntervalSec, 0, 3600, 0),
+};
+const ConfigSchema NetworkConfig::SCHEMA = {"network", NETWORK_FIELDS, FIELD_COUNT(NETWORK_FIELDS)};
+
+NetworkConfig::NetworkConfig() { configDefaults(*this); }
+
+// --- hardware ---
+
+static const ConfigField HARDWARE_FIELDS[] = {
+    CONFIG_INT(HardwareConfig, ledPin, 0, MAX_PIN, 21),
+    CONFIG_ENUM(HardwareConfig, ledColorOrder, LED_COLOR_ORDERS, LedColorOrder::GRB),
+};
+const ConfigSchema HardwareConfig::SCHEMA = {"hardware", HARDWARE_FIELDS, FIELD_COUNT(HARDWARE_FIELDS)};
+
+HardwareConfig::HardwareConfig() { configDefaults(*this); }
@@ -0,0 +1,129 @@
+#ifndef CONFIG_TYPES_H
+#define CONFIG_TYPES_H
+
+#include <Arduino.h>
+#include "ConfigSchema.h"
+
+/**
+ * Typed sections of config.json.
+ *
+ * Each struct mirrors one JSON section; member names are the JSON keys.
+ * Defaults, ranges and allowed values live in the struct's SCHEMA table
+ * (ConfigTypes.cpp), and a default-constructed struct holds the defaults.
+ * Strings are fixed-size buffers so the structs are plain values that can
+ * be copied between tasks without touching the heap.
+ */
+
+/** RetroTINK serial transport */
+enum class TinkSerialMode : uint8_t {
+    USB,   ///< USB Host FTDI (ESP32-S3 only)
+    UART   ///< Hardware UART
+};
+
+/**
+ * Power management mode for RetroTINK communication.
+ *
+ * Controls how TinkLink handles RT4K power state:
+ * - OFF: No power management. Commands sent immediately. User must ensure
+ *   RT4K is on. Best when the RT4K is always on and power management is
+ *   not needed.
+ * - SIMPLE: On first input change, sends "pwr on" and waits 15 seconds
+ *   before sending the profile command. All subsequent commands are sent
+ *   immediately. Suitable when power state messages are not available.
+ * - FULL: Tracks RT4K power state via serial messages (Powering Up, Boot
+ *   Sequence Complete, Power Off). Requires that the serial connection
+ *   provides these status messages. Default mode.
+ */
+enum class PowerManagementMode : uint8_t {
+    OFF,     ///< No power management, always send commands immediately
+    SIMPLE,  ///< One-time "pwr on" + 15s wait on first use, then immediate
+    FULL     ///< Full state tracking via serial messages
+};
+
+/** WS2812 LED color order */
+enum class LedColorOrder : uint8_t { GRB, RGB };
+
+/**
+ * WiFi station power save, trading inbound latency for current draw.
+ *
+ * With modem sleep the radio is off between beacons, and the AP holds
+ * frames for the station until the next DTIM beacon it wakes for, so
+ * inbound packets (HTTP requests, AVR telnet replies) wait up to one
+ * DTIM period (typically 100-300 ms).
+ * - PERFORMANCE: Radio always on (WIFI_PS_NONE). Lowest latency, highest draw.
+ * - BALANCED: Wake for every DTIM beacon (WIFI_PS_MIN_MODEM). The ESP32 default.
+ * - LOW_POWER: Wake every listen interval, 3 beacons (WIFI_PS_MAX_MODEM).
+ */
+enum class WifiPowerMode : uint8_t {
+    PERFORMANCE,
+    BALANCED,
+    LOW_POWER
+};
+
+/** "switcher" section */
+struct SwitcherConfig {
+    char type[24];       ///< SwitcherFactory type name
+    uint8_t uartId;
+    uint8_t txPin;
+    uint8_t rxPin;
+    bool autoSwitch;     ///< Follow the switcher's auto-switch input detection
+
+    SwitcherConfig();
+    static const ConfigSchema SCHEMA;
+};
+
+/** "tink" section */
+struct TinkConfig {
+    TinkSerialMode serialMode;
+    PowerManagementMode powerManagementMode;
+    uint8_t uartId;      ///< UART mode only
+    uint8_t txPin;       ///< UART mode only
+    uint8_t rxPin;       ///< UART mode only
+
+    TinkConfig();
+    static const ConfigSchema SCHEMA;
+};
+
+/** "avr" section */
+struct AvrConfig {
+    char type[24];
+    bool enabled;
+    char ip[40];         ///< Empty when not set
+    char input[16];      ///< Denon input source (e.g. "GAME")
+
+    AvrConfig();
+    static const ConfigSchema SCHEMA;
+};
+
+/** "ota" section (pull OTA) */
+struct OtaConfig {
+    char manifestUrl[128];     ///< Empty disables pull OTA
+    uint16_t checkIntervalMin;
+    uint8_t windowStart;       ///< Local hour the update window opens
+    uint8_t windowEnd;         ///< Local hour it closes (equal to start: no window)
+    int16_t utcOffsetMin;
+    uint16_t maxKBps;          ///< Download rate limit
+
+    OtaConfig();
+    static const ConfigSchema SCHEMA;
+};
+
+/** "network" section */
+struct NetworkConfig {
+    WifiPowerMode powerMode;
+    uint16_t probeIntervalSec;  ///< Periodic gateway RTT probe (0 = off)
+
+    NetworkConfig();
+    static const ConfigSchema SCHEMA;
+};
+
+/** "hardware" section */
+struct HardwareConfig {
+    uint8_t ledPin;             ///< WS2812 LED data pin
+    LedColorOrder ledColorOrder;
+
+    HardwareConfig();
+    static const ConfigSchema SCHEMA;
+};
+
+#endif // CONFIG_TYPES_H
@@ -6,6 +6,7 @@
 
 DenonAvr::DenonAvr()
     : _serial(nullptr)
+    , _reportedConnected(false)
     , _siPending(false)
     , _siPendingTime(0)
 {
@@ -18,9 +19,9 @@ DenonAvr::~DenonAvr() {
     }
 }
 
-void DenonAvr::configure(const JsonObject& config) {
-    _input = config["input"] | "DVD";
-    String ip = config["ip"] | "";
+void DenonAvr::configure(const AvrConfig& config) {
+    setInput(config.input);
+    String ip = config.ip;
 
     LOG_DEBUG("DenonAvr: Configuring (ip=%s, input=%s)", ip.c_str(), _input.c_str());
 
@@ -36,6 +37,11 @@ void DenonAvr::configure(const JsonObject& config) {
     }
 }
 
+void DenonAvr::setInput(const String& input) {
+    _input = input;
+    _stateVersion.bump();
+}
+
 bool DenonAvr::begin() {
     if (!_serial) {
         LOG_ERROR("DenonAvr: Cannot begin - not configured");
@@ -51,6 +57,14 @@ bool DenonAvr::begin() {
     return true;
 }
 
+void DenonAvr::end() {
+    if (_serial) {
+        delete _serial;
+        _serial = nullptr;
+    }
+    _siPending = false;
+}
+
 void DenonAvr::update() {
     // Process SSDP discovery
     if (_discovering) {
@@ -58,6 +72,7 @@ void DenonAvr::update() {
         if (millis() - _discoveryStartTime >= DISCOVERY_TIMEOUT_MS) {
             _discoveryUdp.stop();
             _discovering = false;
+            _discoveryVersion.bump();
             LOG_INFO("DenonAvr: Discovery complete, found %d device(s)", _discoveredDevices.size());
         }
     }
@@ -72,6 +87,12 @@ void DenonAvr::update() {
 
     // Read any available responses
     readResponse();
+
+    bool connected = isConnected();
+    if (connected != _reportedConnected) {
+        _reportedConnected = connected;
+        _stateVersion.bump();
+    }
 }
 
 void DenonAvr::onInputChange() {
@@ -133,6 +154,7 @@ bool DenonAvr::startDiscovery() {
 
     _discovering = true;
     _discoveryStartTime = millis();
+    _discoveryVersion.bump();
 
     LOG_INFO("DenonAvr: SSDP discovery started");
     return true;
@@ -190,6 +212,7 @@ void DenonAvr::processDiscoveryResponses() {
         avr.ip = ip;
         avr.friendlyName = friendlyName;
         _discoveredDevices.push_back(avr);
+        _discoveryVersion.bump();
 
         LOG_INFO("DenonAvr: Discovered %s at %s", friendlyName.c_str(), ip.c_str());
     }
@@ -277,6 +300,7 @@ bool DenonAvr::sendCommand(const String& command) {
     // Denon protocol: commands terminated with CR
     String data = command + "\r";
     _lastCommand = command;
+    _stateVersion.bump();
 
     if (_serial->sendData(data)) {
         LOG_DEBUG("DenonAvr TX: [%s]", command.c_str());
@@ -293,6 +317,7 @@ void DenonAvr::readResponse() {
     String line;
     while (_serial->readLine(line)) {
         _lastResponse = line;
+        _stateVersion.bump();
         LOG_DEBUG("DenonAvr RX: %s", line.c_str());
     }
 }
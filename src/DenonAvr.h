@@ -5,6 +5,8 @@
 #include <ArduinoJson.h>
 #include <WiFiUdp.h>
 #include <vector>
+#include "StateVersion.h"
+#include "ConfigTypes.h"
 
 class SerialInterface;
 
@@ -35,7 +37,7 @@ struct DiscoveredAvr {
  *
  * Usage:
  *   DenonAvr avr;
- *   avr.configure(config);  // Reads ip, input from JSON
+ *   avr.configure(config);  // Uses ip, input
  *   avr.begin();
  *   // On input change:
  *   avr.onInputChange();
@@ -53,11 +55,18 @@ public:
     ~DenonAvr();
 
     /**
-     * Configure the AVR from JSON settings.
-     * Reads ip, input fields and creates TelnetSerial transport.
-     * @param config JSON object containing AVR configuration
+     * Configure the AVR from its config section.
+     * Uses ip and input, and creates the TelnetSerial transport.
+     * @param config Validated "avr" config section
      */
-    void configure(const JsonObject& config);
+    void configure(const AvrConfig& config);
+
+    /**
+     * Change the input source selected on the next input change.
+     * The connection is left as is.
+     * @param input Denon input source (e.g. "GAME")
+     */
+    void setInput(const String& input);
 
     /**
      * Initialize the AVR and its transport.
@@ -66,6 +75,12 @@ public:
      */
     bool begin();
 
+    /**
+     * Close the telnet session and release the transport.
+     * Discovery is left alone; the destructor stops it.
+     */
+    void end();
+
     /**
      * Process pending commands and read responses.
      * Must be called in loop().
@@ -98,6 +113,12 @@ public:
     /** @return Last response received from AVR */
     String getLastResponse() const { return _lastResponse; }
 
+    /**
+     * Get the version of the state reported in /api/status.
+     * @return StateVersion of the last change
+     */
+    uint32_t getStateVersion() const { return _stateVersion.get(); }
+
     /**
      * Start SSDP discovery for Denon/Marantz AVRs on the local network.
      * Sends M-SEARCH multicast and collects responses for DISCOVERY_TIMEOUT_MS.
@@ -117,12 +138,23 @@ public:
      */
     std::vector<DiscoveredAvr> getDiscoveryResults() const;
 
+    /**
+     * Get the version of the discovery state (running flag and results).
+     * Bumped when discovery starts, finds a device or completes.
+     * @return StateVersion of the last change
+     */
+    uint32_t getDiscoveryVersion() const { return _discoveryVersion.get(); }
+
 private:
     SerialInterface* _serial;
     String _input;
     String _lastCommand;
     String _lastResponse;
 
+    // Change tracking for /api/status
+    StateVersion _stateVersion;
+    bool _reportedConnected;
+
     bool _siPending;
     unsigned long _siPendingTime;
     static const unsigned long SI_DELAY_MS = 1000;
@@ -133,6 +165,7 @@ private:
     static const unsigned long DISCOVERY_TIMEOUT_MS = 3000;
     WiFiUDP _discoveryUdp;
     std::vector<DiscoveredAvr> _discoveredDevices;
+    StateVersion _discoveryVersion;
 
     /** Process incoming SSDP responses during discovery. */
     void processDiscoveryResponses();
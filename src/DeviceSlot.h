@@ -0,0 +1,99 @@
+#ifndef DEVICE_SLOT_H
+#define DEVICE_SLOT_H
+
+#include <atomic>
+#include <vector>
+
+/**
+ * Owning pointer to a device that the loop task may replace while another
+ * task reads it (read-copy-update).
+ *
+ * The owner (loop task) builds a replacement off to the side and publishes
+ * it with replace(); the old object is retired, not deleted. Readers on
+ * other tasks hold a Reader for the duration of their access, which counts
+ * them in. reclaim() deletes retired objects only once that count is zero:
+ * a reader that starts after the pointer was swapped can only see the new
+ * object, and one that started before is still counted, so no reader ever
+ * holds a deleted object. Neither side blocks; a busy reader just delays
+ * the delete to a later loop() iteration.
+ *
+ * Read sections must be short (one HTTP handler) and must not wait on the
+ * loop task.
+ *
+ * @tparam T Device type (deleted through T*)
+ */
+template <typename T>
+class DeviceSlot {
+public:
+    DeviceSlot() : _current(nullptr), _readers(0) {}
+
+    ~DeviceSlot() {
+        delete _current.load(std::memory_order_relaxed);
+        for (T* old : _retired) delete old;
+    }
+
+    DeviceSlot(const DeviceSlot&) = delete;
+    DeviceSlot& operator=(const DeviceSlot&) = delete;
+
+    /**
+     * Read section for tasks other than the owner. Holds off reclaim() of
+     * whatever get() returns until destroyed.
+     *
+     *   DeviceSlot<DenonAvr>::Reader avr(slot);
+     *   if (avr) avr->startDiscovery();
+     */
+    class Reader {
+    public:
+        explicit Reader(const DeviceSlot& slot) : _slot(slot) {
+            _slot._readers.fetch_add(1, std::memory_order_seq_cst);
+            _ptr = _slot._current.load(std::memory_order_seq_cst);
+        }
+        ~Reader() { _slot._readers.fetch_sub(1, std::memory_order_release); }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        /** The object current when the section started (may be nullptr) */
+        T* get() const { return _ptr; }
+        T* operator->() const { return _ptr; }
+        explicit operator bool() const { return _ptr != nullptr; }
+
+    private:
+        const DeviceSlot& _slot;
+        T* _ptr;
+    };
+
+    /** Current object (owner task; no Reader needed there). */
+    T* get() const { return _current.load(std::memory_order_relaxed); }
+
+    /**
+     * Publish `next` (may be nullptr) and retire the current object (owner
+     * task). The caller stops using the old object; it is deleted by a later
+     * reclaim().
+     */
+    void replace(T* next) {
+        T* old = _current.exchange(next, std::memory_order_seq_cst);
+        if (old) _retired.push_back(old);
+        reclaim();
+    }
+
+    /**
+     * Delete retired objects if no reader is inside a section (owner task,
+     * call every loop).
+     * @return true if nothing is left waiting
+     */
+    bool reclaim() {
+        if (_retired.empty()) return true;
+        if (_readers.load(std::memory_order_seq_cst) != 0) return false;
+        for (T* old : _retired) delete old;
+        _retired.clear();
+        return true;
+    }
+
+private:
+    std::atomic<T*> _current;
+    mutable std::atomic<uint32_t> _readers;
+    std::vector<T*> _retired;  ///< Owner task only
+};
+
+#endif // DEVICE_SLOT_H
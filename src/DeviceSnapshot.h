@@ -0,0 +1,104 @@
+#ifndef DEVICE_SNAPSHOT_H
+#define DEVICE_SNAPSHOT_H
+
+#include <Arduino.h>
+#include "Seqlock.h"
+#include "WifiManager.h"
+
+/**
+ * Point-in-time copy of device state for the web API.
+ *
+ * loop() owns WifiManager, Switcher, RetroTink and DenonAvr. It fills one of
+ * these from their getters (WebServer::update()) and publishes it through a
+ * Seqlock; read-only HTTP handlers serialize from their own copy instead of
+ * calling into the live objects from the AsyncTCP task.
+ *
+ * Plain data only (fixed-size, NUL-terminated strings) so it can be copied
+ * with memcpy. Longer strings are truncated.
+ */
+struct DeviceSnapshot {
+    static const size_t TEXT_LEN = 64;  ///< Buffer size for command/response text
+
+    // WiFi
+    WifiManager::State wifiState;
+    WifiManager::Mode wifiMode;
+    int32_t wifiRssi;
+    char wifiSsid[33];
+    char wifiIp[16];
+    char apSsid[33];
+    char apIp[16];
+
+    // Switcher
+    const char* switcherType;  ///< Points at a string literal
+    int switcherInput;
+
+    // RetroTINK
+    bool tinkConnected;
+    const char* tinkPowerState;  ///< Points at a string literal
+    char tinkLastCommand[TEXT_LEN];
+
+    // AVR
+    bool avrEnabled;
+    bool avrConnected;
+    char avrInput[16];
+    char avrLastCommand[TEXT_LEN];
+    char avrLastResponse[TEXT_LEN];
+
+    // StateVersion of each section when captured
+    uint32_t wifiVersion;
+    uint32_t switcherVersion;
+    uint32_t tinkVersion;
+    uint32_t avrVersion;
+
+    uint32_t configEpoch;     ///< Last device config change applied (Devices::getEpoch())
+    unsigned long updatedAt;  ///< millis() when captured
+};
+
+/** Snapshot published by loop() and read by HTTP handlers */
+using DeviceSnapshotLock = Seqlock<DeviceSnapshot>;
+
+/**
+ * Copy of the switcher's recent received lines for the web API.
+ *
+ * Published by loop() whenever Switcher::getMessageVersion() changes, so
+ * handlers never walk the switcher's own list while update() appends to
+ * it. Kept out of DeviceSnapshot because it is large (a few KB) and
+ * rarely changes. Lines are stored oldest first and truncated to TEXT_LEN.
+ */
+struct SwitcherMessages {
+    static const size_t MAX_MESSAGES = 50;  ///< Matches the switcher's own history
+    static const size_t TEXT_LEN = 64;      ///< Buffer size per line
+
+    uint32_t version;  ///< Switcher::getMessageVersion() when captured (0: no switcher)
+    uint8_t count;     ///< Lines in use
+    char lines[MAX_MESSAGES][TEXT_LEN];
+};
+
+/** Switcher messages published by loop() and read by HTTP handlers */
+using SwitcherMessagesLock = Seqlock<SwitcherMessages>;
+
+/**
+ * Copy of the AVR's SSDP discovery state for the web API.
+ *
+ * Published by loop() whenever DenonAvr::getDiscoveryVersion() changes
+ * (or the AVR is enabled, disabled or replaced). Discovery itself is
+ * started with an AVR_DISCOVER command. At most MAX_DEVICES results are
+ * kept; names are truncated.
+ */
+struct AvrDiscovery {
+    static const size_t MAX_DEVICES = 8;
+
+    uint32_t version;  ///< DenonAvr::getDiscoveryVersion() when captured (0: AVR disabled)
+    bool enabled;      ///< AVR configured
+    bool discovering;  ///< Discovery running
+    uint8_t count;     ///< Devices in use
+    struct {
+        char ip[16];
+        char name[48];
+    } devices[MAX_DEVICES];
+};
+
+/** AVR discovery state published by loop() and read by HTTP handlers */
+using AvrDiscoveryLock = Seqlock<AvrDiscovery>;
+
+#endif // DEVICE_SNAPSHOT_H
@@ -0,0 +1,132 @@
+#include "Devices.h"
+#include "SwitcherFactory.h"
+#include "RetroTink.h"
+#include "DenonAvr.h"
+#include "Logger.h"
+
+Devices::Devices()
+    : _tink(nullptr)
+    , _epoch(0)
+{
+}
+
+Devices::~Devices() {
+    delete _tink;
+}
+
+void Devices::beginTink(const TinkConfig& config) {
+    _running.tink = config;
+    _tink = new RetroTink();
+    _tink->configure(config);
+    _tink->begin();
+}
+
+void Devices::beginAvr(const AvrConfig& config) {
+    _running.avr = config;
+    if (config.enabled) {
+        startAvr(config);
+    } else {
+        LOG_INFO("AVR control disabled");
+    }
+}
+
+void Devices::beginSwitcher(const SwitcherConfig& config, Switcher::InputChangeCallback onInputChange) {
+    _running.switcher = config;
+    _onInputChange = onInputChange;
+    startSwitcher(config);
+}
+
+void Devices::startSwitcher(const SwitcherConfig& config) {
+    Switcher* next = SwitcherFactory::create(config.type);
+    if (!next) {
+        LOG_ERROR("Unknown switcher type: %s", config.type);
+    } else {
+        next->configure(config);
+        next->onInputChange(_onInputChange);
+    }
+
+    // The old switcher lets go of its UART before the new one claims it
+    Switcher* old = _switcher.get();
+    if (old) old->end();
+    _switcher.replace(next);
+
+    if (next && !next->begin()) {
+        LOG_ERROR("Failed to initialize switcher!");
+    }
+}
+
+void Devices::startAvr(const AvrConfig& config) {
+    DenonAvr* next = new DenonAvr();
+    next->configure(config);
+
+    // Close the old telnet session before the new one connects
+    DenonAvr* old = _avr.get();
+    if (old) old->end();
+    _avr.replace(next);
+    next->begin();
+}
+
+uint8_t Devices::apply(const DeviceConfigSet& config, uint32_t epoch) {
+    uint8_t touched = 0;
+
+    if (configDiff(_running.switcher, config.switcher)) {
+        LOG_INFO("Devices: Switcher config changed - restarting %s", config.switcher.type);
+        startSwitcher(config.switcher);
+        touched |= SWITCHER;
+    }
+
+    uint32_t tinkChanged = configDiff(_running.tink, config.tink);
+    if (tinkChanged) {
+        const uint32_t powerOnly = TinkConfig::SCHEMA.bit("powerManagementMode");
+        if (tinkChanged == powerOnly) {
+            _tink->setPowerManagementMode(config.tink.powerManagementMode);
+        } else {
+            LOG_INFO("Devices: RetroTINK transport changed - reconnecting");
+            // The old transport lets go of its UART or USB device first
+            _tink->end();
+            _tink->configure(config.tink);
+            _tink->begin();
+        }
+        touched |= TINK;
+    }
+
+    uint32_t avrChanged = configDiff(_running.avr, config.avr);
+    if (avrChanged) {
+        const uint32_t inputOnly = AvrConfig::SCHEMA.bit("input");
+        if (!config.avr.enabled) {
+            DenonAvr* old = _avr.get();
+            if (old) {
+                LOG_INFO("Devices: AVR disabled");
+                old->end();
+            }
+            _avr.replace(nullptr);
+        } else if (_avr.get() && avrChanged == inputOnly) {
+            _avr.get()->setInput(config.avr.input);
+        } else {
+            LOG_INFO("Devices: AVR config changed - connecting to %s", config.avr.ip);
+            startAvr(config.avr);
+        }
+        touched |= AVR;
+    }
+
+    _running = config;
+    _epoch = epoch;
+    return touched;
+}
+
+void Devices::update() {
+    // Objects replaced by apply() go once the web task has let go of them
+    _switcher.reclaim();
+    _avr.reclaim();
+
+    // Process incoming switcher messages
+    Switcher* sw = _switcher.get();
+    if (sw) sw->update();
+
+    // Process USB Host events and RT4K communication
+    _tink->update();
+
+    // Process AVR commands and responses
+    DenonAvr* avr = _avr.get();
+    if (avr) avr->update();
+}
@@ -0,0 +1,117 @@
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <Arduino.h>
+#include "ConfigTypes.h"
+#include "DeviceSlot.h"
+#include "Switcher.h"
+
+class RetroTink;
+class DenonAvr;
+
+/**
+ * The config sections that drive devices. Plain value, so a copy can be
+ * handed from the web task to loop() in a DeviceCommand.
+ */
+struct DeviceConfigSet {
+    SwitcherConfig switcher;
+    TinkConfig tink;
+    AvrConfig avr;
+    NetworkConfig network;  ///< For WifiManager::configure(); apply() ignores it
+};
+
+/**
+ * Owns the video switcher, RetroTINK and AVR controllers and applies
+ * config changes to them while the rest keep running.
+ *
+ * apply() diffs the new sections against the running ones (configDiff())
+ * and touches only what changed:
+ * - switcher: any change builds a new instance (type, UART and pins are
+ *   all fixed at begin())
+ * - tink: a new powerManagementMode is set in place; serialMode, uartId or
+ *   pins recreate the transport. The controller and its triggers stay.
+ * - avr: enabling creates it, disabling retires it, a new type or ip builds
+ *   a new instance, and a new input alone is set in place
+ *
+ * All device calls, including apply(), run on the loop task. The web task
+ * never calls into these objects: it posts commands to WebServer's mailbox
+ * and reads copies WebServer publishes from loop (device state, recent
+ * switcher messages, AVR discovery). The switcher and AVR still live in
+ * DeviceSlots, so a replacement is published atomically and update()
+ * deletes the old object once no DeviceSlot::Reader holds it.
+ */
+class Devices {
+public:
+    /** apply() result bits */
+    static const uint8_t SWITCHER = 0x01;
+    static const uint8_t TINK = 0x02;
+    static const uint8_t AVR = 0x04;
+
+    Devices();
+    ~Devices();
+
+    /**
+     * Create and start the RetroTINK controller (setup).
+     * @param config Validated "tink" section
+     */
+    void beginTink(const TinkConfig& config);
+
+    /**
+     * Create and start the AVR controller if enabled (setup).
+     * @param config Validated "avr" section
+     */
+    void beginAvr(const AvrConfig& config);
+
+    /**
+     * Create and start the video switcher (setup).
+     * @param config Validated "switcher" section
+     * @param onInputChange Input callback, also given to rebuilt switchers
+     */
+    void beginSwitcher(const SwitcherConfig& config, Switcher::InputChangeCallback onInputChange);
+
+    /**
+     * Reconfigure the devices whose sections changed (loop task).
+     * @param config New device sections
+     * @param epoch Config epoch the change was posted with; getEpoch()
+     *              reports it once applied
+     * @return SWITCHER/TINK/AVR bits of the devices touched
+     */
+    uint8_t apply(const DeviceConfigSet& config, uint32_t epoch);
+
+    /**
+     * Run the devices and free replaced ones no reader holds any more.
+     * Must be called from loop().
+     */
+    void update();
+
+    /** @return Video switcher (loop task; nullptr if none) */
+    Switcher* switcher() const { return _switcher.get(); }
+
+    /** @return RetroTINK controller (loop task) */
+    RetroTink* tink() const { return _tink; }
+
+    /** @return AVR controller (loop task; nullptr when disabled) */
+    DenonAvr* avr() const { return _avr.get(); }
+
+    /** Switcher slot, for DeviceSlot::Reader on other tasks */
+    const DeviceSlot<Switcher>& switcherSlot() const { return _switcher; }
+
+    /** AVR slot, for DeviceSlot::Reader on other tasks */
+    const DeviceSlot<DenonAvr>& avrSlot() const { return _avr; }
+
+    /** @return Epoch of the last config applied (0: the boot config) */
+    uint32_t getEpoch() const { return _epoch; }
+
+private:
+    DeviceSlot<Switcher> _switcher;
+    RetroTink* _tink;
+    DeviceSlot<DenonAvr> _avr;
+    DeviceConfigSet _running;
+    Switcher::InputChangeCallback _onInputChange;
+    uint32_t _epoch;
+
+    void startSwitcher(const SwitcherConfig& config);
+    void startAvr(const AvrConfig& config);
+};
+
+#endif // DEVICES_H
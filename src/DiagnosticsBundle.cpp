@@ -0,0 +1,247 @@
+#include "DiagnosticsBundle.h"
+#include "ConfigManager.h"
+#include "HttpServer.h"
+#include "Logger.h"
+#include "version.h"
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+
+const char* const DiagnosticsBundle::CONTENT_TYPE = "application/x-ndjson";
+
+/// Config keys whose values are never included (matched case-insensitively as substrings)
+static const char* const SECRET_KEYS[] = {"password", "passphrase", "psk", "secret", "token"};
+
+static bool isSecretKey(const char* key) {
+    String lower(key);
+    lower.toLowerCase();
+    for (const char* secret : SECRET_KEYS) {
+        if (lower.indexOf(secret) >= 0) return true;
+    }
+    return false;
+}
+
+static const char* wifiStateName(WifiManager::State state) {
+    switch (state) {
+        case WifiManager::State::DISCONNECTED: return "disconnected";
+        case WifiManager::State::CONNECTING: return "connecting";
+        case WifiManager::State::CONNECTED: return "connected";
+        case WifiManager::State::FAILED: return "failed";
+        case WifiManager::State::AP_ACTIVE: return "ap_active";
+    }
+    return "unknown";
+}
+
+DiagnosticsBundle::DiagnosticsBundle(const DeviceSnapshot& snap, std::vector<String> switcherMessages,
+                                     const ConfigManager& config)
+    : _section(Section::HEADER)
+    , _lines(0)
+    , _snap(snap)
+    , _messages(std::move(switcherMessages))
+    , _nextMessage(0)
+    , _transport(0)
+    , _configLine(captureConfig(config, false))
+    , _wifiConfigLine(captureConfig(config, true))
+{
+    Logger& logger = Logger::instance();
+    _logEnd = logger.getLogCount();
+    _logNext = logger.getOldestIndex();
+
+    _heapFree = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    _heapLargest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    _heapMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    _psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+
+    Metrics& metrics = Metrics::instance();
+    for (int i = 0; i < (int)Metrics::Transport::COUNT; i++) {
+        _txBytes[i] = metrics.getTransportTx((Metrics::Transport)i);
+        _rxBytes[i] = metrics.getTransportRx((Metrics::Transport)i);
+    }
+}
+
+void DiagnosticsBundle::appendLine(const JsonDocument& doc, String& out) {
+    serializeJson(doc, out);
+    out += '\n';
+    _lines++;
+}
+
+bool DiagnosticsBundle::next(String& out) {
+    switch (_section) {
+        case Section::HEADER: {
+            JsonDocument doc;
+            doc["type"] = "diagnostics";
+            doc["format"] = FORMAT_VERSION;
+            doc["version"] = TINKLINK_VERSION_STRING;
+            doc["uptimeMs"] = millis();
+            doc["capturedAt"] = _snap.updatedAt;
+            doc["resetReason"] = (int)esp_reset_reason();
+            doc["chip"] = ESP.getChipModel();
+            doc["sdk"] = ESP.getSdkVersion();
+            doc["httpBackend"] = HttpServer::BACKEND;
+            appendLine(doc, out);
+            _section = Section::STATUS;
+            return true;
+        }
+
+        case Section::STATUS:
+            writeStatus(out);
+            _section = Section::HEAP;
+            return true;
+
+        case Section::HEAP: {
+            JsonDocument doc;
+            doc["type"] = "heap";
+            doc["internalFree"] = _heapFree;
+            doc["internalLargestBlock"] = _heapLargest;
+            doc["internalMinFree"] = _heapMinFree;
+            doc["psramFree"] = _psramFree;
+            appendLine(doc, out);
+            _section = Section::TRANSPORTS;
+            return true;
+        }
+
+        case Section::TRANSPORTS: {
+            JsonDocument doc;
+            doc["type"] = "transport";
+            doc["name"] = Metrics::transportName((Metrics::Transport)_transport);
+            doc["txBytes"] = _txBytes[_transport];
+            doc["rxBytes"] = _rxBytes[_transport];
+            appendLine(doc, out);
+            if (++_transport >= (int)Metrics::Transport::COUNT) _section = Section::SWITCHER;
+            return true;
+        }
+
+        case Section::SWITCHER:
+            if (_nextMessage < _messages.size()) {
+                JsonDocument doc;
+                doc["type"] = "switcher";
+                doc["msg"] = _messages[_nextMessage];
+                appendLine(doc, out);
+                _messages[_nextMessage++] = String();  // Release as we go
+                return true;
+            }
+            _section = Section::LOGS;
+            return true;
+
+        case Section::LOGS: {
+            LogEntry entry;
+            while (_logNext < _logEnd) {
+                // Entries evicted since the bundle was started are skipped
+                unsigned long index = _logNext++;
+                if (!Logger::instance().getLogEntry(index, entry)) continue;
+
+                JsonDocument doc;
+                doc["type"] = "log";
+                doc["i"] = index;
+                doc["ts"] = entry.timestamp;
+                doc["lvl"] = static_cast<int>(entry.level);
+                doc["msg"] = entry.message;
+                appendLine(doc, out);
+                return true;
+            }
+            _section = Section::CONFIG;
+            return true;
+        }
+
+        case Section::CONFIG:
+            writeConfig(_configLine, out);
+            _section = Section::WIFI_CONFIG;
+            return true;
+
+        case Section::WIFI_CONFIG:
+            writeConfig(_wifiConfigLine, out);
+            _section = Section::END;
+            return true;
+
+        case Section::END: {
+            JsonDocument doc;
+            doc["type"] = "end";
+            doc["lines"] = _lines;
+            serializeJson(doc, out);
+            out += '\n';
+            _section = Section::DONE;
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+void DiagnosticsBundle::writeStatus(String& out) {
+    JsonDocument doc;
+    doc["type"] = "status";
+
+    JsonObject wifi = doc["wifi"].to<JsonObject>();
+    wifi["state"] = wifiStateName(_snap.wifiState);
+    wifi["ssid"] = _snap.wifiSsid;
+    wifi["ip"] = _snap.wifiIp;
+    wifi["rssi"] = _snap.wifiRssi;
+    wifi["apSsid"] = _snap.apSsid;
+    wifi["apIp"] = _snap.apIp;
+    wifi["version"] = _snap.wifiVersion;
+
+    JsonObject switcher = doc["switcher"].to<JsonObject>();
+    switcher["type"] = _snap.switcherType;
+    switcher["currentInput"] = _snap.switcherInput;
+    switcher["version"] = _snap.switcherVersion;
+
+    JsonObject tink = doc["tink"].to<JsonObject>();
+    tink["connected"] = _snap.tinkConnected;
+    tink["powerState"] = _snap.tinkPowerState;
+    tink["lastCommand"] = _snap.tinkLastCommand;
+    tink["version"] = _snap.tinkVersion;
+
+    JsonObject avr = doc["avr"].to<JsonObject>();
+    avr["enabled"] = _snap.avrEnabled;
+    if (_snap.avrEnabled) {
+        avr["connected"] = _snap.avrConnected;
+        avr["input"] = _snap.avrInput;
+        avr["lastCommand"] = _snap.avrLastCommand;
+        avr["lastResponse"] = _snap.avrLastResponse;
+    }
+    avr["version"] = _snap.avrVersion;
+
+    appendLine(doc, out);
+}
+
+String DiagnosticsBundle::captureConfig(const ConfigManager& config, bool wifi) {
+    JsonDocument doc;
+    doc["type"] = "config";
+    // Named after the files a backup restores, which share this layout
+    doc["file"] = wifi ? "wifi.json" : "config.json";
+    JsonObject data = doc["data"].to<JsonObject>();
+    if (wifi) {
+        config.exportWifiConfig(data);
+    } else {
+        config.exportConfig(data);
+    }
+    redact(data);
+
+    String line;
+    serializeJson(doc, line);
+    line += '\n';
+    return line;
+}
+
+void DiagnosticsBundle::writeConfig(String& line, String& out) {
+    out += line;
+    line = String();  // Release once sent
+    _lines++;
+}
+
+void DiagnosticsBundle::redact(JsonVariant value) {
+    if (value.is<JsonObject>()) {
+        for (JsonPair pair : value.as<JsonObject>()) {
+            JsonVariant child = pair.value();
+            if (isSecretKey(pair.key().c_str()) && child.is<const char*>()) {
+                if (strlen(child.as<const char*>()) > 0) child.set("***");
+            } else {
+                redact(child);
+            }
+        }
+    } else if (value.is<JsonArray>()) {
+        for (JsonVariant child : value.as<JsonArray>()) {
+            redact(child);
+        }
+    }
+}
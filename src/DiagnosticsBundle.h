@@ -0,0 +1,110 @@
+#ifndef DIAGNOSTICS_BUNDLE_H
+#define DIAGNOSTICS_BUNDLE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <vector>
+#include "DeviceSnapshot.h"
+#include "Metrics.h"
+
+class ConfigManager;
+
+/**
+ * Support bundle streamed by GET /api/diagnostics as NDJSON (one JSON
+ * object per line, each with a "type" field):
+ *
+ *   diagnostics  Firmware version, uptime, reset reason, HTTP backend
+ *   status       Device state (same snapshot /api/status serves)
+ *   heap         Internal and PSRAM heap statistics
+ *   transport    Byte counters, one line per serial transport
+ *   switcher     Recent switcher messages, one line each
+ *   log          Log ring entries, oldest first, one line each
+ *   config       Settings and WiFi settings (backup format) with secrets redacted
+ *   end          Number of lines before it (detects a truncated download)
+ *
+ * Everything that changes from moment to moment - snapshot, heap,
+ * counters, switcher messages, the range of log entries and both config
+ * lines - is captured when the bundle is created, so the sections describe
+ * the same instant even though the body is generated a line at a time as
+ * the socket drains. The config lines are held already serialized and
+ * redacted; apart from them only one line is in memory at once.
+ *
+ * Usage:
+ *   auto bundle = std::make_shared<DiagnosticsBundle>(snap, messages, config);
+ *   request->send(ChunkedResponse::create(request, DiagnosticsBundle::CONTENT_TYPE,
+ *       [bundle](String& out) { return bundle->next(out); }));
+ */
+class DiagnosticsBundle {
+public:
+    /** Most switcher messages included */
+    static const int MAX_SWITCHER_MESSAGES = 50;
+
+    /** Bumped when a line type changes incompatibly */
+    static const int FORMAT_VERSION = 1;
+
+    static const char* const CONTENT_TYPE;
+
+    /**
+     * Capture the point-in-time parts of the bundle.
+     * @param snap Device snapshot
+     * @param switcherMessages Recent switcher messages (oldest first)
+     * @param config Settings source; only read here
+     */
+    DiagnosticsBundle(const DeviceSnapshot& snap, std::vector<String> switcherMessages,
+                      const ConfigManager& config);
+
+    /**
+     * Produce the next line (ChunkGenerator contract).
+     * @param out String to append the line to
+     * @return false once the bundle is complete
+     */
+    bool next(String& out);
+
+    /**
+     * Replace secret values (passwords, tokens) in a config document.
+     * Empty values are left alone so "not set" stays visible.
+     * @param value Document or element to redact in place
+     */
+    static void redact(JsonVariant value);
+
+private:
+    enum class Section : uint8_t {
+        HEADER, STATUS, HEAP, TRANSPORTS, SWITCHER, LOGS, CONFIG, WIFI_CONFIG, END, DONE
+    };
+
+    Section _section;
+    uint32_t _lines;
+
+    DeviceSnapshot _snap;
+    std::vector<String> _messages;
+    size_t _nextMessage;
+
+    unsigned long _logNext;
+    unsigned long _logEnd;
+
+    // Heap and counters at capture time
+    size_t _heapFree;
+    size_t _heapLargest;
+    size_t _heapMinFree;
+    size_t _psramFree;
+    uint32_t _txBytes[(int)Metrics::Transport::COUNT];
+    uint32_t _rxBytes[(int)Metrics::Transport::COUNT];
+    int _transport;
+
+    // Redacted config lines at capture time, newline-terminated
+    String _configLine;
+    String _wifiConfigLine;
+
+    /** Serialize `doc` as one line into `out` and count it. */
+    void appendLine(const JsonDocument& doc, String& out);
+
+    void writeStatus(String& out);
+
+    /** Serialize the settings (or, with `wifi`, the WiFi settings) as a redacted config line. */
+    static String captureConfig(const ConfigManager& config, bool wifi);
+
+    /** Move a captured config line into `out` and count it. */
+    void writeConfig(String& line, String& out);
+};
+
+#endif // DIAGNOSTICS_BUNDLE_H
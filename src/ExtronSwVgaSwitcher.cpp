@@ -20,15 +20,9 @@ ExtronSwVgaSwitcher::~ExtronSwVgaSwitcher() {
     end();
 }
 
-void ExtronSwVgaSwitcher::configure(const JsonObject& config) {
-    // Read Extron-specific fields from JSON
-    uint8_t uartId = config["uartId"] | 1;
-    uint8_t txPin = config["txPin"] | 43;
-    uint8_t rxPin = config["rxPin"] | 44;
-    bool autoSwitch = config["autoSwitch"] | true;
-
+void ExtronSwVgaSwitcher::configure(const SwitcherConfig& config) {
     LOG_DEBUG("ExtronSwVgaSwitcher: Configuring (UART%d, TX=%d, RX=%d, autoSwitch=%d)",
-              uartId, txPin, rxPin, autoSwitch);
+              config.uartId, config.txPin, config.rxPin, config.autoSwitch);
 
     // Clean up existing serial
     if (_serial) {
@@ -37,8 +31,8 @@ void ExtronSwVgaSwitcher::configure(const JsonObject& config) {
     }
 
     // Create UartSerial at 9600 baud for Extron
-    _serial = new UartSerial(uartId, rxPin, txPin, 9600);
-    _autoSwitchEnabled = autoSwitch;
+    _serial = new UartSerial(config.uartId, config.rxPin, config.txPin, 9600);
+    _autoSwitchEnabled = config.autoSwitch;
 }
 
 bool ExtronSwVgaSwitcher::begin() {
@@ -89,11 +83,13 @@ void ExtronSwVgaSwitcher::processLine(const String& line) {
     if (_recentMessages.size() > MAX_RECENT_MESSAGES) {
         _recentMessages.erase(_recentMessages.begin());
     }
+    _messageVersion.bump();
 
     if (isInputMessage(line)) {
         int input = parseInputNumber(line);
         if (input > 0) {
             _currentInput = input;
+            _stateVersion.bump();
             LOG_INFO("Extron input changed to: %d", input);
 
             if (_inputCallback) {
@@ -151,6 +147,7 @@ std::vector<String> ExtronSwVgaSwitcher::getRecentMessages(int count) {
 
 void ExtronSwVgaSwitcher::clearRecentMessages() {
     _recentMessages.clear();
+    _messageVersion.bump();
 }
 
 bool ExtronSwVgaSwitcher::isSigMessage(const String& line) {
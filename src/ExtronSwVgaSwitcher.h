@@ -20,7 +20,7 @@ class SerialInterface;
  *
  * Usage:
  *   Switcher* sw = new ExtronSwVgaSwitcher();
- *   sw->configure(config);  // Reads uartId, txPin, rxPin, autoSwitch from JSON
+ *   sw->configure(config);  // Uses uartId, txPin, rxPin, autoSwitch
  *   sw->begin();
  *   sw->onInputChange([](int input) { ... });
  *   // In loop():
@@ -37,7 +37,7 @@ public:
     ~ExtronSwVgaSwitcher();
 
     // Switcher interface overrides
-    void configure(const JsonObject& config) override;
+    void configure(const SwitcherConfig& config) override;
     bool begin() override;
     void end() override;
     void update() override;
@@ -0,0 +1,98 @@
+#ifndef TINKLINK_HTTPD_IDF
+
+#include "HttpServer.h"
+
+const char* const HttpServer::BACKEND = "async";
+
+namespace {
+
+/**
+ * Catch-all handler registered ahead of all routes. It runs the admission
+ * hook once the headers have arrived: admitted requests fall through to
+ * the real routes, rejected requests are claimed here and answered with
+ * 503 + Retry-After. The finish hook runs when the connection closes (the
+ * server closes every connection after its response).
+ */
+class GateHandler : public AsyncWebHandler {
+public:
+    GateHandler(const HttpServer::AdmitHook& admit, const HttpServer::FinishHook& finish)
+        : _admit(admit), _finish(finish) {}
+
+    bool canHandle(AsyncWebServerRequest* request) override {
+        if (!_admit) return false;
+
+        unsigned long start = micros();
+        HttpServer::Admission admission = _admit(request);
+
+        // The request holds a single disconnect callback, so it is only set here
+        HttpServer::FinishHook finish = _finish;
+        request->onDisconnect([admission, start, finish]() {
+            if (finish) finish(admission, micros() - start);
+        });
+        if (admission.admitted) return false;
+
+        // Freed with the request
+        HttpServer::Admission* info = (HttpServer::Admission*)malloc(sizeof(HttpServer::Admission));
+        if (info) *info = admission;
+        request->_tempObject = info;
+        return true;
+    }
+
+    void handleRequest(AsyncWebServerRequest* request) override {
+        const HttpServer::Admission* info = (const HttpServer::Admission*)request->_tempObject;
+        const char* body = info && info->body ? info->body : "{\"error\":\"Server busy\"}";
+
+        AsyncWebServerResponse* response = request->beginResponse(503, "application/json", body);
+        response->addHeader("Retry-After", String(info ? info->retryAfter : 1));
+        request->send(response);
+    }
+
+private:
+    const HttpServer::AdmitHook& _admit;
+    const HttpServer::FinishHook& _finish;
+};
+
+}  // namespace
+
+HttpServer::HttpServer(uint16_t port)
+    : _port(port)
+    , _server(port)
+{
+    // Must be the first handler so it sees requests before any route
+    _server.addHandler(new GateHandler(_admit, _finish));
+}
+
+HttpServer::~HttpServer() {
+}
+
+void HttpServer::on(const char* path, HttpMethod method, HttpHandler handler,
+                    HttpUploadHandler upload, HttpBodyHandler body) {
+    _server.on(path, method, handler, upload, body);
+}
+
+void HttpServer::serveStatic(const char* uri, fs::FS& fs, const char* root, const char* defaultFile) {
+    _server.serveStatic(uri, fs, root).setDefaultFile(defaultFile);
+}
+
+void HttpServer::onNotFound(HttpHandler handler) {
+    _server.onNotFound(handler);
+}
+
+void HttpServer::setAdmission(AdmitHook admit, FinishHook finish) {
+    _admit = admit;
+    _finish = finish;
+}
+
+void HttpServer::begin() {
+    _server.begin();
+}
+
+void HttpServer::end() {
+    _server.end();
+}
+
+uint32_t HttpServer::remoteIp(HttpRequest* request) {
+    return request->client() ? (uint32_t)request->client()->remoteIP() : 0;
+}
+
+#endif  // TINKLINK_HTTPD_IDF
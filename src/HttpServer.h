@@ -0,0 +1,260 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <functional>
+
+/**
+ * HTTP server backend selection.
+ *
+ * WebServer is written against the names below (HttpRequest, HttpResponse,
+ * HttpParam, HttpServer) rather than a specific library:
+ *
+ * - Default: ESPAsyncWebServer on AsyncTCP. The names are aliases for the
+ *   library's own types, so this backend costs nothing extra.
+ * - TINKLINK_HTTPD_IDF: ESP-IDF's esp_http_server. Requests are handled one
+ *   at a time on the httpd task by small classes that implement the subset
+ *   of the AsyncWebServerRequest API WebServer uses. Responses are sent
+ *   before the handler returns, and chunked responses are pulled from their
+ *   filler on the spot.
+ *
+ * The request API is the ESPAsyncWebServer one (hasParam/getParam with a
+ * `post` flag, beginResponse/beginChunkedResponse, body and upload
+ * handlers), so handler code is identical on both backends.
+ */
+
+#ifndef TINKLINK_HTTPD_IDF
+
+#include <ESPAsyncWebServer.h>
+
+using HttpRequest = AsyncWebServerRequest;
+using HttpResponse = AsyncWebServerResponse;
+using HttpResponseStream = AsyncResponseStream;
+using HttpParam = AsyncWebParameter;
+using HttpMethod = WebRequestMethodComposite;
+
+#else  // TINKLINK_HTTPD_IDF
+
+#include <esp_http_server.h>
+#include <list>
+#include <vector>
+
+/** Request method (http_parser's HTTP_GET, HTTP_POST, ...) */
+using HttpMethod = int;
+
+/** Fills `buffer` with up to `maxLen` bytes of a chunked body; 0 ends it */
+using HttpChunkFiller = std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)>;
+
+/** Query, form or multipart field */
+class HttpParam {
+public:
+    HttpParam(const String& name, const String& value, bool post)
+        : _name(name), _value(value), _post(post) {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+    bool isPost() const { return _post; }
+
+private:
+    String _name;
+    String _value;
+    bool _post;
+};
+
+/** Request header, as returned by HttpRequest::getHeader() */
+class HttpHeader {
+public:
+    HttpHeader(const String& name, const String& value) : _name(name), _value(value) {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+
+private:
+    String _name;
+    String _value;
+};
+
+/** Response under construction; sent and deleted by HttpRequest::send() */
+class HttpResponse {
+public:
+    HttpResponse(int code, const String& contentType);
+    virtual ~HttpResponse() {}
+
+    void setCode(int code) { _code = code; }
+    void addHeader(const String& name, const String& value);
+
+protected:
+    friend class HttpRequest;
+
+    int _code;
+    String _contentType;
+    std::vector<std::pair<String, String>> _headers;
+
+    /** Send the body (status and headers are already set). */
+    virtual esp_err_t sendBody(httpd_req_t* req) = 0;
+};
+
+/** Response whose body is written through Print (e.g. serializeMsgPack) */
+class HttpResponseStream : public HttpResponse, public Print {
+public:
+    explicit HttpResponseStream(const String& contentType) : HttpResponse(200, contentType) {}
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t* data, size_t len) override;
+
+protected:
+    esp_err_t sendBody(httpd_req_t* req) override;
+
+private:
+    std::vector<uint8_t> _body;
+};
+
+/** One request on the esp_http_server backend. */
+class HttpRequest {
+public:
+    explicit HttpRequest(httpd_req_t* req);
+    ~HttpRequest();
+
+    /** @return Decoded path without the query string */
+    const String& url() const { return _url; }
+    HttpMethod method() const { return _req->method; }
+    String contentType() const { return header("Content-Type"); }
+    size_t contentLength() const { return _req->content_len; }
+
+    bool hasParam(const String& name, bool post = false, bool file = false) const;
+    const HttpParam* getParam(const String& name, bool post = false, bool file = false) const;
+
+    bool hasHeader(const String& name) const;
+    const HttpHeader* getHeader(const String& name);
+    String header(const char* name) const;
+
+    void send(int code, const String& contentType = String(), const String& content = String());
+    void send(HttpResponse* response);
+    HttpResponse* beginResponse(int code, const String& contentType = String(),
+                                const String& content = String());
+    HttpResponseStream* beginResponseStream(const String& contentType, size_t bufferSize = 1460);
+    HttpResponse* beginChunkedResponse(const String& contentType, HttpChunkFiller filler);
+
+    /** Opaque per-request pointer, freed with free() after the request */
+    void* _tempObject;
+
+private:
+    friend class HttpServer;
+
+    httpd_req_t* _req;
+    String _url;
+    std::list<HttpParam> _params;    ///< Lists so getParam()/getHeader() pointers stay valid
+    std::list<HttpHeader> _headers;
+    char _status[40];                ///< Status line; must outlive the send
+    bool _sent;
+
+    void addParams(const char* encoded, size_t len, bool post);
+};
+
+#endif  // TINKLINK_HTTPD_IDF
+
+using HttpHandler = std::function<void(HttpRequest* request)>;
+using HttpBodyHandler = std::function<void(HttpRequest* request, uint8_t* data, size_t len,
+                                           size_t index, size_t total)>;
+using HttpUploadHandler = std::function<void(HttpRequest* request, String filename, size_t index,
+                                             uint8_t* data, size_t len, bool final)>;
+
+/**
+ * Route registration and lifecycle for the selected backend.
+ *
+ * An optional admission hook sees every request once its headers are in,
+ * before any route runs: rejected requests are answered with 503 and
+ * Retry-After without reaching the route (any body is discarded unread).
+ * The finish hook runs once per request when it is done, admitted or not.
+ */
+class HttpServer {
+public:
+    /** Result of the admission hook */
+    struct Admission {
+        bool admitted;
+        uint32_t retryAfter;  ///< Seconds, when rejected
+        const char* body;     ///< JSON error body (string literal), when rejected
+        uint32_t token;       ///< Opaque value handed back to the finish hook
+    };
+
+    using AdmitHook = std::function<Admission(HttpRequest* request)>;
+    using FinishHook = std::function<void(const Admission& admission, uint32_t us)>;
+
+    /** Backend name for diagnostics ("async" or "idf") */
+    static const char* const BACKEND;
+
+    explicit HttpServer(uint16_t port);
+    ~HttpServer();
+
+    /**
+     * Register a route.
+     * @param path Exact request path
+     * @param method Request method
+     * @param handler Called once the request (and its body) is complete
+     * @param upload Multipart file upload handler (optional)
+     * @param body Raw body handler for non-form bodies (optional)
+     */
+    void on(const char* path, HttpMethod method, HttpHandler handler,
+            HttpUploadHandler upload = nullptr, HttpBodyHandler body = nullptr);
+
+    /**
+     * Serve files from a filesystem for requests no route matched.
+     * Prefers a ".gz" sibling if present.
+     */
+    void serveStatic(const char* uri, fs::FS& fs, const char* root, const char* defaultFile);
+
+    /** Handler for requests nothing else matched. */
+    void onNotFound(HttpHandler handler);
+
+    /** Install the admission and finish hooks (before begin()). */
+    void setAdmission(AdmitHook admit, FinishHook finish);
+
+    void begin();
+    void end();
+
+    /**
+     * Client IPv4 address of a request.
+     * @return Address in network byte order, 0 if unknown
+     */
+    static uint32_t remoteIp(HttpRequest* request);
+
+private:
+    uint16_t _port;
+    AdmitHook _admit;
+    FinishHook _finish;
+
+#ifndef TINKLINK_HTTPD_IDF
+    AsyncWebServer _server;
+#else
+    struct Route {
+        String path;
+        HttpMethod method;
+        HttpHandler handler;
+        HttpUploadHandler upload;
+        HttpBodyHandler body;
+    };
+
+    httpd_handle_t _handle;
+    std::vector<Route> _routes;
+    HttpHandler _notFound;
+    fs::FS* _staticFs;
+    String _staticUri;
+    String _staticRoot;
+    String _staticDefault;
+
+    static esp_err_t dispatch(httpd_req_t* req);
+
+    /** Run one request; false if the connection should be dropped. */
+    bool handle(HttpRequest& request);
+    bool route(HttpRequest& request);
+
+    // Body readers: false on a socket error; a bad body is answered with 4xx
+    bool readRequestBody(HttpRequest& request, const Route& route);
+    bool readForm(HttpRequest& request);
+    bool readBody(HttpRequest& request, const HttpBodyHandler& body);
+    bool readMultipart(HttpRequest& request, const HttpUploadHandler& upload);
+
+    bool serveFile(HttpRequest& request);
+#endif
+};
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,629 @@
+#ifdef TINKLINK_HTTPD_IDF
+
+#include "HttpServer.h"
+#include "Logger.h"
+#include <lwip/sockets.h>
+#include <algorithm>
+#include <memory>
+
+const char* const HttpServer::BACKEND = "idf";
+
+/// httpd task stack; handlers build JSON documents on it
+static const size_t TASK_STACK_SIZE = 8192;
+
+/// Bytes read from the socket per call when streaming a body
+static const size_t RECV_CHUNK = 1024;
+
+/// Bytes per chunk of a chunked response or static file
+static const size_t SEND_CHUNK = 1460;
+
+/// Largest urlencoded form body accepted
+static const size_t MAX_FORM_SIZE = 8192;
+
+/// Multipart parse buffer (must hold a part's headers)
+static const size_t MULTIPART_BUFFER = 2048;
+
+/// Largest multipart text field kept
+static const size_t MAX_FIELD_SIZE = 512;
+
+/// Tries before giving up on a receive that keeps timing out
+static const int RECV_RETRIES = 3;
+
+/** Reason phrase for the status line. */
+static const char* statusText(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "";
+    }
+}
+
+/** Decode %XX escapes and '+' in a urlencoded string. */
+static String urlDecode(const char* text, size_t len) {
+    String out;
+    out.reserve(len);
+    for (size_t i = 0; i < len; i++) {
+        char c = text[i];
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%' && i + 2 < len && isxdigit(text[i + 1]) && isxdigit(text[i + 2])) {
+            char hex[3] = {text[i + 1], text[i + 2], '\0'};
+            c = (char)strtol(hex, nullptr, 16);
+            i += 2;
+        }
+        out += c;
+    }
+    return out;
+}
+
+/** Index of `needle` in `hay`, or -1. */
+static int findBytes(const char* hay, size_t hayLen, const char* needle, size_t needleLen) {
+    if (needleLen == 0 || hayLen < needleLen) return -1;
+    for (size_t i = 0; i + needleLen <= hayLen; i++) {
+        if (hay[i] == needle[0] && memcmp(hay + i, needle, needleLen) == 0) return (int)i;
+    }
+    return -1;
+}
+
+/** Receive up to `len` body bytes, retrying on timeouts. @return bytes, or <= 0 on error */
+static int recvSome(httpd_req_t* req, char* buf, size_t len) {
+    int n = HTTPD_SOCK_ERR_TIMEOUT;
+    for (int i = 0; i < RECV_RETRIES && n == HTTPD_SOCK_ERR_TIMEOUT; i++) {
+        n = httpd_req_recv(req, buf, len);
+    }
+    return n;
+}
+
+/** Value of `key="..."` in a Content-Disposition header, empty if absent. */
+static String dispositionValue(const String& header, const char* key) {
+    String pattern = String(key) + "=\"";
+    int start = header.indexOf(pattern);
+    if (start < 0) return String();
+    start += pattern.length();
+    int end = header.indexOf('"', start);
+    return end < 0 ? String() : header.substring(start, end);
+}
+
+static const char* contentTypeFor(const String& path) {
+    if (path.endsWith(".html")) return "text/html";
+    if (path.endsWith(".css")) return "text/css";
+    if (path.endsWith(".js")) return "application/javascript";
+    if (path.endsWith(".json")) return "application/json";
+    if (path.endsWith(".png")) return "image/png";
+    if (path.endsWith(".ico")) return "image/x-icon";
+    if (path.endsWith(".svg")) return "image/svg+xml";
+    if (path.endsWith(".txt")) return "text/plain";
+    return "application/octet-stream";
+}
+
+namespace {
+
+/** Response with the whole body in a String */
+class BasicResponse : public HttpResponse {
+public:
+    BasicResponse(int code, const String& contentType, const String& content)
+        : HttpResponse(code, contentType), _content(content) {}
+
+protected:
+    esp_err_t sendBody(httpd_req_t* req) override {
+        return httpd_resp_send(req, _content.c_str(), _content.length());
+    }
+
+private:
+    String _content;
+};
+
+/** Chunked response pulled from a filler until it returns 0 */
+class ChunkedFillerResponse : public HttpResponse {
+public:
+    ChunkedFillerResponse(const String& contentType, HttpChunkFiller filler)
+        : HttpResponse(200, contentType), _filler(filler) {}
+
+protected:
+    esp_err_t sendBody(httpd_req_t* req) override {
+        std::unique_ptr<uint8_t[]> buf(new uint8_t[SEND_CHUNK]);
+        size_t index = 0;
+        for (;;) {
+            size_t n = _filler(buf.get(), SEND_CHUNK, index);
+            if (n == 0) break;
+            esp_err_t err = httpd_resp_send_chunk(req, (const char*)buf.get(), n);
+            if (err != ESP_OK) return err;
+            index += n;
+        }
+        return httpd_resp_send_chunk(req, nullptr, 0);
+    }
+
+private:
+    HttpChunkFiller _filler;
+};
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// Responses
+// ---------------------------------------------------------------------------
+
+HttpResponse::HttpResponse(int code, const String& contentType)
+    : _code(code)
+    , _contentType(contentType)
+{
+}
+
+void HttpResponse::addHeader(const String& name, const String& value) {
+    _headers.emplace_back(name, value);
+}
+
+size_t HttpResponseStream::write(uint8_t data) {
+    _body.push_back(data);
+    return 1;
+}
+
+size_t HttpResponseStream::write(const uint8_t* data, size_t len) {
+    _body.insert(_body.end(), data, data + len);
+    return len;
+}
+
+esp_err_t HttpResponseStream::sendBody(httpd_req_t* req) {
+    return httpd_resp_send(req, (const char*)_body.data(), _body.size());
+}
+
+// ---------------------------------------------------------------------------
+// Requests
+// ---------------------------------------------------------------------------
+
+HttpRequest::HttpRequest(httpd_req_t* req)
+    : _tempObject(nullptr)
+    , _req(req)
+    , _sent(false)
+{
+    _status[0] = '\0';
+
+    const char* uri = req->uri;
+    const char* query = strchr(uri, '?');
+    size_t pathLen = query ? (size_t)(query - uri) : strlen(uri);
+    _url = urlDecode(uri, pathLen);
+    if (query) addParams(query + 1, strlen(query + 1), false);
+}
+
+HttpRequest::~HttpRequest() {
+    free(_tempObject);
+}
+
+void HttpRequest::addParams(const char* encoded, size_t len, bool post) {
+    size_t pos = 0;
+    while (pos < len) {
+        const char* start = encoded + pos;
+        const char* amp = (const char*)memchr(start, '&', len - pos);
+        size_t pairLen = amp ? (size_t)(amp - start) : len - pos;
+
+        if (pairLen > 0) {
+            const char* eq = (const char*)memchr(start, '=', pairLen);
+            size_t nameLen = eq ? (size_t)(eq - start) : pairLen;
+            String value = eq ? urlDecode(eq + 1, pairLen - nameLen - 1) : String();
+            _params.emplace_back(urlDecode(start, nameLen), value, post);
+        }
+        pos += pairLen + 1;
+    }
+}
+
+bool HttpRequest::hasParam(const String& name, bool post, bool file) const {
+    return getParam(name, post, file) != nullptr;
+}
+
+const HttpParam* HttpRequest::getParam(const String& name, bool post, bool file) const {
+    (void)file;  // Uploaded files go to the upload handler, never into params
+    for (const HttpParam& param : _params) {
+        if (param.isPost() == post && param.name() == name) return &param;
+    }
+    return nullptr;
+}
+
+bool HttpRequest::hasHeader(const String& name) const {
+    return httpd_req_get_hdr_value_len(_req, name.c_str()) > 0;
+}
+
+const HttpHeader* HttpRequest::getHeader(const String& name) {
+    String value = header(name.c_str());
+    if (value.length() == 0) return nullptr;
+    _headers.emplace_back(name, value);
+    return &_headers.back();
+}
+
+String HttpRequest::header(const char* name) const {
+    size_t len = httpd_req_get_hdr_value_len(_req, name);
+    if (len == 0) return String();
+
+    std::unique_ptr<char[]> buf(new char[len + 1]);
+    if (httpd_req_get_hdr_value_str(_req, name, buf.get(), len + 1) != ESP_OK) return String();
+    return String(buf.get());
+}
+
+void HttpRequest::send(int code, const String& contentType, const String& content) {
+    send(beginResponse(code, contentType, content));
+}
+
+void HttpRequest::send(HttpResponse* response) {
+    if (_sent) {
+        LOG_WARN("HttpServer: Second response to %s dropped", _url.c_str());
+        delete response;
+        return;
+    }
+    _sent = true;
+
+    // httpd keeps pointers to these strings until the body is sent
+    snprintf(_status, sizeof(_status), "%d %s", response->_code, statusText(response->_code));
+    httpd_resp_set_status(_req, _status);
+    if (response->_contentType.length() > 0) {
+        httpd_resp_set_type(_req, response->_contentType.c_str());
+    }
+    for (const auto& header : response->_headers) {
+        httpd_resp_set_hdr(_req, header.first.c_str(), header.second.c_str());
+    }
+
+    esp_err_t err = response->sendBody(_req);
+    if (err != ESP_OK) {
+        LOG_WARN("HttpServer: Sending %s failed: %s", _url.c_str(), esp_err_to_name(err));
+    }
+    delete response;
+}
+
+HttpResponse* HttpRequest::beginResponse(int code, const String& contentType, const String& content) {
+    return new BasicResponse(code, contentType, content);
+}
+
+HttpResponseStream* HttpRequest::beginResponseStream(const String& contentType, size_t bufferSize) {
+    (void)bufferSize;  // Body is buffered whole and sent with a Content-Length
+    return new HttpResponseStream(contentType);
+}
+
+HttpResponse* HttpRequest::beginChunkedResponse(const String& contentType, HttpChunkFiller filler) {
+    return new ChunkedFillerResponse(contentType, filler);
+}
+
+// ---------------------------------------------------------------------------
+// Server
+// ---------------------------------------------------------------------------
+
+HttpServer::HttpServer(uint16_t port)
+    : _port(port)
+    , _handle(nullptr)
+    , _staticFs(nullptr)
+{
+}
+
+HttpServer::~HttpServer() {
+    end();
+}
+
+void HttpServer::on(const char* path, HttpMethod method, HttpHandler handler,
+                    HttpUploadHandler upload, HttpBodyHandler body) {
+    Route route;
+    route.path = path;
+    route.method = method;
+    route.handler = handler;
+    route.upload = upload;
+    route.body = body;
+    _routes.push_back(route);
+}
+
+void HttpServer::serveStatic(const char* uri, fs::FS& fs, const char* root, const char* defaultFile) {
+    _staticFs = &fs;
+    _staticUri = uri;
+    _staticRoot = root;
+    _staticDefault = defaultFile;
+}
+
+void HttpServer::onNotFound(HttpHandler handler) {
+    _notFound = handler;
+}
+
+void HttpServer::setAdmission(AdmitHook admit, FinishHook finish) {
+    _admit = admit;
+    _finish = finish;
+}
+
+void HttpServer::begin() {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = _port;
+    config.stack_size = TASK_STACK_SIZE;
+    config.lru_purge_enable = true;  // Recycle idle keep-alive sockets instead of refusing
+    config.uri_match_fn = httpd_uri_match_wildcard;
+
+    esp_err_t err = httpd_start(&_handle, &config);
+    if (err != ESP_OK) {
+        LOG_ERROR("HttpServer: httpd_start failed: %s", esp_err_to_name(err));
+        _handle = nullptr;
+        return;
+    }
+
+    // One wildcard handler per method; routing happens in dispatch()
+    static const httpd_method_t METHODS[] = {HTTP_GET, HTTP_POST, HTTP_DELETE};
+    for (httpd_method_t method : METHODS) {
+        httpd_uri_t uri = {};
+        uri.uri = "/*";
+        uri.method = method;
+        uri.handler = dispatch;
+        uri.user_ctx = this;
+        httpd_register_uri_handler(_handle, &uri);
+    }
+}
+
+void HttpServer::end() {
+    if (_handle) {
+        httpd_stop(_handle);
+        _handle = nullptr;
+    }
+}
+
+uint32_t HttpServer::remoteIp(HttpRequest* request) {
+    int fd = httpd_req_to_sockfd(request->_req);
+    struct sockaddr_in6 addr;
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || getpeername(fd, (struct sockaddr*)&addr, &len) < 0) return 0;
+
+    if (addr.sin6_family == AF_INET) {
+        return ((struct sockaddr_in*)&addr)->sin_addr.s_addr;
+    }
+    return addr.sin6_addr.un.u32_addr[3];  // IPv4-mapped IPv6
+}
+
+esp_err_t HttpServer::dispatch(httpd_req_t* req) {
+    HttpServer* self = (HttpServer*)req->user_ctx;
+    HttpRequest request(req);
+    return self->handle(request) ? ESP_OK : ESP_FAIL;
+}
+
+bool HttpServer::handle(HttpRequest& request) {
+    unsigned long start = micros();
+
+    Admission admission = {true, 0, nullptr, 0};
+    if (_admit) admission = _admit(&request);
+
+    bool ok = true;
+    if (admission.admitted) {
+        ok = route(request);
+    } else {
+        // httpd discards the unread body after we return
+        HttpResponse* response = request.beginResponse(503, "application/json",
+            admission.body ? admission.body : "{\"error\":\"Server busy\"}");
+        response->addHeader("Retry-After", String(admission.retryAfter));
+        request.send(response);
+    }
+
+    if (_finish) _finish(admission, micros() - start);
+    return ok;
+}
+
+bool HttpServer::route(HttpRequest& request) {
+    const Route* match = nullptr;
+    for (const Route& r : _routes) {
+        if (r.method == request.method() && r.path == request.url()) {
+            match = &r;
+            break;
+        }
+    }
+
+    if (match) {
+        if (!readRequestBody(request, *match)) return false;
+        if (!request._sent) match->handler(&request);
+    } else if (request.method() == HTTP_GET && _staticFs && serveFile(request)) {
+        // Served from the filesystem
+    } else if (_notFound) {
+        _notFound(&request);
+    } else {
+        request.send(404, "text/plain", "Not Found");
+    }
+
+    if (!request._sent) {
+        LOG_WARN("HttpServer: No response for %s", request.url().c_str());
+        request.send(500, "text/plain", "No response");
+    }
+    return true;
+}
+
+bool HttpServer::readRequestBody(HttpRequest& request, const Route& route) {
+    if (request.contentLength() == 0) return true;
+
+    String type = request.contentType();
+    if (type.startsWith("application/x-www-form-urlencoded")) return readForm(request);
+    if (type.startsWith("multipart/form-data")) return readMultipart(request, route.upload);
+    if (route.body) return readBody(request, route.body);
+    return true;  // Unused body is discarded by httpd
+}
+
+bool HttpServer::readForm(HttpRequest& request) {
+    size_t total = request.contentLength();
+    if (total > MAX_FORM_SIZE) {
+        request.send(413, "application/json", "{\"error\":\"Form too large\"}");
+        return true;
+    }
+
+    std::unique_ptr<char[]> buf(new char[total]);
+    size_t received = 0;
+    while (received < total) {
+        int n = recvSome(request._req, buf.get() + received, total - received);
+        if (n <= 0) return false;
+        received += n;
+    }
+
+    request.addParams(buf.get(), total, true);
+    return true;
+}
+
+bool HttpServer::readBody(HttpRequest& request, const HttpBodyHandler& body) {
+    size_t total = request.contentLength();
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[RECV_CHUNK]);
+
+    size_t index = 0;
+    while (index < total) {
+        int n = recvSome(request._req, (char*)buf.get(), std::min(RECV_CHUNK, total - index));
+        if (n <= 0) return false;
+        body(&request, buf.get(), n, index, total);
+        index += n;
+    }
+    return true;
+}
+
+bool HttpServer::readMultipart(HttpRequest& request, const HttpUploadHandler& upload) {
+    String type = request.contentType();
+    int b = type.indexOf("boundary=");
+    if (b < 0) {
+        request.send(400, "application/json", "{\"error\":\"Missing multipart boundary\"}");
+        return true;
+    }
+    String boundary = type.substring(b + 9);
+    int semi = boundary.indexOf(';');
+    if (semi >= 0) boundary = boundary.substring(0, semi);
+    boundary.trim();
+    if (boundary.length() >= 2 && boundary.startsWith("\"") && boundary.endsWith("\"")) {
+        boundary = boundary.substring(1, boundary.length() - 1);
+    }
+
+    // Every delimiter is CRLF "--" boundary; the body's first one lacks the
+    // CRLF, so the buffer starts with one to make them all look alike
+    String delim = "\r\n--" + boundary;
+    const size_t delimLen = delim.length();
+    if (boundary.length() == 0 || delimLen > MULTIPART_BUFFER / 4) {
+        request.send(400, "application/json", "{\"error\":\"Bad multipart boundary\"}");
+        return true;
+    }
+
+    enum class Part { PREAMBLE, DELIMITER, HEADERS, FIELD, FILE, DONE };
+    Part part = Part::PREAMBLE;
+
+    std::unique_ptr<char[]> buf(new char[MULTIPART_BUFFER]);
+    size_t len = 0;
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+    size_t remaining = request.contentLength();
+
+    String name;
+    String filename;
+    String value;
+    size_t fileIndex = 0;
+
+    auto consume = [&](size_t n) {
+        memmove(buf.get(), buf.get() + n, len - n);
+        len -= n;
+    };
+
+    while (part != Part::DONE) {
+        // Keep the buffer topped up
+        if (remaining > 0 && len < MULTIPART_BUFFER) {
+            int n = recvSome(request._req, buf.get() + len, std::min(MULTIPART_BUFFER - len, remaining));
+            if (n <= 0) return false;
+            len += n;
+            remaining -= n;
+        }
+
+        switch (part) {
+            case Part::PREAMBLE:
+            case Part::FIELD:
+            case Part::FILE: {
+                int hit = findBytes(buf.get(), len, delim.c_str(), delimLen);
+
+                // Without a delimiter, hold back a tail that may be the start of one
+                size_t dataLen = hit >= 0 ? (size_t)hit : (len >= delimLen ? len - (delimLen - 1) : 0);
+                if (part == Part::FIELD) {
+                    if (value.length() < MAX_FIELD_SIZE) {
+                        value.concat(buf.get(), std::min(dataLen, MAX_FIELD_SIZE - value.length()));
+                    }
+                } else if (part == Part::FILE && upload && dataLen > 0) {
+                    upload(&request, filename, fileIndex, (uint8_t*)buf.get(), dataLen, false);
+                    fileIndex += dataLen;
+                }
+                consume(dataLen);
+
+                if (hit < 0) {
+                    if (remaining == 0) {
+                        request.send(400, "application/json", "{\"error\":\"Truncated multipart body\"}");
+                        return true;
+                    }
+                    break;
+                }
+
+                if (part == Part::FIELD) {
+                    request._params.emplace_back(name, value, true);
+                } else if (part == Part::FILE && upload) {
+                    upload(&request, filename, fileIndex, nullptr, 0, true);
+                }
+                part = Part::DELIMITER;
+                break;
+            }
+
+            case Part::DELIMITER:
+                // Delimiter is followed by "--" (last part) or CRLF (next part)
+                if (len < delimLen + 2) {
+                    if (remaining == 0) part = Part::DONE;
+                    break;
+                }
+                if (buf[delimLen] == '-' && buf[delimLen + 1] == '-') {
+                    part = Part::DONE;
+                } else {
+                    consume(delimLen + 2);
+                    part = Part::HEADERS;
+                }
+                break;
+
+            case Part::HEADERS: {
+                int end = findBytes(buf.get(), len, "\r\n\r\n", 4);
+                if (end < 0) {
+                    if (remaining == 0 || len >= MULTIPART_BUFFER) {
+                        request.send(400, "application/json", "{\"error\":\"Bad multipart headers\"}");
+                        return true;
+                    }
+                    break;
+                }
+
+                String headers;
+                headers.concat(buf.get(), end);
+                consume(end + 4);
+
+                name = dispositionValue(headers, " name");
+                filename = dispositionValue(headers, "filename");
+                value = "";
+                fileIndex = 0;
+                part = headers.indexOf("filename=\"") >= 0 ? Part::FILE : Part::FIELD;
+                break;
+            }
+
+            case Part::DONE:
+                break;
+        }
+    }
+    return true;  // Epilogue is discarded by httpd
+}
+
+bool HttpServer::serveFile(HttpRequest& request) {
+    const String& url = request.url();
+    if (!url.startsWith(_staticUri) || url.indexOf("..") >= 0) return false;
+
+    String path = _staticRoot + url.substring(_staticUri.length());
+    path.replace("//", "/");
+    if (path.endsWith("/")) path += _staticDefault;
+
+    // Prefer a pre-compressed copy, like serveStatic() on the async backend
+    bool gzip = _staticFs->exists(path + ".gz");
+    File file = _staticFs->open(gzip ? path + ".gz" : path, "r");
+    if (!file) return false;
+    if (file.isDirectory()) {
+        file.close();
+        return false;
+    }
+
+    HttpResponse* response = request.beginChunkedResponse(contentTypeFor(path),
+        [file](uint8_t* buffer, size_t maxLen, size_t) mutable -> size_t {
+            return file.read(buffer, maxLen);
+        });
+    if (gzip) response->addHeader("Content-Encoding", "gzip");
+    request.send(response);
+    return true;
+}
+
+#endif  // TINKLINK_HTTPD_IDF
@@ -0,0 +1,86 @@
+#include "LatencyProbe.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+LatencyProbe::LatencyProbe()
+    : _running(false)
+{
+    memset(&_result, 0, sizeof(_result));
+}
+
+bool LatencyProbe::start(IPAddress target, uint16_t count, uint16_t intervalMs, WifiPowerMode mode) {
+    if (isRunning()) return false;
+
+    memset(&_result, 0, sizeof(_result));
+    _result.mode = mode;
+    _result.running = true;
+    _result.target = (uint32_t)target;
+    _result.count = count;
+
+    esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+    IP_ADDR4(&config.target_addr, target[0], target[1], target[2], target[3]);
+    config.count = count;
+    config.interval_ms = intervalMs;
+    config.timeout_ms = TIMEOUT_MS;
+    config.data_size = 32;
+
+    esp_ping_callbacks_t callbacks;
+    callbacks.cb_args = this;
+    callbacks.on_ping_success = onSuccess;
+    callbacks.on_ping_timeout = onTimeout;
+    callbacks.on_ping_end = onEnd;
+
+    esp_ping_handle_t session;
+    if (esp_ping_new_session(&config, &callbacks, &session) != ESP_OK) {
+        LOG_ERROR("LatencyProbe: Cannot create ping session");
+        return false;
+    }
+
+    // From here on the ping task owns _result until onEnd()
+    _published.store(_result);
+    _running.store(true, std::memory_order_release);
+    esp_ping_start(session);
+    LOG_DEBUG("LatencyProbe: %u echo request(s) to %s every %u ms",
+              count, target.toString().c_str(), intervalMs);
+    return true;
+}
+
+void LatencyProbe::onSuccess(esp_ping_handle_t session, void* arg) {
+    LatencyProbe* self = static_cast<LatencyProbe*>(arg);
+    uint32_t elapsedMs = 0;
+    esp_ping_get_profile(session, ESP_PING_PROF_TIMEGAP, &elapsedMs, sizeof(elapsedMs));
+    uint32_t us = elapsedMs * 1000;
+
+    Result& r = self->_result;
+    if (r.received == 0 || us < r.minUs) r.minUs = us;
+    if (us > r.maxUs) r.maxUs = us;
+    r.sumUs += us;
+    r.received++;
+    r.sent++;
+    self->_published.store(r);
+
+    Metrics::instance().recordWifiRtt((uint8_t)r.mode, us);
+}
+
+void LatencyProbe::onTimeout(esp_ping_handle_t session, void* arg) {
+    LatencyProbe* self = static_cast<LatencyProbe*>(arg);
+    Result& r = self->_result;
+    r.sent++;
+    self->_published.store(r);
+
+    Metrics::instance().recordWifiRttLost((uint8_t)r.mode);
+}
+
+void LatencyProbe::onEnd(esp_ping_handle_t session, void* arg) {
+    LatencyProbe* self = static_cast<LatencyProbe*>(arg);
+    Result& r = self->_result;
+    r.running = false;
+    self->_published.store(r);
+
+    // Ends the ping task once this callback returns
+    esp_ping_delete_session(session);
+
+    LOG_DEBUG("LatencyProbe: %u/%u replies, avg %lu ms",
+              r.received, r.sent, r.received ? (unsigned long)(r.sumUs / r.received / 1000) : 0UL);
+    self->_running.store(false, std::memory_order_release);
+}
@@ -0,0 +1,86 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <atomic>
+#include <ping/ping_sock.h>
+#include "ConfigTypes.h"
+#include "Seqlock.h"
+
+/**
+ * Round-trip time probe: a burst of ICMP echo requests to one host,
+ * normally the WiFi gateway.
+ *
+ * Each reply goes into the tinklink_wifi_rtt_seconds histogram of the power
+ * mode the burst ran under, and each lost request into its loss counter,
+ * so the modes can be compared on one install over time. The gateway is
+ * one hop away, so the time is dominated by the radio: with modem sleep,
+ * by how long the AP holds the reply until the station wakes.
+ *
+ * The echoes are sent by the lwIP ping task (esp_ping), which reports
+ * times in whole milliseconds; start() only creates the session and
+ * returns. One burst runs at a time.
+ *
+ * Usage:
+ *   LatencyProbe probe;
+ *   probe.start(WiFi.gatewayIP(), 20, 200, WifiPowerMode::BALANCED);  // loop task
+ *   LatencyProbe::Result r;
+ *   probe.read(r);  // any task
+ */
+class LatencyProbe {
+public:
+    /** Progress of the current or last burst. Plain data for the Seqlock. */
+    struct Result {
+        WifiPowerMode mode;   ///< Power mode during the burst
+        bool running;
+        uint32_t target;      ///< IPv4 address probed (0 before the first burst)
+        uint16_t count;       ///< Requests in the burst
+        uint16_t sent;        ///< Requests answered or timed out so far
+        uint16_t received;
+        uint32_t minUs;       ///< Over received replies (0 if none)
+        uint32_t maxUs;
+        uint32_t sumUs;
+    };
+
+    /** Wait for each reply before counting it lost */
+    static const uint32_t TIMEOUT_MS = 1000;
+
+    LatencyProbe();
+
+    /**
+     * Start a burst (loop task).
+     * @param target Host to probe
+     * @param count Echo requests to send
+     * @param intervalMs Time between requests
+     * @param mode Power mode in effect, to file the samples under
+     * @return false if a burst is running or the session can't be created
+     */
+    bool start(IPAddress target, uint16_t count, uint16_t intervalMs, WifiPowerMode mode);
+
+    /** @return true while a burst is running (any task) */
+    bool isRunning() const { return _running.load(std::memory_order_acquire); }
+
+    /**
+     * Copy the progress of the current or last burst (any task).
+     * @param out Receives the result
+     */
+    void read(Result& out) const { _published.load(out); }
+
+private:
+    LatencyProbe(const LatencyProbe&) = delete;
+    LatencyProbe& operator=(const LatencyProbe&) = delete;
+
+    // Written by start() while idle and by the ping task while running,
+    // so the Seqlock has one writer at a time
+    Result _result;
+    Seqlock<Result> _published;
+    std::atomic<bool> _running;
+
+    // Ping task callbacks
+    static void onSuccess(esp_ping_handle_t session, void* arg);
+    static void onTimeout(esp_ping_handle_t session, void* arg);
+    static void onEnd(esp_ping_handle_t session, void* arg);
+};
+
+#endif // LATENCY_PROBE_H
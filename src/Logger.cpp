@@ -1,6 +1,28 @@
 #include "Logger.h"
 #include <stdarg.h>
 
+namespace {
+
+/** Holds the Logger mutex for the enclosing scope */
+class BufferLock {
+public:
+    explicit BufferLock(SemaphoreHandle_t lock) : _lock(lock) { xSemaphoreTake(_lock, portMAX_DELAY); }
+    ~BufferLock() { xSemaphoreGive(_lock); }
+
+    BufferLock(const BufferLock&) = delete;
+    BufferLock& operator=(const BufferLock&) = delete;
+
+private:
+    SemaphoreHandle_t _lock;
+};
+
+}  // namespace
+
+Logger::Logger()
+    : _lock(xSemaphoreCreateMutex())
+{
+}
+
 Logger& Logger::instance() {
     static Logger instance;
     return instance;
@@ -8,6 +30,7 @@ Logger& Logger::instance() {
 
 void Logger::begin() {
     _startTime = millis();
+    BufferLock lock(_lock);
     _logBuffer.reserve(MAX_LOG_ENTRIES);
 }
 
@@ -95,6 +118,7 @@ void Logger::addToBuffer(LogLevel level, const String& message) {
     entry.level = level;
     entry.message = message;
 
+    BufferLock lock(_lock);
     // Circular buffer: remove oldest if full
     if (_logBuffer.size() >= MAX_LOG_ENTRIES) {
         _logBuffer.erase(_logBuffer.begin());
@@ -126,6 +150,7 @@ const char* Logger::levelToShortString(LogLevel level) {
 
 std::vector<LogEntry> Logger::getRecentLogs(int count) {
     std::vector<LogEntry> result;
+    BufferLock lock(_lock);
 
     int start = 0;
     if ((int)_logBuffer.size() > count) {
@@ -141,6 +166,7 @@ std::vector<LogEntry> Logger::getRecentLogs(int count) {
 
 std::vector<LogEntry> Logger::getLogsSince(unsigned long sinceIndex, int maxCount) {
     std::vector<LogEntry> result;
+    BufferLock lock(_lock);
 
     // Calculate how many logs we've received since sinceIndex
     if (_totalCount <= sinceIndex) {
@@ -166,7 +192,24 @@ std::vector<LogEntry> Logger::getLogsSince(unsigned long sinceIndex, int maxCoun
     return result;
 }
 
+unsigned long Logger::getOldestIndex() const {
+    BufferLock lock(_lock);
+    return _totalCount - _logBuffer.size();
+}
+
+bool Logger::getLogEntry(unsigned long index, LogEntry& entry) const {
+    BufferLock lock(_lock);
+    unsigned long oldest = _totalCount - _logBuffer.size();
+    if (index < oldest || index >= _totalCount) {
+        return false;
+    }
+
+    entry = _logBuffer[index - oldest];
+    return true;
+}
+
 void Logger::clearLogs() {
+    BufferLock lock(_lock);
     _logBuffer.clear();
     // Don't reset _totalCount so clients can detect the clear
 }
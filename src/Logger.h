@@ -2,6 +2,7 @@
 #define LOGGER_H
 
 #include <Arduino.h>
+#include <freertos/semphr.h>
 #include <vector>
 #include <functional>
 
@@ -38,6 +39,9 @@ struct LogEntry {
  *
  * The buffer holds up to MAX_LOG_ENTRIES messages. When full, oldest entries
  * are removed to make room for new ones.
+ *
+ * Any task may log (loop, HTTP server, pull OTA, the lwIP ping callback):
+ * the buffer is guarded by a mutex, so logging must not happen from an ISR.
  */
 class Logger {
 public:
@@ -124,6 +128,22 @@ public:
      */
     unsigned long getLogCount() const { return _totalCount; }
 
+    /**
+     * Get the log index of the oldest entry still held in the buffer.
+     * Indices count up from 0 at boot, matching getLogCount().
+     * @return Index of the oldest buffered entry (== getLogCount() if empty)
+     */
+    unsigned long getOldestIndex() const;
+
+    /**
+     * Copy a single entry by its log index.
+     * Used to stream logs one entry at a time without copying the buffer.
+     * @param index Log index (getOldestIndex() <= index < getLogCount())
+     * @param entry Receives a copy of the entry
+     * @return false if the entry has been evicted or does not exist yet
+     */
+    bool getLogEntry(unsigned long index, LogEntry& entry) const;
+
     /**
      * Clear all entries from the log buffer.
      * Note: _totalCount is preserved so clients can detect the clear.
@@ -154,8 +174,11 @@ public:
      */
     void setBufferLogLevel(LogLevel level) { _bufferLogLevel = level; }
 
+    /** @return Minimum level stored in the buffer */
+    LogLevel getBufferLogLevel() const { return _bufferLogLevel; }
+
 private:
-    Logger() = default;
+    Logger();
     ~Logger() = default;
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
@@ -168,6 +191,7 @@ private:
     static const int MAX_LOG_ENTRIES = 100;
     std::vector<LogEntry> _logBuffer;
     unsigned long _totalCount = 0;
+    SemaphoreHandle_t _lock;  // Guards _logBuffer and _totalCount
 
     bool _serialEnabled = true;
     LogLevel _serialLogLevel = LogLevel::DEBUG;
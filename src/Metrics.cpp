@@ -0,0 +1,455 @@
+#include "Metrics.h"
+#include "DeviceSnapshot.h"
+#include "HttpServer.h"
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+// Bucket bounds in microseconds
+static const uint32_t LOOP_BOUNDS[] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000, 100000
+};
+static const uint32_t INPUT_LATENCY_BOUNDS[] = {
+    1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000, 15000000, 30000000
+};
+static const uint32_t HTTP_BOUNDS[] = {
+    1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 5000000
+};
+// Whole milliseconds (esp_ping resolution), around typical DTIM periods
+static const uint32_t WIFI_RTT_BOUNDS[] = {
+    2000, 5000, 10000, 20000, 50000, 100000, 200000, 350000, 500000, 1000000
+};
+
+#define BOUNDS_COUNT(a) (uint8_t)(sizeof(a) / sizeof(a[0]))
+
+// Label values, indexed by the matching enum
+static const char* const TRANSPORT_NAMES[] = {"usb_host", "uart", "telnet"};
+static const char* const HTTP_KIND_NAMES[] = {"api", "static", "metrics"};
+static const char* const SHED_REASON_NAMES[] = {"concurrency", "rate", "heap"};
+static const char* const POWER_STATE_NAMES[] = {"unknown", "waking", "booting", "on", "sleeping"};
+static const char* const BOOT_PHASE_NAMES[] = {"config", "led", "tink", "avr", "switcher", "wifi", "web"};
+static const char* const WIFI_POWER_MODE_NAMES[] = {"performance", "balanced", "low_power"};
+
+const char* const Metrics::CONTENT_TYPE = "text/plain; version=0.0.4";
+
+// --- Histogram ---
+
+Histogram::Histogram(const uint32_t* bounds, uint8_t numBounds)
+    : _bounds(bounds)
+    , _numBounds(numBounds > MAX_BOUNDS ? MAX_BOUNDS : numBounds)
+{
+    memset(&_data, 0, sizeof(_data));
+}
+
+void Histogram::observe(uint32_t us) {
+    uint8_t i = 0;
+    while (i < _numBounds && us > _bounds[i]) i++;
+    _data.buckets[i]++;
+    _data.count++;
+    _data.sum += us;
+}
+
+uint32_t Histogram::percentileBound(const Data& data, uint8_t percent) const {
+    if (data.count == 0) return 0;
+    // Smallest bucket whose cumulative count reaches the rank
+    uint64_t rank = (data.count * percent + 99) / 100;
+    uint64_t cumulative = 0;
+    for (uint8_t i = 0; i < _numBounds; i++) {
+        cumulative += data.buckets[i];
+        if (cumulative >= rank) return _bounds[i];
+    }
+    return UINT32_MAX;
+}
+
+// --- Metrics ---
+
+Metrics& Metrics::instance() {
+    static Metrics instance;
+    return instance;
+}
+
+Metrics::Metrics()
+    : _loopTime(LOOP_BOUNDS, BOUNDS_COUNT(LOOP_BOUNDS))
+    , _loopMaxWindow(0)
+    , _loopLastPublish(0)
+    , _loopMax(0)
+    , _inputChanges(0)
+    , _inputLatency(INPUT_LATENCY_BOUNDS, BOUNDS_COUNT(INPUT_LATENCY_BOUNDS))
+    , _configNvsUs(0)
+    , _configJsonUs(0)
+    , _wifiConnects(0)
+    , _wifiReconnects(0)
+    , _wifiBootConnectUs(0)
+    , _wifiBootConnectFast(false)
+    , _wifiRttPerformance(WIFI_RTT_BOUNDS, BOUNDS_COUNT(WIFI_RTT_BOUNDS))
+    , _wifiRttBalanced(WIFI_RTT_BOUNDS, BOUNDS_COUNT(WIFI_RTT_BOUNDS))
+    , _wifiRttLowPower(WIFI_RTT_BOUNDS, BOUNDS_COUNT(WIFI_RTT_BOUNDS))
+    , _httpApi(HTTP_BOUNDS, BOUNDS_COUNT(HTTP_BOUNDS))
+    , _httpStatic(HTTP_BOUNDS, BOUNDS_COUNT(HTTP_BOUNDS))
+    , _httpMetrics(HTTP_BOUNDS, BOUNDS_COUNT(HTTP_BOUNDS))
+{
+    for (auto& c : _powerTransitions) c.store(0);
+    for (auto& c : _txBytes) c.store(0);
+    for (auto& c : _rxBytes) c.store(0);
+    for (auto& c : _httpShed) c.store(0);
+    for (auto& c : _bootPhaseUs) c.store(0);
+    for (auto& c : _wifiRttLost) c.store(0);
+    _http[(int)HttpKind::API] = &_httpApi;
+    _http[(int)HttpKind::STATIC] = &_httpStatic;
+    _http[(int)HttpKind::METRICS] = &_httpMetrics;
+    _wifiRtt[0] = &_wifiRttPerformance;
+    _wifiRtt[1] = &_wifiRttBalanced;
+    _wifiRtt[2] = &_wifiRttLowPower;
+}
+
+void Metrics::recordLoop(uint32_t us) {
+    _loopTime.observe(us);
+    if (us > _loopMaxWindow) _loopMaxWindow = us;
+
+    unsigned long now = millis();
+    if (now - _loopLastPublish >= LOOP_PUBLISH_INTERVAL_MS) {
+        _loopTime.publish();
+        _loopMax.store(_loopMaxWindow, std::memory_order_relaxed);
+        _loopMaxWindow = 0;
+        _loopLastPublish = now;
+    }
+}
+
+void Metrics::recordInputChange() {
+    _inputChanges.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::recordInputLatency(uint32_t us) {
+    _inputLatency.observe(us);
+    _inputLatency.publish();
+}
+
+void Metrics::recordPowerTransition(int toState) {
+    if (toState >= 0 && toState < POWER_STATE_COUNT) {
+        _powerTransitions[toState].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::addTransportTx(Transport transport, size_t bytes) {
+    _txBytes[(int)transport].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::addTransportRx(Transport transport, size_t bytes) {
+    _rxBytes[(int)transport].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+const char* Metrics::transportName(Transport transport) {
+    return TRANSPORT_NAMES[(int)transport];
+}
+
+void Metrics::recordBootPhase(BootPhase phase, uint32_t us) {
+    _bootPhaseUs[(int)phase].store(us, std::memory_order_relaxed);
+}
+
+void Metrics::recordConfigLoad(bool migrated, uint32_t loadUs) {
+    _configNvsUs.store(migrated ? 0 : loadUs, std::memory_order_relaxed);
+    _configJsonUs.store(migrated ? loadUs : 0, std::memory_order_relaxed);
+}
+
+void Metrics::recordWifiConnected(bool fast) {
+    if (_wifiConnects++ > 0) {
+        _wifiReconnects.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // Time since the chip started, not since setup() (includes ROM boot)
+        int64_t us = esp_timer_get_time();
+        _wifiBootConnectFast.store(fast, std::memory_order_relaxed);
+        _wifiBootConnectUs.store(us > UINT32_MAX ? UINT32_MAX : (uint32_t)us, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::recordWifiRtt(uint8_t mode, uint32_t us) {
+    if (mode >= WIFI_POWER_MODE_COUNT) return;
+    _wifiRtt[mode]->observe(us);
+    _wifiRtt[mode]->publish();
+}
+
+void Metrics::recordWifiRttLost(uint8_t mode) {
+    if (mode >= WIFI_POWER_MODE_COUNT) return;
+    _wifiRttLost[mode].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t Metrics::readWifiRtt(uint8_t mode, Histogram::Data& data) const {
+    if (mode >= WIFI_POWER_MODE_COUNT) {
+        memset(&data, 0, sizeof(data));
+        return 0;
+    }
+    _wifiRtt[mode]->read(data);
+    return _wifiRttLost[mode].load(std::memory_order_relaxed);
+}
+
+void Metrics::recordHttpRequest(HttpKind kind, uint32_t us) {
+    Histogram* h = _http[(int)kind];
+    h->observe(us);
+    h->publish();
+}
+
+void Metrics::recordHttpShed(ShedReason reason) {
+    _httpShed[(int)reason].fetch_add(1, std::memory_order_relaxed);
+}
+
+Metrics::HttpKind Metrics::classify(const String& url) {
+    if (url.startsWith("/api/")) return HttpKind::API;
+    if (url == "/metrics") return HttpKind::METRICS;
+    return HttpKind::STATIC;
+}
+
+// --- Exposition ---
+
+/** Append "# HELP" and "# TYPE" lines. */
+static void appendHeader(String& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+/** Append one sample line; label may be nullptr. */
+static void appendSample(String& out, const char* name, const char* labelName,
+                         const char* labelValue, const char* value) {
+    out += name;
+    if (labelName) {
+        out += '{';
+        out += labelName;
+        out += "=\"";
+        out += labelValue;
+        out += "\"}";
+    }
+    out += ' ';
+    out += value;
+    out += '\n';
+}
+
+static void appendSample(String& out, const char* name, const char* labelName,
+                         const char* labelValue, uint64_t value) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value);
+    appendSample(out, name, labelName, labelValue, buf);
+}
+
+static void appendSeconds(String& out, const char* name, const char* labelName,
+                          const char* labelValue, uint64_t us) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%.6f", us / 1e6);
+    appendSample(out, name, labelName, labelValue, buf);
+}
+
+void Metrics::renderHistogram(String& out, const char* name, const char* help,
+                              const char* labelName, const char* const* labelValues,
+                              const Histogram* const* histograms, size_t count) {
+    appendHeader(out, name, "histogram", help);
+
+    char metric[64];
+    char line[160];
+    for (size_t h = 0; h < count; h++) {
+        Histogram::Data data;
+        histograms[h]->read(data);
+
+        // Optional leading label, e.g. kind="api",
+        char label[32] = "";
+        if (labelName) {
+            snprintf(label, sizeof(label), "%s=\"%s\",", labelName, labelValues[h]);
+        }
+
+        uint64_t cumulative = 0;
+        for (uint8_t i = 0; i <= histograms[h]->getNumBounds(); i++) {
+            cumulative += data.buckets[i];
+            char le[16];
+            if (i < histograms[h]->getNumBounds()) {
+                snprintf(le, sizeof(le), "%g", histograms[h]->getBound(i) / 1e6);
+            } else {
+                strcpy(le, "+Inf");
+            }
+            snprintf(line, sizeof(line), "%s_bucket{%sle=\"%s\"} %llu\n",
+                     name, label, le, (unsigned long long)cumulative);
+            out += line;
+        }
+
+        const char* labelValue = labelName ? labelValues[h] : nullptr;
+        snprintf(metric, sizeof(metric), "%s_sum", name);
+        appendSeconds(out, metric, labelName, labelValue, data.sum);
+        snprintf(metric, sizeof(metric), "%s_count", name);
+        appendSample(out, metric, labelName, labelValue, data.count);
+    }
+}
+
+bool Metrics::render(size_t index, const DeviceSnapshot& snap, String& out) const {
+    switch (index) {
+        case 0:
+            appendHeader(out, "tinklink_uptime_seconds", "gauge", "Time since boot");
+            appendSample(out, "tinklink_uptime_seconds", nullptr, nullptr, (uint64_t)(millis() / 1000));
+            return true;
+
+        case 1: {
+            const Histogram* h = &_loopTime;
+            renderHistogram(out, "tinklink_loop_duration_seconds",
+                            "Duration of main loop iterations", nullptr, nullptr, &h, 1);
+            return true;
+        }
+
+        case 2:
+            appendHeader(out, "tinklink_loop_duration_max_seconds", "gauge",
+                         "Longest main loop iteration in the last second");
+            appendSeconds(out, "tinklink_loop_duration_max_seconds", nullptr, nullptr,
+                          _loopMax.load(std::memory_order_relaxed));
+            return true;
+
+        case 3:
+            appendHeader(out, "tinklink_heap_free_bytes", "gauge", "Free heap");
+            appendSample(out, "tinklink_heap_free_bytes", "type", "internal",
+                         (uint64_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+            appendSample(out, "tinklink_heap_free_bytes", "type", "psram",
+                         (uint64_t)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+            return true;
+
+        case 4:
+            appendHeader(out, "tinklink_heap_largest_free_block_bytes", "gauge",
+                         "Largest allocatable heap block");
+            appendSample(out, "tinklink_heap_largest_free_block_bytes", "type", "internal",
+                         (uint64_t)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+            appendSample(out, "tinklink_heap_largest_free_block_bytes", "type", "psram",
+                         (uint64_t)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+            return true;
+
+        case 5:
+            appendHeader(out, "tinklink_input_changes_total", "counter", "Switcher input changes");
+            appendSample(out, "tinklink_input_changes_total", nullptr, nullptr,
+                         (uint64_t)_inputChanges.load(std::memory_order_relaxed));
+            return true;
+
+        case 6: {
+            const Histogram* h = &_inputLatency;
+            renderHistogram(out, "tinklink_input_change_latency_seconds",
+                            "Time from switcher input change to RetroTINK command sent",
+                            nullptr, nullptr, &h, 1);
+            return true;
+        }
+
+        case 7:
+            appendHeader(out, "tinklink_rt4k_power_transitions_total", "counter",
+                         "RetroTINK power state transitions by new state");
+            for (uint8_t i = 0; i < POWER_STATE_COUNT; i++) {
+                appendSample(out, "tinklink_rt4k_power_transitions_total", "state",
+                             POWER_STATE_NAMES[i],
+                             (uint64_t)_powerTransitions[i].load(std::memory_order_relaxed));
+            }
+            return true;
+
+        case 8:
+            appendHeader(out, "tinklink_rt4k_power_state", "gauge",
+                         "Current RetroTINK power state (1 = active)");
+            for (uint8_t i = 0; i < POWER_STATE_COUNT; i++) {
+                bool active = snap.tinkPowerState && strcmp(snap.tinkPowerState, POWER_STATE_NAMES[i]) == 0;
+                appendSample(out, "tinklink_rt4k_power_state", "state", POWER_STATE_NAMES[i],
+                             (uint64_t)(active ? 1 : 0));
+            }
+            return true;
+
+        case 9:
+        case 10: {
+            bool tx = index == 9;
+            const char* name = tx ? "tinklink_transport_tx_bytes_total" : "tinklink_transport_rx_bytes_total";
+            appendHeader(out, name, "counter", tx ? "Bytes sent per serial transport"
+                                                  : "Bytes received per serial transport");
+            const std::atomic<uint32_t>* counters = tx ? _txBytes : _rxBytes;
+            for (int i = 0; i < (int)Transport::COUNT; i++) {
+                appendSample(out, name, "transport", TRANSPORT_NAMES[i],
+                             (uint64_t)counters[i].load(std::memory_order_relaxed));
+            }
+            return true;
+        }
+
+        case 11: {
+            appendHeader(out, "tinklink_wifi_rssi_dbm", "gauge", "WiFi signal strength (0 when not connected)");
+            char buf[12];
+            snprintf(buf, sizeof(buf), "%d", (int)snap.wifiRssi);
+            appendSample(out, "tinklink_wifi_rssi_dbm", nullptr, nullptr, buf);
+            return true;
+        }
+
+        case 12:
+            appendHeader(out, "tinklink_wifi_reconnects_total", "counter",
+                         "WiFi station connections after the first");
+            appendSample(out, "tinklink_wifi_reconnects_total", nullptr, nullptr,
+                         (uint64_t)_wifiReconnects.load(std::memory_order_relaxed));
+            return true;
+
+        case 13:
+            renderHistogram(out, "tinklink_http_request_duration_seconds",
+                            "HTTP requests from headers received to connection closed",
+                            "kind", HTTP_KIND_NAMES, _http, (size_t)HttpKind::COUNT);
+            return true;
+
+        case 14:
+            appendHeader(out, "tinklink_http_shed_total", "counter",
+                         "HTTP requests answered with 503 by admission control");
+            for (int i = 0; i < (int)ShedReason::COUNT; i++) {
+                appendSample(out, "tinklink_http_shed_total", "reason", SHED_REASON_NAMES[i],
+                             (uint64_t)_httpShed[i].load(std::memory_order_relaxed));
+            }
+            return true;
+
+        case 15:
+            appendHeader(out, "tinklink_http_backend_info", "gauge", "HTTP server backend in this build");
+            appendSample(out, "tinklink_http_backend_info", "backend", HttpServer::BACKEND, (uint64_t)1);
+            return true;
+
+        case 16:
+            appendHeader(out, "tinklink_heap_min_free_bytes", "gauge", "Lowest free internal heap since boot");
+            appendSample(out, "tinklink_heap_min_free_bytes", nullptr, nullptr,
+                         (uint64_t)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+            return true;
+
+        case 17:
+            appendHeader(out, "tinklink_boot_phase_seconds", "gauge", "Duration of each setup step this boot");
+            for (int i = 0; i < (int)BootPhase::COUNT; i++) {
+                appendSeconds(out, "tinklink_boot_phase_seconds", "phase", BOOT_PHASE_NAMES[i],
+                              _bootPhaseUs[i].load(std::memory_order_relaxed));
+            }
+            return true;
+
+        case 18:
+            appendHeader(out, "tinklink_config_load_seconds", "gauge",
+                         "Config load from NVS this boot, or the import from "
+                         "config.json/wifi.json on the first boot (0 if not taken)");
+            appendSeconds(out, "tinklink_config_load_seconds", "source", "nvs",
+                          _configNvsUs.load(std::memory_order_relaxed));
+            appendSeconds(out, "tinklink_config_load_seconds", "source", "json",
+                          _configJsonUs.load(std::memory_order_relaxed));
+            return true;
+
+        case 19:
+            appendHeader(out, "tinklink_wifi_boot_connect_seconds", "gauge",
+                         "Time from power-on or restart to the first WiFi connection (0 until connected)");
+            appendSeconds(out, "tinklink_wifi_boot_connect_seconds", "path",
+                          _wifiBootConnectFast.load(std::memory_order_relaxed) ? "fast" : "scan",
+                          _wifiBootConnectUs.load(std::memory_order_relaxed));
+            return true;
+
+        case 20:
+            renderHistogram(out, "tinklink_wifi_rtt_seconds",
+                            "Round trip to the WiFi gateway by power mode (1 ms resolution)",
+                            "mode", WIFI_POWER_MODE_NAMES, _wifiRtt, WIFI_POWER_MODE_COUNT);
+            return true;
+
+        case 21:
+            appendHeader(out, "tinklink_wifi_rtt_lost_total", "counter",
+                         "Gateway probe requests without a reply by power mode");
+            for (uint8_t i = 0; i < WIFI_POWER_MODE_COUNT; i++) {
+                appendSample(out, "tinklink_wifi_rtt_lost_total", "mode", WIFI_POWER_MODE_NAMES[i],
+                             (uint64_t)_wifiRttLost[i].load(std::memory_order_relaxed));
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,264 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Seqlock.h"
+
+struct DeviceSnapshot;
+
+/**
+ * Bucketed distribution of a value in microseconds.
+ *
+ * Each histogram has exactly one writing task. observe() updates a private
+ * copy; publish() makes it visible to readers on other tasks through a
+ * Seqlock, so hot paths can observe often and publish rarely.
+ */
+class Histogram {
+public:
+    static const uint8_t MAX_BOUNDS = 10;
+
+    /** Published histogram contents */
+    struct Data {
+        uint64_t buckets[MAX_BOUNDS + 1];  ///< Per-bucket counts (not cumulative), last is +Inf
+        uint64_t count;
+        uint64_t sum;                      ///< Sum of observations in microseconds
+    };
+
+    /**
+     * @param bounds Ascending bucket upper bounds in microseconds (static storage)
+     * @param numBounds Number of bounds (at most MAX_BOUNDS)
+     */
+    Histogram(const uint32_t* bounds, uint8_t numBounds);
+
+    /** Record one observation (writer task only). */
+    void observe(uint32_t us);
+
+    /** Make observations so far visible to read() (writer task only). */
+    void publish() { _published.store(_data); }
+
+    /** Copy the last published contents (any task). */
+    void read(Data& out) const { _published.load(out); }
+
+    /**
+     * Upper bound of the bucket holding a percentile of the observations.
+     * @param data Contents from read()
+     * @param percent Percentile, 1-100
+     * @return Bound in microseconds; UINT32_MAX past the last bound, 0 if empty
+     */
+    uint32_t percentileBound(const Data& data, uint8_t percent) const;
+
+    uint8_t getNumBounds() const { return _numBounds; }
+    uint32_t getBound(uint8_t i) const { return _bounds[i]; }
+
+private:
+    const uint32_t* _bounds;
+    uint8_t _numBounds;
+    Data _data;
+    Seqlock<Data> _published;
+};
+
+/**
+ * Runtime counters exposed at /metrics in Prometheus text format.
+ *
+ * Components record events as they happen (counters are relaxed atomics,
+ * histograms are single-writer); render() formats one metric family per
+ * call so the endpoint can stream the exposition straight from the
+ * counters without building a document.
+ *
+ * Usage:
+ *   Metrics::instance().recordInputChange();
+ *   while (Metrics::instance().render(i++, snapshot, out)) { ... }
+ */
+class Metrics {
+public:
+    /** Serial transports with byte counters */
+    enum class Transport : uint8_t { USB_HOST, UART, TELNET, COUNT };
+
+    /** Coarse request classes for HTTP timing */
+    enum class HttpKind : uint8_t { API, STATIC, METRICS, COUNT };
+
+    /** Reasons an HTTP request is shed by admission control */
+    enum class ShedReason : uint8_t { CONCURRENCY, RATE, HEAP, COUNT };
+
+    /** Steps of setup(), timed once per boot */
+    enum class BootPhase : uint8_t { CONFIG, LED, TINK, AVR, SWITCHER, WIFI, WEB, COUNT };
+
+    /** Number of RT4KPowerState values */
+    static const uint8_t POWER_STATE_COUNT = 5;
+
+    /** Number of WifiPowerMode values */
+    static const uint8_t WIFI_POWER_MODE_COUNT = 3;
+
+    /**
+     * Get the singleton Metrics instance.
+     * @return Reference to the global Metrics
+     */
+    static Metrics& instance();
+
+    /**
+     * Record the duration of one loop() iteration (loop task only).
+     * Published to readers about once per second.
+     * @param us Iteration time in microseconds
+     */
+    void recordLoop(uint32_t us);
+
+    /** Count a switcher input change (loop task only). */
+    void recordInputChange();
+
+    /**
+     * Record the time from an input change to its RetroTINK command being sent.
+     * @param us Latency in microseconds
+     */
+    void recordInputLatency(uint32_t us);
+
+    /**
+     * Count an RT4K power state transition.
+     * @param toState New state (RT4KPowerState cast to int)
+     */
+    void recordPowerTransition(int toState);
+
+    /** Count bytes written to a transport. */
+    void addTransportTx(Transport transport, size_t bytes);
+
+    /** Count bytes read from a transport. */
+    void addTransportRx(Transport transport, size_t bytes);
+
+    /** @return Bytes written to a transport since boot (any task) */
+    uint32_t getTransportTx(Transport transport) const {
+        return _txBytes[(int)transport].load(std::memory_order_relaxed);
+    }
+
+    /** @return Bytes read from a transport since boot (any task) */
+    uint32_t getTransportRx(Transport transport) const {
+        return _rxBytes[(int)transport].load(std::memory_order_relaxed);
+    }
+
+    /** Label value of a transport ("usb_host", "uart", "telnet") */
+    static const char* transportName(Transport transport);
+
+    /**
+     * Record how long a setup() step took (setup only).
+     * @param phase Step
+     * @param us Duration in microseconds
+     */
+    void recordBootPhase(BootPhase phase, uint32_t us);
+
+    /**
+     * Record how the configuration was loaded at boot.
+     * @param migrated true if config.json/wifi.json were imported into NVS
+     * @param loadUs Total load time in microseconds
+     */
+    void recordConfigLoad(bool migrated, uint32_t loadUs);
+
+    /**
+     * Count a successful WiFi station connection (loop task only). The
+     * first one since boot also records the boot-to-connected time.
+     * @param fast true if it went straight to the cached AP (no scan)
+     */
+    void recordWifiConnected(bool fast);
+
+    /**
+     * Record a WiFi round trip (LatencyProbe ping task only).
+     * @param mode WifiPowerMode in effect, cast to int
+     * @param us Round-trip time in microseconds
+     */
+    void recordWifiRtt(uint8_t mode, uint32_t us);
+
+    /** Count a probe request that got no reply (LatencyProbe ping task only). */
+    void recordWifiRttLost(uint8_t mode);
+
+    /**
+     * Read the round trips recorded under one power mode (any task).
+     * @param mode WifiPowerMode cast to int
+     * @param data Receives the histogram
+     * @return Requests lost under that mode
+     */
+    uint32_t readWifiRtt(uint8_t mode, Histogram::Data& data) const;
+
+    /** Round-trip histogram of a power mode, for its bucket bounds (mode < WIFI_POWER_MODE_COUNT) */
+    const Histogram& wifiRttHistogram(uint8_t mode) const { return *_wifiRtt[mode]; }
+
+    /**
+     * Record a completed HTTP request (HTTP server task only).
+     * @param kind Request class
+     * @param us Time from headers received to connection closed, in microseconds
+     */
+    void recordHttpRequest(HttpKind kind, uint32_t us);
+
+    /** Count a request answered with 503 by admission control. */
+    void recordHttpShed(ShedReason reason);
+
+    /**
+     * Classify a request URL.
+     * @param url Request path
+     * @return Request class
+     */
+    static HttpKind classify(const String& url);
+
+    /**
+     * Format one metric family in Prometheus text format.
+     * @param index Family index, starting at 0
+     * @param snap Current device snapshot (WiFi RSSI, RT4K state)
+     * @param out String to append to
+     * @return false once index is past the last family
+     */
+    bool render(size_t index, const DeviceSnapshot& snap, String& out) const;
+
+    /** Content type of the exposition format */
+    static const char* const CONTENT_TYPE;
+
+private:
+    Metrics();
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    static const unsigned long LOOP_PUBLISH_INTERVAL_MS = 1000;
+
+    // Loop timing (loop task)
+    Histogram _loopTime;
+    uint32_t _loopMaxWindow;
+    unsigned long _loopLastPublish;
+    std::atomic<uint32_t> _loopMax;  ///< Longest iteration in the last window
+
+    // Input changes and RT4K power (loop task)
+    std::atomic<uint32_t> _inputChanges;
+    Histogram _inputLatency;
+    std::atomic<uint32_t> _powerTransitions[POWER_STATE_COUNT];
+
+    // Transports (loop task, USB host callbacks)
+    std::atomic<uint32_t> _txBytes[(int)Transport::COUNT];
+    std::atomic<uint32_t> _rxBytes[(int)Transport::COUNT];
+
+    // Boot (setup, before and while the HTTP server starts)
+    std::atomic<uint32_t> _bootPhaseUs[(int)BootPhase::COUNT];
+    std::atomic<uint32_t> _configNvsUs;   ///< 0 when migrated this boot
+    std::atomic<uint32_t> _configJsonUs;  ///< 0 unless migrated this boot
+
+    // WiFi (loop task)
+    uint32_t _wifiConnects;
+    std::atomic<uint32_t> _wifiReconnects;
+    std::atomic<uint32_t> _wifiBootConnectUs;  ///< 0 until the first connection
+    std::atomic<bool> _wifiBootConnectFast;
+
+    // WiFi round trips per power mode (LatencyProbe ping task)
+    Histogram* _wifiRtt[WIFI_POWER_MODE_COUNT];
+    Histogram _wifiRttPerformance;
+    Histogram _wifiRttBalanced;
+    Histogram _wifiRttLowPower;
+    std::atomic<uint32_t> _wifiRttLost[WIFI_POWER_MODE_COUNT];
+
+    // HTTP (HTTP server task)
+    Histogram* _http[(int)HttpKind::COUNT];
+    Histogram _httpApi;
+    Histogram _httpStatic;
+    Histogram _httpMetrics;
+    std::atomic<uint32_t> _httpShed[(int)ShedReason::COUNT];
+
+    /** Append a histogram family. */
+    static void renderHistogram(String& out, const char* name, const char* help,
+                                const char* labelName, const char* const* labelValues,
+                                const Histogram* const* histograms, size_t count);
+};
+
+#endif // METRICS_H
@@ -0,0 +1,167 @@
+#include "OtaSession.h"
+#include "Logger.h"
+#include <esp_rom_crc.h>
+
+OtaSession::OtaSession(OtaWriter& writer)
+    : _writer(writer)
+    , _active(false)
+    , _mode(OTAMode::FIRMWARE)
+    , _size(0)
+    , _offset(0)
+    , _lastActivity(0)
+    , _chunkBuf(nullptr)
+    , _chunkOffset(0)
+    , _chunkLen(0)
+    , _chunkReceived(0)
+    , _chunkCrc(0)
+    , _chunkValid(false)
+{
+}
+
+OtaSession::~OtaSession() {
+    if (_chunkBuf) free(_chunkBuf);
+}
+
+bool OtaSession::start(OTAMode mode, size_t size, const String& sha256) {
+    String digest = sha256;
+    digest.toLowerCase();
+
+    // Same image as the open session - resume where it left off
+    if (_active && mode == _mode && size == _size && digest == _sha256) {
+        _lastActivity = millis();
+        LOG_INFO("OTA: Resuming session at offset %u of %u", _offset, _size);
+        return true;
+    }
+
+    if (_active) {
+        abort("replaced by new session");
+    }
+
+    if (size == 0 || digest.length() != 64) {
+        _error = "size and 64-character sha256 are required";
+        return false;
+    }
+
+    if (!_writer.begin(mode, digest)) {
+        _error = _writer.getError();
+        return false;
+    }
+
+    if (!_chunkBuf) {
+        _chunkBuf = (uint8_t*)malloc(MAX_CHUNK_SIZE);
+        if (!_chunkBuf) {
+            _writer.abort();
+            _error = "Out of memory for chunk buffer";
+            return false;
+        }
+    }
+
+    _active = true;
+    _mode = mode;
+    _size = size;
+    _offset = 0;
+    _sha256 = digest;
+    _error = "";
+    _chunkValid = false;
+    _lastActivity = millis();
+
+    LOG_INFO("OTA: Session started (%s, %u bytes)",
+             mode == OTAMode::FILESYSTEM ? "filesystem" : "firmware", size);
+    return true;
+}
+
+bool OtaSession::beginChunk(size_t offset, size_t len, uint32_t crc32) {
+    _chunkValid = false;
+    if (!_active || len == 0 || len > MAX_CHUNK_SIZE) {
+        return false;
+    }
+
+    _chunkOffset = offset;
+    _chunkLen = len;
+    _chunkReceived = 0;
+    _chunkCrc = crc32;
+    _chunkValid = true;
+    _lastActivity = millis();
+    return true;
+}
+
+void OtaSession::appendChunk(const uint8_t* data, size_t len, size_t index) {
+    if (!_chunkValid || index + len > _chunkLen) {
+        _chunkValid = false;
+        return;
+    }
+    memcpy(_chunkBuf + index, data, len);
+    _chunkReceived += len;
+    _lastActivity = millis();
+}
+
+OtaSession::ChunkResult OtaSession::commitChunk() {
+    if (!_active) return ChunkResult::NO_SESSION;
+
+    bool complete = _chunkValid && _chunkReceived == _chunkLen;
+    _chunkValid = false;
+
+    if (!complete) return ChunkResult::BAD_CRC;
+
+    // Retransmit of data we already have (e.g. the ack was lost)
+    if (_chunkOffset + _chunkLen <= _offset) return ChunkResult::DUPLICATE;
+    if (_chunkOffset != _offset) return ChunkResult::OUT_OF_ORDER;
+
+    // esp_rom_crc32_le(0, ...) matches zlib's crc32()
+    if (esp_rom_crc32_le(0, _chunkBuf, _chunkLen) != _chunkCrc) {
+        LOG_WARN("OTA: CRC mismatch for chunk at offset %u", _chunkOffset);
+        return ChunkResult::BAD_CRC;
+    }
+
+    if (_offset + _chunkLen > _size) {
+        abort("chunk past declared size");
+        _error = "Chunk past declared size";
+        return ChunkResult::ERROR;
+    }
+
+    if (!_writer.write(_chunkBuf, _chunkLen)) {
+        _error = _writer.getError();
+        abort("write failed");
+        return ChunkResult::ERROR;
+    }
+
+    _offset += _chunkLen;
+    _lastActivity = millis();
+    return ChunkResult::COMMITTED;
+}
+
+bool OtaSession::finish() {
+    if (!_active) {
+        _error = "No active session";
+        return false;
+    }
+    if (_offset != _size) {
+        _error = "Upload incomplete (" + String(_offset) + " of " + String(_size) + " bytes)";
+        return false;
+    }
+
+    bool ok = _writer.end();
+    if (!ok) _error = _writer.getError();
+    _active = false;
+    free(_chunkBuf);
+    _chunkBuf = nullptr;
+    return ok;
+}
+
+void OtaSession::abort(const char* reason) {
+    if (!_active) return;
+
+    LOG_WARN("OTA: Session aborted at %u of %u bytes (%s)", _offset, _size, reason);
+    _writer.abort();
+    _active = false;
+    _chunkValid = false;
+    free(_chunkBuf);
+    _chunkBuf = nullptr;
+}
+
+void OtaSession::checkTimeout() {
+    if (_active && millis() - _lastActivity >= SESSION_TIMEOUT_MS) {
+        abort("idle timeout");
+        _error = "Session timed out";
+    }
+}
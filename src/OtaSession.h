@@ -0,0 +1,140 @@
+#ifndef OTA_SESSION_H
+#define OTA_SESSION_H
+
+#include <Arduino.h>
+#include "OtaWriter.h"
+
+/**
+ * Resumable, chunked OTA upload session.
+ *
+ * Lets a client upload an image as a series of independently checksummed
+ * chunks, so a dropped connection only costs the chunk in flight:
+ *
+ * 1. start()   - open a session for an image of known size and SHA-256.
+ *                Starting again with the same size/digest/mode resumes the
+ *                existing session instead of restarting it.
+ * 2. chunks    - each chunk carries its byte offset and CRC32. It is
+ *                buffered in full, checked, and only then written through
+ *                OtaWriter. The committed offset advances per chunk.
+ * 3. getOffset() lets a reconnecting client find where to continue.
+ * 4. finish()  - verify the digest and commit the update.
+ *
+ * Sessions with no chunk activity for SESSION_TIMEOUT_MS are aborted by
+ * checkTimeout(), which discards the half-written partition.
+ *
+ * Not thread-safe: every call, checkTimeout() included, must come from the
+ * HTTP task that feeds the chunks, so an abort can never free the chunk
+ * buffer while a body is being copied into it.
+ *
+ * Offsets and sizes refer to the bytes as uploaded (compressed if gzip).
+ */
+class OtaSession {
+public:
+    /** Outcome of a received chunk */
+    enum class ChunkResult {
+        COMMITTED,     ///< Written, offset advanced
+        DUPLICATE,     ///< Already committed earlier (retransmit), ignored
+        OUT_OF_ORDER,  ///< Offset ahead of committed offset
+        BAD_CRC,       ///< Checksum mismatch, client should resend
+        NO_SESSION,    ///< No active session
+        ERROR          ///< Write failure, session aborted (see getError())
+    };
+
+    /**
+     * Create a session manager writing through the given writer.
+     * @param writer OTA writer shared with the single-request upload path
+     */
+    explicit OtaSession(OtaWriter& writer);
+    ~OtaSession();
+
+    /**
+     * Start or resume a session.
+     * @param mode Firmware or filesystem
+     * @param size Total upload size in bytes
+     * @param sha256 Hex SHA-256 of the uncompressed image
+     * @return true if a session is active (new or resumed)
+     */
+    bool start(OTAMode mode, size_t size, const String& sha256);
+
+    /**
+     * Begin receiving a chunk.
+     * @param offset Byte offset of the chunk within the upload
+     * @param len Chunk length (at most MAX_CHUNK_SIZE)
+     * @param crc32 CRC32 (zlib polynomial) of the chunk
+     * @return false if the chunk cannot be accepted (too large, no session)
+     */
+    bool beginChunk(size_t offset, size_t len, uint32_t crc32);
+
+    /**
+     * Copy part of the chunk body into the chunk buffer.
+     * @param data Body data
+     * @param len Body data length
+     * @param index Position of this data within the chunk
+     */
+    void appendChunk(const uint8_t* data, size_t len, size_t index);
+
+    /**
+     * Check and write the buffered chunk.
+     * @return Result of the chunk
+     */
+    ChunkResult commitChunk();
+
+    /**
+     * Finish the session: verify and commit the image.
+     * @return true if the update was committed
+     */
+    bool finish();
+
+    /**
+     * Abort the session and discard the partial update.
+     * @param reason Logged reason
+     */
+    void abort(const char* reason);
+
+    /** Abort the session if idle for longer than SESSION_TIMEOUT_MS. */
+    void checkTimeout();
+
+    /** @return true while a session is open */
+    bool isActive() const { return _active; }
+
+    /** @return Bytes committed so far */
+    size_t getOffset() const { return _offset; }
+
+    /** @return Total upload size */
+    size_t getSize() const { return _size; }
+
+    /** @return Update mode of the session */
+    OTAMode getMode() const { return _mode; }
+
+    /** @return Expected SHA-256 of the session */
+    const String& getSha256() const { return _sha256; }
+
+    /** @return Error from the last failure */
+    const String& getError() const { return _error; }
+
+    /** Largest accepted chunk */
+    static const size_t MAX_CHUNK_SIZE = 8192;
+
+    /** Idle time after which a session is abandoned */
+    static const unsigned long SESSION_TIMEOUT_MS = 120000;
+
+private:
+    OtaWriter& _writer;
+    bool _active;
+    OTAMode _mode;
+    size_t _size;
+    size_t _offset;
+    String _sha256;
+    String _error;
+    unsigned long _lastActivity;
+
+    // Chunk being received
+    uint8_t* _chunkBuf;
+    size_t _chunkOffset;
+    size_t _chunkLen;
+    size_t _chunkReceived;
+    uint32_t _chunkCrc;
+    bool _chunkValid;
+};
+
+#endif // OTA_SESSION_H
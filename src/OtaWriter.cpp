@@ -0,0 +1,339 @@
+#include "OtaWriter.h"
+#include "Logger.h"
+#include <LittleFS.h>
+#include <Update.h>
+#include <atomic>
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#include "esp32s3/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32C3
+#include "esp32c3/rom/miniz.h"
+#else
+#include "rom/miniz.h"
+#endif
+
+// gzip header flag bits (RFC 1952)
+static const uint8_t GZ_FLAG_HCRC = 0x02;
+static const uint8_t GZ_FLAG_EXTRA = 0x04;
+static const uint8_t GZ_FLAG_NAME = 0x08;
+static const uint8_t GZ_FLAG_COMMENT = 0x10;
+static const size_t GZ_HEADER_SIZE = 10;
+
+const char* const OtaWriter::BUSY_ERROR = "Another update is in progress";
+
+/// Held by the writer between begin() and end()/abort(), whichever task it runs on
+static std::atomic<bool> s_updateBusy(false);
+
+bool OtaWriter::isBusy() {
+    return s_updateBusy.load();
+}
+
+OtaWriter::OtaWriter()
+    : _active(false)
+    , _mode(OTAMode::FIRMWARE)
+    , _firstChunk(false)
+    , _compressed(false)
+    , _written(0)
+    , _gzState(GzState::HEADER)
+    , _gzFlags(0)
+    , _gzFieldRemaining(0)
+    , _gzTrailerLen(0)
+    , _inflator(nullptr)
+    , _dict(nullptr)
+    , _dictOfs(0)
+{
+    mbedtls_sha256_init(&_shaCtx);
+}
+
+OtaWriter::~OtaWriter() {
+    if (_active) abort();
+    freeBuffers();
+    mbedtls_sha256_free(&_shaCtx);
+}
+
+bool OtaWriter::begin(OTAMode mode, const String& expectedSha256) {
+    if (_active) abort();
+
+    _error = "";
+    _sha256 = "";
+    _written = 0;
+    _firstChunk = true;
+    _compressed = false;
+    _expectedSha256 = expectedSha256;
+    _expectedSha256.trim();
+    _expectedSha256.toLowerCase();
+
+    if (_expectedSha256.length() > 0 && _expectedSha256.length() != 64) {
+        fail("Invalid sha256 (expected 64 hex characters)");
+        return false;
+    }
+
+    // Claimed before anything is touched, so a refused update leaves LittleFS mounted
+    bool idle = false;
+    if (!s_updateBusy.compare_exchange_strong(idle, true)) {
+        fail(BUSY_ERROR);
+        return false;
+    }
+    _mode = mode;
+
+    // For filesystem updates, unmount LittleFS first
+    if (mode == OTAMode::FILESYSTEM) {
+        LittleFS.end();
+    }
+
+    int updateCommand = (mode == OTAMode::FILESYSTEM) ? U_SPIFFS : U_FLASH;
+    if (!Update.begin(UPDATE_SIZE_UNKNOWN, updateCommand)) {
+        fail(Update.errorString());
+        release(true);
+        return false;
+    }
+
+    mbedtls_sha256_starts(&_shaCtx, 0);  // 0 = SHA-256 (not SHA-224)
+    _active = true;
+    return true;
+}
+
+bool OtaWriter::write(const uint8_t* data, size_t len) {
+    if (!_active) return false;
+    if (len == 0) return true;
+
+    // gzip images are recognised by their magic bytes
+    if (_firstChunk) {
+        _firstChunk = false;
+        if (len >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+            _inflator = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+            _dict = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+            if (!_inflator || !_dict) {
+                fail("Out of memory for decompression");
+                abort();
+                return false;
+            }
+            tinfl_init(_inflator);
+            _dictOfs = 0;
+            _gzState = GzState::HEADER;
+            _gzFieldRemaining = GZ_HEADER_SIZE;
+            _gzTrailerLen = 0;
+            _compressed = true;
+            LOG_INFO("OTA: gzip-compressed image, decompressing on the fly");
+        }
+    }
+
+    bool ok = _compressed ? writeCompressed(data, len) : writeOut(data, len);
+    if (!ok) abort();
+    return ok;
+}
+
+bool OtaWriter::writeOut(const uint8_t* data, size_t len) {
+    if (Update.write(const_cast<uint8_t*>(data), len) != len) {
+        fail(Update.errorString());
+        return false;
+    }
+    mbedtls_sha256_update(&_shaCtx, data, len);
+    _written += len;
+    return true;
+}
+
+bool OtaWriter::writeCompressed(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        uint8_t c = *data;
+
+        switch (_gzState) {
+            case GzState::HEADER: {
+                size_t pos = GZ_HEADER_SIZE - _gzFieldRemaining;
+                if ((pos == 0 && c != 0x1f) || (pos == 1 && c != 0x8b) || (pos == 2 && c != 8)) {
+                    fail("Unsupported gzip header");
+                    return false;
+                }
+                if (pos == 3) _gzFlags = c;
+                data++; len--;
+                if (--_gzFieldRemaining == 0) {
+                    _gzTrailerLen = 0;
+                    _gzState = (_gzFlags & GZ_FLAG_EXTRA) ? GzState::EXTRA_LEN
+                             : (_gzFlags & GZ_FLAG_NAME) ? GzState::NAME
+                             : (_gzFlags & GZ_FLAG_COMMENT) ? GzState::COMMENT
+                             : (_gzFlags & GZ_FLAG_HCRC) ? GzState::HEADER_CRC
+                             : GzState::DEFLATE;
+                    if (_gzState == GzState::HEADER_CRC) _gzFieldRemaining = 2;
+                }
+                break;
+            }
+
+            case GzState::EXTRA_LEN:
+                _gzTrailer[_gzTrailerLen++] = c;
+                data++; len--;
+                if (_gzTrailerLen == 2) {
+                    _gzFieldRemaining = _gzTrailer[0] | (_gzTrailer[1] << 8);
+                    _gzState = GzState::EXTRA;
+                }
+                break;
+
+            case GzState::EXTRA:
+                if (_gzFieldRemaining == 0) {
+                    _gzState = (_gzFlags & GZ_FLAG_NAME) ? GzState::NAME
+                             : (_gzFlags & GZ_FLAG_COMMENT) ? GzState::COMMENT
+                             : (_gzFlags & GZ_FLAG_HCRC) ? GzState::HEADER_CRC
+                             : GzState::DEFLATE;
+                    if (_gzState == GzState::HEADER_CRC) _gzFieldRemaining = 2;
+                    break;
+                }
+                data++; len--;
+                _gzFieldRemaining--;
+                break;
+
+            case GzState::NAME:
+                data++; len--;
+                if (c == 0) {
+                    _gzState = (_gzFlags & GZ_FLAG_COMMENT) ? GzState::COMMENT
+                             : (_gzFlags & GZ_FLAG_HCRC) ? GzState::HEADER_CRC
+                             : GzState::DEFLATE;
+                    if (_gzState == GzState::HEADER_CRC) _gzFieldRemaining = 2;
+                }
+                break;
+
+            case GzState::COMMENT:
+                data++; len--;
+                if (c == 0) {
+                    _gzState = (_gzFlags & GZ_FLAG_HCRC) ? GzState::HEADER_CRC : GzState::DEFLATE;
+                    if (_gzState == GzState::HEADER_CRC) _gzFieldRemaining = 2;
+                }
+                break;
+
+            case GzState::HEADER_CRC:
+                data++; len--;
+                if (--_gzFieldRemaining == 0) _gzState = GzState::DEFLATE;
+                break;
+
+            case GzState::DEFLATE:
+                if (!inflateChunk(data, len)) return false;
+                break;
+
+            case GzState::TRAILER:
+                _gzTrailer[_gzTrailerLen++] = c;
+                data++; len--;
+                if (_gzTrailerLen == sizeof(_gzTrailer)) {
+                    // ISIZE is the uncompressed length modulo 2^32
+                    uint32_t isize = _gzTrailer[4] | (_gzTrailer[5] << 8) |
+                                     (_gzTrailer[6] << 16) | ((uint32_t)_gzTrailer[7] << 24);
+                    if (isize != (uint32_t)_written) {
+                        fail("Decompressed size mismatch");
+                        return false;
+                    }
+                    _gzState = GzState::DONE;
+                }
+                break;
+
+            case GzState::DONE:
+                // Anything after the first gzip member is ignored
+                return true;
+        }
+    }
+    return true;
+}
+
+bool OtaWriter::inflateChunk(const uint8_t*& data, size_t& len) {
+    for (;;) {
+        size_t inBytes = len;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - _dictOfs;
+        tinfl_status status = tinfl_decompress(_inflator, data, &inBytes,
+                                               _dict, _dict + _dictOfs, &outBytes,
+                                               TINFL_FLAG_HAS_MORE_INPUT);
+        data += inBytes;
+        len -= inBytes;
+
+        // The dictionary doubles as the output window
+        if (outBytes > 0) {
+            if (!writeOut(_dict + _dictOfs, outBytes)) return false;
+            _dictOfs = (_dictOfs + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            fail("Corrupt compressed image");
+            return false;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            _gzState = GzState::TRAILER;
+            _gzTrailerLen = 0;
+            return true;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && (len == 0 || inBytes == 0)) {
+            return true;
+        }
+        // TINFL_STATUS_HAS_MORE_OUTPUT: window full, keep draining
+    }
+}
+
+bool OtaWriter::end() {
+    if (!_active) {
+        if (_error.length() == 0) _error = "No update in progress";
+        return false;
+    }
+
+    if (_compressed && _gzState != GzState::DONE) {
+        fail("Truncated compressed image");
+        abort();
+        return false;
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&_shaCtx, digest);
+    char hex[65];
+    for (int i = 0; i < 32; i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    _sha256 = hex;
+
+    // Verify before Update.end() marks the new partition bootable
+    if (_expectedSha256.length() > 0 && _sha256 != _expectedSha256) {
+        fail("SHA-256 mismatch (got " + _sha256 + ")");
+        abort();
+        return false;
+    }
+    if (_expectedSha256.length() == 0) {
+        LOG_WARN("OTA: No sha256 supplied - image not verified");
+    }
+
+    freeBuffers();
+    _active = false;
+
+    if (!Update.end(true)) {
+        fail(Update.errorString());
+        release(true);
+        return false;
+    }
+    release(false);
+
+    LOG_INFO("OTA: Image verified (sha256 %s, %u bytes)", _sha256.c_str(), _written);
+    return true;
+}
+
+void OtaWriter::abort() {
+    if (_active) {
+        Update.abort();
+        _active = false;
+        release(true);
+    }
+    freeBuffers();
+}
+
+void OtaWriter::release(bool failed) {
+    // A committed filesystem image stays unmounted until the reboot that follows
+    if (failed && _mode == OTAMode::FILESYSTEM && !LittleFS.begin(false)) {
+        LOG_ERROR("OTA: Failed to remount LittleFS");
+    }
+    s_updateBusy.store(false);
+}
+
+void OtaWriter::freeBuffers() {
+    if (_inflator) {
+        free(_inflator);
+        _inflator = nullptr;
+    }
+    if (_dict) {
+        free(_dict);
+        _dict = nullptr;
+    }
+}
+
+void OtaWriter::fail(const String& error) {
+    if (_error.length() == 0) _error = error;
+}
@@ -0,0 +1,134 @@
+#ifndef OTA_WRITER_H
+#define OTA_WRITER_H
+
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+
+/** OTA update type */
+enum class OTAMode {
+    FIRMWARE,    ///< Application firmware update
+    FILESYSTEM   ///< LittleFS filesystem update
+};
+
+struct tinfl_decompressor_tag;
+
+/**
+ * Streaming writer for OTA images.
+ *
+ * Wraps the Arduino Update library and adds:
+ * - Transparent gzip decompression: images starting with the gzip magic
+ *   bytes are inflated through a 32 KB window straight into flash, so the
+ *   full image never has to be held in RAM
+ * - Streaming SHA-256 over the decompressed image, checked against an
+ *   expected digest before Update.end() marks the partition bootable
+ *
+ * The inflate state (~43 KB) is only allocated while a compressed update
+ * is in progress.
+ *
+ * All writers share the one global Update, so only one may be active at a
+ * time across push uploads, resumable sessions and pull OTA: begin() fails
+ * with BUSY_ERROR while another writer is active (callers answer 409).
+ *
+ * Usage:
+ *   OtaWriter ota;
+ *   ota.begin(OTAMode::FIRMWARE, expectedSha256Hex);
+ *   ota.write(data, len);  // once per received chunk
+ *   if (!ota.end()) LOG_ERROR("%s", ota.getError().c_str());
+ */
+class OtaWriter {
+public:
+    OtaWriter();
+    ~OtaWriter();
+
+    /**
+     * Start an update. For filesystem updates LittleFS is unmounted first,
+     * and mounted again if the update fails to start or is aborted.
+     * @param mode Firmware or filesystem partition
+     * @param expectedSha256 Hex SHA-256 of the uncompressed image, or empty to skip verification
+     * @return false if another update is active or Update.begin() failed (see getError())
+     */
+    bool begin(OTAMode mode, const String& expectedSha256 = "");
+
+    /**
+     * Write the next chunk of the (possibly compressed) image.
+     * @param data Chunk data
+     * @param len Chunk length
+     * @return false on decompression or flash write error
+     */
+    bool write(const uint8_t* data, size_t len);
+
+    /**
+     * Finish the update: verify the digest and commit the partition.
+     * @return true if the image was verified and committed
+     */
+    bool end();
+
+    /** Abandon the update and release all buffers. */
+    void abort();
+
+    /** @return true between a successful begin() and end()/abort() */
+    bool isActive() const { return _active; }
+
+    /** @return true while any writer holds the update (any task) */
+    static bool isBusy();
+
+    /** getError() after begin() found another update active */
+    static const char* const BUSY_ERROR;
+
+    /** @return true if the image being written is gzip-compressed */
+    bool isCompressed() const { return _compressed; }
+
+    /** @return Bytes written to flash (after decompression) */
+    size_t getBytesWritten() const { return _written; }
+
+    /** @return Error from the last failed call, empty if none */
+    const String& getError() const { return _error; }
+
+    /** @return Hex SHA-256 of the written image (valid after end()) */
+    const String& getSha256() const { return _sha256; }
+
+private:
+    /** gzip container parser states (RFC 1952) */
+    enum class GzState {
+        HEADER,      ///< 10-byte fixed header
+        EXTRA_LEN,   ///< FEXTRA length field
+        EXTRA,       ///< FEXTRA payload
+        NAME,        ///< Zero-terminated FNAME
+        COMMENT,     ///< Zero-terminated FCOMMENT
+        HEADER_CRC,  ///< FHCRC
+        DEFLATE,     ///< Compressed payload
+        TRAILER,     ///< CRC32 + ISIZE
+        DONE
+    };
+
+    bool _active;
+    OTAMode _mode;
+    bool _firstChunk;
+    bool _compressed;
+    size_t _written;
+    String _expectedSha256;
+    String _sha256;
+    String _error;
+    mbedtls_sha256_context _shaCtx;
+
+    // gzip state
+    GzState _gzState;
+    uint8_t _gzFlags;
+    size_t _gzFieldRemaining;
+    uint8_t _gzTrailer[8];
+    size_t _gzTrailerLen;
+    tinfl_decompressor_tag* _inflator;
+    uint8_t* _dict;
+    size_t _dictOfs;
+
+    bool writeOut(const uint8_t* data, size_t len);
+    bool writeCompressed(const uint8_t* data, size_t len);
+    bool inflateChunk(const uint8_t*& data, size_t& len);
+    void freeBuffers();
+    void fail(const String& error);
+
+    /** Let the next writer begin; remounts LittleFS after a failed filesystem update. */
+    void release(bool failed);
+};
+
+#endif // OTA_WRITER_H
@@ -0,0 +1,346 @@
+#include "PullOta.h"
+#include "Logger.h"
+#include "version.h"
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <algorithm>
+
+/// Background task settings: low priority so the loop and AsyncTCP always win
+static const uint32_t TASK_STACK_SIZE = 6144;
+static const UBaseType_t TASK_PRIORITY = 1;
+
+/// Bytes read from the socket per write into OtaWriter
+static const size_t DOWNLOAD_BUFFER_SIZE = 1024;
+
+/// Publish download progress every this many bytes
+static const uint32_t PROGRESS_STEP = 16 * 1024;
+
+PullOta::PullOta()
+    : _checkIntervalMs(60UL * 60 * 1000)
+    , _windowStart(0)
+    , _windowEnd(0)
+    , _utcOffsetMin(0)
+    , _maxBytesPerSec(64 * 1024)
+    , _clockMinute(-1)
+    , _clockSetAt(0)
+    , _idle(false)
+    , _lastActivity(0)
+    , _checkRequested(false)
+    , _ignoreWindow(false)
+    , _task(nullptr)
+{
+    memset(&_working, 0, sizeof(_working));
+    _working.state = PullOtaStatus::State::DISABLED;
+    _working.clockMinute = -1;
+    _status.store(_working);
+}
+
+void PullOta::configure(const OtaConfig& config) {
+    // Ranges are enforced by OtaConfig's schema
+    _manifestUrl = config.manifestUrl;
+    _checkIntervalMs = config.checkIntervalMin * 60UL * 1000;
+    _windowStart = config.windowStart;
+    _windowEnd = config.windowEnd;
+    _utcOffsetMin = config.utcOffsetMin;
+    _maxBytesPerSec = config.maxKBps * 1024UL;
+}
+
+void PullOta::begin() {
+    if (!isEnabled()) {
+        LOG_INFO("PullOta: Disabled (no manifest URL)");
+        return;
+    }
+    if (_task) return;
+
+    setState(PullOtaStatus::State::IDLE);
+    xTaskCreate(taskEntry, "pull_ota", TASK_STACK_SIZE, this, TASK_PRIORITY, &_task);
+    LOG_INFO("PullOta: Checking %s every %lu min", _manifestUrl.c_str(),
+             _checkIntervalMs / 60000);
+}
+
+void PullOta::update(bool deviceIdle) {
+    unsigned long now = millis();
+    unsigned long lastActivity = _lastActivity.load(std::memory_order_relaxed);
+    bool idle = deviceIdle && now - lastActivity >= IDLE_BEFORE_APPLY_MS;
+    _idle.store(idle, std::memory_order_relaxed);
+
+    // Reboot from the loop task once the task has committed an image
+    if (!_task) return;
+    PullOtaStatus status;
+    _status.load(status);
+    if (status.state == PullOtaStatus::State::READY &&
+        (idle || _ignoreWindow.load(std::memory_order_relaxed))) {
+        LOG_INFO("PullOta: Rebooting into v%s", status.available);
+        delay(500);  // Let the log reach the web console
+        ESP.restart();
+    }
+}
+
+void PullOta::requestCheck(bool ignoreWindow) {
+    if (ignoreWindow) _ignoreWindow.store(true, std::memory_order_relaxed);
+    _checkRequested.store(true, std::memory_order_relaxed);
+}
+
+const char* PullOta::stateName(PullOtaStatus::State state) {
+    switch (state) {
+        case PullOtaStatus::State::DISABLED:    return "disabled";
+        case PullOtaStatus::State::IDLE:        return "idle";
+        case PullOtaStatus::State::CHECKING:    return "checking";
+        case PullOtaStatus::State::PENDING:     return "pending";
+        case PullOtaStatus::State::DOWNLOADING: return "downloading";
+        case PullOtaStatus::State::READY:       return "ready";
+        case PullOtaStatus::State::FAILED:      return "failed";
+        default:                                return "unknown";
+    }
+}
+
+int PullOta::compareVersions(const char* a, const char* b) {
+    for (int part = 0; part < 3; part++) {
+        long va = strtol(a, const_cast<char**>(&a), 10);
+        long vb = strtol(b, const_cast<char**>(&b), 10);
+        if (va != vb) return va < vb ? -1 : 1;
+        if (*a == '.') a++;
+        if (*b == '.') b++;
+    }
+    return 0;
+}
+
+void PullOta::taskEntry(void* arg) {
+    static_cast<PullOta*>(arg)->run();
+}
+
+void PullOta::run() {
+    unsigned long lastCheck = 0;
+    bool checked = false;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+
+        PullOtaStatus::State state = _working.state;
+        if (state == PullOtaStatus::State::READY) continue;  // Waiting for update() to reboot
+        if (WiFi.status() != WL_CONNECTED) continue;
+
+        unsigned long now = millis();
+        bool requested = _checkRequested.exchange(false, std::memory_order_relaxed);
+        if (requested || !checked || now - lastCheck >= _checkIntervalMs) {
+            lastCheck = now;
+            checked = true;
+            checkManifest();
+        }
+
+        // Keep the published clock ticking for the API
+        int minute = currentMinute();
+        if (minute != _working.clockMinute) {
+            _working.clockMinute = minute;
+            _status.store(_working);
+        }
+
+        if (_working.state == PullOtaStatus::State::PENDING) {
+            bool force = _ignoreWindow.load(std::memory_order_relaxed);
+            if (force || (inWindow() && _idle.load(std::memory_order_relaxed))) {
+                if (!download()) _ignoreWindow.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+bool PullOta::checkManifest() {
+    setState(PullOtaStatus::State::CHECKING);
+
+    HTTPClient http;
+    http.setTimeout(5000);
+    if (!http.begin(_manifestUrl)) {
+        fail("Invalid manifest URL");
+        return false;
+    }
+    const char* headerKeys[] = {"Date"};
+    http.collectHeaders(headerKeys, 1);
+
+    int code = http.GET();
+    if (code != HTTP_CODE_OK) {
+        fail("Manifest request failed (" + String(code) + ")");
+        http.end();
+        return false;
+    }
+    parseDateHeader(http.header("Date"));
+    String body = http.getString();
+    http.end();
+
+    JsonDocument doc;
+    if (deserializeJson(doc, body)) {
+        fail("Invalid manifest JSON");
+        return false;
+    }
+
+    const char* version = doc["version"] | "";
+    const char* url = doc["firmware"]["url"] | "";
+    const char* sha256 = doc["firmware"]["sha256"] | "";
+    if (strlen(version) == 0 || strlen(url) == 0) {
+        fail("Manifest missing version or firmware.url");
+        return false;
+    }
+    if (strlen(sha256) != 64) {
+        fail("Manifest missing firmware.sha256");
+        return false;
+    }
+
+    _working.lastCheck = millis();
+    strlcpy(_working.available, version, sizeof(_working.available));
+    _working.total = doc["firmware"]["size"] | 0;
+    _working.received = 0;
+    _working.error[0] = '\0';
+
+    if (compareVersions(version, TINKLINK_VERSION_STRING) <= 0) {
+        LOG_DEBUG("PullOta: Up to date (manifest v%s)", version);
+        setState(PullOtaStatus::State::IDLE);
+        return true;
+    }
+
+    _imageUrl = url;
+    _imageSha256 = sha256;
+    LOG_INFO("PullOta: v%s available, waiting for maintenance window", version);
+    setState(PullOtaStatus::State::PENDING);
+    return true;
+}
+
+bool PullOta::download() {
+    LOG_INFO("PullOta: Downloading %s", _imageUrl.c_str());
+    setState(PullOtaStatus::State::DOWNLOADING);
+
+    HTTPClient http;
+    http.setTimeout(DOWNLOAD_STALL_MS);
+    if (!http.begin(_imageUrl)) {
+        fail("Invalid firmware URL");
+        return false;
+    }
+
+    int code = http.GET();
+    if (code != HTTP_CODE_OK) {
+        fail("Firmware request failed (" + String(code) + ")");
+        http.end();
+        return false;
+    }
+
+    // The raw stream is read directly, so chunked transfer encoding is not supported
+    int size = http.getSize();
+    if (size <= 0) {
+        fail("Server did not send Content-Length");
+        http.end();
+        return false;
+    }
+
+    if (!_ota.begin(OTAMode::FIRMWARE, _imageSha256)) {
+        fail(_ota.getError());
+        http.end();
+        return false;
+    }
+
+    _working.total = size;
+    _working.received = 0;
+    _status.store(_working);
+
+    WiFiClient* stream = http.getStreamPtr();
+    uint8_t buf[DOWNLOAD_BUFFER_SIZE];
+    uint32_t received = 0;
+    uint32_t lastPublished = 0;
+    unsigned long start = millis();
+    unsigned long lastData = start;
+
+    while (received < (uint32_t)size) {
+        size_t avail = stream->available();
+        if (avail == 0) {
+            if (!stream->connected() || millis() - lastData >= DOWNLOAD_STALL_MS) break;
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        int n = stream->readBytes(buf, std::min(avail, sizeof(buf)));
+        if (n <= 0) continue;
+        lastData = millis();
+
+        if (!_ota.write(buf, n)) {
+            String error = _ota.getError();
+            _ota.abort();
+            http.end();
+            fail(error);
+            return false;
+        }
+        received += n;
+
+        if (received - lastPublished >= PROGRESS_STEP) {
+            lastPublished = received;
+            _working.received = received;
+            _status.store(_working);
+        }
+
+        // Throttle: sleep until the transfer is back under the rate limit
+        unsigned long due = (uint64_t)received * 1000 / _maxBytesPerSec;
+        unsigned long elapsed = millis() - start;
+        if (due > elapsed) vTaskDelay(pdMS_TO_TICKS(due - elapsed));
+    }
+    http.end();
+
+    _working.received = received;
+    if (received < (uint32_t)size) {
+        _ota.abort();
+        fail("Download incomplete (" + String(received) + "/" + String(size) + " bytes)");
+        return false;
+    }
+
+    if (!_ota.end()) {
+        fail(_ota.getError());
+        return false;
+    }
+
+    LOG_INFO("PullOta: v%s verified (%lu bytes in %lu ms), rebooting when idle",
+             _working.available, (unsigned long)received, millis() - start);
+    setState(PullOtaStatus::State::READY);
+    return true;
+}
+
+bool PullOta::inWindow() const {
+    if (_windowStart == _windowEnd) return true;  // No window configured
+    int minute = currentMinute();
+    if (minute < 0) return false;                 // Clock unknown yet
+
+    int hour = minute / 60;
+    if (_windowStart < _windowEnd) {
+        return hour >= _windowStart && hour < _windowEnd;
+    }
+    return hour >= _windowStart || hour < _windowEnd;  // Window wraps midnight
+}
+
+int PullOta::currentMinute() const {
+    if (_clockMinute < 0) return -1;
+    unsigned long elapsedMin = (millis() - _clockSetAt) / 60000;
+    return (_clockMinute + elapsedMin) % (24 * 60);
+}
+
+void PullOta::parseDateHeader(const String& date) {
+    // RFC 7231 IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    int day, year, hour, minute, second;
+    char month[4];
+    if (sscanf(date.c_str(), "%*3s, %d %3s %d %d:%d:%d", &day, month, &year,
+               &hour, &minute, &second) != 6) {
+        return;
+    }
+
+    int local = (hour * 60 + minute + _utcOffsetMin) % (24 * 60);
+    if (local < 0) local += 24 * 60;
+    _clockMinute = local;
+    _clockSetAt = millis() - second * 1000UL;
+    _working.clockMinute = local;
+}
+
+void PullOta::setState(PullOtaStatus::State state) {
+    _working.state = state;
+    if (state != PullOtaStatus::State::FAILED) _working.error[0] = '\0';
+    _status.store(_working);
+}
+
+void PullOta::fail(const String& error) {
+    LOG_ERROR("PullOta: %s", error.c_str());
+    strlcpy(_working.error, error.c_str(), sizeof(_working.error));
+    _working.state = PullOtaStatus::State::FAILED;
+    _status.store(_working);
+}
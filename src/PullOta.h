@@ -0,0 +1,155 @@
+#ifndef PULL_OTA_H
+#define PULL_OTA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include "OtaWriter.h"
+#include "ConfigTypes.h"
+#include "Seqlock.h"
+
+/**
+ * Progress of pull OTA, published for the web API.
+ * Plain data so it can go through a Seqlock.
+ */
+struct PullOtaStatus {
+    enum class State : uint8_t {
+        DISABLED,     ///< No manifest URL configured
+        IDLE,         ///< Waiting for the next check
+        CHECKING,     ///< Fetching the manifest
+        PENDING,      ///< Newer firmware found, waiting for the maintenance window
+        DOWNLOADING,  ///< Streaming the image into flash
+        READY,        ///< Image verified and committed, waiting to reboot
+        FAILED        ///< Last check or download failed (retried next interval)
+    };
+
+    State state;
+    char available[16];     ///< Version offered by the manifest, empty if none
+    uint32_t received;      ///< Bytes downloaded so far
+    uint32_t total;         ///< Image size from the manifest (0 if unknown)
+    uint32_t lastCheck;     ///< millis() of the last manifest fetch, 0 if never
+    int16_t clockMinute;    ///< Minute of the local day, -1 until known
+    char error[64];
+};
+
+/**
+ * Pull-based firmware updates from a local manifest server.
+ *
+ * Periodically fetches a JSON manifest over plain HTTP:
+ *   {"version":"1.11.0",
+ *    "firmware":{"url":"http://host/firmware.bin.gz","sha256":"...","size":123456}}
+ *
+ * If the manifest version is newer than TINKLINK_VERSION_STRING, the image
+ * is downloaded once the maintenance window opens and the device has been
+ * idle for a while. The download streams straight into OtaWriter (gzip
+ * inflate + SHA-256 check) and is throttled to a configured rate, so it
+ * never holds the loop or the radio for long. update() then reboots into
+ * the new image while the device is still idle.
+ *
+ * Network work runs on its own low-priority task; the loop only feeds in
+ * the idle state and performs the final reboot. The wall clock for the
+ * maintenance window comes from the manifest server's Date header, so no
+ * internet NTP server is needed.
+ *
+ * Config ("ota" section of config.json):
+ *   manifestUrl       Manifest URL, empty to disable
+ *   checkIntervalMin  Minutes between manifest checks (default 60)
+ *   windowStart/End   Local hours of the maintenance window; equal means any time
+ *   utcOffsetMin      Local time offset from UTC in minutes
+ *   maxKBps           Download rate limit in KB/s (default 64)
+ *
+ * Usage:
+ *   PullOta pullOta;
+ *   pullOta.configure(config.getOtaConfig());
+ *   pullOta.begin();
+ *   pullOta.update(tinkIsOff);  // from loop()
+ */
+class PullOta {
+public:
+    // Device must be idle this long before an update is downloaded or applied
+    static const unsigned long IDLE_BEFORE_APPLY_MS = 10UL * 60 * 1000;
+
+    // Give up on a download that stalls this long
+    static const unsigned long DOWNLOAD_STALL_MS = 15000;
+
+    PullOta();
+
+    /**
+     * Apply settings from the "ota" config section.
+     * @param config Validated OTA settings
+     */
+    void configure(const OtaConfig& config);
+
+    /** Start the background task (no-op while disabled). */
+    void begin();
+
+    /**
+     * Loop-side housekeeping: track idleness and reboot once an image is ready.
+     * @param deviceIdle true while nothing is being switched or displayed
+     */
+    void update(bool deviceIdle);
+
+    /** Note user activity (e.g. a switcher input change) - restarts the idle timer. */
+    void noteActivity() { _lastActivity.store(millis(), std::memory_order_relaxed); }
+
+    /**
+     * Ask for a manifest check as soon as possible (any task).
+     * @param ignoreWindow Download right away instead of waiting for the window
+     */
+    void requestCheck(bool ignoreWindow = false);
+
+    /** Copy the current status (any task). */
+    void getStatus(PullOtaStatus& out) const { _status.load(out); }
+
+    /** @return true if a manifest URL is configured */
+    bool isEnabled() const { return _manifestUrl.length() > 0; }
+
+    /** Name of a state for the API */
+    static const char* stateName(PullOtaStatus::State state);
+
+    /**
+     * Compare dotted MAJOR.MINOR.PATCH version strings numerically.
+     * @return <0, 0 or >0 like strcmp
+     */
+    static int compareVersions(const char* a, const char* b);
+
+private:
+    // Settings (written by configure() before begin())
+    String _manifestUrl;
+    unsigned long _checkIntervalMs;
+    uint8_t _windowStart;
+    uint8_t _windowEnd;
+    int16_t _utcOffsetMin;
+    uint32_t _maxBytesPerSec;
+
+    // Manifest details (task only)
+    String _imageUrl;
+    String _imageSha256;
+
+    // Wall clock from the server's Date header (task only)
+    int16_t _clockMinute;
+    unsigned long _clockSetAt;
+
+    std::atomic<bool> _idle;
+    std::atomic<unsigned long> _lastActivity;
+    std::atomic<bool> _checkRequested;
+    std::atomic<bool> _ignoreWindow;
+
+    TaskHandle_t _task;
+    OtaWriter _ota;
+
+    PullOtaStatus _working;  ///< Task's private copy, published through _status
+    Seqlock<PullOtaStatus> _status;
+
+    static void taskEntry(void* arg);
+    void run();
+    bool checkManifest();
+    bool download();
+    bool inWindow() const;
+    int currentMinute() const;
+    void parseDateHeader(const String& date);
+    void setState(PullOtaStatus::State state);
+    void fail(const String& error);
+};
+
+#endif // PULL_OTA_H
@@ -5,6 +5,7 @@
 #endif
 #include "UartSerial.h"
 #include "Logger.h"
+#include "Metrics.h"
 
 RetroTink::RetroTink()
     : _serial(nullptr)
@@ -16,6 +17,9 @@ RetroTink::RetroTink()
     , _lastSvsInput(0)
     , _svsKeepAliveTime(0)
     , _svsKeepAlivePending(false)
+    , _reportedPowerState(RT4KPowerState::UNKNOWN)
+    , _reportedConnected(false)
+    , _inputChangeAt(0)
 {
 }
 
@@ -26,24 +30,8 @@ RetroTink::~RetroTink() {
     }
 }
 
-void RetroTink::configure(const JsonObject& config) {
-    // Read serial mode configuration
-    String serialMode = config["serialMode"] | "usb";
-
-    // Read power management mode
-    String pmMode = config["powerManagementMode"] | "full";
-    if (pmMode == "off") {
-        _powerMgmtMode = PowerManagementMode::OFF;
-        _powerState = RT4KPowerState::ON;  // Assume always on
-    } else if (pmMode == "simple") {
-        _powerMgmtMode = PowerManagementMode::SIMPLE;
-        _powerState = RT4KPowerState::UNKNOWN;
-    } else {
-        _powerMgmtMode = PowerManagementMode::FULL;
-        _powerState = RT4KPowerState::UNKNOWN;
-    }
-
-    LOG_DEBUG("RetroTink: Power management mode: %s", pmMode.c_str());
+void RetroTink::configure(const TinkConfig& config) {
+    setPowerManagementMode(config.powerManagementMode);
 
     // Clean up existing serial
     if (_serial) {
@@ -52,17 +40,12 @@ void RetroTink::configure(const JsonObject& config) {
     }
 
     // Create appropriate serial interface based on mode
-    if (serialMode == "uart") {
-        // UART mode - read UART configuration
-        uint8_t uartId = config["uartId"] | 2;
-        uint8_t txPin = config["txPin"] | 17;
-        uint8_t rxPin = config["rxPin"] | 18;
-
+    if (config.serialMode == TinkSerialMode::UART) {
         LOG_DEBUG("RetroTink: Configuring UART mode (UART%d, TX=%d, RX=%d)",
-                  uartId, txPin, rxPin);
+                  config.uartId, config.txPin, config.rxPin);
 
         // RetroTink uses 115200 baud
-        _serial = new UartSerial(uartId, rxPin, txPin, 115200);
+        _serial = new UartSerial(config.uartId, config.rxPin, config.txPin, 115200);
     } else {
         // USB mode (default)
 #ifndef NO_USB_HOST
@@ -74,6 +57,16 @@ void RetroTink::configure(const JsonObject& config) {
     }
 }
 
+void RetroTink::setPowerManagementMode(PowerManagementMode mode) {
+    _powerMgmtMode = mode;
+    // OFF assumes the RT4K is always on
+    _powerState = _powerMgmtMode == PowerManagementMode::OFF ? RT4KPowerState::ON
+                                                             : RT4KPowerState::UNKNOWN;
+
+    LOG_DEBUG("RetroTink: Power management mode: %s",
+              TinkConfig::SCHEMA.enumName("powerManagementMode", (uint8_t)_powerMgmtMode));
+}
+
 bool RetroTink::begin() {
     if (!_serial) {
         LOG_ERROR("RetroTink: Cannot begin - not configured");
@@ -89,6 +82,13 @@ bool RetroTink::begin() {
     return true;
 }
 
+void RetroTink::end() {
+    if (_serial) {
+        delete _serial;
+        _serial = nullptr;
+    }
+}
+
 void RetroTink::update() {
     if (!_serial) return;
 
@@ -100,6 +100,19 @@ void RetroTink::update() {
 
     // Handle pending operations (boot timeout, SVS keep-alive)
     processPendingOperations();
+
+    // Power state may also change in onSwitcherInputChange(); counted here
+    if (_powerState != _reportedPowerState) {
+        Metrics::instance().recordPowerTransition((int)_powerState);
+        _reportedPowerState = _powerState;
+        _stateVersion.bump();
+    }
+
+    bool connected = _serial->isConnected();
+    if (connected != _reportedConnected) {
+        _reportedConnected = connected;
+        _stateVersion.bump();
+    }
 }
 
 void RetroTink::addTrigger(const TriggerMapping& trigger) {
@@ -125,6 +138,10 @@ void RetroTink::onSwitcherInputChange(int input) {
 
     String command = generateCommand(*trigger);
 
+    // Latency is recorded when the trigger command goes out (see sendCommand)
+    _inputChangeAt = micros();
+    if (_inputChangeAt == 0) _inputChangeAt = 1;
+
     // OFF mode: no power management, send immediately
     if (_powerMgmtMode == PowerManagementMode::OFF) {
         sendCommand(command);
@@ -277,6 +294,13 @@ String RetroTink::generateCommand(const TriggerMapping& trigger) const {
 
 void RetroTink::sendCommand(const String& command) {
     _lastCommand = command;
+    _stateVersion.bump();
+
+    // First command after an input change other than the wake-up is the trigger
+    if (_inputChangeAt != 0 && command != "pwr on") {
+        Metrics::instance().recordInputLatency(micros() - _inputChangeAt);
+        _inputChangeAt = 0;
+    }
 
     if (_serial && _serial->isConnected()) {
         // Frame command with leading/trailing CR for RT4K protocol
@@ -4,6 +4,8 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <vector>
+#include "StateVersion.h"
+#include "ConfigTypes.h"
 
 class SerialInterface;
 
@@ -43,26 +45,6 @@ enum class RT4KPowerState {
     SLEEPING   ///< In sleep/standby mode
 };
 
-/**
- * Power management mode for RetroTINK communication.
- *
- * Controls how TinkLink handles RT4K power state:
- * - OFF: No power management. Commands sent immediately. User must ensure
- *   RT4K is on. Best when the RT4K is always on and power management is
- *   not needed.
- * - SIMPLE: On first input change, sends "pwr on" and waits 15 seconds
- *   before sending the profile command. All subsequent commands are sent
- *   immediately. Suitable when power state messages are not available.
- * - FULL: Tracks RT4K power state via serial messages (Powering Up, Boot
- *   Sequence Complete, Power Off). Requires that the serial connection
- *   provides these status messages. Default mode.
- */
-enum class PowerManagementMode {
-    OFF,     ///< No power management, always send commands immediately
-    SIMPLE,  ///< One-time "pwr on" + 15s wait on first use, then immediate
-    FULL     ///< Full state tracking via serial messages
-};
-
 /**
  * RetroTINK 4K controller via serial interface.
  *
@@ -83,7 +65,7 @@ enum class PowerManagementMode {
  *
  * Usage:
  *   RetroTink tink;
- *   tink.configure(config);  // config contains serialMode, uartId, txPin, rxPin
+ *   tink.configure(configManager.getRetroTinkConfig());
  *   tink.begin();
  *   tink.addTrigger({1, TriggerMapping::SVS, 1, "Console 1"});
  *   // In loop():
@@ -100,19 +82,19 @@ public:
     ~RetroTink();
 
     /**
-     * Configure the RetroTINK controller from JSON settings.
-     * Creates either USB Host or UART serial transport based on config.
-     *
-     * Config fields:
-     * - serialMode: "usb" (default) or "uart"
-     * - powerManagementMode: "off", "simple", or "full" (default "full")
-     * - uartId: UART number (for uart mode, default 2)
-     * - txPin: TX GPIO pin (for uart mode, default 17)
-     * - rxPin: RX GPIO pin (for uart mode, default 18)
-     *
-     * @param config JSON object containing RetroTINK configuration
+     * Configure the RetroTINK controller.
+     * Creates either USB Host or UART serial transport based on serialMode;
+     * uartId/txPin/rxPin are only used in UART mode.
+     * @param config Validated "tink" config section
+     */
+    void configure(const TinkConfig& config);
+
+    /**
+     * Change the power management mode without touching the transport.
+     * Power state tracking restarts as after configure().
+     * @param mode New mode
      */
-    void configure(const JsonObject& config);
+    void setPowerManagementMode(PowerManagementMode mode);
 
     /**
      * Initialize the RetroTINK controller and its transport.
@@ -121,6 +103,12 @@ public:
      */
     bool begin();
 
+    /**
+     * Release the serial transport (and its UART pins or USB device).
+     * configure() and begin() start it again.
+     */
+    void end();
+
     /**
      * Process serial data and pending commands.
      * Must be called in loop(). Handles:
@@ -180,6 +168,12 @@ public:
      */
     String getLastCommand() const { return _lastCommand; }
 
+    /**
+     * Get the version of the state reported in /api/status.
+     * @return StateVersion of the last change
+     */
+    uint32_t getStateVersion() const { return _stateVersion.get(); }
+
 private:
     SerialInterface* _serial;
     std::vector<TriggerMapping> _triggers;
@@ -202,6 +196,12 @@ private:
     bool _svsKeepAlivePending;
     static const unsigned long SVS_KEEPALIVE_DELAY_MS = 1000;
 
+    // Change tracking (metrics and /api/status versions)
+    StateVersion _stateVersion;
+    RT4KPowerState _reportedPowerState;  ///< Last state counted as a transition
+    bool _reportedConnected;             ///< Last serial connection state seen by update()
+    unsigned long _inputChangeAt;        ///< micros() of the last triggered input change (0 = none)
+
     /**
      * Find the trigger mapping for a given switcher input.
      * @param input The input number to look up
@@ -0,0 +1,76 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * Single-writer sequence lock publishing a plain-old-data value.
+ *
+ * The writer bumps the sequence to an odd number, copies the new value in,
+ * then bumps it to the next even number. Readers copy the value out and
+ * retry if the sequence was odd or changed during the copy, so they always
+ * see a value from exactly one store(). Neither side takes a lock and the
+ * writer never waits for readers.
+ *
+ * Readers normally run at a higher priority than the writer (AsyncTCP task
+ * vs. loop task). On a single-core chip a reader spinning on an interrupted
+ * write would starve the writer, so after a few failed attempts load()
+ * sleeps for a tick to let the write complete.
+ *
+ * @tparam T Value type (trivially copyable; copied with memcpy)
+ */
+template <typename T>
+class Seqlock {
+public:
+    Seqlock() : _seq(0) {
+        memset(&_value, 0, sizeof(_value));
+    }
+
+    /**
+     * Publish a new value (writer side only).
+     * @param value Value to copy in
+     */
+    void store(const T& value) {
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&_value, &value, sizeof(T));
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * Read a consistent copy of the latest value (any task).
+     * @param out Receives the value
+     */
+    void load(T& out) const {
+        for (int attempt = 0; ; attempt++) {
+            uint32_t before = _seq.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                memcpy(&out, &_value, sizeof(T));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_seq.load(std::memory_order_relaxed) == before) {
+                    return;
+                }
+            }
+            if (attempt >= SPIN_LIMIT) {
+                vTaskDelay(1);
+            }
+        }
+    }
+
+    /** @return Number of values published so far */
+    uint32_t getVersion() const {
+        return _seq.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    static const int SPIN_LIMIT = 8;
+
+    std::atomic<uint32_t> _seq;
+    T _value;
+};
+
+#endif // SEQLOCK_H
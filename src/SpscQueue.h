@@ -0,0 +1,74 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Fixed-capacity lock-free single-producer/single-consumer ring buffer.
+ *
+ * Exactly one task may call push() and exactly one (other) task may call
+ * pop(). Neither side ever blocks or takes a lock: the producer owns
+ * _head, the consumer owns _tail, and each only reads the other's index
+ * with acquire ordering after the slot contents were published with
+ * release ordering.
+ *
+ * One slot is kept empty to tell full from empty, so the queue holds
+ * Capacity - 1 items.
+ *
+ * @tparam T Item type (copied in and out; keep it small and trivially copyable)
+ * @tparam Capacity Number of slots, must be a power of two
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : _head(0), _tail(0) {}
+
+    /**
+     * Append an item (producer side only).
+     * @param item Item to copy into the queue
+     * @return false if the queue is full
+     */
+    bool push(const T& item) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t next = (head + 1) & MASK;
+        if (next == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        _slots[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest item (consumer side only).
+     * @param item Receives the item
+     * @return false if the queue is empty
+     */
+    bool pop(T& item) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _slots[tail];
+        _tail.store((tail + 1) & MASK, std::memory_order_release);
+        return true;
+    }
+
+    /** @return true if no items are queued (approximate from the producer side) */
+    bool isEmpty() const {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t MASK = Capacity - 1;
+
+    T _slots[Capacity];
+    std::atomic<size_t> _head;  ///< Next slot to write (producer)
+    std::atomic<size_t> _tail;  ///< Next slot to read (consumer)
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,48 @@
+#ifndef STATE_VERSION_H
+#define STATE_VERSION_H
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * Change counter for one section of device state.
+ *
+ * All StateVersion instances draw from one global, monotonically increasing
+ * sequence, so versions from different sections are directly comparable: a
+ * client that last saw version N needs exactly the sections whose version is
+ * greater than N. This is what /api/status?since=N relies on.
+ *
+ * The sequence starts at a random point each boot, so a version remembered
+ * from before a reboot is very unlikely to fall inside the current range
+ * (and one above current() is recognisably stale).
+ *
+ * Owners call bump() whenever the state they expose changes. get() may be
+ * called from any task.
+ */
+class StateVersion {
+public:
+    StateVersion() : _version(next()) {}
+
+    /** Record a change. */
+    void bump() { _version.store(next(), std::memory_order_release); }
+
+    /** @return Version of the most recent change */
+    uint32_t get() const { return _version.load(std::memory_order_acquire); }
+
+    /** @return Latest version issued to any section */
+    static uint32_t current() { return counter().load(std::memory_order_acquire); }
+
+private:
+    std::atomic<uint32_t> _version;
+
+    static std::atomic<uint32_t>& counter() {
+        static std::atomic<uint32_t> value(esp_random() >> 2);
+        return value;
+    }
+
+    static uint32_t next() {
+        return counter().fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+};
+
+#endif // STATE_VERSION_H
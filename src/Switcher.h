@@ -5,6 +5,8 @@
 #include <ArduinoJson.h>
 #include <functional>
 #include <vector>
+#include "StateVersion.h"
+#include "ConfigTypes.h"
 
 /**
  * Abstract base class for video switchers.
@@ -33,12 +35,11 @@ public:
     virtual ~Switcher() = default;
 
     /**
-     * Configure the switcher from JSON settings.
-     * Each concrete switcher reads its own type-specific fields.
+     * Configure the switcher from its config section.
      * Creates and configures the appropriate serial transport internally.
-     * @param config JSON object containing switcher configuration
+     * @param config Validated "switcher" config section
      */
-    virtual void configure(const JsonObject& config) = 0;
+    virtual void configure(const SwitcherConfig& config) = 0;
 
     /**
      * Initialize the switcher and its transport.
@@ -104,6 +105,25 @@ public:
      * @return true if auto-switching is enabled
      */
     virtual bool isAutoSwitchEnabled() const = 0;
+
+    /**
+     * Get the version of the current input state.
+     * Implementations bump _stateVersion when the current input changes.
+     * @return StateVersion of the last change
+     */
+    uint32_t getStateVersion() const { return _stateVersion.get(); }
+
+    /**
+     * Get the version of the recent message list.
+     * Implementations bump _messageVersion when a message is stored or the
+     * list is cleared, so loop() republishes it only when it changed.
+     * @return StateVersion of the last change
+     */
+    uint32_t getMessageVersion() const { return _messageVersion.get(); }
+
+protected:
+    StateVersion _stateVersion;
+    StateVersion _messageVersion;
 };
 
 #endif // SWITCHER_H
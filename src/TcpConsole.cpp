@@ -0,0 +1,331 @@
+#ifndef TINKLINK_HTTPD_IDF  // Needs AsyncTCP; the httpd build has no console
+
+#include "TcpConsole.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "version.h"
+#include <AsyncTCP.h>
+#include <algorithm>
+
+static const char HELP_TEXT[] =
+    "status                    device state\n"
+    "tink <cmd>                send a RetroTINK command\n"
+    "switcher <cmd>            send a switcher command\n"
+    "avr <cmd>                 send an AVR command\n"
+    "logs [n]                  last n log entries (default 20)\n"
+    "tail                      follow the log until the next input line\n"
+    "metrics                   Prometheus metrics\n"
+    "loglevel [debug|info|warn|error]  show or set the log level\n"
+    "quit                      close the connection\n";
+
+static const char* const LEVEL_NAMES[] = {"debug", "info", "warn", "error"};
+
+/// Most log entries "logs" will return
+static const int MAX_LOG_LINES = 100;
+
+TcpConsole::TcpConsole()
+    : _server(nullptr)
+{
+    for (Connection& conn : _connections) {
+        conn.client = nullptr;
+    }
+}
+
+TcpConsole::~TcpConsole() {
+    delete _server;
+}
+
+void TcpConsole::begin(uint16_t port, CommandPoster poster, SnapshotReader reader) {
+    _poster = poster;
+    _reader = reader;
+
+    _server = new AsyncServer(port);
+    _server->onClient([this](void*, AsyncClient* client) { onConnect(client); }, nullptr);
+    _server->begin();
+
+    LOG_INFO("TcpConsole: Listening on port %u", port);
+}
+
+void TcpConsole::onConnect(AsyncClient* client) {
+    Connection* slot = nullptr;
+    for (Connection& conn : _connections) {
+        if (!conn.client) {
+            slot = &conn;
+            break;
+        }
+    }
+
+    if (!slot) {
+        static const char BUSY[] = "error: too many connections\n";
+        client->onDisconnect([](void*, AsyncClient* c) { delete c; }, nullptr);
+        client->add(BUSY, sizeof(BUSY) - 1);
+        client->send();
+        client->close();
+        return;
+    }
+
+    Connection& conn = *slot;
+    conn.client = client;
+    conn.inLen = 0;
+    conn.out = "";
+    conn.outPos = 0;
+    conn.stream = Stream::NONE;
+    conn.logNext = 0;
+    conn.logEnd = 0;
+    conn.metricsFamily = 0;
+    conn.quit = false;
+
+    // Interactive traffic: don't let Nagle hold back short replies
+    client->setNoDelay(true);
+
+    client->onData([this, &conn](void*, AsyncClient*, void* data, size_t len) {
+        onData(conn, static_cast<const uint8_t*>(data), len);
+    }, nullptr);
+
+    // Room freed on the socket - continue a long output
+    client->onAck([this, &conn](void*, AsyncClient*, size_t, uint32_t) {
+        service(conn);
+    }, nullptr);
+
+    // Periodic: pick up new entries while tailing, and close after "quit"
+    client->onPoll([this, &conn](void*, AsyncClient* c) {
+        if (conn.quit && conn.outPos >= conn.out.length()) {
+            c->close();
+            return;
+        }
+        service(conn);
+    }, nullptr);
+
+    client->onDisconnect([this, &conn](void*, AsyncClient*) { onDisconnect(conn); }, nullptr);
+
+    LOG_DEBUG("TcpConsole: Client connected from %s", client->remoteIP().toString().c_str());
+}
+
+void TcpConsole::onData(Connection& conn, const uint8_t* data, size_t len) {
+    if (conn.quit) return;
+
+    for (size_t i = 0; i < len; i++) {
+        if (conn.inLen >= sizeof(conn.in)) {
+            // Line too long (or too much pipelined input) - drop what we have
+            conn.inLen = 0;
+            conn.out += "error: line too long\n";
+        }
+        conn.in[conn.inLen++] = (char)data[i];
+    }
+
+    service(conn);
+}
+
+void TcpConsole::onDisconnect(Connection& conn) {
+    LOG_DEBUG("TcpConsole: Client disconnected");
+    delete conn.client;
+    conn.client = nullptr;
+    conn.out = "";
+}
+
+void TcpConsole::service(Connection& conn) {
+    AsyncClient* client = conn.client;
+    if (!client) return;
+
+    for (;;) {
+        // Queue the current piece as far as the socket allows
+        if (conn.outPos < conn.out.length()) {
+            size_t n = std::min(client->space(), conn.out.length() - conn.outPos);
+            if (n == 0) break;
+            n = client->add(conn.out.c_str() + conn.outPos, n);
+            if (n == 0) break;
+            conn.outPos += n;
+            continue;
+        }
+        conn.out = "";
+        conn.outPos = 0;
+
+        char* newline = (char*)memchr(conn.in, '\n', conn.inLen);
+
+        // Any input line ends a tail
+        if (conn.stream == Stream::TAIL && newline) {
+            conn.stream = Stream::NONE;
+            conn.out = "ok\n";
+            continue;
+        }
+
+        if (conn.stream != Stream::NONE) {
+            if (nextPiece(conn)) continue;
+            break;  // Tail caught up; the next poll looks again
+        }
+
+        if (!newline || conn.quit) break;
+
+        // Take the line out of the input buffer and run it
+        char line[INPUT_BUFFER_SIZE];
+        size_t lineLen = newline - conn.in;
+        memcpy(line, conn.in, lineLen);
+        line[lineLen] = '\0';
+        if (lineLen > 0 && line[lineLen - 1] == '\r') line[lineLen - 1] = '\0';
+        conn.inLen -= lineLen + 1;
+        memmove(conn.in, newline + 1, conn.inLen);
+
+        execute(conn, line);
+    }
+
+    client->send();
+}
+
+bool TcpConsole::nextPiece(Connection& conn) {
+    Logger& logger = Logger::instance();
+
+    switch (conn.stream) {
+        case Stream::LOGS:
+        case Stream::TAIL: {
+            unsigned long end = conn.stream == Stream::TAIL ? logger.getLogCount() : conn.logEnd;
+            if (conn.logNext < logger.getOldestIndex()) conn.logNext = logger.getOldestIndex();
+
+            LogEntry entry;
+            while (conn.logNext < end) {
+                // Entries evicted since the command started are skipped
+                if (!logger.getLogEntry(conn.logNext++, entry)) continue;
+                char prefix[24];
+                snprintf(prefix, sizeof(prefix), "%lu %c ", entry.timestamp,
+                         "DIWE"[static_cast<int>(entry.level)]);
+                conn.out = prefix;
+                conn.out += entry.message;
+                conn.out += '\n';
+                return true;
+            }
+            if (conn.stream == Stream::TAIL) return false;
+            break;
+        }
+
+        case Stream::METRICS: {
+            DeviceSnapshot snap;
+            _reader(snap);
+            if (Metrics::instance().render(conn.metricsFamily++, snap, conn.out)) return true;
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    // Finite output done
+    conn.stream = Stream::NONE;
+    conn.out = "ok\n";
+    return true;
+}
+
+void TcpConsole::execute(Connection& conn, char* line) {
+    // Split into command and arguments
+    while (*line == ' ') line++;
+    char* args = strchr(line, ' ');
+    if (args) {
+        *args++ = '\0';
+        while (*args == ' ') args++;
+    } else {
+        args = line + strlen(line);
+    }
+
+    if (*line == '\0') return;  // Blank line
+
+    if (strcmp(line, "help") == 0) {
+        conn.out = HELP_TEXT;
+        conn.out += "ok\n";
+    } else if (strcmp(line, "status") == 0) {
+        writeStatus(conn);
+    } else if (strcmp(line, "tink") == 0) {
+        sendDevice(conn, DeviceCommand::Type::TINK_SEND, args);
+    } else if (strcmp(line, "switcher") == 0) {
+        sendDevice(conn, DeviceCommand::Type::SWITCHER_SEND, args);
+    } else if (strcmp(line, "avr") == 0) {
+        sendDevice(conn, DeviceCommand::Type::AVR_SEND, args);
+    } else if (strcmp(line, "logs") == 0) {
+        int count = *args ? atoi(args) : 20;
+        if (count < 1) count = 1;
+        if (count > MAX_LOG_LINES) count = MAX_LOG_LINES;
+        Logger& logger = Logger::instance();
+        conn.logEnd = logger.getLogCount();
+        conn.logNext = conn.logEnd > (unsigned long)count ? conn.logEnd - count : 0;
+        conn.stream = Stream::LOGS;
+    } else if (strcmp(line, "tail") == 0) {
+        conn.logNext = Logger::instance().getLogCount();
+        conn.stream = Stream::TAIL;
+    } else if (strcmp(line, "metrics") == 0) {
+        conn.metricsFamily = 0;
+        conn.stream = Stream::METRICS;
+    } else if (strcmp(line, "loglevel") == 0) {
+        if (*args == '\0') {
+            conn.out = LEVEL_NAMES[static_cast<int>(Logger::instance().getBufferLogLevel())];
+            conn.out += "\nok\n";
+            return;
+        }
+        for (int i = 0; i < 4; i++) {
+            if (strcasecmp(args, LEVEL_NAMES[i]) == 0) {
+                Logger::instance().setBufferLogLevel(static_cast<LogLevel>(i));
+                conn.out = "ok\n";
+                return;
+            }
+        }
+        conn.out = "error: level must be debug, info, warn or error\n";
+    } else if (strcmp(line, "quit") == 0 || strcmp(line, "exit") == 0) {
+        conn.out = "ok\n";
+        conn.quit = true;
+    } else {
+        conn.out = "error: unknown command (try help)\n";
+    }
+}
+
+void TcpConsole::writeStatus(Connection& conn) {
+    DeviceSnapshot snap;
+    _reader(snap);
+
+    const char* state = "unknown";
+    switch (snap.wifiState) {
+        case WifiManager::State::DISCONNECTED: state = "disconnected"; break;
+        case WifiManager::State::CONNECTING: state = "connecting"; break;
+        case WifiManager::State::CONNECTED: state = "connected"; break;
+        case WifiManager::State::FAILED: state = "failed"; break;
+        case WifiManager::State::AP_ACTIVE: state = "ap_active"; break;
+    }
+
+    char buf[200];
+    snprintf(buf, sizeof(buf), "version %s uptime=%lu\n", TINKLINK_VERSION_STRING, millis() / 1000);
+    conn.out = buf;
+    snprintf(buf, sizeof(buf), "wifi state=%s ssid=%s ip=%s rssi=%d\n",
+             state, snap.wifiSsid, snap.wifiIp, (int)snap.wifiRssi);
+    conn.out += buf;
+    snprintf(buf, sizeof(buf), "switcher type=%s input=%d\n",
+             snap.switcherType ? snap.switcherType : "none", snap.switcherInput);
+    conn.out += buf;
+    snprintf(buf, sizeof(buf), "tink connected=%d power=%s last=\"%s\"\n",
+             snap.tinkConnected, snap.tinkPowerState ? snap.tinkPowerState : "unknown",
+             snap.tinkLastCommand);
+    conn.out += buf;
+    if (snap.avrEnabled) {
+        snprintf(buf, sizeof(buf), "avr connected=%d input=%s last=\"%s\" response=\"%s\"\n",
+                 snap.avrConnected, snap.avrInput, snap.avrLastCommand, snap.avrLastResponse);
+    } else {
+        snprintf(buf, sizeof(buf), "avr disabled\n");
+    }
+    conn.out += buf;
+    conn.out += "ok\n";
+}
+
+void TcpConsole::sendDevice(Connection& conn, DeviceCommand::Type type, const char* text) {
+    if (*text == '\0') {
+        conn.out = "error: command required\n";
+        return;
+    }
+
+    if (type == DeviceCommand::Type::AVR_SEND) {
+        DeviceSnapshot snap;
+        _reader(snap);
+        if (!snap.avrEnabled) {
+            conn.out = "error: AVR is disabled\n";
+            return;
+        }
+    }
+
+    // Same mailbox as the HTTP handlers; loop() runs the command
+    conn.out = _poster(type, String(text)) ? "ok\n" : "error: command queue full or command too long\n";
+}
+
+#endif  // TINKLINK_HTTPD_IDF
@@ -0,0 +1,95 @@
+#ifndef TCP_CONSOLE_H
+#define TCP_CONSOLE_H
+
+#include <Arduino.h>
+#include <functional>
+#include "CommandMailbox.h"
+#include "DeviceSnapshot.h"
+
+class AsyncServer;
+class AsyncClient;
+
+/**
+ * Line-oriented TCP console for diagnostics (e.g. `nc tinklink.local 2323`).
+ *
+ * Runs on the AsyncTCP task like the HTTP handlers and shares their
+ * non-blocking paths: device commands are posted to the WebServer's
+ * command mailbox and state is read from the published DeviceSnapshot,
+ * so a console never blocks loop() or touches devices directly.
+ *
+ * Every command's output ends with a line "ok" or "error: <reason>", so
+ * scripts can read until one of those. Long outputs (logs, metrics) are
+ * generated a piece at a time as the socket has room, so each connection
+ * only holds a small line buffer and the piece being sent.
+ *
+ * Commands:
+ *   help                      List commands
+ *   status                    Device state, one section per line
+ *   tink|switcher|avr <cmd>   Send a command to a device
+ *   logs [n]                  Last n log entries (default 20)
+ *   tail                      Follow new log entries until the next input line
+ *   metrics                   Prometheus metrics
+ *   loglevel [debug|info|warn|error]  Show or set the buffered log level
+ *   quit                      Close the connection
+ */
+class TcpConsole {
+public:
+    /** Posts a device command; false if the mailbox is full */
+    using CommandPoster = std::function<bool(DeviceCommand::Type type, const String& text)>;
+
+    /** Copies the latest device snapshot */
+    using SnapshotReader = std::function<void(DeviceSnapshot& out)>;
+
+    static const uint16_t DEFAULT_PORT = 2323;
+    static const uint8_t MAX_CONNECTIONS = 2;
+    static const size_t INPUT_BUFFER_SIZE = 160;  ///< Longest accepted line + pipelined input
+
+    TcpConsole();
+    ~TcpConsole();
+
+    /**
+     * Start listening.
+     * @param port TCP port
+     * @param poster Posts device commands (called on the AsyncTCP task)
+     * @param reader Reads the device snapshot (called on the AsyncTCP task)
+     */
+    void begin(uint16_t port, CommandPoster poster, SnapshotReader reader);
+
+private:
+    /** Output still to be generated for a connection */
+    enum class Stream : uint8_t { NONE, LOGS, TAIL, METRICS };
+
+    struct Connection {
+        AsyncClient* client;
+        char in[INPUT_BUFFER_SIZE];
+        size_t inLen;
+        String out;           ///< Piece being sent
+        size_t outPos;        ///< Bytes of out already queued on the socket
+        Stream stream;
+        unsigned long logNext;
+        unsigned long logEnd;  ///< LOGS only; TAIL follows the live count
+        size_t metricsFamily;
+        bool quit;             ///< Close once the output has been sent
+    };
+
+    AsyncServer* _server;
+    Connection _connections[MAX_CONNECTIONS];
+    CommandPoster _poster;
+    SnapshotReader _reader;
+
+    void onConnect(AsyncClient* client);
+    void onData(Connection& conn, const uint8_t* data, size_t len);
+    void onDisconnect(Connection& conn);
+
+    /** Send pending output and run buffered lines until blocked. */
+    void service(Connection& conn);
+
+    /** Generate the next piece of a streaming command; false when none. */
+    bool nextPiece(Connection& conn);
+
+    void execute(Connection& conn, char* line);
+    void writeStatus(Connection& conn);
+    void sendDevice(Connection& conn, DeviceCommand::Type type, const char* text);
+};
+
+#endif // TCP_CONSOLE_H
@@ -1,5 +1,6 @@
 #include "TelnetSerial.h"
 #include "Logger.h"
+#include "Metrics.h"
 
 TelnetSerial::TelnetSerial(const String& ip, uint16_t port)
     : _ip(ip), _port(port)
@@ -30,6 +31,7 @@ bool TelnetSerial::sendData(const String& data) {
     }
 
     size_t written = _client.print(data);
+    Metrics::instance().addTransportTx(Metrics::Transport::TELNET, written);
     if (written == data.length()) {
         LOG_DEBUG("TelnetSerial TX: [%s]", data.c_str());
         return true;
@@ -43,6 +45,7 @@ bool TelnetSerial::sendData(const String& data) {
 bool TelnetSerial::readLine(String& line) {
     while (_client.available()) {
         char c = _client.read();
+        Metrics::instance().addTransportRx(Metrics::Transport::TELNET, 1);
 
         if (c == '\r') {
             // Denon responses terminate with CR
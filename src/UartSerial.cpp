@@ -1,5 +1,6 @@
 #include "UartSerial.h"
 #include "Logger.h"
+#include "Metrics.h"
 
 UartSerial::UartSerial(uint8_t uartNum, uint8_t rxPin, uint8_t txPin, uint32_t baud)
     : _hwSerial(uartNum)
@@ -37,6 +38,7 @@ bool UartSerial::sendData(const String& data) {
     }
 
     size_t written = _hwSerial.print(data);
+    Metrics::instance().addTransportTx(Metrics::Transport::UART, written);
     return written == data.length();
 }
 
@@ -48,6 +50,7 @@ bool UartSerial::readLine(String& line) {
     // Read available characters and accumulate in buffer
     while (_hwSerial.available()) {
         char c = _hwSerial.read();
+        Metrics::instance().addTransportRx(Metrics::Transport::UART, 1);
 
         if (c == '\n') {
             // Newline marks end of line
@@ -3,6 +3,7 @@
 #ifndef NO_USB_HOST
 
 #include "Logger.h"
+#include "Metrics.h"
 
 UsbHostSerial::UsbHostSerial()
     : _connected(false)
@@ -45,6 +46,7 @@ bool UsbHostSerial::sendData(const uint8_t* data, size_t length) {
     }
 
     submit(data, length);
+    Metrics::instance().addTransportTx(Metrics::Transport::USB_HOST, length);
     return true;
 }
 
@@ -147,6 +149,7 @@ void UsbHostSerial::onGone() {
 }
 
 void UsbHostSerial::onReceive(const uint8_t* data, const size_t length) {
+    Metrics::instance().addTransportRx(Metrics::Transport::USB_HOST, length);
     for (size_t i = 0; i < length; i++) {
         rxBufferWrite(data[i]);
     }
@@ -1,270 +1,719 @@
 #include "WebServer.h"
 #include "WifiManager.h"
 #include "ConfigManager.h"
+#include "Devices.h"
 #include "Switcher.h"
 #include "RetroTink.h"
 #include "DenonAvr.h"
 #include "Logger.h"
+#include "ApiResponse.h"
+#include "ChunkedResponse.h"
+#include "DiagnosticsBundle.h"
+#include "Metrics.h"
 #include "version.h"
 #include <ArduinoJson.h>
 #include <LittleFS.h>
-#include <Update.h>
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+Metrics::ShedReason shedReason(AdmissionControl::Verdict verdict) {
+    switch (verdict) {
+        case AdmissionControl::Verdict::SHED_RATE: return Metrics::ShedReason::RATE;
+        case AdmissionControl::Verdict::SHED_HEAP: return Metrics::ShedReason::HEAP;
+        default: return Metrics::ShedReason::CONCURRENCY;
+    }
+}
+
+const char* shedBody(AdmissionControl::Verdict verdict) {
+    switch (verdict) {
+        case AdmissionControl::Verdict::SHED_RATE: return "{\"error\":\"Too many requests\"}";
+        case AdmissionControl::Verdict::SHED_HEAP: return "{\"error\":\"Low memory\"}";
+        default: return "{\"error\":\"Server busy\"}";
+    }
+}
+
+}  // namespace
+
+/**
+ * Read an unsigned integer request parameter (query or form).
+ * Accepts decimal or 0x-prefixed hex so full 32-bit CRCs round-trip.
+ */
+static unsigned long getUnsignedParam(HttpRequest* request, const char* name,
+                                      unsigned long fallback = 0) {
+    const HttpParam* param = nullptr;
+    if (request->hasParam(name, true)) {
+        param = request->getParam(name, true);
+    } else if (request->hasParam(name)) {
+        param = request->getParam(name);
+    }
+    return param ? strtoul(param->value().c_str(), nullptr, 0) : fallback;
+}
 
 WebServer::WebServer(uint16_t port)
-    : _server(new AsyncWebServer(port))
+    : _server(new HttpServer(port))
     , _wifi(nullptr)
     , _config(nullptr)
-    , _switcher(nullptr)
-    , _tink(nullptr)
-    , _avrPtr(nullptr)
+    , _devices(nullptr)
+    , _pullOta(nullptr)
+    , _lastSnapshot(0)
+    , _avrDiscoveryVersion(0)
+    , _nextBatchId(1)
+    , _configEpoch(0)
+    , _otaSession(_ota)
+    , _otaChunkResult(OtaSession::ChunkResult::NO_SESSION)
     , _otaMode(OTAMode::FIRMWARE)
     , _otaProgress(0)
     , _otaTotal(0)
     , _otaInProgress(false)
     , _otaError("")
+    , _restoreNeedsReboot(false)
+    , _triggersBodyTooLarge(false)
 {
+    memset(&_messagesScratch, 0, sizeof(_messagesScratch));
 }
 
 WebServer::~WebServer() {
     delete _server;
 }
 
-void WebServer::begin(WifiManager* wifi, ConfigManager* config, Switcher* switcher, RetroTink* tink, DenonAvr** avr) {
+void WebServer::begin(WifiManager* wifi, ConfigManager* config, Devices* devices) {
     _wifi = wifi;
     _config = config;
-    _switcher = switcher;
-    _tink = tink;
-    _avrPtr = avr;
+    _devices = devices;
+    _batch.begin(devices);
 
+    publishSnapshot();
+    publishSwitcherMessages();
+    publishAvrDiscovery();
     setupRoutes();
     _server->begin();
 
-    LOG_INFO("WebServer: Started on port 80");
+    LOG_INFO("WebServer: Started on port 80 (%s backend)", HttpServer::BACKEND);
+
+#ifndef TINKLINK_HTTPD_IDF
+    // Console callbacks run on the AsyncTCP task, the mailbox's only producer
+    _console.begin(TcpConsole::DEFAULT_PORT,
+        [this](DeviceCommand::Type type, const String& text) { return postCommand(type, text); },
+        [this](DeviceSnapshot& out) { _snapshot.load(out); });
+#endif
 }
 
 void WebServer::end() {
     _server->end();
 }
 
+void WebServer::update() {
+    bool executed = processCommands();
+    if (executed) _wifi->noteActivity();  // Scans wait for the device to go quiet
+    _batch.update();
+
+    // Refresh periodically, and right away so a command's effect is visible
+    if (executed || millis() - _lastSnapshot >= SNAPSHOT_INTERVAL_MS) {
+        publishSnapshot();
+        publishSwitcherMessages();
+        publishAvrDiscovery();
+    }
+}
+
+void WebServer::publishSnapshot() {
+    DeviceSnapshot snap;
+    memset(&snap, 0, sizeof(snap));
+    Switcher* switcher = _devices->switcher();
+    RetroTink* tink = _devices->tink();
+    DenonAvr* avr = _devices->avr();
+
+    // Versions first: a change racing the copy below is then re-reported next time
+    snap.wifiVersion = _wifi->getStateVersion();
+    snap.switcherVersion = switcher ? switcher->getStateVersion() : 0;
+    snap.tinkVersion = tink->getStateVersion();
+    snap.avrVersion = avr ? avr->getStateVersion() : 0;
+
+    snap.wifiState = _wifi->getState();
+    snap.wifiMode = _wifi->getMode();
+    snap.wifiRssi = _wifi->getRSSI();
+    strlcpy(snap.wifiSsid, _wifi->getSSID().c_str(), sizeof(snap.wifiSsid));
+    strlcpy(snap.wifiIp, _wifi->getIP().c_str(), sizeof(snap.wifiIp));
+    if (_wifi->isAPActive()) {
+        auto apConfig = _wifi->getAPConfig();
+        strlcpy(snap.apSsid, apConfig.ssid.c_str(), sizeof(snap.apSsid));
+        strlcpy(snap.apIp, apConfig.ip.toString().c_str(), sizeof(snap.apIp));
+    }
+
+    snap.switcherType = switcher ? switcher->getTypeName() : "none";
+    snap.switcherInput = switcher ? switcher->getCurrentInput() : 0;
+
+    snap.tinkConnected = tink->isConnected();
+    snap.tinkPowerState = tink->getPowerStateString();
+    strlcpy(snap.tinkLastCommand, tink->getLastCommand().c_str(), sizeof(snap.tinkLastCommand));
+
+    snap.avrEnabled = avr != nullptr;
+    if (avr) {
+        snap.avrConnected = avr->isConnected();
+        strlcpy(snap.avrInput, avr->getInput().c_str(), sizeof(snap.avrInput));
+        strlcpy(snap.avrLastCommand, avr->getLastCommand().c_str(), sizeof(snap.avrLastCommand));
+        strlcpy(snap.avrLastResponse, avr->getLastResponse().c_str(), sizeof(snap.avrLastResponse));
+    }
+
+    snap.configEpoch = _devices->getEpoch();
+    snap.updatedAt = millis();
+    _snapshot.store(snap);
+    _lastSnapshot = snap.updatedAt;
+}
+
+void WebServer::publishSwitcherMessages() {
+    Switcher* switcher = _devices->switcher();
+    uint32_t version = switcher ? switcher->getMessageVersion() : 0;
+    if (version == _messagesScratch.version) return;
+
+    _messagesScratch.version = version;
+    _messagesScratch.count = 0;
+    if (switcher) {
+        std::vector<String> messages = switcher->getRecentMessages(SwitcherMessages::MAX_MESSAGES);
+        for (const String& msg : messages) {
+            strlcpy(_messagesScratch.lines[_messagesScratch.count++], msg.c_str(),
+                    SwitcherMessages::TEXT_LEN);
+        }
+    }
+    _switcherMessages.store(_messagesScratch);
+}
+
+void WebServer::publishAvrDiscovery() {
+    DenonAvr* avr = _devices->avr();
+    uint32_t version = avr ? avr->getDiscoveryVersion() : 0;
+    if (version == _avrDiscoveryVersion) return;
+    _avrDiscoveryVersion = version;
+
+    AvrDiscovery discovery;
+    memset(&discovery, 0, sizeof(discovery));
+    discovery.version = version;
+    discovery.enabled = avr != nullptr;
+    if (avr) {
+        discovery.discovering = !avr->isDiscoveryComplete();
+        for (const auto& dev : avr->getDiscoveryResults()) {
+            if (discovery.count >= AvrDiscovery::MAX_DEVICES) break;
+            auto& entry = discovery.devices[discovery.count++];
+            strlcpy(entry.ip, dev.ip.c_str(), sizeof(entry.ip));
+            strlcpy(entry.name, dev.friendlyName.c_str(), sizeof(entry.name));
+        }
+    }
+    _avrDiscovery.store(discovery);
+}
+
+bool WebServer::postCommand(DeviceCommand::Type type, const String& text,
+                            std::vector<TriggerMapping>* triggers) {
+    if (text.length() > DeviceCommand::MAX_TEXT_LEN) {
+        delete triggers;
+        return false;
+    }
+
+    DeviceCommand cmd = DeviceCommand::make(type);
+    strlcpy(cmd.text, text.c_str(), sizeof(cmd.text));
+    cmd.triggers = triggers;
+
+    if (!_commands.push(cmd)) {
+        LOG_WARN("WebServer: Command mailbox full - dropping command");
+        delete triggers;
+        return false;
+    }
+    return true;
+}
+
+bool WebServer::postBatch(uint32_t id, std::vector<BatchStep>* steps) {
+    DeviceCommand cmd = DeviceCommand::make(DeviceCommand::Type::RUN_BATCH);
+    cmd.batch = steps;
+    cmd.batchId = id;
+
+    if (!_commands.push(cmd)) {
+        LOG_WARN("WebServer: Command mailbox full - dropping batch");
+        delete steps;
+        return false;
+    }
+    return true;
+}
+
+uint32_t WebServer::postReconfigure() {
+    DeviceCommand cmd = DeviceCommand::make(DeviceCommand::Type::RECONFIGURE);
+    cmd.config = new DeviceConfigSet();
+    cmd.config->switcher = _config->getSwitcherConfig();
+    cmd.config->tink = _config->getRetroTinkConfig();
+    cmd.config->avr = _config->getAvrConfig();
+    cmd.config->network = _config->getNetworkConfig();
+    cmd.configEpoch = _configEpoch + 1;
+
+    if (!_commands.push(cmd)) {
+        LOG_WARN("WebServer: Command mailbox full - config change applies at reboot");
+        delete cmd.config;
+        return 0;
+    }
+    return ++_configEpoch;
+}
+
+bool WebServer::postNetworks() {
+    auto networks = new std::vector<WifiManager::Credentials>();
+    for (const auto& network : _config->getWifiConfig().networks) {
+        networks->push_back(WifiManager::Credentials{network.ssid, network.password});
+    }
+
+    DeviceCommand cmd = DeviceCommand::make(DeviceCommand::Type::WIFI_NETWORKS);
+    cmd.networks = networks;
+
+    if (!_commands.push(cmd)) {
+        LOG_WARN("WebServer: Command mailbox full - saved networks apply at reboot");
+        delete networks;
+        return false;
+    }
+    return true;
+}
+
+bool WebServer::processCommands() {
+    bool executed = false;
+    DeviceCommand cmd;
+    while (_commands.pop(cmd)) {
+        executed = true;
+        switch (cmd.type) {
+            case DeviceCommand::Type::TINK_SEND:
+                _devices->tink()->sendRawCommand(cmd.text);
+                break;
+
+            case DeviceCommand::Type::SWITCHER_SEND:
+                if (_devices->switcher()) _devices->switcher()->sendCommand(cmd.text);
+                break;
+
+            case DeviceCommand::Type::SWITCHER_CLEAR:
+                if (_devices->switcher()) _devices->switcher()->clearRecentMessages();
+                break;
+
+            case DeviceCommand::Type::AVR_SEND:
+                if (!_devices->avr()) {
+                    LOG_WARN("WebServer: AVR disabled - dropping command %s", cmd.text);
+                } else if (!_devices->avr()->sendRawCommand(cmd.text)) {
+                    LOG_ERROR("WebServer: Failed to send AVR command %s", cmd.text);
+                }
+                break;
+
+            case DeviceCommand::Type::AVR_DISCOVER:
+                if (_devices->avr()) _devices->avr()->startDiscovery();
+                break;
+
+            case DeviceCommand::Type::SET_TRIGGERS:
+                if (cmd.triggers) {
+                    RetroTink* tink = _devices->tink();
+                    tink->clearTriggers();
+                    for (const auto& trigger : *cmd.triggers) {
+                        tink->addTrigger(trigger);
+                    }
+                    delete cmd.triggers;
+                }
+                break;
+
+            case DeviceCommand::Type::RUN_BATCH:
+                if (cmd.batch) {
+                    _batch.start(cmd.batchId, std::move(*cmd.batch));
+                    delete cmd.batch;
+                }
+                break;
+
+            case DeviceCommand::Type::RECONFIGURE:
+                if (cmd.config) {
+                    _wifi->configure(cmd.config->network);
+                    uint8_t touched = _devices->apply(*cmd.config, cmd.configEpoch);
+                    LOG_INFO("WebServer: Config epoch %lu applied (switcher: %s, tink: %s, avr: %s)",
+                             (unsigned long)cmd.configEpoch,
+                             (touched & Devices::SWITCHER) ? "changed" : "unchanged",
+                             (touched & Devices::TINK) ? "changed" : "unchanged",
+                             (touched & Devices::AVR) ? "changed" : "unchanged");
+                    delete cmd.config;
+                }
+                break;
+
+            case DeviceCommand::Type::WIFI_CONNECT:
+                if (cmd.wifi) {
+                    _wifi->connect(cmd.wifi->ssid, cmd.wifi->password);
+                    delete cmd.wifi;
+                }
+                break;
+
+            case DeviceCommand::Type::WIFI_DISCONNECT:
+                _wifi->disconnect();
+                break;
+
+            case DeviceCommand::Type::WIFI_PROBE:
+                if (!_wifi->startProbe(cmd.probeCount, cmd.probeIntervalMs)) {
+                    LOG_WARN("WebServer: WiFi probe not started (not connected or already running)");
+                }
+                break;
+
+            case DeviceCommand::Type::WIFI_NETWORKS:
+                if (cmd.networks) {
+                    _wifi->setNetworks(*cmd.networks);
+                    delete cmd.networks;
+                }
+                break;
+        }
+    }
+    return executed;
+}
+
 void WebServer::setLEDCallback(LEDControlCallback callback) {
     _ledCallback = callback;
 }
 
 void WebServer::setupRoutes() {
+    // Admission control and request timing, ahead of every route. The
+    // token carries the admission class and metrics kind to the finish hook.
+    _server->setAdmission(
+        [this](HttpRequest* request) {
+            AdmissionControl::Class cls = AdmissionControl::classify(request->url(), request->method());
+            Metrics::HttpKind kind = Metrics::classify(request->url());
+
+            HttpServer::Admission admission;
+            AdmissionControl::Verdict verdict = _admission.admit(
+                cls, HttpServer::remoteIp(request), millis(), admission.retryAfter);
+            admission.admitted = verdict == AdmissionControl::Verdict::ADMIT;
+            admission.body = admission.admitted ? nullptr : shedBody(verdict);
+            admission.token = ((uint32_t)cls << 8) | (uint32_t)kind;
+
+            if (!admission.admitted) Metrics::instance().recordHttpShed(shedReason(verdict));
+            return admission;
+        },
+        [this](const HttpServer::Admission& admission, uint32_t us) {
+            if (admission.admitted) _admission.release((AdmissionControl::Class)(admission.token >> 8));
+            Metrics::instance().recordHttpRequest((Metrics::HttpKind)(admission.token & 0xff), us);
+        });
+
+    // Prometheus metrics
+    _server->on("/metrics", HTTP_GET,
+        [this](HttpRequest* request) { handleMetrics(request); });
+
     // API endpoints - register these BEFORE serveStatic to ensure they're matched first
     _server->on("/api/status", HTTP_GET,
-        [this](AsyncWebServerRequest* request) { handleApiStatus(request); });
+        [this](HttpRequest* request) { handleApiStatus(request); });
 
     // WiFi endpoints
     _server->on("/api/wifi/scan", HTTP_GET,
-        [this](AsyncWebServerRequest* request) { handleApiScan(request); });
+        [this](HttpRequest* request) { handleApiScan(request); });
 
     _server->on("/api/wifi/connect", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiConnect(request); });
+        [this](HttpRequest* request) { handleApiConnect(request); });
 
     _server->on("/api/wifi/disconnect", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiDisconnect(request); });
+        [this](HttpRequest* request) { handleApiDisconnect(request); });
 
     _server->on("/api/wifi/save", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiSave(request); });
+        [this](HttpRequest* request) { handleApiSave(request); });
+
+    _server->on("/api/wifi/forget", HTTP_POST,
+        [this](HttpRequest* request) { handleApiForget(request); });
+
+    _server->on("/api/wifi/networks", HTTP_GET,
+        [this](HttpRequest* request) { handleApiNetworks(request); });
+
+    _server->on("/api/wifi/probe", HTTP_POST,
+        [this](HttpRequest* request) { handleApiProbe(request); });
+
+    _server->on("/api/wifi/probe", HTTP_GET,
+        [this](HttpRequest* request) { handleApiProbeStatus(request); });
 
     // Configuration endpoints
     _server->on("/api/config/triggers", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiConfigTriggers(request); });
+        [this](HttpRequest* request) { handleApiConfigTriggers(request); },
+        NULL,
+        [this](HttpRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            handleApiConfigTriggersBody(request, data, len, index, total);
+        });
 
     // RetroTINK endpoints
     _server->on("/api/tink/send", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiTinkSend(request); });
+        [this](HttpRequest* request) { handleApiTinkSend(request); });
+
+    // Batch endpoint - several device commands in one request
+    _server->on("/api/batch", HTTP_POST,
+        [this](HttpRequest* request) { handleApiBatch(request); });
+
+    _server->on("/api/batch", HTTP_GET,
+        [this](HttpRequest* request) { handleApiBatchStatus(request); });
 
     // Debug endpoints
     _server->on("/api/debug/led", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiDebugLED(request); });
+        [this](HttpRequest* request) { handleApiDebugLED(request); });
 
     // Switcher endpoints
     _server->on("/api/switcher/send", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiSwitcherSend(request); });
+        [this](HttpRequest* request) { handleApiSwitcherSend(request); });
 
     _server->on("/api/switcher/receive", HTTP_GET,
-        [this](AsyncWebServerRequest* request) { handleApiSwitcherReceive(request); });
+        [this](HttpRequest* request) { handleApiSwitcherReceive(request); });
 
     // AVR endpoints
     _server->on("/api/avr/discover", HTTP_GET,
-        [this](AsyncWebServerRequest* request) { handleApiAvrDiscover(request); });
+        [this](HttpRequest* request) { handleApiAvrDiscover(request); });
 
     _server->on("/api/avr/send", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiAvrSend(request); });
+        [this](HttpRequest* request) { handleApiAvrSend(request); });
 
     _server->on("/api/config/avr", HTTP_GET,
-        [this](AsyncWebServerRequest* request) { handleApiConfigAvrGet(request); });
+        [this](HttpRequest* request) { handleApiConfigAvrGet(request); });
 
     _server->on("/api/config/avr", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiConfigAvr(request); });
+        [this](HttpRequest* request) { handleApiConfigAvr(request); });
+
+    _server->on("/api/config/network", HTTP_GET,
+        [this](HttpRequest* request) { handleApiConfigNetworkGet(request); });
+
+    _server->on("/api/config/network", HTTP_POST,
+        [this](HttpRequest* request) { handleApiConfigNetwork(request); });
 
     // System logs endpoint
     _server->on("/api/logs", HTTP_GET,
-        [this](AsyncWebServerRequest* request) { handleApiLogs(request); });
+        [this](HttpRequest* request) { handleApiLogs(request); });
+
+    // Support bundle: state, logs, counters and redacted config in one stream
+    _server->on("/api/diagnostics", HTTP_GET,
+        [this](HttpRequest* request) { handleApiDiagnostics(request); });
 
     // OTA update endpoints
     _server->on("/api/ota/status", HTTP_GET,
-        [this](AsyncWebServerRequest* request) { handleApiOtaStatus(request); });
+        [this](HttpRequest* request) { handleApiOtaStatus(request); });
 
     _server->on("/api/ota/upload", HTTP_POST,
-        [this](AsyncWebServerRequest* request) {
+        [this](HttpRequest* request) {
             // Final response after upload completes
             if (_otaError.length() > 0) {
-                request->send(400, "application/json", "{\"error\":\"" + _otaError + "\"}");
+                JsonDocument doc;
+                doc["error"] = _otaError;
+                // Another upload, session or pull OTA holds the update
+                ApiResponse::send(request, _otaError == OtaWriter::BUSY_ERROR ? 409 : 400, doc);
             } else {
-                request->send(200, "application/json", "{\"status\":\"ok\",\"message\":\"Update successful. Rebooting...\"}");
+                ApiResponse::send(request, 200, "{\"status\":\"ok\",\"message\":\"Update successful. Rebooting...\"}");
                 delay(500);
                 ESP.restart();
             }
         },
-        [this](AsyncWebServerRequest* request, String filename, size_t index,
+        [this](HttpRequest* request, String filename, size_t index,
                uint8_t* data, size_t len, bool final) {
             handleOtaUpload(request, filename, index, data, len, final);
         }
     );
 
+    // Resumable OTA: session + checksummed chunks at explicit offsets
+    _server->on("/api/ota/session", HTTP_POST,
+        [this](HttpRequest* request) { handleApiOtaSessionStart(request); });
+
+    _server->on("/api/ota/session", HTTP_GET,
+        [this](HttpRequest* request) { handleApiOtaSessionGet(request); });
+
+    _server->on("/api/ota/session", HTTP_DELETE,
+        [this](HttpRequest* request) { handleApiOtaSessionAbort(request); });
+
+    _server->on("/api/ota/chunk", HTTP_POST,
+        [this](HttpRequest* request) { handleApiOtaChunk(request); },
+        NULL,
+        [this](HttpRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            handleApiOtaChunkBody(request, data, len, index, total);
+        });
+
+    _server->on("/api/ota/finish", HTTP_POST,
+        [this](HttpRequest* request) { handleApiOtaFinish(request); });
+
+    // Pull OTA from a manifest server
+    _server->on("/api/ota/pull", HTTP_GET,
+        [this](HttpRequest* request) { handleApiOtaPullStatus(request); });
+
+    _server->on("/api/ota/pull", HTTP_POST,
+        [this](HttpRequest* request) { handleApiOtaPullCheck(request); });
+
     // Config backup endpoint - download all config files as JSON
     _server->on("/api/config/backup", HTTP_GET,
-        [this](AsyncWebServerRequest* request) { handleApiConfigBackup(request); });
+        [this](HttpRequest* request) { handleApiConfigBackup(request); });
 
     // Config restore endpoint - restore config files from JSON backup
     _server->on("/api/config/restore", HTTP_POST,
-        [this](AsyncWebServerRequest* request) { handleApiConfigRestore(request); },
+        [this](HttpRequest* request) { handleApiConfigRestore(request); },
         NULL,
-        [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+        [this](HttpRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
             handleApiConfigRestoreBody(request, data, len, index, total);
         });
 
     // System reboot endpoint
     _server->on("/api/system/reboot", HTTP_POST,
-        [](AsyncWebServerRequest* request) {
+        [](HttpRequest* request) {
             LOG_INFO("WebServer: Reboot requested via API");
-            request->send(200, "application/json", "{\"status\":\"ok\",\"message\":\"Rebooting...\"}");
+            ApiResponse::send(request, 200, "{\"status\":\"ok\",\"message\":\"Rebooting...\"}");
             delay(500);
             ESP.restart();
         });
 
     // Serve static files from LittleFS - must come AFTER API routes
-    _server->serveStatic("/", LittleFS, "/").setDefaultFile("index.html");
+    _server->serveStatic("/", LittleFS, "/", "index.html");
 
     // Handle 404
     _server->onNotFound(
-        [this](AsyncWebServerRequest* request) { handleNotFound(request); });
+        [this](HttpRequest* request) { handleNotFound(request); });
 }
 
-void WebServer::handleApiStatus(AsyncWebServerRequest* request) {
+void WebServer::handleApiStatus(HttpRequest* request) {
+    // Device state comes from the loop's snapshot, not the live objects
+    DeviceSnapshot snap;
+    _snapshot.load(snap);
+
+    // Section versions (see StateVersion); the AVR section also shows config
+    uint32_t configVersion = _config->getStateVersion();
+    uint32_t avrVersion = std::max(snap.avrVersion, configVersion);
+    uint32_t stateVersion = std::max(std::max(snap.wifiVersion, snap.switcherVersion),
+                                     std::max(snap.tinkVersion, avrVersion));
+
+    // ?since=N returns only sections changed after N. A version above the
+    // current sequence is from before a reboot, so send everything.
+    bool delta = request->hasParam("since");
+    uint32_t since = delta ? getUnsignedParam(request, "since") : 0;
+    if (delta && since > StateVersion::current()) {
+        delta = false;
+        since = 0;
+    }
+
+    if (delta && since >= stateVersion) {
+        ApiResponse::send(request, 200,
+                          "{\"stateVersion\":" + String(stateVersion) + ",\"unchanged\":true}");
+        return;
+    }
+
     JsonDocument doc;
 
     // Version
     doc["version"] = TINKLINK_VERSION_STRING;
+    doc["stateVersion"] = stateVersion;
+    doc["configEpoch"] = snap.configEpoch;
 
     // WiFi status
-    doc["wifi"]["connected"] = _wifi->isConnected();
-    doc["wifi"]["ssid"] = _wifi->getSSID();
-    doc["wifi"]["ip"] = _wifi->getIP();
-    doc["wifi"]["rssi"] = _wifi->getRSSI();
-    doc["wifi"]["hostname"] = WiFi.getHostname();
-
-    const char* stateStr = "unknown";
-    switch (_wifi->getState()) {
-        case WifiManager::State::DISCONNECTED: stateStr = "disconnected"; break;
-        case WifiManager::State::CONNECTING: stateStr = "connecting"; break;
-        case WifiManager::State::CONNECTED: stateStr = "connected"; break;
-        case WifiManager::State::FAILED: stateStr = "failed"; break;
-        case WifiManager::State::AP_ACTIVE: stateStr = "ap_active"; break;
-    }
-    doc["wifi"]["state"] = stateStr;
-
-    const char* modeStr = "sta";
-    switch (_wifi->getMode()) {
-        case WifiManager::Mode::STA: modeStr = "sta"; break;
-        case WifiManager::Mode::AP: modeStr = "ap"; break;
-        case WifiManager::Mode::AP_STA: modeStr = "ap_sta"; break;
-    }
-    doc["wifi"]["mode"] = modeStr;
-
-    // Add AP info if in AP mode
-    if (_wifi->isAPActive()) {
-        auto apConfig = _wifi->getAPConfig();
-        doc["wifi"]["ap_ssid"] = apConfig.ssid;
-        doc["wifi"]["ap_ip"] = apConfig.ip.toString();
+    if (!delta || snap.wifiVersion > since) {
+        doc["wifi"]["connected"] = snap.wifiState == WifiManager::State::CONNECTED;
+        doc["wifi"]["ssid"] = snap.wifiSsid;
+        doc["wifi"]["ip"] = snap.wifiIp;
+        doc["wifi"]["rssi"] = snap.wifiRssi;
+        doc["wifi"]["hostname"] = WiFi.getHostname();
+
+        const char* stateStr = "unknown";
+        switch (snap.wifiState) {
+            case WifiManager::State::DISCONNECTED: stateStr = "disconnected"; break;
+            case WifiManager::State::CONNECTING: stateStr = "connecting"; break;
+            case WifiManager::State::CONNECTED: stateStr = "connected"; break;
+            case WifiManager::State::FAILED: stateStr = "failed"; break;
+            case WifiManager::State::AP_ACTIVE: stateStr = "ap_active"; break;
+        }
+        doc["wifi"]["state"] = stateStr;
+
+        const char* modeStr = "sta";
+        switch (snap.wifiMode) {
+            case WifiManager::Mode::STA: modeStr = "sta"; break;
+            case WifiManager::Mode::AP: modeStr = "ap"; break;
+            case WifiManager::Mode::AP_STA: modeStr = "ap_sta"; break;
+        }
+        doc["wifi"]["mode"] = modeStr;
+
+        // Add AP info if in AP mode
+        if (snap.wifiState == WifiManager::State::AP_ACTIVE) {
+            doc["wifi"]["ap_ssid"] = snap.apSsid;
+            doc["wifi"]["ap_ip"] = snap.apIp;
+        }
     }
 
     // Switcher status
-    doc["switcher"]["type"] = _switcher->getTypeName();
-    doc["switcher"]["currentInput"] = _switcher->getCurrentInput();
+    if (!delta || snap.switcherVersion > since) {
+        doc["switcher"]["type"] = snap.switcherType;
+        doc["switcher"]["currentInput"] = snap.switcherInput;
+    }
 
     // RetroTINK status
-    doc["tink"]["connected"] = _tink->isConnected();
-    doc["tink"]["powerState"] = _tink->getPowerStateString();
-    doc["tink"]["lastCommand"] = _tink->getLastCommand();
+    if (!delta || snap.tinkVersion > since) {
+        doc["tink"]["connected"] = snap.tinkConnected;
+        doc["tink"]["powerState"] = snap.tinkPowerState;
+        doc["tink"]["lastCommand"] = snap.tinkLastCommand;
+    }
 
     // AVR status
-    if (avr()) {
-        auto avrConfig = _config->getAvrConfig();
-        doc["avr"]["type"] = avrConfig["type"] | "Denon X4300H";
-        doc["avr"]["enabled"] = true;  // AVR exists, so it's enabled
-        doc["avr"]["connected"] = avr()->isConnected();
-        doc["avr"]["ip"] = avrConfig["ip"] | "";
-        doc["avr"]["input"] = avr()->getInput();
-        doc["avr"]["lastCommand"] = avr()->getLastCommand();
-        doc["avr"]["lastResponse"] = avr()->getLastResponse();
-    } else {
-        doc["avr"]["enabled"] = false;
+    if (!delta || avrVersion > since) {
+        if (snap.avrEnabled) {
+            const AvrConfig& avrConfig = _config->getAvrConfig();
+            doc["avr"]["type"] = String(avrConfig.type);
+            doc["avr"]["enabled"] = true;  // AVR exists, so it's enabled
+            doc["avr"]["connected"] = snap.avrConnected;
+            doc["avr"]["ip"] = String(avrConfig.ip);
+            doc["avr"]["input"] = snap.avrInput;
+            doc["avr"]["lastCommand"] = snap.avrLastCommand;
+            doc["avr"]["lastResponse"] = snap.avrLastResponse;
+        } else {
+            doc["avr"]["enabled"] = false;
+        }
     }
 
     // Triggers
-    JsonArray triggersArray = doc["triggers"].to<JsonArray>();
-    for (const auto& trigger : _config->getTriggers()) {
-        JsonObject triggerObj = triggersArray.add<JsonObject>();
-        triggerObj["input"] = trigger.switcherInput;
-        triggerObj["profile"] = trigger.profile;
-        triggerObj["mode"] = trigger.mode == TriggerMapping::SVS ? "SVS" : "Remote";
-        triggerObj["name"] = trigger.name;
+    if (!delta || configVersion > since) {
+        JsonArray triggersArray = doc["triggers"].to<JsonArray>();
+        for (const auto& trigger : _config->getTriggers()) {
+            JsonObject triggerObj = triggersArray.add<JsonObject>();
+            triggerObj["input"] = trigger.switcherInput;
+            triggerObj["profile"] = trigger.profile;
+            triggerObj["mode"] = trigger.mode == TriggerMapping::SVS ? "SVS" : "Remote";
+            triggerObj["name"] = trigger.name;
+        }
     }
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleApiScan(AsyncWebServerRequest* request) {
-    JsonDocument doc;
+void WebServer::handleMetrics(HttpRequest* request) {
+    // One snapshot for the whole scrape; families are formatted as they are sent
+    auto snap = std::make_shared<DeviceSnapshot>();
+    _snapshot.load(*snap);
 
-    if (_wifi->isScanComplete()) {
-        auto networks = _wifi->getScanResults();
-
-        if (networks.size() > 0) {
-            // Have results — return them and start next scan
-            doc["status"] = "complete";
-            JsonArray networksArray = doc["networks"].to<JsonArray>();
-            for (const auto& net : networks) {
-                JsonObject netObj = networksArray.add<JsonObject>();
-                netObj["ssid"] = net.ssid;
-                netObj["rssi"] = net.rssi;
-                netObj["secure"] = net.encryptionType != WIFI_AUTH_OPEN;
-            }
-            _wifi->startScan();
-        } else {
-            // Complete but no results (first call or empty) — start a scan
-            _wifi->startScan();
-            doc["status"] = "scanning";
-            doc["networks"].to<JsonArray>();
-        }
-    } else {
-        // Scan in progress
+    size_t family = 0;
+    request->send(ChunkedResponse::create(request, Metrics::CONTENT_TYPE,
+        [snap, family](String& out) mutable {
+            return Metrics::instance().render(family++, *snap, out);
+        }));
+}
+
+void WebServer::handleApiScan(HttpRequest* request) {
+    // Answered from the cache; a stale one is refreshed in the background
+    // once the device is idle (WifiManager::update())
+    WifiManager::ScanCache scan;
+    _wifi->readScan(scan);
+
+    unsigned long age = millis() - scan.updatedAt;
+    bool refresh = request->hasParam("refresh") && age >= SCAN_MIN_REFRESH_MS;
+    bool requested = false;
+    if (scan.updatedAt == 0 || age >= WifiManager::SCAN_CACHE_TTL_MS || refresh) {
+        _wifi->requestScan();
+        requested = true;
+    }
+
+    JsonDocument doc;
+    if (scan.updatedAt == 0) {
+        // First scan since boot still to come
         doc["status"] = "scanning";
         doc["networks"].to<JsonArray>();
+    } else {
+        doc["status"] = "complete";
+        doc["ageSec"] = age / 1000;
+        doc["refreshing"] = scan.scanning || requested;
+        doc["partial"] = scan.partial;
+        JsonArray networksArray = doc["networks"].to<JsonArray>();
+        for (uint8_t i = 0; i < scan.count; i++) {
+            const WifiManager::NetworkInfo& net = scan.networks[i];
+            JsonObject netObj = networksArray.add<JsonObject>();
+            netObj["ssid"] = net.ssid;
+            netObj["rssi"] = net.rssi;
+            netObj["channel"] = net.channel;
+            netObj["secure"] = net.encryptionType != WIFI_AUTH_OPEN;
+        }
     }
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleApiConnect(AsyncWebServerRequest* request) {
+void WebServer::handleApiConnect(HttpRequest* request) {
     String ssid;
     String password;
 
@@ -276,25 +725,33 @@ void WebServer::handleApiConnect(AsyncWebServerRequest* request) {
     }
 
     if (ssid.length() == 0) {
-        request->send(400, "application/json", "{\"error\":\"SSID required\"}");
+        ApiResponse::send(request, 400, "{\"error\":\"SSID required\"}");
         return;
     }
 
     LOG_INFO("WebServer: Connect request for '%s'", ssid.c_str());
 
-    if (_wifi->connect(ssid, password)) {
-        request->send(200, "application/json", "{\"status\":\"ok\"}");
-    } else {
-        request->send(500, "application/json", "{\"error\":\"Failed to start connection\"}");
+    // loop() owns the WiFi state machine; the attempt starts there
+    DeviceCommand cmd = DeviceCommand::make(DeviceCommand::Type::WIFI_CONNECT);
+    cmd.wifi = new WifiManager::Credentials{ssid, password};
+
+    if (!_commands.push(cmd)) {
+        delete cmd.wifi;
+        ApiResponse::send(request, 503, "{\"error\":\"Command queue full\"}");
+        return;
     }
+    ApiResponse::send(request, 200, "{\"status\":\"ok\"}");
 }
 
-void WebServer::handleApiDisconnect(AsyncWebServerRequest* request) {
-    _wifi->disconnect();
-    request->send(200, "application/json", "{\"status\":\"ok\"}");
+void WebServer::handleApiDisconnect(HttpRequest* request) {
+    if (!postCommand(DeviceCommand::Type::WIFI_DISCONNECT, "")) {
+        ApiResponse::send(request, 503, "{\"error\":\"Command queue full\"}");
+        return;
+    }
+    ApiResponse::send(request, 200, "{\"status\":\"ok\"}");
 }
 
-void WebServer::handleApiSave(AsyncWebServerRequest* request) {
+void WebServer::handleApiSave(HttpRequest* request) {
     String ssid;
     String password;
 
@@ -306,37 +763,211 @@ void WebServer::handleApiSave(AsyncWebServerRequest* request) {
     }
 
     if (ssid.length() == 0) {
-        request->send(400, "application/json", "{\"error\":\"SSID required\"}");
+        ApiResponse::send(request, 400, "{\"error\":\"SSID required\"}");
         return;
     }
 
-    _config->setWifiCredentials(ssid, password);
-    if (_config->saveWifiConfig()) {
-        request->send(200, "application/json", "{\"status\":\"ok\"}");
-    } else {
-        request->send(500, "application/json", "{\"error\":\"Failed to save configuration\"}");
+    // Static IP is optional; an empty "ip" switches back to DHCP
+    if (request->hasParam("ip", true)) {
+        auto param = [request](const char* name) {
+            return request->hasParam(name, true) ? request->getParam(name, true)->value() : String();
+        };
+        String error;
+        if (!_config->setStaticIp(param("ip"), param("gateway"), param("subnet"), param("dns"), error)) {
+            JsonDocument doc;
+            doc["error"] = error;
+            ApiResponse::send(request, 400, doc);
+            return;
+        }
     }
+
+    _config->addWifiNetwork(ssid, password);
+    _config->saveWifiConfig();
+    postNetworks();
+    ApiResponse::send(request, 200, "{\"status\":\"ok\"}");
 }
 
-void WebServer::handleApiConfigTriggers(AsyncWebServerRequest* request) {
-    if (!request->hasParam("triggers", true)) {
-        request->send(400, "application/json", "{\"error\":\"Missing triggers parameter\"}");
+void WebServer::handleApiForget(HttpRequest* request) {
+    String ssid;
+    if (request->hasParam("ssid", true)) {
+        ssid = request->getParam("ssid", true)->value();
+    }
+    if (ssid.length() == 0) {
+        ApiResponse::send(request, 400, "{\"error\":\"SSID required\"}");
         return;
     }
 
-    String triggersJson = request->getParam("triggers", true)->value();
+    if (!_config->forgetWifiNetwork(ssid)) {
+        ApiResponse::send(request, 404, "{\"error\":\"Network not saved\"}");
+        return;
+    }
+    _config->saveWifiConfig();
+    LOG_INFO("WebServer: Forgot WiFi network '%s'", ssid.c_str());
+    postNetworks();
+    ApiResponse::send(request, 200, "{\"status\":\"ok\"}");
+}
+
+void WebServer::handleApiNetworks(HttpRequest* request) {
+    // Signal comes from the scan cache; passwords never leave the device
+    WifiManager::ScanCache scan;
+    _wifi->readScan(scan);
 
-    // Parse JSON array of triggers
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, triggersJson);
+    doc["max"] = (int)ConfigManager::MAX_WIFI_NETWORKS;
+    JsonArray networks = doc["networks"].to<JsonArray>();
+    for (const auto& network : _config->getWifiConfig().networks) {
+        JsonObject entry = networks.add<JsonObject>();
+        entry["ssid"] = network.ssid;
+        entry["secure"] = network.password.length() > 0;
+        for (uint8_t i = 0; i < scan.count; i++) {
+            if (network.ssid == scan.networks[i].ssid) {
+                entry["rssi"] = scan.networks[i].rssi;
+                break;
+            }
+        }
+    }
+    ApiResponse::send(request, 200, doc);
+}
+
+void WebServer::handleApiProbe(HttpRequest* request) {
+    long count = PROBE_DEFAULT_COUNT;
+    long intervalMs = PROBE_DEFAULT_INTERVAL_MS;
+    if (request->hasParam("count", true)) {
+        count = request->getParam("count", true)->value().toInt();
+    }
+    if (request->hasParam("interval", true)) {
+        intervalMs = request->getParam("interval", true)->value().toInt();
+    }
+    if (count < 1 || count > PROBE_MAX_COUNT) {
+        ApiResponse::send(request, 400, "{\"error\":\"count must be 1-200\"}");
+        return;
+    }
+    if (intervalMs < PROBE_MIN_INTERVAL_MS || intervalMs > PROBE_MAX_INTERVAL_MS) {
+        ApiResponse::send(request, 400, "{\"error\":\"interval must be 20-5000 ms\"}");
+        return;
+    }
+
+    DeviceSnapshot snap;
+    _snapshot.load(snap);
+    if (snap.wifiState != WifiManager::State::CONNECTED) {
+        ApiResponse::send(request, 409, "{\"error\":\"WiFi not connected\"}");
+        return;
+    }
+    if (_wifi->probe().isRunning()) {
+        ApiResponse::send(request, 409, "{\"error\":\"Probe already running\"}");
+        return;
+    }
+
+    // loop() owns WifiManager; the burst starts there
+    DeviceCommand cmd = DeviceCommand::make(DeviceCommand::Type::WIFI_PROBE);
+    cmd.probeCount = (uint16_t)count;
+    cmd.probeIntervalMs = (uint16_t)intervalMs;
+
+    if (!_commands.push(cmd)) {
+        ApiResponse::send(request, 503, "{\"error\":\"Command queue full\"}");
+        return;
+    }
+    ApiResponse::send(request, 202, "{\"status\":\"started\"}");
+}
+
+void WebServer::handleApiProbeStatus(HttpRequest* request) {
+    const ConfigSchema& schema = NetworkConfig::SCHEMA;
+    JsonDocument doc;
+    doc["powerMode"] = schema.enumName("powerMode", (uint8_t)_config->getNetworkConfig().powerMode);
+
+    LatencyProbe::Result last;
+    _wifi->probe().read(last);
+    doc["running"] = last.running;
+    if (last.target != 0) {
+        JsonObject lastObj = doc["last"].to<JsonObject>();
+        lastObj["mode"] = schema.enumName("powerMode", (uint8_t)last.mode);
+        lastObj["target"] = IPAddress(last.target).toString();
+        lastObj["count"] = last.count;
+        lastObj["sent"] = last.sent;
+        lastObj["received"] = last.received;
+        if (last.received > 0) {
+            lastObj["minMs"] = last.minUs / 1000;
+            lastObj["avgMs"] = last.sumUs / last.received / 1000;
+            lastObj["maxMs"] = last.maxUs / 1000;
+        }
+    }
+
+    // Everything recorded since boot, per mode (tinklink_wifi_rtt_seconds)
+    JsonObject modes = doc["modes"].to<JsonObject>();
+    for (uint8_t i = 0; i < Metrics::WIFI_POWER_MODE_COUNT; i++) {
+        Histogram::Data data;
+        uint32_t lost = Metrics::instance().readWifiRtt(i, data);
+        JsonObject modeObj = modes[schema.enumName("powerMode", i)].to<JsonObject>();
+        modeObj["count"] = data.count;
+        modeObj["lost"] = lost;
+        if (data.count > 0) {
+            const Histogram& h = Metrics::instance().wifiRttHistogram(i);
+            modeObj["avgMs"] = (uint32_t)(data.sum / data.count / 1000);
+            // Bucket upper bounds; null when past the last bucket
+            uint32_t p50 = h.percentileBound(data, 50);
+            uint32_t p90 = h.percentileBound(data, 90);
+            if (p50 != UINT32_MAX) modeObj["p50Ms"] = p50 / 1000;
+            else modeObj["p50Ms"] = nullptr;
+            if (p90 != UINT32_MAX) modeObj["p90Ms"] = p90 / 1000;
+            else modeObj["p90Ms"] = nullptr;
+        }
+    }
+
+    ApiResponse::send(request, 200, doc);
+}
+
+void WebServer::handleApiConfigTriggersBody(HttpRequest* request,
+                                            uint8_t* data, size_t len,
+                                            size_t index, size_t total) {
+    // Only MessagePack bodies arrive here; form posts are parsed into params
+    if (index == 0) {
+        _triggersBody.clear();
+        _triggersBodyTooLarge = total > MAX_TRIGGERS_BODY;
+        if (!_triggersBodyTooLarge) _triggersBody.reserve(total);
+    }
+    // Once over the limit, drop every remaining chunk of this request
+    if (_triggersBodyTooLarge || _triggersBody.size() + len > MAX_TRIGGERS_BODY) {
+        _triggersBodyTooLarge = true;
+        _triggersBody.clear();
+        _triggersBody.shrink_to_fit();
+        return;
+    }
+    _triggersBody.insert(_triggersBody.end(), data, data + len);
+}
+
+void WebServer::handleApiConfigTriggers(HttpRequest* request) {
+    JsonDocument doc;
+    DeserializationError error;
+
+    if (ApiResponse::isMsgPackBody(request)) {
+        if (_triggersBodyTooLarge) {
+            _triggersBodyTooLarge = false;
+            ApiResponse::send(request, 413, "{\"error\":\"Body too large\"}");
+            return;
+        }
+
+        // Raw MessagePack array as the request body
+        error = deserializeMsgPack(doc, _triggersBody.data(), _triggersBody.size());
+        _triggersBody.clear();
+        _triggersBody.shrink_to_fit();
+    } else {
+        if (!request->hasParam("triggers", true)) {
+            ApiResponse::send(request, 400, "{\"error\":\"Missing triggers parameter\"}");
+            return;
+        }
+
+        // Parse JSON array of triggers
+        String triggersJson = request->getParam("triggers", true)->value();
+        error = deserializeJson(doc, triggersJson);
+    }
 
     if (error) {
-        request->send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+        ApiResponse::send(request, 400, "{\"error\":\"Invalid JSON\"}");
         return;
     }
 
     if (!doc.is<JsonArray>()) {
-        request->send(400, "application/json", "{\"error\":\"Triggers must be an array\"}");
+        ApiResponse::send(request, 400, "{\"error\":\"Triggers must be an array\"}");
         return;
     }
 
@@ -360,22 +991,20 @@ void WebServer::handleApiConfigTriggers(AsyncWebServerRequest* request) {
 
     // Update configuration
     _config->setTriggers(triggers);
-    if (_config->saveConfig()) {
-        // Update RetroTink with new triggers
-        _tink->clearTriggers();
-        for (const auto& trigger : triggers) {
-            _tink->addTrigger(trigger);
-        }
+    _config->saveConfig();
 
-        request->send(200, "application/json", "{\"status\":\"ok\"}");
-        LOG_INFO("WebServer: Triggers saved successfully");
-    } else {
-        request->send(500, "application/json", "{\"error\":\"Failed to save configuration\"}");
-        LOG_ERROR("WebServer: Failed to save triggers");
+    // RetroTink picks up the new triggers on the loop task
+    if (!postCommand(DeviceCommand::Type::SET_TRIGGERS, "",
+                     new std::vector<TriggerMapping>(triggers))) {
+        ApiResponse::send(request, 503, "{\"error\":\"Command queue full\"}");
+        return;
     }
+
+    ApiResponse::send(request, 200, "{\"status\":\"ok\"}");
+    LOG_INFO("WebServer: Triggers saved successfully");
 }
 
-void WebServer::handleApiTinkSend(AsyncWebServerRequest* request) {
+void WebServer::handleApiTinkSend(HttpRequest* request) {
     String command;
 
     if (request->hasParam("command", true)) {
@@ -383,28 +1012,142 @@ void WebServer::handleApiTinkSend(AsyncWebServerRequest* request) {
     }
 
     if (command.length() == 0) {
-        request->send(400, "application/json", "{\"error\":\"Command required\"}");
+        ApiResponse::send(request, 400, "{\"error\":\"Command required\"}");
         return;
     }
 
     LOG_DEBUG("WebServer: Tink command: %s", command.c_str());
 
-    // Send command to RetroTINK
-    _tink->sendRawCommand(command.c_str());
+    // Hand the command to loop() and return without waiting for it
+    if (!postCommand(DeviceCommand::Type::TINK_SEND, command)) {
+        ApiResponse::send(request, 503, "{\"error\":\"Command queue full or command too long\"}");
+        return;
+    }
 
     // Return success response
     JsonDocument doc;
     doc["status"] = "ok";
     doc["command"] = command;
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    ApiResponse::send(request, 200, doc);
+}
+
+void WebServer::handleApiBatch(HttpRequest* request) {
+    if (!request->hasParam("steps", true)) {
+        ApiResponse::send(request, 400, "{\"error\":\"Missing steps parameter\"}");
+        return;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, request->getParam("steps", true)->value());
+    if (error || !doc.is<JsonArray>()) {
+        ApiResponse::send(request, 400, "{\"error\":\"Steps must be a JSON array\"}");
+        return;
+    }
+
+    // One batch at a time: the last one posted must have finished. It is
+    // missing from the history only while it waits in the mailbox.
+    uint32_t lastId = _nextBatchId - 1;
+    if (lastId > 0) {
+        std::unique_ptr<BatchHistory> history(new BatchHistory);
+        _batch.getHistory(*history);
+        const BatchStatus* last = history->find(lastId);
+        if (!last || last->state == BatchStatus::State::RUNNING) {
+            JsonDocument err;
+            err["error"] = "Batch #" + String(lastId) + " is still running";
+            err["id"] = lastId;
+            ApiResponse::send(request, 409, err);
+            return;
+        }
+    }
+
+    std::vector<BatchStep>* steps = new std::vector<BatchStep>();
+    String parseError;
+    if (!BatchRunner::parse(doc.as<JsonArrayConst>(), *steps, parseError)) {
+        delete steps;
+        JsonDocument err;
+        err["error"] = parseError;
+        ApiResponse::send(request, 400, err);
+        return;
+    }
+
+    size_t count = steps->size();
+    uint32_t id = _nextBatchId;
+    if (!postBatch(id, steps)) {
+        ApiResponse::send(request, 503, "{\"error\":\"Command queue full\"}");
+        return;
+    }
+    _nextBatchId++;  // Only ids that reached the mailbox count as posted
+
+    LOG_DEBUG("WebServer: Batch #%u queued (%u steps)", id, count);
+
+    JsonDocument resp;
+    resp["status"] = "queued";
+    resp["id"] = id;
+    resp["steps"] = count;
+
+    ApiResponse::send(request, 200, resp);
+}
+
+void WebServer::handleApiBatchStatus(HttpRequest* request) {
+    // ?id= picks one of the recent batches; without it, the last one posted
+    uint32_t lastId = _nextBatchId - 1;
+    uint32_t id = getUnsignedParam(request, "id", lastId);
+
+    std::unique_ptr<BatchHistory> history(new BatchHistory);
+    _batch.getHistory(*history);
+    const BatchStatus* found = history->find(id);
+
+    BatchStatus status;
+    memset(&status, 0, sizeof(status));
+    if (found) {
+        status = *found;
+    } else if (id != 0 && id == lastId) {
+        // Posted, still waiting in the mailbox
+        JsonDocument doc;
+        doc["id"] = id;
+        doc["state"] = "queued";
+        doc["steps"].to<JsonArray>();
+        ApiResponse::send(request, 200, doc);
+        return;
+    } else if (id != 0) {
+        JsonDocument doc;
+        doc["error"] = "Unknown batch (only the last " + String(BatchHistory::MAX_BATCHES) + " are kept)";
+        doc["id"] = id;
+        ApiResponse::send(request, 404, doc);
+        return;
+    }
+
+    static const char* const STATE_NAMES[] = {"idle", "running", "done", "failed"};
+    static const char* const STEP_STATE_NAMES[] = {"pending", "running", "ok", "failed", "timeout"};
+
+    JsonDocument doc;
+    doc["id"] = status.id;
+    doc["state"] = STATE_NAMES[(int)status.state];
+    doc["elapsed"] = status.elapsed;
+    if (status.error[0]) {
+        doc["error"] = status.error;
+    }
+
+    JsonArray steps = doc["steps"].to<JsonArray>();
+    for (uint8_t i = 0; i < status.stepCount; i++) {
+        const BatchStatus::Step& step = status.steps[i];
+        JsonObject obj = steps.add<JsonObject>();
+        obj["state"] = STEP_STATE_NAMES[(int)step.state];
+        if (step.state != BatchStatus::StepState::PENDING &&
+            step.state != BatchStatus::StepState::RUNNING) {
+            obj["start"] = step.startedAt;
+            obj["end"] = step.finishedAt;
+            obj["duration"] = step.finishedAt - step.startedAt;
+        }
+    }
+
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleApiDebugLED(AsyncWebServerRequest* request) {
+void WebServer::handleApiDebugLED(HttpRequest* request) {
     if (!_ledCallback) {
-        request->send(500, "application/json", "{\"error\":\"LED control not available\"}");
+        ApiResponse::send(request, 500, "{\"error\":\"LED control not available\"}");
         return;
     }
 
@@ -429,7 +1172,7 @@ void WebServer::handleApiDebugLED(AsyncWebServerRequest* request) {
         else if (color == "white") { r = 255; g = 255; b = 255; }
         else if (color == "off") { r = 0; g = 0; b = 0; }
         else {
-            request->send(400, "application/json", "{\"error\":\"Unknown color\"}");
+            ApiResponse::send(request, 400, "{\"error\":\"Unknown color\"}");
             return;
         }
     }
@@ -440,12 +1183,12 @@ void WebServer::handleApiDebugLED(AsyncWebServerRequest* request) {
         b = request->getParam("b", true)->value().toInt();
 
         if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255) {
-            request->send(400, "application/json", "{\"error\":\"RGB values must be 0-255\"}");
+            ApiResponse::send(request, 400, "{\"error\":\"RGB values must be 0-255\"}");
             return;
         }
     }
     else {
-        request->send(400, "application/json", "{\"error\":\"Missing parameters\"}");
+        ApiResponse::send(request, 400, "{\"error\":\"Missing parameters\"}");
         return;
     }
 
@@ -453,7 +1196,7 @@ void WebServer::handleApiDebugLED(AsyncWebServerRequest* request) {
     if (reset) {
         _ledCallback(-1, -1, -1);  // -1 = reset to WiFi mode
         LOG_DEBUG("WebServer: LED reset to WiFi mode");
-        request->send(200, "application/json", "{\"status\":\"ok\"}");
+        ApiResponse::send(request, 200, "{\"status\":\"ok\"}");
     } else {
         _ledCallback(r, g, b);
         LOG_DEBUG("WebServer: LED set to RGB(%d,%d,%d)", r, g, b);
@@ -465,15 +1208,13 @@ void WebServer::handleApiDebugLED(AsyncWebServerRequest* request) {
         doc["g"] = g;
         doc["b"] = b;
 
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+        ApiResponse::send(request, 200, doc);
     }
 }
 
-void WebServer::handleApiSwitcherSend(AsyncWebServerRequest* request) {
+void WebServer::handleApiSwitcherSend(HttpRequest* request) {
     if (!request->hasParam("message", true)) {
-        request->send(400, "application/json", "{\"error\":\"Missing message parameter\"}");
+        ApiResponse::send(request, 400, "{\"error\":\"Missing message parameter\"}");
         return;
     }
 
@@ -481,20 +1222,21 @@ void WebServer::handleApiSwitcherSend(AsyncWebServerRequest* request) {
 
     LOG_DEBUG("WebServer: Sending switcher message: [%s]", message.c_str());
 
-    // Send via switcher UART
-    _switcher->sendCommand(message.c_str());
+    // Hand the message to loop() for the switcher UART
+    if (!postCommand(DeviceCommand::Type::SWITCHER_SEND, message)) {
+        ApiResponse::send(request, 503, "{\"error\":\"Command queue full or message too long\"}");
+        return;
+    }
 
     // Return success response
     JsonDocument doc;
     doc["status"] = "ok";
     doc["message"] = message;
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleApiSwitcherReceive(AsyncWebServerRequest* request) {
+void WebServer::handleApiSwitcherReceive(HttpRequest* request) {
     // Get count parameter (default 10, max 50)
     int count = 10;
     if (request->hasParam("count")) {
@@ -503,29 +1245,31 @@ void WebServer::handleApiSwitcherReceive(AsyncWebServerRequest* request) {
         if (count > 50) count = 50;
     }
 
-    // Check if clear parameter is present
-    if (request->hasParam("clear")) {
-        _switcher->clearRecentMessages();
+    // Clearing runs on loop; the list it empties is what this request answers with
+    bool clear = request->hasParam("clear");
+    if (clear && !postCommand(DeviceCommand::Type::SWITCHER_CLEAR, "")) {
+        ApiResponse::send(request, 503, "{\"error\":\"Command queue full\"}");
+        return;
     }
 
-    // Get recent messages
-    std::vector<String> messages = _switcher->getRecentMessages(count);
+    // Too large for the server task's stack
+    std::unique_ptr<SwitcherMessages> published(new SwitcherMessages);
+    _switcherMessages.load(*published);
+    int first = clear ? published->count : std::max(0, (int)published->count - count);
 
     // Build JSON response
     JsonDocument doc;
-    doc["count"] = messages.size();
+    doc["count"] = published->count - first;
 
     JsonArray messagesArray = doc["messages"].to<JsonArray>();
-    for (const String& msg : messages) {
-        messagesArray.add(msg);
+    for (int i = first; i < published->count; i++) {
+        messagesArray.add(published->lines[i]);
     }
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleApiLogs(AsyncWebServerRequest* request) {
+void WebServer::handleApiLogs(HttpRequest* request) {
     Logger& logger = Logger::instance();
 
     // Get since parameter for incremental updates
@@ -547,39 +1291,128 @@ void WebServer::handleApiLogs(AsyncWebServerRequest* request) {
         logger.clearLogs();
     }
 
-    // Get logs
-    std::vector<LogEntry> logs;
-    if (since > 0) {
-        logs = logger.getLogsSince(since, count);
-    } else {
-        logs = logger.getRecentLogs(count);
-    }
+    // Fix the range of log indices to send up front. Entries logged while
+    // the response is streaming are left for the next poll so that "total"
+    // stays a valid "since" value for the client.
+    struct LogStream {
+        unsigned long next;
+        unsigned long end;
+        int sent;
+        int stage;
+        bool msgpack;
+    };
+    LogStream stream;
+    stream.end = logger.getLogCount();
+    stream.next = logger.getOldestIndex();
+    if (since > stream.next) stream.next = since;
+    if (stream.next > stream.end) stream.next = stream.end;
+    if (stream.end - stream.next > (unsigned long)count) stream.next = stream.end - count;
+    stream.sent = 0;
+    stream.stage = 0;
+    stream.msgpack = ApiResponse::wantsMsgPack(request);
+
+    // Stream one entry per piece straight from the log ring
+    const char* type = stream.msgpack ? ApiResponse::MSGPACK_TYPE : ApiResponse::JSON_TYPE;
+    request->send(ChunkedResponse::create(request, type,
+        [stream](String& out) mutable {
+            if (stream.stage == 0) {
+                if (stream.msgpack) {
+                    // MessagePack arrays are length-prefixed, so the range is
+                    // announced up front and evicted entries are sent as nil
+                    JsonDocument total;
+                    total.set(stream.end);
+                    ApiResponse::appendMsgPackMap(3, out);
+                    ApiResponse::appendMsgPackStr("total", out);
+                    ApiResponse::appendMsgPack(total, out);
+                    ApiResponse::appendMsgPackStr("logs", out);
+                    ApiResponse::appendMsgPackArray(stream.end - stream.next, out);
+                } else {
+                    out = "{\"total\":" + String(stream.end) + ",\"logs\":[";
+                }
+                stream.stage = 1;
+                return true;
+            }
 
-    // Build JSON response
-    JsonDocument doc;
-    doc["total"] = logger.getLogCount();
-    doc["count"] = logs.size();
+            if (stream.stage == 1) {
+                LogEntry entry;
+                while (stream.next < stream.end) {
+                    // Entries evicted since the request started are skipped
+                    if (!Logger::instance().getLogEntry(stream.next++, entry)) {
+                        if (!stream.msgpack) continue;
+                        ApiResponse::appendMsgPackNil(out);
+                        return true;
+                    }
+
+                    JsonDocument doc;
+                    doc["ts"] = entry.timestamp;
+                    doc["lvl"] = static_cast<int>(entry.level);
+                    doc["msg"] = entry.message;
+
+                    if (stream.msgpack) {
+                        stream.sent++;
+                        ApiResponse::appendMsgPack(doc, out);
+                        return true;
+                    }
+
+                    String json;
+                    serializeJson(doc, json);
+                    if (stream.sent++ > 0) out = ",";
+                    out += json;
+                    return true;
+                }
+                stream.stage = 2;
+            }
+
+            if (stream.stage == 2) {
+                // Count goes last since evicted entries are only known at the end
+                if (stream.msgpack) {
+                    JsonDocument count;
+                    count.set(stream.sent);
+                    ApiResponse::appendMsgPackStr("count", out);
+                    ApiResponse::appendMsgPack(count, out);
+                } else {
+                    out = "],\"count\":" + String(stream.sent) + "}";
+                }
+                stream.stage = 3;
+                return true;
+            }
+
+            return false;
+        }));
+}
 
-    JsonArray logsArray = doc["logs"].to<JsonArray>();
-    for (const LogEntry& entry : logs) {
-        JsonObject logObj = logsArray.add<JsonObject>();
-        logObj["ts"] = entry.timestamp;
-        logObj["lvl"] = static_cast<int>(entry.level);
-        logObj["msg"] = entry.message;
+void WebServer::handleApiDiagnostics(HttpRequest* request) {
+    // Capture the moving parts now; the bundle then streams a line at a time
+    DeviceSnapshot snap;
+    _snapshot.load(snap);
+    std::vector<String> messages;
+    {
+        std::unique_ptr<SwitcherMessages> published(new SwitcherMessages);
+        _switcherMessages.load(*published);
+        int first = std::max(0, (int)published->count - DiagnosticsBundle::MAX_SWITCHER_MESSAGES);
+        for (int i = first; i < published->count; i++) {
+            messages.push_back(published->lines[i]);
+        }
     }
+    auto bundle = std::make_shared<DiagnosticsBundle>(snap, std::move(messages), *_config);
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    HttpResponse* response = ChunkedResponse::create(request, DiagnosticsBundle::CONTENT_TYPE,
+        [bundle](String& out) { return bundle->next(out); });
+    response->addHeader("Content-Disposition", "attachment; filename=\"tinklink-diagnostics.ndjson\"");
+    request->send(response);
+    LOG_INFO("WebServer: Diagnostics bundle started");
 }
 
-void WebServer::handleApiOtaStatus(AsyncWebServerRequest* request) {
+void WebServer::handleApiOtaStatus(HttpRequest* request) {
     JsonDocument doc;
 
     doc["inProgress"] = _otaInProgress;
     doc["progress"] = _otaProgress;
     doc["total"] = _otaTotal;
     doc["error"] = _otaError;
+    doc["compressed"] = _ota.isCompressed();
+    doc["written"] = _ota.getBytesWritten();
+    doc["sha256"] = _ota.getSha256();
 
     if (_otaTotal > 0) {
         doc["percent"] = (int)((_otaProgress * 100) / _otaTotal);
@@ -587,18 +1420,23 @@ void WebServer::handleApiOtaStatus(AsyncWebServerRequest* request) {
         doc["percent"] = 0;
     }
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleOtaUpload(AsyncWebServerRequest* request, String filename,
+void WebServer::handleOtaUpload(HttpRequest* request, String filename,
                                  size_t index, uint8_t* data, size_t len, bool final) {
     // Track progress percentage for logging (reset each upload)
     static int lastPercent = -1;
 
     // First chunk - initialize update
     if (index == 0) {
+        _otaSession.checkTimeout();
+        if (_otaSession.isActive()) {
+            _otaError = OtaWriter::BUSY_ERROR;  // Resumable session holds the update
+            _otaInProgress = false;
+            return;
+        }
+
         _otaError = "";
         _otaProgress = 0;
         _otaTotal = request->contentLength();
@@ -612,34 +1450,36 @@ void WebServer::handleOtaUpload(AsyncWebServerRequest* request, String filename,
             if (mode == "fs" || mode == "filesystem") {
                 _otaMode = OTAMode::FILESYSTEM;
             }
-        } else if (filename.endsWith(".bin") && filename.indexOf("littlefs") >= 0) {
+        } else if (filename.indexOf("littlefs") >= 0) {
             _otaMode = OTAMode::FILESYSTEM;
         }
 
-        int updateCommand = (_otaMode == OTAMode::FILESYSTEM) ? U_SPIFFS : U_FLASH;
+        // Expected digest of the uncompressed image (form field or header)
+        String sha256;
+        if (request->hasParam("sha256", true)) {
+            sha256 = request->getParam("sha256", true)->value();
+        } else if (request->hasHeader("X-SHA256")) {
+            sha256 = request->header("X-SHA256");
+        }
+
         const char* updateType = (_otaMode == OTAMode::FILESYSTEM) ? "filesystem" : "firmware";
 
         LOG_INFO("OTA: Starting %s update, size: %u bytes", updateType, _otaTotal);
         LOG_INFO("OTA: Filename: %s", filename.c_str());
 
-        // For filesystem updates, unmount LittleFS first
-        if (_otaMode == OTAMode::FILESYSTEM) {
-            LittleFS.end();
-        }
-
-        if (!Update.begin(UPDATE_SIZE_UNKNOWN, updateCommand)) {
-            _otaError = Update.errorString();
-            LOG_ERROR("OTA: Update.begin() failed: %s", _otaError.c_str());
+        if (!_ota.begin(_otaMode, sha256)) {
+            _otaError = _ota.getError();
+            LOG_ERROR("OTA: Update begin failed: %s", _otaError.c_str());
             _otaInProgress = false;
             return;
         }
     }
 
-    // Write chunk
+    // Write chunk (decompressed and hashed by OtaWriter)
     if (_otaInProgress && len > 0) {
-        if (Update.write(data, len) != len) {
-            _otaError = Update.errorString();
-            LOG_ERROR("OTA: Update.write() failed: %s", _otaError.c_str());
+        if (!_ota.write(data, len)) {
+            _otaError = _ota.getError();
+            LOG_ERROR("OTA: Write failed: %s", _otaError.c_str());
             _otaInProgress = false;
             return;
         }
@@ -653,21 +1493,202 @@ void WebServer::handleOtaUpload(AsyncWebServerRequest* request, String filename,
         }
     }
 
-    // Final chunk - finish update
-    if (final) {
-        if (!Update.end(true)) {
-            _otaError = Update.errorString();
-            LOG_ERROR("OTA: Update.end() failed: %s", _otaError.c_str());
+    // Final chunk - verify and finish update
+    if (final && _otaInProgress) {
+        if (!_ota.end()) {
+            _otaError = _ota.getError();
+            LOG_ERROR("OTA: Update end failed: %s", _otaError.c_str());
         } else {
-            LOG_INFO("OTA: Update successful! Total: %u bytes", _otaProgress);
+            LOG_INFO("OTA: Update successful! Received %u bytes, wrote %u bytes%s",
+                     _otaProgress, _ota.getBytesWritten(),
+                     _ota.isCompressed() ? " (gzip)" : "");
         }
         _otaInProgress = false;
     }
 }
 
-void WebServer::handleApiAvrSend(AsyncWebServerRequest* request) {
-    if (!avr()) {
-        request->send(400, "application/json", "{\"error\":\"AVR is disabled. Enable it in Config.\"}");
+/** Serialize the resumable OTA session state into `doc`. */
+static void fillOtaSessionJson(JsonDocument& doc, const OtaSession& session) {
+    doc["active"] = session.isActive();
+    doc["offset"] = session.getOffset();
+    doc["size"] = session.getSize();
+    doc["sha256"] = session.getSha256();
+    doc["mode"] = session.getMode() == OTAMode::FILESYSTEM ? "fs" : "firmware";
+    doc["chunkSize"] = OtaSession::MAX_CHUNK_SIZE;
+    if (session.getError().length() > 0) {
+        doc["error"] = session.getError();
+    }
+}
+
+void WebServer::handleApiOtaSessionStart(HttpRequest* request) {
+    // The session is only touched from the HTTP task, so its idle timeout is checked here too
+    _otaSession.checkTimeout();
+    if (_otaInProgress) {
+        ApiResponse::send(request, 409, "{\"error\":\"Upload already in progress\"}");
+        return;
+    }
+
+    OTAMode mode = OTAMode::FIRMWARE;
+    String modeStr;
+    if (request->hasParam("mode", true)) modeStr = request->getParam("mode", true)->value();
+    else if (request->hasParam("mode")) modeStr = request->getParam("mode")->value();
+    if (modeStr == "fs" || modeStr == "filesystem") mode = OTAMode::FILESYSTEM;
+
+    String sha256;
+    if (request->hasParam("sha256", true)) sha256 = request->getParam("sha256", true)->value();
+    else if (request->hasParam("sha256")) sha256 = request->getParam("sha256")->value();
+
+    size_t size = getUnsignedParam(request, "size");
+
+    JsonDocument doc;
+    bool ok = _otaSession.start(mode, size, sha256);
+    fillOtaSessionJson(doc, _otaSession);
+    if (!ok) doc["error"] = _otaSession.getError();
+
+    int code = ok ? 200 : _otaSession.getError() == OtaWriter::BUSY_ERROR ? 409 : 400;
+    ApiResponse::send(request, code, doc);
+}
+
+void WebServer::handleApiOtaSessionGet(HttpRequest* request) {
+    _otaSession.checkTimeout();
+    JsonDocument doc;
+    fillOtaSessionJson(doc, _otaSession);
+
+    ApiResponse::send(request, 200, doc);
+}
+
+void WebServer::handleApiOtaSessionAbort(HttpRequest* request) {
+    _otaSession.checkTimeout();
+    _otaSession.abort("cancelled by client");
+    ApiResponse::send(request, 200, "{\"status\":\"ok\"}");
+}
+
+void WebServer::handleApiOtaChunkBody(HttpRequest* request,
+                                       uint8_t* data, size_t len,
+                                       size_t index, size_t total) {
+    if (index == 0) {
+        _otaChunkResult = OtaSession::ChunkResult::NO_SESSION;
+        _otaSession.checkTimeout();
+        size_t offset = getUnsignedParam(request, "offset");
+        uint32_t crc = getUnsignedParam(request, "crc32");
+        if (!_otaSession.beginChunk(offset, total, crc)) return;
+    }
+
+    _otaSession.appendChunk(data, len, index);
+
+    if (index + len >= total) {
+        _otaChunkResult = _otaSession.commitChunk();
+        _otaProgress = _otaSession.getOffset();
+        _otaTotal = _otaSession.getSize();
+    }
+}
+
+void WebServer::handleApiOtaChunk(HttpRequest* request) {
+    int code = 200;
+    JsonDocument doc;
+
+    switch (_otaChunkResult) {
+        case OtaSession::ChunkResult::COMMITTED:
+        case OtaSession::ChunkResult::DUPLICATE:
+            doc["status"] = "ok";
+            break;
+        case OtaSession::ChunkResult::OUT_OF_ORDER:
+            code = 409;
+            doc["error"] = "Offset does not match committed offset";
+            break;
+        case OtaSession::ChunkResult::BAD_CRC:
+            code = 422;
+            doc["error"] = "Chunk checksum mismatch or incomplete chunk";
+            break;
+        case OtaSession::ChunkResult::NO_SESSION:
+            code = _otaSession.isActive() ? 413 : 410;
+            doc["error"] = _otaSession.isActive() ? "Chunk too large" : "No active session";
+            break;
+        case OtaSession::ChunkResult::ERROR:
+            code = 500;
+            doc["error"] = _otaSession.getError();
+            break;
+    }
+    _otaChunkResult = OtaSession::ChunkResult::NO_SESSION;
+
+    // Always report the committed offset so the client knows where to resume
+    doc["offset"] = _otaSession.getOffset();
+
+    ApiResponse::send(request, code, doc);
+}
+
+void WebServer::handleApiOtaFinish(HttpRequest* request) {
+    _otaSession.checkTimeout();
+    if (!_otaSession.finish()) {
+        JsonDocument doc;
+        doc["error"] = _otaSession.getError();
+        doc["offset"] = _otaSession.getOffset();
+        ApiResponse::send(request, 400, doc);
+        LOG_ERROR("OTA: Session finish failed: %s", _otaSession.getError().c_str());
+        return;
+    }
+
+    LOG_INFO("OTA: Resumable update successful! Rebooting...");
+    ApiResponse::send(request, 200, "{\"status\":\"ok\",\"message\":\"Update successful. Rebooting...\"}");
+    delay(500);
+    ESP.restart();
+}
+
+void WebServer::handleApiOtaPullStatus(HttpRequest* request) {
+    if (!_pullOta) {
+        ApiResponse::send(request, 400, "{\"error\":\"Pull OTA not available\"}");
+        return;
+    }
+
+    PullOtaStatus status;
+    _pullOta->getStatus(status);
+
+    JsonDocument doc;
+    doc["state"] = PullOta::stateName(status.state);
+    doc["current"] = TINKLINK_VERSION_STRING;
+    doc["available"] = status.available;
+    doc["received"] = status.received;
+    doc["total"] = status.total;
+    if (status.lastCheck > 0) {
+        doc["lastCheckAgo"] = (millis() - status.lastCheck) / 1000;
+    }
+    if (status.clockMinute >= 0) {
+        char clock[6];
+        snprintf(clock, sizeof(clock), "%02d:%02d", status.clockMinute / 60, status.clockMinute % 60);
+        doc["clock"] = clock;
+    }
+    if (status.error[0]) {
+        doc["error"] = status.error;
+    }
+
+    ApiResponse::send(request, 200, doc);
+}
+
+void WebServer::handleApiOtaPullCheck(HttpRequest* request) {
+    if (!_pullOta || !_pullOta->isEnabled()) {
+        ApiResponse::send(request, 400, "{\"error\":\"Pull OTA disabled (no manifest URL)\"}");
+        return;
+    }
+
+    _otaSession.checkTimeout();  // An abandoned session must not hold the update forever
+    if (OtaWriter::isBusy()) {
+        ApiResponse::send(request, 409, "{\"error\":\"Another update is in progress\"}");
+        return;
+    }
+
+    // now=1 skips the maintenance window and idle wait
+    bool now = request->hasParam("now", true) && request->getParam("now", true)->value() == "1";
+    _pullOta->requestCheck(now);
+    LOG_INFO("WebServer: Pull OTA check requested%s", now ? " (apply now)" : "");
+
+    ApiResponse::send(request, 200, "{\"status\":\"ok\"}");
+}
+
+void WebServer::handleApiAvrSend(HttpRequest* request) {
+    DeviceSnapshot snap;
+    _snapshot.load(snap);
+    if (!snap.avrEnabled) {
+        ApiResponse::send(request, 400, "{\"error\":\"AVR is disabled. Enable it in Config.\"}");
         return;
     }
 
@@ -677,239 +1698,276 @@ void WebServer::handleApiAvrSend(AsyncWebServerRequest* request) {
     }
 
     if (command.length() == 0) {
-        request->send(400, "application/json", "{\"error\":\"Command required\"}");
+        ApiResponse::send(request, 400, "{\"error\":\"Command required\"}");
         return;
     }
 
     LOG_DEBUG("WebServer: AVR command: %s", command.c_str());
 
-    bool sent = avr()->sendRawCommand(command);
+    // Queued for loop(); the AVR's reply shows up in /api/status lastResponse
+    bool queued = postCommand(DeviceCommand::Type::AVR_SEND, command);
 
     JsonDocument doc;
-    doc["status"] = sent ? "ok" : "error";
+    doc["status"] = queued ? "ok" : "error";
     doc["command"] = command;
-    if (!sent) {
-        doc["error"] = "Failed to send command";
+    if (!queued) {
+        doc["error"] = "Command queue full or command too long";
     }
 
-    String response;
-    serializeJson(doc, response);
-    request->send(sent ? 200 : 500, "application/json", response);
+    ApiResponse::send(request, queued ? 200 : 503, doc);
 }
 
-void WebServer::handleApiAvrDiscover(AsyncWebServerRequest* request) {
-    if (!avr()) {
-        request->send(400, "application/json", "{\"error\":\"AVR is disabled. Enable it in Config.\"}");
+void WebServer::handleApiAvrDiscover(HttpRequest* request) {
+    // Discovery runs on loop; this reports its last published state
+    AvrDiscovery discovery;
+    _avrDiscovery.load(discovery);
+    if (!discovery.enabled) {
+        ApiResponse::send(request, 400, "{\"error\":\"AVR is disabled. Enable it in Config.\"}");
         return;
     }
 
     JsonDocument doc;
+    JsonArray devicesArray = doc["devices"].to<JsonArray>();
 
-    if (avr()->isDiscoveryComplete()) {
-        auto devices = avr()->getDiscoveryResults();
-
-        if (devices.size() > 0) {
-            // Have results — return them and start next discovery
-            doc["status"] = "complete";
-            JsonArray devicesArray = doc["devices"].to<JsonArray>();
-            for (const auto& dev : devices) {
-                JsonObject devObj = devicesArray.add<JsonObject>();
-                devObj["ip"] = dev.ip;
-                devObj["name"] = dev.friendlyName;
-            }
-            avr()->startDiscovery();
-        } else {
-            // Complete but no results (first call or nothing found) — start discovery
-            avr()->startDiscovery();
-            doc["status"] = "discovering";
-            doc["devices"].to<JsonArray>();
+    if (discovery.discovering) {
+        doc["status"] = "discovering";
+    } else if (discovery.count > 0) {
+        // Have results — return them and start next discovery
+        doc["status"] = "complete";
+        for (uint8_t i = 0; i < discovery.count; i++) {
+            JsonObject devObj = devicesArray.add<JsonObject>();
+            devObj["ip"] = discovery.devices[i].ip;
+            devObj["name"] = discovery.devices[i].name;
         }
+        postCommand(DeviceCommand::Type::AVR_DISCOVER, "");
     } else {
-        // Discovery in progress
+        // Complete but no results (first call or nothing found) — start discovery
+        if (!postCommand(DeviceCommand::Type::AVR_DISCOVER, "")) {
+            ApiResponse::send(request, 503, "{\"error\":\"Command queue full\"}");
+            return;
+        }
         doc["status"] = "discovering";
-        doc["devices"].to<JsonArray>();
     }
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleApiConfigAvrGet(AsyncWebServerRequest* request) {
-    auto avrConfig = _config->getAvrConfig();
-
+void WebServer::handleApiConfigAvrGet(HttpRequest* request) {
     JsonDocument doc;
-    doc["type"] = avrConfig["type"] | "Denon X4300H";
-    doc["enabled"] = avrConfig["enabled"] | false;
-    doc["ip"] = avrConfig["ip"] | "";
-    doc["input"] = avrConfig["input"] | "DVD";
-
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    configWrite(_config->getAvrConfig(), doc.to<JsonObject>());
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleApiConfigAvr(AsyncWebServerRequest* request) {
-    // Build new config from request params
-    JsonDocument newConfigDoc;
-    auto avrConfig = _config->getAvrConfig();
-
-    // Start with existing values
-    newConfigDoc["type"] = avrConfig["type"] | "Denon X4300H";
-    newConfigDoc["enabled"] = avrConfig["enabled"] | false;
-    newConfigDoc["ip"] = avrConfig["ip"] | "";
-    newConfigDoc["input"] = avrConfig["input"] | "DVD";
-
-    // Update with request params
-    if (request->hasParam("enabled", true)) {
-        String val = request->getParam("enabled", true)->value();
-        newConfigDoc["enabled"] = (val == "true" || val == "1");
-    }
-    if (request->hasParam("ip", true)) {
-        newConfigDoc["ip"] = request->getParam("ip", true)->value();
-    }
-    if (request->hasParam("input", true)) {
-        newConfigDoc["input"] = request->getParam("input", true)->value();
+void WebServer::handleApiConfigAvr(HttpRequest* request) {
+    // Start with existing values; each param is checked against the AVR schema
+    AvrConfig newConfig = _config->getAvrConfig();
+    String error;
+    static const char* const PARAMS[] = {"enabled", "ip", "input"};
+    for (const char* name : PARAMS) {
+        if (request->hasParam(name, true) &&
+            !configSet(newConfig, name, request->getParam(name, true)->value(), error)) {
+            JsonDocument doc;
+            doc["error"] = error;
+            ApiResponse::send(request, 400, doc);
+            return;
+        }
     }
 
-    JsonObject newConfig = newConfigDoc.as<JsonObject>();
     _config->setAvrConfig(newConfig);
+    _config->saveConfig();
 
-    if (_config->saveConfig()) {
-        bool enabled = newConfig["enabled"].as<bool>();
+    // loop() creates, rebuilds or retires the AVR as the change requires
+    uint32_t epoch = postReconfigure();
 
-        if (enabled && _avrPtr) {
-            // Create or reconfigure AVR instance
-            if (!avr()) {
-                *_avrPtr = new DenonAvr();
-                LOG_INFO("WebServer: Created AVR instance");
-            }
-            avr()->configure(newConfig);
-            avr()->begin();
-        } else if (!enabled && _avrPtr && avr()) {
-            // Destroy AVR instance
-            delete *_avrPtr;
-            *_avrPtr = nullptr;
-            LOG_INFO("WebServer: Destroyed AVR instance");
-        }
-
-        request->send(200, "application/json", "{\"status\":\"ok\"}");
-        LOG_INFO("WebServer: AVR config saved (enabled: %s, ip: %s, input: %s)",
-                 enabled ? "yes" : "no",
-                 newConfig["ip"].as<const char*>(),
-                 newConfig["input"].as<const char*>());
-    } else {
-        request->send(500, "application/json", "{\"error\":\"Failed to save configuration\"}");
-    }
+    JsonDocument doc;
+    doc["status"] = "ok";
+    doc["configEpoch"] = epoch;
+    ApiResponse::send(request, 200, doc);
+    LOG_INFO("WebServer: AVR config saved (enabled: %s, ip: %s, input: %s)",
+             newConfig.enabled ? "yes" : "no",
+             newConfig.ip, newConfig.input);
 }
 
-void WebServer::handleApiConfigBackup(AsyncWebServerRequest* request) {
+void WebServer::handleApiConfigNetworkGet(HttpRequest* request) {
     JsonDocument doc;
+    configWrite(_config->getNetworkConfig(), doc.to<JsonObject>());
+    ApiResponse::send(request, 200, doc);
+}
 
-    // Backup format version (MAJOR.MINOR)
-    // Major bump = breaking change (removed/renamed fields, type changes)
-    // Minor bump = non-breaking change (new fields added)
-    doc["version"] = "1.0";
-
-    // Read config.json
-    File configFile = LittleFS.open("/config.json", "r");
-    if (configFile) {
-        JsonDocument configDoc;
-        if (!deserializeJson(configDoc, configFile)) {
-            doc["config"] = configDoc;
+void WebServer::handleApiConfigNetwork(HttpRequest* request) {
+    // Start with existing values; each param is checked against the network schema
+    NetworkConfig newConfig = _config->getNetworkConfig();
+    String error;
+    static const char* const PARAMS[] = {"powerMode", "probeIntervalSec"};
+    for (const char* name : PARAMS) {
+        if (request->hasParam(name, true) &&
+            !configSet(newConfig, name, request->getParam(name, true)->value(), error)) {
+            JsonDocument doc;
+            doc["error"] = error;
+            ApiResponse::send(request, 400, doc);
+            return;
         }
-        configFile.close();
     }
 
-    // Read wifi.json
-    File wifiFile = LittleFS.open("/wifi.json", "r");
-    if (wifiFile) {
-        JsonDocument wifiDoc;
-        if (!deserializeJson(wifiDoc, wifiFile)) {
-            doc["wifi"] = wifiDoc;
-        }
-        wifiFile.close();
-    }
+    _config->setNetworkConfig(newConfig);
+    _config->saveConfig();
+
+    // loop() hands the new section to WifiManager
+    uint32_t epoch = postReconfigure();
 
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
-    LOG_INFO("WebServer: Config backup created (%d bytes)", response.length());
+    JsonDocument doc;
+    doc["status"] = "ok";
+    doc["configEpoch"] = epoch;
+    ApiResponse::send(request, 200, doc);
+    LOG_INFO("WebServer: Network config saved (power mode: %s, probe interval: %u s)",
+             NetworkConfig::SCHEMA.enumName("powerMode", (uint8_t)newConfig.powerMode),
+             newConfig.probeIntervalSec);
 }
 
-void WebServer::handleApiConfigRestore(AsyncWebServerRequest* request) {
+void WebServer::handleApiConfigBackup(HttpRequest* request) {
+    // Backup format version (MAJOR.MINOR)
+    // Major bump = breaking change (removed/renamed fields, type changes)
+    // Minor bump = non-breaking change (new fields added)
+    // 1.1 added "store"; "nvs" tells tools that settings survive a filesystem upload
+    //
+    // Settings live in NVS; the backup exports them in the config.json and
+    // wifi.json layouts, so older backups and this one restore the same way.
+    // Streamed a section at a time so only one section is in memory at once.
+    const ConfigManager* config = _config;
+    bool msgpack = ApiResponse::wantsMsgPack(request);
+    int section = 0;
+
+    const char* type = msgpack ? ApiResponse::MSGPACK_TYPE : ApiResponse::JSON_TYPE;
+    request->send(ChunkedResponse::create(request, type,
+        [config, msgpack, section](String& out) mutable {
+            switch (section++) {
+                case 0:
+                    if (msgpack) {
+                        ApiResponse::appendMsgPackMap(4, out);
+                        ApiResponse::appendMsgPackStr("version", out);
+                        ApiResponse::appendMsgPackStr("1.1", out);
+                        ApiResponse::appendMsgPackStr("store", out);
+                        ApiResponse::appendMsgPackStr("nvs", out);
+                    } else {
+                        out = "{\"version\":\"1.1\",\"store\":\"nvs\"";
+                    }
+                    return true;
+
+                case 1:
+                case 2: {
+                    bool wifi = section == 3;
+                    const char* key = wifi ? "wifi" : "config";
+                    JsonDocument doc;
+                    JsonObject data = doc.to<JsonObject>();
+                    if (wifi) {
+                        config->exportWifiConfig(data);
+                    } else {
+                        config->exportConfig(data);
+                    }
+
+                    if (msgpack) {
+                        ApiResponse::appendMsgPackStr(key, out);
+                        ApiResponse::appendMsgPack(doc, out);
+                        return true;
+                    }
+
+                    String json;
+                    serializeJson(doc, json);
+                    out = ",\"";
+                    out += key;
+                    out += "\":";
+                    out += json;
+                    return true;
+                }
+
+                case 3:
+                    // A MessagePack map is complete once its pairs are sent
+                    if (msgpack) return false;
+                    out = "}";
+                    return true;
+
+                default:
+                    return false;
+            }
+        }));
+    LOG_INFO("WebServer: Config backup sent");
+}
+
+void WebServer::handleApiConfigRestore(HttpRequest* request) {
     // Body is handled by handleApiConfigRestoreBody; this runs after body is complete
     if (_restoreError.length() > 0) {
-        request->send(400, "application/json", "{\"error\":\"" + _restoreError + "\"}");
+        // Built as a document: the error can quote keys from the upload
+        JsonDocument doc;
+        doc["error"] = _restoreError;
+        ApiResponse::send(request, 400, doc);
         _restoreError = "";
         return;
     }
-    request->send(200, "application/json", "{\"status\":\"ok\",\"message\":\"Config restored. Reboot to apply.\"}");
+    JsonDocument doc;
+    doc["status"] = "ok";
+    doc["configEpoch"] = _configEpoch;
+    doc["rebootRequired"] = _restoreNeedsReboot;
+    doc["message"] = _restoreNeedsReboot
+        ? "Config restored. Device settings applied; reboot to apply WiFi, OTA and hardware settings."
+        : "Config restored and applied.";
+    ApiResponse::send(request, 200, doc);
 }
 
-void WebServer::handleApiConfigRestoreBody(AsyncWebServerRequest* request,
+void WebServer::handleApiConfigRestoreBody(HttpRequest* request,
                                             uint8_t* data, size_t len,
                                             size_t index, size_t total) {
-    // Accumulate body data
+    // Parse incrementally as chunks arrive; sections are staged in temp
+    // files and only swapped in once the whole body has been validated
     if (index == 0) {
-        _restoreBody = "";
         _restoreError = "";
-    }
-    _restoreBody += String((char*)data, len);
-
-    // Process when complete
-    if (index + len >= total) {
-        JsonDocument doc;
-        DeserializationError error = deserializeJson(doc, _restoreBody);
-        _restoreBody = "";  // Free memory
-
-        if (error) {
-            _restoreError = "Invalid JSON: " + String(error.c_str());
+        if (!_restore.begin(total, ApiResponse::isMsgPackBody(request))) {
+            _restoreError = _restore.getError();
             LOG_ERROR("WebServer: Config restore failed: %s", _restoreError.c_str());
             return;
         }
+    }
 
-        // Validate backup version
-        // Accept: missing version (legacy), same major version (any minor)
-        // Reject: unknown major version
-        if (doc["version"].is<const char*>()) {
-            String version = doc["version"].as<String>();
-            int dotIdx = version.indexOf('.');
-            int major = (dotIdx > 0) ? version.substring(0, dotIdx).toInt() : version.toInt();
-            if (major > 1) {
-                _restoreError = "Incompatible backup version " + version + " (expected 1.x)";
-                LOG_ERROR("WebServer: %s", _restoreError.c_str());
-                return;
-            }
-            LOG_INFO("WebServer: Restoring backup version %s", version.c_str());
-        } else {
-            LOG_INFO("WebServer: Restoring legacy backup (no version)");
-        }
+    if (_restoreError.length() > 0) return;  // Already rejected, drain the rest
 
-        // Write config.json
-        if (doc["config"].is<JsonObject>()) {
-            File file = LittleFS.open("/config.json", "w");
-            if (file) {
-                serializeJson(doc["config"], file);
-                file.close();
-                LOG_INFO("WebServer: Restored config.json");
-            }
-        }
+    if (!_restore.feed(data, len)) {
+        _restoreError = _restore.getError();
+        _restore.abort();
+        LOG_ERROR("WebServer: Config restore failed: %s", _restoreError.c_str());
+        return;
+    }
 
-        // Write wifi.json
-        if (doc["wifi"].is<JsonObject>()) {
-            File file = LittleFS.open("/wifi.json", "w");
-            if (file) {
-                serializeJson(doc["wifi"], file);
-                file.close();
-                LOG_INFO("WebServer: Restored wifi.json");
-            }
+    // Process when complete
+    if (index + len >= total) {
+        if (finishRestore()) {
+            LOG_INFO("WebServer: Config restore complete");
+        } else {
+            _restoreError = _restore.getError();
+            LOG_ERROR("WebServer: Config restore failed: %s", _restoreError.c_str());
         }
-
-        LOG_INFO("WebServer: Config restore complete");
     }
 }
 
-void WebServer::handleNotFound(AsyncWebServerRequest* request) {
+bool WebServer::finishRestore() {
+    // Settings only read at boot, compared before the restore replaces them
+    HardwareConfig oldHardware = _config->getHardwareConfig();
+    OtaConfig oldOta = _config->getOtaConfig();
+    String oldHostname = _config->getWifiConfig().hostname;
+
+    if (!_restore.finish(*_config)) return false;
+
+    _restoreNeedsReboot = configDiff(oldHardware, _config->getHardwareConfig()) != 0 ||
+                          configDiff(oldOta, _config->getOtaConfig()) != 0 ||
+                          oldHostname != _config->getWifiConfig().hostname;
+
+    // Devices and the saved networks pick up the rest without a reboot
+    // (the current link stays up until it drops)
+    postCommand(DeviceCommand::Type::SET_TRIGGERS, "",
+                new std::vector<TriggerMapping>(_config->getTriggers()));
+    postReconfigure();
+    postNetworks();
+    return true;
+}
+
+void WebServer::handleNotFound(HttpRequest* request) {
     request->send(404, "text/plain", "Not Found");
 }
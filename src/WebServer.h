@@ -2,14 +2,24 @@
 #define WEB_SERVER_H
 
 #include <Arduino.h>
-#include <ESPAsyncWebServer.h>
+#include "HttpServer.h"
 #include <functional>
+#include <vector>
+#include "AdmissionControl.h"
+#include "BatchRunner.h"
+#include "CommandMailbox.h"
+#include "ConfigRestore.h"
+#include "DeviceSnapshot.h"
+#include "OtaSession.h"
+#include "OtaWriter.h"
+#include "PullOta.h"
+#ifndef TINKLINK_HTTPD_IDF
+#include "TcpConsole.h"
+#endif
 
 class WifiManager;
 class ConfigManager;
-class Switcher;
-class RetroTink;
-class DenonAvr;
+class Devices;
 
 /**
  * LED control callback function type.
@@ -19,14 +29,14 @@ class DenonAvr;
  */
 using LEDControlCallback = std::function<void(int r, int g, int b)>;
 
-/** OTA update type */
-enum class OTAMode {
-    FIRMWARE,    ///< Application firmware update
-    FILESYSTEM   ///< LittleFS filesystem update
-};
-
 /**
- * Async web server for TinkLink-USB.
+ * Web server for TinkLink-USB.
+ *
+ * Runs on ESPAsyncWebServer by default, or on ESP-IDF's esp_http_server
+ * when built with TINKLINK_HTTPD_IDF (see HttpServer). Handlers are the
+ * same on both; they run on the server's task (AsyncTCP or httpd) and
+ * reach devices only through the command mailbox and the Seqlock-published
+ * snapshots (device state, switcher messages, AVR discovery).
  *
  * Provides:
  * - Static file serving from LittleFS (index.html, config.html, debug.html)
@@ -34,20 +44,37 @@ enum class OTAMode {
  * - OTA firmware and filesystem updates
  * - UART testing endpoints
  * - System log retrieval
+ * - Line-oriented TCP console on port 2323 (see TcpConsole; async backend only)
+ *
+ * Large responses (logs, config backup) are streamed as chunked responses
+ * via ChunkedResponse so memory use does not grow with payload size.
  *
  * API Endpoints:
  * - GET  /api/status             - System status (WiFi, switcher, triggers)
- * - GET  /api/wifi/scan          - Scan for WiFi networks
+ * - GET  /api/wifi/scan          - Cached WiFi networks (refreshed in the background)
  * - POST /api/wifi/connect       - Connect to WiFi network
  * - POST /api/wifi/disconnect    - Disconnect from WiFi
- * - POST /api/wifi/save          - Save WiFi credentials
+ * - POST /api/wifi/save          - Save a WiFi network as the most preferred
+ * - POST /api/wifi/forget        - Remove a saved WiFi network
+ * - GET  /api/wifi/networks      - Saved WiFi networks (no passwords)
+ * - POST /api/wifi/probe         - Measure round trips to the gateway
+ * - GET  /api/wifi/probe         - Last probe and round trips per power mode
  * - POST /api/tink/send          - Send command to RetroTINK
+ * - POST /api/batch              - Queue a batch of device commands/delays/waits
+ * - GET  /api/batch              - Batch progress with per-step timing (?id= for one of the last 4)
  * - POST /api/debug/led          - Control status LED
  * - POST /api/switcher/send      - Send message to video switcher
  * - GET  /api/switcher/receive   - Get recent switcher messages
  * - GET  /api/logs               - Get system logs
+ * - GET  /api/diagnostics        - Support bundle (NDJSON: state, logs, counters, redacted config)
  * - GET  /api/ota/status         - Get OTA update progress
- * - POST /api/ota/upload         - Upload firmware or filesystem
+ * - POST /api/ota/upload         - Upload firmware or filesystem (raw or gzip, optional sha256)
+ * - POST /api/ota/session        - Start/resume a chunked resumable upload
+ * - GET  /api/ota/session        - Query committed offset of the session
+ * - DELETE /api/ota/session      - Abort the session
+ * - POST /api/ota/chunk          - Upload one chunk (?offset=&crc32=)
+ * - POST /api/ota/finish         - Verify and commit the session
+ * - GET  /metrics                - Prometheus metrics (text exposition format)
  */
 class WebServer {
 public:
@@ -63,32 +90,78 @@ public:
      * Start the web server with required dependencies.
      * @param wifi WiFi manager for network operations
      * @param config Configuration manager for settings
-     * @param switcher Video switcher handler for commands
-     * @param tink RetroTINK controller for commands
-     * @param avr Denon AVR controller (nullptr if not used)
+     * @param devices Switcher, RetroTINK and AVR; config changes are applied
+     *                to them through the command mailbox
      */
-    void begin(WifiManager* wifi, ConfigManager* config, Switcher* switcher, RetroTink* tink, DenonAvr** avr = nullptr);
+    void begin(WifiManager* wifi, ConfigManager* config, Devices* devices);
 
     /** Stop the web server. */
     void end();
 
+    /**
+     * Main-loop side of the web server. Must be called from loop().
+     * Executes device commands posted by HTTP handlers, advances the
+     * running command batch, publishes the device state snapshot read by
+     * /api/status, and expires idle resumable OTA sessions.
+     */
+    void update();
+
     /**
      * Set callback for LED control from debug interface.
      * @param callback Function to call for LED color changes
      */
     void setLEDCallback(LEDControlCallback callback);
 
+    /**
+     * Set the pull OTA updater exposed at /api/ota/pull.
+     * @param pullOta Pull OTA instance (nullptr to disable the endpoint)
+     */
+    void setPullOta(PullOta* pullOta) { _pullOta = pullOta; }
+
 private:
-    AsyncWebServer* _server;
+    HttpServer* _server;
     WifiManager* _wifi;
     ConfigManager* _config;
-    Switcher* _switcher;
-    RetroTink* _tink;
-    DenonAvr** _avrPtr;  // Pointer-to-pointer so we can create/destroy at runtime
-    DenonAvr* avr() const { return _avrPtr ? *_avrPtr : nullptr; }
+    Devices* _devices;
     LEDControlCallback _ledCallback;
+    PullOta* _pullOta;
+
+    // Per-class concurrency, per-client rate and low-heap shedding (server task)
+    AdmissionControl _admission;
+
+    // Device commands posted by handlers and the console (server task), drained by update() (loop task)
+    CommandMailbox _commands;
+
+    // Device state published by update() (loop task), read by handlers
+    DeviceSnapshotLock _snapshot;
+    unsigned long _lastSnapshot;
+
+    // Recent switcher lines, republished by update() when the switcher's
+    // message version changes; _messagesScratch is only touched by loop
+    SwitcherMessagesLock _switcherMessages;
+    SwitcherMessages _messagesScratch;
+
+    // AVR discovery state, republished by update() when it changes
+    AvrDiscoveryLock _avrDiscovery;
+    uint32_t _avrDiscoveryVersion;  // Loop task only
+
+#ifndef TINKLINK_HTTPD_IDF
+    // Line-oriented TCP console (AsyncTCP task); shares the command mailbox
+    TcpConsole _console;
+#endif
+
+    // Command batches: parsed by handlers, run by update() (loop task)
+    BatchRunner _batch;
+    uint32_t _nextBatchId;  // Only touched by handlers (server task)
+
+    // Device config changes posted so far (server task); loop() reports the
+    // last one applied as configEpoch in /api/status
+    uint32_t _configEpoch;
 
     // OTA state
+    OtaWriter _ota;
+    OtaSession _otaSession;
+    OtaSession::ChunkResult _otaChunkResult;
     OTAMode _otaMode;
     size_t _otaProgress;
     size_t _otaTotal;
@@ -96,38 +169,143 @@ private:
     String _otaError;
 
     // Config restore state
-    String _restoreBody;
+    ConfigRestore _restore;
     String _restoreError;
+    bool _restoreNeedsReboot;  // Restored sections that only apply at boot changed
+
+    // MessagePack body of POST /api/config/triggers
+    std::vector<uint8_t> _triggersBody;
+    bool _triggersBodyTooLarge;  // Body exceeded the limit; reject with 413
+    static const size_t MAX_TRIGGERS_BODY = 4096;
 
     /** Configure all HTTP routes and handlers. */
     void setupRoutes();
 
+    /**
+     * Post a device command for loop() to execute.
+     * @param type Command type
+     * @param text Command text (must fit DeviceCommand::MAX_TEXT_LEN)
+     * @param triggers Trigger list for SET_TRIGGERS (ownership transferred)
+     * @return false if the mailbox is full or text is too long (triggers freed)
+     */
+    bool postCommand(DeviceCommand::Type type, const String& text,
+                     std::vector<TriggerMapping>* triggers = nullptr);
+
+    /**
+     * Post a command batch for loop() to run.
+     * @param id Batch ID reported by GET /api/batch
+     * @param steps Parsed steps (ownership transferred)
+     * @return false if the mailbox is full (steps freed)
+     */
+    bool postBatch(uint32_t id, std::vector<BatchStep>* steps);
+
+    /**
+     * Post the config manager's current device sections for loop() to
+     * apply. Only devices whose sections changed are reconfigured.
+     * @return Config epoch of the change, 0 if the mailbox is full
+     */
+    uint32_t postReconfigure();
+
+    /**
+     * Post the config manager's saved WiFi networks for loop() to hand to
+     * WifiManager.
+     * @return false if the mailbox is full (the list applies at reboot)
+     */
+    bool postNetworks();
+
+    /**
+     * Execute all queued device commands. Runs on the loop task.
+     * @return true if any command was executed
+     */
+    bool processCommands();
+
+    /**
+     * Import a fully received restore into the config manager and hand the
+     * device sections and triggers to loop(). Sets _restoreNeedsReboot if
+     * a setting that is only read at boot changed.
+     * @return false if the restore was rejected (see _restore.getError())
+     */
+    bool finishRestore();
+
+    /** Capture device state into _snapshot. Runs on the loop task. */
+    void publishSnapshot();
+
+    /**
+     * Copy the switcher's recent messages into _switcherMessages if they
+     * changed since the last call. Runs on the loop task.
+     */
+    void publishSwitcherMessages();
+
+    /**
+     * Copy the AVR's discovery state into _avrDiscovery if it changed
+     * since the last call. Runs on the loop task.
+     */
+    void publishAvrDiscovery();
+
+    /** Minimum interval between snapshot refreshes */
+    static const unsigned long SNAPSHOT_INTERVAL_MS = 100;
+
+    // GET /api/wifi/scan?refresh: minimum age of the cache before it is rescanned
+    static const unsigned long SCAN_MIN_REFRESH_MS = 10000;
+
+    // POST /api/wifi/probe limits
+    static const long PROBE_DEFAULT_COUNT = 20;
+    static const long PROBE_MAX_COUNT = 200;
+    static const long PROBE_DEFAULT_INTERVAL_MS = 200;
+    static const long PROBE_MIN_INTERVAL_MS = 20;
+    static const long PROBE_MAX_INTERVAL_MS = 5000;
+
     // API route handlers
-    void handleApiStatus(AsyncWebServerRequest* request);
-    void handleApiScan(AsyncWebServerRequest* request);
-    void handleApiConnect(AsyncWebServerRequest* request);
-    void handleApiDisconnect(AsyncWebServerRequest* request);
-    void handleApiSave(AsyncWebServerRequest* request);
-    void handleApiConfigTriggers(AsyncWebServerRequest* request);
-    void handleApiTinkSend(AsyncWebServerRequest* request);
-    void handleApiDebugLED(AsyncWebServerRequest* request);
-    void handleApiSwitcherSend(AsyncWebServerRequest* request);
-    void handleApiSwitcherReceive(AsyncWebServerRequest* request);
-    void handleApiLogs(AsyncWebServerRequest* request);
-    void handleApiOtaStatus(AsyncWebServerRequest* request);
-    void handleApiAvrSend(AsyncWebServerRequest* request);
-    void handleApiAvrDiscover(AsyncWebServerRequest* request);
-    void handleApiConfigAvr(AsyncWebServerRequest* request);
-    void handleApiConfigAvrGet(AsyncWebServerRequest* request);
-    void handleApiConfigBackup(AsyncWebServerRequest* request);
-    void handleApiConfigRestore(AsyncWebServerRequest* request);
-    void handleApiConfigRestoreBody(AsyncWebServerRequest* request,
+    void handleApiStatus(HttpRequest* request);
+    void handleMetrics(HttpRequest* request);
+    void handleApiScan(HttpRequest* request);
+    void handleApiConnect(HttpRequest* request);
+    void handleApiDisconnect(HttpRequest* request);
+    void handleApiSave(HttpRequest* request);
+    void handleApiForget(HttpRequest* request);
+    void handleApiNetworks(HttpRequest* request);
+    void handleApiProbe(HttpRequest* request);
+    void handleApiProbeStatus(HttpRequest* request);
+    void handleApiConfigTriggers(HttpRequest* request);
+    void handleApiConfigTriggersBody(HttpRequest* request, uint8_t* data,
+                                     size_t len, size_t index, size_t total);
+    void handleApiTinkSend(HttpRequest* request);
+    void handleApiBatch(HttpRequest* request);
+    void handleApiBatchStatus(HttpRequest* request);
+    void handleApiDebugLED(HttpRequest* request);
+    void handleApiSwitcherSend(HttpRequest* request);
+    void handleApiSwitcherReceive(HttpRequest* request);
+    void handleApiLogs(HttpRequest* request);
+    void handleApiDiagnostics(HttpRequest* request);
+    void handleApiOtaStatus(HttpRequest* request);
+    void handleApiOtaSessionStart(HttpRequest* request);
+    void handleApiOtaSessionGet(HttpRequest* request);
+    void handleApiOtaSessionAbort(HttpRequest* request);
+    void handleApiOtaChunk(HttpRequest* request);
+    void handleApiOtaChunkBody(HttpRequest* request,
+                               uint8_t* data, size_t len,
+                               size_t index, size_t total);
+    void handleApiOtaFinish(HttpRequest* request);
+    void handleApiOtaPullStatus(HttpRequest* request);
+    void handleApiOtaPullCheck(HttpRequest* request);
+    void handleApiAvrSend(HttpRequest* request);
+    void handleApiAvrDiscover(HttpRequest* request);
+    void handleApiConfigAvr(HttpRequest* request);
+    void handleApiConfigAvrGet(HttpRequest* request);
+    void handleApiConfigNetwork(HttpRequest* request);
+    void handleApiConfigNetworkGet(HttpRequest* request);
+    void handleApiConfigBackup(HttpRequest* request);
+    void handleApiConfigRestore(HttpRequest* request);
+    void handleApiConfigRestoreBody(HttpRequest* request,
                                      uint8_t* data, size_t len,
                                      size_t index, size_t total);
-    void handleNotFound(AsyncWebServerRequest* request);
+    void handleNotFound(HttpRequest* request);
 
     /**
      * Handle chunked OTA upload.
+     * gzip-compressed images are inflated on the fly; if a "sha256" form
+     * field or X-SHA256 header is supplied, the decompressed image must
+     * match it before the partition is committed.
      * @param request The HTTP request
      * @param filename Uploaded filename
      * @param index Byte offset of this chunk
@@ -135,7 +313,7 @@ private:
      * @param len Chunk length
      * @param final true if this is the last chunk
      */
-    void handleOtaUpload(AsyncWebServerRequest* request, String filename, size_t index,
+    void handleOtaUpload(HttpRequest* request, String filename, size_t index,
                          uint8_t* data, size_t len, bool final);
 };
 
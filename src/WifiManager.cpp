@@ -1,5 +1,39 @@
 #include "WifiManager.h"
+#include "ConfigStore.h"
 #include "Logger.h"
+#include "Metrics.h"
+#include <esp_netif.h>
+#include <esp_system.h>
+#include <esp_wifi.h>
+#include <algorithm>
+
+// NVS location of the fast reconnect cache
+static const char* const LINK_SECTION = "wifilink";
+static const char* const LINK_KEY = "last";
+
+/** Driver power save setting for each WifiPowerMode */
+static wifi_ps_type_t powerSaveType(WifiPowerMode mode) {
+    switch (mode) {
+        case WifiPowerMode::PERFORMANCE: return WIFI_PS_NONE;
+        case WifiPowerMode::LOW_POWER:   return WIFI_PS_MAX_MODEM;
+        case WifiPowerMode::BALANCED:
+        default:                         return WIFI_PS_MIN_MODEM;
+    }
+}
+
+/** Restart where the link was up moments ago, so its lease is still held. */
+static bool isWarmRestart() {
+    switch (esp_reset_reason()) {
+        case ESP_RST_SW:
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            return true;
+        default:
+            return false;
+    }
+}
 
 WifiManager::WifiManager()
     : _state(State::DISCONNECTED)
@@ -10,11 +44,40 @@ WifiManager::WifiManager()
     , _retryDelayMs(0)
     , _lastRetryTime(0)
     , _lastDisconnectCheck(0)
+    , _events(0)
+    , _disconnectReason(0)
+    , _eventHandlerId(0)
+    , _awaitingDisconnect(false)
+    , _disconnectRequestTime(0)
+    , _cacheValid(false)
+    , _fastAttempt(false)
+    , _leaseReusable(false)
+    , _leaseInUse(false)
+    , _leaseRenewing(false)
+    , _attemptStartTime(0)
+    , _candidateIndex(0)
+    , _selecting(false)
+    , _targetChannel(0)
+    , _lastProbeTime(0)
+    , _scanRequested(false)
+    , _lastActivity(0)
+    , _telnetBytes(0)
+    , _scanChannelCount(0)
+    , _scanStep(0)
+    , _scanStepRunning(false)
+    , _lastScanStepTime(0)
+    , _apStarting(false)
+    , _apStartTime(0)
     , _apReconnecting(false)
     , _lastApReconnectAttempt(0)
     , _apReconnectStartTime(0)
     , _stateCallback(nullptr)
+    , _reportedRssi(0)
+    , _lastRssiCheck(0)
 {
+    memset(&_cache, 0, sizeof(_cache));
+    memset(&_scan, 0, sizeof(_scan));
+    memset(_targetBssid, 0, sizeof(_targetBssid));
     generateAPConfig();
 }
 
@@ -22,15 +85,21 @@ bool WifiManager::begin(const String& hostname) {
     _hostname = hostname;
     generateAPConfig();
 
+    _eventHandlerId = WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
+        onWifiEvent(event, info);
+    });
+
     // Set WiFi mode to station initially
     WiFi.mode(WIFI_STA);
-    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
-    WiFi.setHostname(_hostname.c_str());
+    applyAddressConfig();
     // Disable ESP32 auto-reconnect — we handle all reconnection ourselves
     // via handleRetryLogic() and handleApReconnect(). Auto-reconnect bypasses
     // our code and reconnects with the default hostname (esp32s3-XXXX).
     WiFi.setAutoReconnect(false);
 
+    loadLinkCache();
+    _leaseReusable = _cacheValid && _cache.ip != 0 && !_cache.leaseReused && isWarmRestart();
+
     LOG_DEBUG("WifiManager: Initialized (hostname: %s)", _hostname.c_str());
     LOG_DEBUG("WifiManager: AP SSID will be '%s' if needed", _apConfig.ssid.c_str());
     return true;
@@ -38,42 +107,331 @@ bool WifiManager::begin(const String& hostname) {
 
 void WifiManager::end() {
     disconnect();
+    WiFi.removeEvent(_eventHandlerId);
     WiFi.mode(WIFI_OFF);
 }
 
+void WifiManager::configure(const NetworkConfig& config) {
+    bool modeChanged = config.powerMode != _network.powerMode;
+    _network = config;
+
+    // Kept by the WiFi library and re-applied whenever the station starts
+    if (!WiFi.setSleep(powerSaveType(config.powerMode))) {
+        LOG_WARN("WifiManager: Failed to set power mode");
+    } else if (modeChanged) {
+        LOG_INFO("WifiManager: Power mode %s",
+                 NetworkConfig::SCHEMA.enumName("powerMode", (uint8_t)config.powerMode));
+    }
+}
+
+bool WifiManager::startProbe(uint16_t count, uint16_t intervalMs) {
+    if (_state != State::CONNECTED) return false;
+    _lastProbeTime = millis();
+    return _probe.start(WiFi.gatewayIP(), count, intervalMs, _network.powerMode);
+}
+
+void WifiManager::onWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+    // WiFi event task: only record what happened, update() acts on it
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            _events.fetch_or(EVENT_STA_GOT_IP);
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            _disconnectReason.store(info.wifi_sta_disconnected.reason);
+            _events.fetch_or(EVENT_STA_DISCONNECTED);
+            break;
+        case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+            _events.fetch_or(EVENT_STA_LOST_IP);
+            break;
+        case ARDUINO_EVENT_WIFI_AP_START:
+            _events.fetch_or(EVENT_AP_STARTED);
+            break;
+        default:
+            break;
+    }
+}
+
 bool WifiManager::connect(const String& ssid, const String& password) {
     if (ssid.length() == 0) {
         LOG_WARN("WifiManager: Cannot connect - no SSID provided");
         return false;
     }
 
+    _ssid = ssid;
+    _password = password;
+
+    LOG_INFO("WifiManager: Connecting to '%s'...", ssid.c_str());
+
+    // Same network as last time: go straight to its AP
+    _fastAttempt = _cacheValid && _ssid == _cache.ssid;
+    startAttempt(false);
+    return true;
+}
+
+void WifiManager::setNetworks(const std::vector<Credentials>& networks) {
+    _networks = networks;
+
+    // A forgotten network is not reconnected to from AP mode or after a failure
+    if (!isKnown(_ssid) && _state != State::CONNECTED && _state != State::CONNECTING) {
+        _ssid = networks.empty() ? String() : networks[0].ssid;
+        _password = networks.empty() ? String() : networks[0].password;
+    }
+}
+
+bool WifiManager::connectKnown() {
+    if (_networks.empty()) {
+        LOG_WARN("WifiManager: Cannot connect - no saved network");
+        return false;
+    }
+    if (_networks.size() == 1) {
+        return connect(_networks[0].ssid, _networks[0].password);
+    }
+
+    // The network of the last good link first, straight at its AP; the
+    // selection scan only runs if that fails
+    if (_cacheValid) {
+        for (const auto& network : _networks) {
+            if (network.ssid == _cache.ssid) return connect(network.ssid, network.password);
+        }
+    }
+
+    LOG_INFO("WifiManager: Looking for the best of %u saved networks...", (unsigned)_networks.size());
+    _fastAttempt = false;
+    startAttempt(true);
+    return true;
+}
+
+void WifiManager::startAttempt(bool select) {
+    // A link or attempt in progress has to drop before the new one starts
+    bool stationBusy = _state == State::CONNECTED || _state == State::CONNECTING ||
+                       _apReconnecting || _awaitingDisconnect;
+
     // If we're in AP or AP+STA mode, stop it and switch to STA
     if (_mode == Mode::AP || _mode == Mode::AP_STA) {
         stopAccessPoint();
     }
 
-    _ssid = ssid;
-    _password = password;
+    // Ensure we're in STA mode
+    if (WiFi.getMode() != WIFI_MODE_STA) {
+        WiFi.mode(WIFI_STA);
+    }
+    _mode = Mode::STA;
+    _stateVersion.bump();
 
-    LOG_INFO("WifiManager: Connecting to '%s'...", ssid.c_str());
+    // Events from the old link must not be taken for the new one
+    _events.fetch_and(~(uint32_t)(EVENT_STA_GOT_IP | EVENT_STA_DISCONNECTED | EVENT_STA_LOST_IP));
 
-    WiFi.disconnect(true);
-    delay(100);
+    _candidates.clear();
+    _targetChannel = 0;
+    _selecting = select;
+    _selectSkip = "";
 
-    // Ensure we're in STA mode
-    WiFi.mode(WIFI_STA);
+    _connectStartTime = millis();
+    setState(State::CONNECTING);
+    continueStation(!stationBusy);
+}
+
+void WifiManager::continueStation(bool linkIdle) {
+    if (!linkIdle) {
+        // update() continues once the driver reports the disconnect
+        WiFi.disconnect(false);
+        _awaitingDisconnect = true;
+        _disconnectRequestTime = millis();
+    } else if (_selecting) {
+        startSelectScan();
+    } else {
+        beginStation();
+    }
+}
+
+void WifiManager::beginStation() {
+    abortScan();
+    applyAddressConfig();
+
+    if (_fastAttempt) {
+        LOG_DEBUG("WifiManager: Fast connect to %02X:%02X:%02X:%02X:%02X:%02X on channel %u%s",
+                  _cache.bssid[0], _cache.bssid[1], _cache.bssid[2], _cache.bssid[3],
+                  _cache.bssid[4], _cache.bssid[5], _cache.channel,
+                  _leaseInUse ? " with cached lease" : "");
+        WiFi.begin(_ssid.c_str(), _password.c_str(), _cache.channel, _cache.bssid);
+    } else if (_targetChannel != 0) {
+        // AP found by the selection scan
+        WiFi.begin(_ssid.c_str(), _password.c_str(), _targetChannel, _targetBssid);
+    } else {
+        WiFi.begin(_ssid.c_str(), _password.c_str());
+    }
+    _attemptStartTime = millis();
+}
+
+void WifiManager::applyAddressConfig() {
     // WiFi.config() must be called before setHostname() on ESP32 Arduino
     // to ensure the DHCP client sends the hostname in its requests
-    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    _leaseInUse = false;
+    _leaseRenewing = false;
+    if ((uint32_t)_staticIp.ip != 0) {
+        WiFi.config(_staticIp.ip, _staticIp.gateway, _staticIp.subnet, _staticIp.dns);
+    } else if (_fastAttempt && _leaseReusable) {
+        WiFi.config(IPAddress(_cache.ip), IPAddress(_cache.gateway),
+                    IPAddress(_cache.subnet), IPAddress(_cache.dns));
+        _leaseInUse = true;
+    } else {
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
     WiFi.setHostname(_hostname.c_str());
-    _mode = Mode::STA;
+}
+
+void WifiManager::fallBackFromFastConnect(bool attemptEnded) {
+    _fastAttempt = false;
+    _leaseReusable = false;
+
+    if (_networks.size() > 1) {
+        // The scan shows whether this network moved to another AP or
+        // another saved network is the one in range
+        LOG_INFO("WifiManager: Cached AP not reachable (reason: %u) - scanning for saved networks",
+                 attemptEnded ? _disconnectReason.load() : 0);
+        _selecting = true;
+        _selectSkip = "";
+    } else {
+        LOG_INFO("WifiManager: Cached AP not reachable (reason: %u) - scanning for '%s'",
+                 attemptEnded ? _disconnectReason.load() : 0, _ssid.c_str());
+    }
+    continueStation(attemptEnded);
+}
+
+void WifiManager::startSelectScan() {
+    // Not idle-gated like a cache refresh: the station is down anyway
+    abortScan();
+    _scanWork.clear();
+    _scanChannels[0] = 0;
+    _scanChannelCount = 1;
+    _scanStep = 0;
+    _scan.partial = false;
+    _scan.scanning = true;
+    _scanPublished.store(_scan);
+    startScanStep();
+}
+
+void WifiManager::selectCandidates(bool scanned) {
+    _selecting = false;
+    _candidates.clear();
+
+    if (scanned) {
+        for (size_t i = 0; i < _networks.size(); i++) {
+            if (_networks[i].ssid == _selectSkip) continue;
+            for (uint8_t j = 0; j < _scan.count; j++) {
+                const NetworkInfo& seen = _scan.networks[j];
+                if (_networks[i].ssid != seen.ssid) continue;
+                Candidate candidate;
+                candidate.network = _networks[i];
+                candidate.score = seen.rssi - (int)i * PRIORITY_BIAS_DB;
+                candidate.rssi = seen.rssi;
+                candidate.channel = seen.channel;
+                memcpy(candidate.bssid, seen.bssid, sizeof(candidate.bssid));
+                _candidates.push_back(candidate);
+                break;
+            }
+        }
+        // Stable, so equal scores keep the saved order
+        std::stable_sort(_candidates.begin(), _candidates.end(),
+                         [](const Candidate& a, const Candidate& b) { return a.score > b.score; });
+    }
+
+    if (_state == State::AP_ACTIVE) {
+        // From AP mode only the best one is tried; the AP stays up meanwhile
+        if (_candidates.empty()) {
+            LOG_DEBUG("WifiManager: No saved network in range");
+            return;
+        }
+        _candidateIndex = 0;
+        targetCandidate(_candidates[0]);
+        LOG_INFO("WifiManager: Attempting to reconnect to '%s' (%d dBm)...",
+                 _ssid.c_str(), _candidates[0].rssi);
+        beginStation();
+        _apReconnecting = true;
+        _apReconnectStartTime = millis();
+        return;
+    }
+
+    if (_candidates.empty()) {
+        // Hidden networks don't show up in a scan: the most preferred one
+        // gets an attempt that leaves the search to the driver
+        for (const auto& network : _networks) {
+            if (network.ssid == _selectSkip) continue;
+            Candidate candidate;
+            candidate.network = network;
+            candidate.score = 0;
+            candidate.rssi = 0;
+            candidate.channel = 0;
+            memset(candidate.bssid, 0, sizeof(candidate.bssid));
+            _candidates.push_back(candidate);
+            break;
+        }
+        if (_candidates.empty()) {
+            setState(State::FAILED);
+            LOG_WARN("WifiManager: No other saved network to try");
+            return;
+        }
+        LOG_INFO("WifiManager: No saved network in range");
+    } else {
+        LOG_INFO("WifiManager: %u saved network(s) in range", (unsigned)_candidates.size());
+    }
+
+    _candidateIndex = 0;
+    startCandidate(true);
+}
+
+void WifiManager::targetCandidate(const Candidate& candidate) {
+    _ssid = candidate.network.ssid;
+    _password = candidate.network.password;
+    _targetChannel = candidate.channel;
+    memcpy(_targetBssid, candidate.bssid, sizeof(_targetBssid));
+}
+
+void WifiManager::startCandidate(bool linkIdle) {
+    const Candidate& candidate = _candidates[_candidateIndex];
+    targetCandidate(candidate);
+    _fastAttempt = false;
 
-    WiFi.begin(ssid.c_str(), password.c_str());
+    if (candidate.channel != 0) {
+        LOG_INFO("WifiManager: Connecting to '%s' (%d dBm, channel %u, %u/%u)...", _ssid.c_str(),
+                 candidate.rssi, candidate.channel, (unsigned)(_candidateIndex + 1),
+                 (unsigned)_candidates.size());
+    } else {
+        LOG_INFO("WifiManager: Connecting to '%s'...", _ssid.c_str());
+    }
 
     _connectStartTime = millis();
     setState(State::CONNECTING);
+    continueStation(linkIdle);
+}
 
-    return true;
+void WifiManager::failOver(bool attemptEnded) {
+    if (!_candidates.empty() && _candidateIndex + 1 < _candidates.size()) {
+        _candidateIndex++;
+        startCandidate(attemptEnded);
+    } else if (_candidates.empty() && _networks.size() > 1) {
+        // A network connected to by name: look for the other saved ones
+        _selecting = true;
+        _selectSkip = _ssid;
+        continueStation(attemptEnded);
+    } else {
+        if (!attemptEnded) WiFi.disconnect(false);  // Abandon the attempt
+        setState(State::FAILED);
+    }
+}
+
+unsigned long WifiManager::attemptTimeoutMs() const {
+    // Shorter when failOver() has another network to try
+    bool more = _candidates.empty() ? _networks.size() > 1 : _candidateIndex + 1 < _candidates.size();
+    if (more) return CANDIDATE_TIMEOUT_MS;
+    return CONNECT_TIMEOUT_MS;
+}
+
+bool WifiManager::isKnown(const String& ssid) const {
+    for (const auto& network : _networks) {
+        if (network.ssid == ssid) return true;
+    }
+    return false;
 }
 
 void WifiManager::disconnect() {
@@ -83,72 +441,130 @@ void WifiManager::disconnect() {
         return;
     }
 
-    WiFi.disconnect(true);
+    // The station stays enabled; turning the radio off would wait for the driver
+    WiFi.disconnect(false);
+    _awaitingDisconnect = false;
+    _selecting = false;
+    _candidates.clear();
     setState(State::DISCONNECTED);
     LOG_INFO("WifiManager: Disconnected");
 }
 
 void WifiManager::update() {
-    wl_status_t status = WiFi.status();
+    const uint32_t linkDown = EVENT_STA_DISCONNECTED | EVENT_STA_LOST_IP;
+    uint32_t events = _events.exchange(0);
+    if ((events & EVENT_STA_GOT_IP) && (events & linkDown)) {
+        // Both since the last update - the link as it is now says which came last
+        events &= WiFi.isConnected() ? ~linkDown : ~(uint32_t)EVENT_STA_GOT_IP;
+    }
+    unsigned long now = millis();
+
+    bool selecting = _selecting;
+    updateScan(now);
+
+    if (_apStarting) {
+        if (events & EVENT_AP_STARTED) {
+            onAccessPointStarted();
+        } else if (now - _apStartTime >= AP_START_TIMEOUT_MS) {
+            // A restart of an AP that was already up reports no new start
+            LOG_WARN("WifiManager: No AP start event - assuming the AP is up");
+            onAccessPointStarted();
+        }
+        return;
+    }
+
+    if (_awaitingDisconnect) {
+        // Station events until then belong to the link being replaced
+        if ((events & EVENT_STA_DISCONNECTED) || now - _disconnectRequestTime >= DISCONNECT_SETTLE_MS) {
+            _awaitingDisconnect = false;
+            continueStation(true);
+        }
+        return;
+    }
+
+    if (selecting) {
+        // updateScan() hands the results to selectCandidates(); station
+        // events until then belong to the attempts before the scan
+        return;
+    }
 
     switch (_state) {
         case State::CONNECTING:
-            if (status == WL_CONNECTED) {
-                setState(State::CONNECTED);
-                _retryCount = 0;  // Reset retry counter on success
-                _retryDelayMs = 0;
-                setupMDNS();
-                LOG_INFO("WifiManager: Connected to '%s' - IP: %s",
-                         _ssid.c_str(), WiFi.localIP().toString().c_str());
-            } else if (status == WL_CONNECT_FAILED ||
-                       status == WL_NO_SSID_AVAIL ||
-                       (millis() - _connectStartTime > CONNECT_TIMEOUT_MS)) {
-                setState(State::FAILED);
-                LOG_WARN("WifiManager: Connection failed (status: %d)", status);
+            if (events & EVENT_STA_GOT_IP) {
+                onStationConnected("Connected to");
+            } else if (_fastAttempt && (events & EVENT_STA_DISCONNECTED)) {
+                fallBackFromFastConnect(true);
+            } else if (_fastAttempt && now - _attemptStartTime >= FAST_CONNECT_TIMEOUT_MS) {
+                fallBackFromFastConnect(false);
+            } else if (events & EVENT_STA_DISCONNECTED) {
+                LOG_WARN("WifiManager: Connection to '%s' failed (reason: %u)",
+                         _ssid.c_str(), _disconnectReason.load());
+                failOver(true);
+            } else if (now - _connectStartTime > attemptTimeoutMs()) {
+                LOG_WARN("WifiManager: Connection to '%s' timed out", _ssid.c_str());
+                failOver(false);
             }
             break;
 
         case State::CONNECTED:
-            if (status != WL_CONNECTED) {
+            if (events & EVENT_STA_GOT_IP) {
+                // Back before the tolerance ran out (or a DHCP renewal)
+                _lastDisconnectCheck = 0;
+                if (_leaseRenewing) {
+                    // DHCP now holds the lease; cache it as a fresh one
+                    _leaseRenewing = false;
+                    _leaseInUse = false;
+                    LOG_INFO("WifiManager: DHCP lease renewed - IP: %s", WiFi.localIP().toString().c_str());
+                    saveLinkCache();
+                }
+            } else if ((events & linkDown) && _lastDisconnectCheck == 0) {
                 // Use debouncing to avoid flapping on transient disconnects
-                if (_lastDisconnectCheck == 0) {
-                    // First time seeing disconnect - start timer
-                    _lastDisconnectCheck = millis();
-                    LOG_DEBUG("WifiManager: Disconnect detected (status: %d), waiting %lums to confirm",
-                              status, DISCONNECT_TOLERANCE_MS);
-                } else if (millis() - _lastDisconnectCheck >= DISCONNECT_TOLERANCE_MS) {
+                _lastDisconnectCheck = now;
+                LOG_DEBUG("WifiManager: Disconnect detected (reason: %u), waiting %lums to confirm",
+                          _disconnectReason.load(), DISCONNECT_TOLERANCE_MS);
+            }
+
+            if (_lastDisconnectCheck != 0) {
+                if (now - _lastDisconnectCheck >= DISCONNECT_TOLERANCE_MS) {
                     // Disconnect persisted for tolerance period - actually disconnected
-                    setState(State::FAILED);  // Go to FAILED instead of DISCONNECTED to trigger retry
-                    LOG_WARN("WifiManager: Connection lost (confirmed)");
                     _lastDisconnectCheck = 0;
+                    if (_networks.size() > 1) {
+                        // Another saved network may be in range: look now, not after a retry delay
+                        LOG_WARN("WifiManager: Connection lost (confirmed) - scanning for saved networks");
+                        _fastAttempt = false;
+                        startAttempt(true);
+                    } else {
+                        setState(State::FAILED);  // Go to FAILED instead of DISCONNECTED to trigger retry
+                        LOG_WARN("WifiManager: Connection lost (confirmed)");
+                    }
+                }
+            } else if (_network.probeIntervalSec > 0 && !_probe.isRunning() &&
+                       now - _lastProbeTime >= _network.probeIntervalSec * 1000UL) {
+                startProbe(PERIODIC_PROBE_COUNT, PERIODIC_PROBE_INTERVAL_MS);
+            } else if (now - _lastRssiCheck >= RSSI_CHECK_INTERVAL_MS) {
+                // Report signal changes large enough to matter
+                _lastRssiCheck = now;
+                int rssi = WiFi.RSSI();
+                if (abs(rssi - _reportedRssi) >= RSSI_CHANGE_DB) {
+                    _reportedRssi = rssi;
+                    _stateVersion.bump();
                 }
-            } else {
-                // WiFi is connected - reset disconnect timer
-                _lastDisconnectCheck = 0;
             }
             break;
 
         case State::DISCONNECTED:
             // Idle state — entered after explicit disconnect() or stopAccessPoint().
             // Connection only resumes via explicit connect() call.
-            if (status == WL_CONNECTED) {
+            if (events & EVENT_STA_GOT_IP) {
                 // Safety check: if WiFi connected unexpectedly, track it
-                setState(State::CONNECTED);
-                setupMDNS();
-                LOG_INFO("WifiManager: Reconnected - IP: %s",
-                         WiFi.localIP().toString().c_str());
+                onStationConnected("Reconnected to");
             }
             break;
 
         case State::FAILED:
-            // First check if we're actually connected (WiFi might have recovered)
-            if (status == WL_CONNECTED) {
-                setState(State::CONNECTED);
-                _retryCount = 0;  // Reset retry counter
-                _retryDelayMs = 0;
-                setupMDNS();
-                LOG_INFO("WifiManager: Connection recovered - IP: %s",
-                         WiFi.localIP().toString().c_str());
+            // WiFi might have recovered on its own
+            if (events & EVENT_STA_GOT_IP) {
+                onStationConnected("Connection recovered on");
             } else {
                 // Handle retry logic with exponential backoff
                 handleRetryLogic();
@@ -157,57 +573,228 @@ void WifiManager::update() {
 
         case State::AP_ACTIVE:
             // Periodically attempt to reconnect to saved network
-            handleApReconnect();
+            handleApReconnect(events);
             break;
     }
 }
 
-bool WifiManager::startScan() {
-    // Check if already scanning
-    int16_t status = WiFi.scanComplete();
-    if (status == WIFI_SCAN_RUNNING) {
-        LOG_DEBUG("WifiManager: Scan already in progress");
-        return false;
+void WifiManager::onStationConnected(const char* how) {
+    _candidates.clear();
+    _retryCount = 0;  // Reset retry counter on success
+    _retryDelayMs = 0;
+    _lastDisconnectCheck = 0;
+    _lastProbeTime = millis();  // First periodic probe one interval after connecting
+    Metrics::instance().recordWifiConnected(_fastAttempt);
+    setState(State::CONNECTED);
+    setupMDNS();
+    LOG_INFO("WifiManager: %s '%s' - IP: %s (%lu ms, %s)", how, _ssid.c_str(),
+             WiFi.localIP().toString().c_str(), millis() - _attemptStartTime,
+             _leaseInUse ? "cached AP and lease" : _fastAttempt ? "cached AP" : "scan");
+
+    saveLinkCache();
+    // The cached lease is only ever reused for the first connect after boot
+    _leaseReusable = false;
+    if (_leaseInUse) renewCachedLease();
+}
+
+void WifiManager::renewCachedLease() {
+    // The link is up, so DHCP runs in the background: lwIP asks for the
+    // address it already has and GOT_IP reports the lease (update())
+    esp_netif_t* netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    esp_err_t err = netif ? esp_netif_dhcpc_start(netif) : ESP_ERR_INVALID_STATE;
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+        LOG_WARN("WifiManager: Failed to start DHCP after reusing the cached lease (%d)", err);
+        return;
     }
+    _leaseRenewing = true;
+}
 
-    // Delete old results if any
-    if (status >= 0) {
-        WiFi.scanDelete();
+void WifiManager::loadLinkCache() {
+    std::vector<uint8_t> data;
+    _cacheValid = ConfigStore::getBlob(LINK_SECTION, LINK_KEY, data) &&
+                  data.size() == sizeof(LinkCache);
+    if (_cacheValid) {
+        memcpy(&_cache, data.data(), sizeof(LinkCache));
+        _cache.ssid[sizeof(_cache.ssid) - 1] = '\0';
+        _cacheValid = _cache.version == LINK_CACHE_VERSION && _cache.channel != 0;
     }
+}
 
-    LOG_DEBUG("WifiManager: Starting async network scan...");
-    WiFi.scanNetworks(true, false);  // async=true, show_hidden=false
-    return true;
+void WifiManager::saveLinkCache() {
+    LinkCache cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.version = LINK_CACHE_VERSION;
+    cache.channel = WiFi.channel();
+    const uint8_t* bssid = WiFi.BSSID();
+    if (!bssid || cache.channel == 0) return;
+    memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+    strlcpy(cache.ssid, _ssid.c_str(), sizeof(cache.ssid));
+
+    // A static address is no lease; a reused one is marked so it is not reused twice
+    if ((uint32_t)_staticIp.ip == 0) {
+        cache.ip = WiFi.localIP();
+        cache.gateway = WiFi.gatewayIP();
+        cache.subnet = WiFi.subnetMask();
+        cache.dns = WiFi.dnsIP();
+        cache.leaseReused = _leaseInUse ? 1 : 0;
+    }
+
+    // Rewritten only when something changed, so steady reconnects cost no flash writes
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&cache);
+    if (ConfigStore::putBlob(LINK_SECTION, LINK_KEY, std::vector<uint8_t>(bytes, bytes + sizeof(cache)))) {
+        _cache = cache;
+        _cacheValid = true;
+    }
 }
 
-bool WifiManager::isScanComplete() {
-    int16_t status = WiFi.scanComplete();
-    return (status != WIFI_SCAN_RUNNING);
+void WifiManager::updateScan(unsigned long now) {
+    if (_scanStepRunning) {
+        if (WiFi.scanComplete() == WIFI_SCAN_RUNNING) return;
+        collectScanResults();
+        _scanStepRunning = false;
+        _scanStep++;
+        _lastScanStepTime = now;
+        if (_scanStep >= _scanChannelCount) finishScan(now);
+        return;
+    }
+
+    if (_scanStep < _scanChannelCount) {
+        // Between channels: back on the home channel for a while, and only
+        // while nothing else needs the link
+        if (now - _lastScanStepTime >= SCAN_STEP_GAP_MS && isIdleForScan(now)) {
+            startScanStep();
+        }
+        return;
+    }
+
+    if (!_scanRequested.load(std::memory_order_relaxed)) return;
+    if (!_scan.scanning) {
+        _scan.scanning = true;
+        _scanPublished.store(_scan);
+    }
+    if (!isIdleForScan(now)) return;
+
+    _scanRequested.store(false, std::memory_order_relaxed);
+    _scanWork.clear();
+    _scanChannelCount = 0;
+    _scanStep = 0;
+    if (_state == State::CONNECTED) {
+        // Home channel first, then the common non-overlapping channels
+        const uint8_t candidates[] = {(uint8_t)WiFi.channel(), 1, 6, 11};
+        for (uint8_t channel : candidates) {
+            bool seen = false;
+            for (uint8_t i = 0; i < _scanChannelCount; i++) seen |= _scanChannels[i] == channel;
+            if (channel != 0 && !seen) _scanChannels[_scanChannelCount++] = channel;
+        }
+    } else {
+        _scanChannels[_scanChannelCount++] = 0;  // No link to protect: all channels at once
+    }
+    _scan.partial = _scanChannels[0] != 0;
+    startScanStep();
 }
 
-std::vector<WifiManager::NetworkInfo> WifiManager::getScanResults() {
-    std::vector<NetworkInfo> networks;
+bool WifiManager::isIdleForScan(unsigned long now) {
+    // AVR replies and status updates arrive over telnet
+    Metrics& metrics = Metrics::instance();
+    uint32_t telnet = metrics.getTransportTx(Metrics::Transport::TELNET) +
+                      metrics.getTransportRx(Metrics::Transport::TELNET);
+    if (telnet != _telnetBytes) {
+        _telnetBytes = telnet;
+        noteActivity();
+    }
 
+    if (_apStarting || _awaitingDisconnect || _apReconnecting || _probe.isRunning() ||
+        _state == State::CONNECTING) {
+        return false;
+    }
+    return now - _lastActivity.load(std::memory_order_relaxed) >= SCAN_IDLE_MS;
+}
+
+void WifiManager::startScanStep() {
+    uint8_t channel = _scanChannels[_scanStep];
+    int16_t result;
+    if (channel == 0) {
+        LOG_DEBUG("WifiManager: Scanning all channels");
+        result = WiFi.scanNetworks(true, false);  // async, no hidden networks
+    } else {
+        LOG_DEBUG("WifiManager: Scanning channel %u", channel);
+        result = WiFi.scanNetworks(true, false, false, SCAN_DWELL_CONNECTED_MS, channel);
+    }
+
+    if (result == WIFI_SCAN_FAILED) {
+        // Keep the old results; the next stale read asks again
+        LOG_WARN("WifiManager: Scan failed to start");
+        _scanStep = _scanChannelCount;
+        _scanWork.clear();
+        _scan.scanning = false;
+        _scanPublished.store(_scan);
+        if (_selecting) selectCandidates(false);
+        return;
+    }
+    _scanStepRunning = true;
+}
+
+void WifiManager::collectScanResults() {
     int n = WiFi.scanComplete();
+    if (n == WIFI_SCAN_FAILED) {
+        LOG_WARN("WifiManager: Scan failed");
+    }
+
+    // One entry per SSID, with its strongest AP
+    for (int i = 0; i < n; i++) {
+        String ssid = WiFi.SSID(i);
+        if (ssid.length() == 0) continue;
+        int8_t rssi = (int8_t)WiFi.RSSI(i);
 
-    if (n >= 0) {
-        LOG_DEBUG("WifiManager: Found %d networks", n);
-        for (int i = 0; i < n; i++) {
-            NetworkInfo info;
-            info.ssid = WiFi.SSID(i);
-            info.rssi = WiFi.RSSI(i);
-            info.encryptionType = WiFi.encryptionType(i);
-            networks.push_back(info);
+        NetworkInfo* entry = nullptr;
+        for (auto& known : _scanWork) {
+            if (ssid == known.ssid) entry = &known;
         }
-        WiFi.scanDelete();
-    } else if (n == WIFI_SCAN_FAILED) {
-        LOG_WARN("WifiManager: Scan failed");
-        WiFi.scanDelete();
-    } else if (n == WIFI_SCAN_RUNNING) {
-        LOG_DEBUG("WifiManager: Scan still running");
+        if (!entry) {
+            _scanWork.emplace_back();
+            entry = &_scanWork.back();
+            strlcpy(entry->ssid, ssid.c_str(), sizeof(entry->ssid));
+        } else if (rssi <= entry->rssi) {
+            continue;
+        }
+        entry->rssi = rssi;
+        entry->channel = WiFi.channel(i);
+        memcpy(entry->bssid, WiFi.BSSID(i), sizeof(entry->bssid));
+        entry->encryptionType = WiFi.encryptionType(i);
     }
+    WiFi.scanDelete();
+}
+
+void WifiManager::finishScan(unsigned long now) {
+    std::sort(_scanWork.begin(), _scanWork.end(),
+              [](const NetworkInfo& a, const NetworkInfo& b) { return a.rssi > b.rssi; });
+
+    _scan.count = _scanWork.size() < MAX_SCAN_RESULTS ? _scanWork.size() : MAX_SCAN_RESULTS;
+    memcpy(_scan.networks, _scanWork.data(), _scan.count * sizeof(NetworkInfo));
+    _scan.updatedAt = now != 0 ? now : 1;
+    _scan.scanning = _scanRequested.load(std::memory_order_relaxed);
+    _scanPublished.store(_scan);
+    _scanWork.clear();
+    _scanWork.shrink_to_fit();
 
-    return networks;
+    LOG_DEBUG("WifiManager: Found %u network(s)%s", _scan.count,
+              _scan.partial ? " on the channels of interest" : "");
+
+    if (_selecting) selectCandidates(true);
+}
+
+void WifiManager::abortScan() {
+    if (_scanStep >= _scanChannelCount) return;
+
+    if (_scanStepRunning) {
+        esp_wifi_scan_stop();
+        WiFi.scanDelete();
+        _scanStepRunning = false;
+    }
+    _scanStep = _scanChannelCount;
+    _scanWork.clear();
+    // Asked for again, so it runs once the device is idle
+    _scanRequested.store(true, std::memory_order_relaxed);
 }
 
 String WifiManager::getIP() const {
@@ -242,6 +829,7 @@ void WifiManager::onStateChange(StateChangeCallback callback) {
 void WifiManager::setState(State newState) {
     if (_state != newState) {
         _state = newState;
+        _stateVersion.bump();
         if (_stateCallback) {
             _stateCallback(newState);
         }
@@ -277,19 +865,25 @@ void WifiManager::generateAPConfig() {
 bool WifiManager::startAccessPoint() {
     LOG_INFO("WifiManager: Starting Access Point...");
 
-    // Stop any existing connection
-    WiFi.disconnect(true);
-    delay(100);
+    // Stop any station link or attempt; the driver finishes it in the background
+    WiFi.disconnect(false);
+    _awaitingDisconnect = false;
+    _fastAttempt = false;  // Retries from AP mode scan
+    _targetChannel = 0;
+    _selecting = false;
+    _candidates.clear();
 
     // Use AP+STA mode if we have saved credentials so we can periodically
     // attempt to reconnect to the network while keeping the AP accessible
-    if (_ssid.length() > 0) {
+    if (_ssid.length() > 0 || !_networks.empty()) {
         WiFi.mode(WIFI_AP_STA);
         _mode = Mode::AP_STA;
+        _stateVersion.bump();
         LOG_DEBUG("WifiManager: AP+STA mode (will periodically retry '%s')", _ssid.c_str());
     } else {
         WiFi.mode(WIFI_AP);
         _mode = Mode::AP;
+        _stateVersion.bump();
     }
 
     // Reset AP reconnection state
@@ -314,6 +908,14 @@ bool WifiManager::startAccessPoint() {
     // The range is typically 192.168.4.2-192.168.4.255 but we use custom IP
     // DHCP server auto-configures based on the softAPConfig settings
 
+    // AP_ACTIVE once the driver reports the AP up (see update())
+    _apStarting = true;
+    _apStartTime = millis();
+    return true;
+}
+
+void WifiManager::onAccessPointStarted() {
+    _apStarting = false;
     setState(State::AP_ACTIVE);
 
     // Enable mDNS in AP mode so tinklink.local works
@@ -327,8 +929,6 @@ bool WifiManager::startAccessPoint() {
     LOG_INFO("  URL:      http://%s.local or http://%s", _hostname.c_str(), _apConfig.ip.toString().c_str());
     LOG_INFO("  Security: Open (no password)");
     LOG_RAW("========================================\n");
-
-    return true;
 }
 
 void WifiManager::stopAccessPoint() {
@@ -336,13 +936,14 @@ void WifiManager::stopAccessPoint() {
         LOG_INFO("WifiManager: Stopping Access Point...");
         WiFi.softAPdisconnect(true);
         WiFi.mode(WIFI_STA);
-        // Re-set hostname after mode change (WiFi.mode() resets it)
-        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
-        WiFi.setHostname(_hostname.c_str());
+        // Re-set address mode and hostname after mode change (WiFi.mode() resets them)
+        applyAddressConfig();
         _mode = Mode::STA;
+        _stateVersion.bump();
         _retryCount = 0;  // Reset retry counter for fresh STA connection
         _retryDelayMs = 0;
         _apReconnecting = false;
+        _apStarting = false;
         setState(State::DISCONNECTED);
     }
 }
@@ -352,51 +953,51 @@ unsigned long WifiManager::getRetryDelay(int retryCount) {
     return BASE_RETRY_DELAY_MS * (1 << retryCount);
 }
 
-void WifiManager::handleApReconnect() {
+void WifiManager::handleApReconnect(uint32_t events) {
     // Only attempt reconnection if we have saved credentials
-    if (_ssid.length() == 0) return;
+    if (_ssid.length() == 0 && _networks.empty()) return;
 
     unsigned long now = millis();
 
     if (_apReconnecting) {
-        wl_status_t status = WiFi.status();
-
-        if (status == WL_CONNECTED) {
+        if (events & EVENT_STA_GOT_IP) {
             // Successfully reconnected to the network
-            LOG_INFO("WifiManager: Reconnected to '%s' from AP mode - IP: %s",
-                     _ssid.c_str(), WiFi.localIP().toString().c_str());
-
             // Transition from AP+STA to STA-only
             WiFi.softAPdisconnect(true);
             WiFi.mode(WIFI_STA);
-            // Re-set hostname after mode change (WiFi.mode() resets it)
-            WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
-            WiFi.setHostname(_hostname.c_str());
+            // Re-set address mode and hostname after mode change (WiFi.mode()
+            // resets them); a static IP must not fall back to DHCP here
+            applyAddressConfig();
             _mode = Mode::STA;
+            _stateVersion.bump();
             _apReconnecting = false;
-            _retryCount = 0;
-            _retryDelayMs = 0;
-            setState(State::CONNECTED);
-            setupMDNS();
+            onStationConnected("Left AP mode, reconnected to");
             return;
         }
 
-        if (status == WL_CONNECT_FAILED ||
-            status == WL_NO_SSID_AVAIL ||
-            (now - _apReconnectStartTime >= AP_RECONNECT_TIMEOUT_MS)) {
+        if ((events & EVENT_STA_DISCONNECTED) ||
+            now - _apReconnectStartTime >= AP_RECONNECT_TIMEOUT_MS) {
             // Attempt failed or timed out
-            LOG_DEBUG("WifiManager: AP reconnect attempt failed (status: %d)", status);
+            LOG_DEBUG("WifiManager: AP reconnect attempt failed (reason: %u)",
+                      (events & EVENT_STA_DISCONNECTED) ? _disconnectReason.load() : 0);
             WiFi.disconnect(false);  // Stop STA attempt, keep AP running
             _apReconnecting = false;
             _lastApReconnectAttempt = now;
         }
     } else {
         // Check if it's time for another attempt
-        if (now - _lastApReconnectAttempt >= AP_RECONNECT_INTERVAL_MS) {
+        if (now - _lastApReconnectAttempt < AP_RECONNECT_INTERVAL_MS) return;
+
+        if (_networks.size() > 1) {
+            // selectCandidates() tries the best saved network in range, if any
+            _lastApReconnectAttempt = now;
+            _selecting = true;
+            _selectSkip = "";
+            startSelectScan();
+        } else {
             LOG_INFO("WifiManager: Attempting to reconnect to '%s'...", _ssid.c_str());
-            WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
-            WiFi.setHostname(_hostname.c_str());
-            WiFi.begin(_ssid.c_str(), _password.c_str());
+            _targetChannel = 0;
+            beginStation();
             _apReconnecting = true;
             _apReconnectStartTime = now;
         }
@@ -404,8 +1005,6 @@ void WifiManager::handleApReconnect() {
 }
 
 void WifiManager::handleRetryLogic() {
-    wl_status_t status = WiFi.status();
-
     // Only handle retry logic if we're in failed state
     if (_state != State::FAILED) {
         return;
@@ -433,6 +1032,10 @@ void WifiManager::handleRetryLogic() {
         LOG_INFO("WifiManager: Retrying connection (attempt %d/%d)...",
                  _retryCount, MAX_RETRIES);
         _retryDelayMs = 0;  // Reset delay
-        connect(_ssid, _password);  // Retry connection
+        if (_networks.size() > 1) {
+            connectKnown();  // Another round over the saved networks
+        } else {
+            connect(_ssid, _password);  // Retry connection
+        }
     }
 }
@@ -4,8 +4,13 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <ESPmDNS.h>
+#include <atomic>
 #include <functional>
 #include <vector>
+#include "ConfigTypes.h"
+#include "LatencyProbe.h"
+#include "Seqlock.h"
+#include "StateVersion.h"
 
 /**
  * WiFi connection manager with Access Point fallback.
@@ -18,14 +23,61 @@
  * - Automatic retry with exponential backoff on connection failure
  * - Automatic fallback to AP mode after max retries
  * - Periodic reconnection attempts from AP mode to saved network
+ * - Several saved networks (see below), ranked by signal from one scan
  * - Transient disconnect tolerance (3s debounce)
  * - mDNS advertisement for easy discovery
- * - Async network scanning
+ * - Background network scanning into a cache (see below)
+ * - Fast reconnect: the BSSID, channel and DHCP lease of the last good
+ *   link are kept in NVS (ConfigStore), and the next connect to the same
+ *   SSID goes straight to that AP without a scan. If it hasn't associated
+ *   within FAST_CONNECT_TIMEOUT_MS, the attempt falls back to a normal
+ *   scanning connect. After a software restart (OTA, reboot, crash) the
+ *   cached lease is reused as-is, skipping DHCP as well; it is at most
+ *   one boot old, since a reused lease is not reused again.
+ * - Optional static IPv4 configuration
+ * - Selectable power save mode (WifiPowerMode), with a gateway round-trip
+ *   probe (LatencyProbe) run on request or periodically, whose results
+ *   are kept per mode so the modes can be compared
+ *
+ * Scans are slow and take the radio off the home channel, so they are
+ * never run on behalf of a single HTTP request. Readers take the cached
+ * results (readScan()) and ask for a refresh when they are older than
+ * SCAN_CACHE_TTL_MS (requestScan()); update() runs it once the device has
+ * been idle for SCAN_IDLE_MS (no input changes, device commands or AVR
+ * traffic, no connect in progress). While connected, only the channels of
+ * interest are scanned - the home channel and 1, 6 and 11, where almost
+ * all 2.4 GHz networks sit - one short channel at a time, returning to
+ * the home channel in between.
+ *
+ * With more than one saved network (setNetworks(), most preferred first),
+ * connectKnown() tries the network of the last good link straight at its
+ * AP, as above. If that fails, or there is no such link, one scan of all
+ * channels shows which saved networks are in range, and they are tried
+ * strongest first - each network's RSSI less PRIORITY_BIAS_DB per place
+ * it has in the list, so a preferred network wins unless clearly weaker -
+ * each directed at the AP the scan found. A network that doesn't connect
+ * within CANDIDATE_TIMEOUT_MS hands over to the next one in range; only
+ * when none connects does the attempt count as failed, and AP mode still
+ * follows only once MAX_RETRIES retries of such a round have failed too.
+ * A confirmed link loss starts a new round at once rather than after the
+ * retry delay. From AP mode, each reconnect attempt scans and tries the
+ * best saved network in range, or waits for the next interval if none is.
+ *
+ * Transitions are driven by ESP WiFi events (got IP, disconnected, AP
+ * started) rather than polling WiFi.status(), and no call waits for the
+ * driver: connect() asks a connected station to drop its link and issues
+ * WiFi.begin() once the disconnect event arrives; startAccessPoint()
+ * reports AP_ACTIVE once the AP-started event does. The events arrive on
+ * the WiFi event task and are only recorded there; update() acts on them.
+ *
+ * Not thread-safe: call everything from the loop task (HTTP handlers go
+ * through the CommandMailbox).
  *
  * Usage:
  *   WifiManager wifi;
  *   wifi.begin("tinklink");
- *   wifi.connect("MyNetwork", "password");
+ *   wifi.setNetworks({{"Home", "password"}, {"Venue", "password"}});
+ *   wifi.connectKnown();  // Or wifi.connect("MyNetwork", "password")
  *   // In loop():
  *   wifi.update();  // Must be called regularly
  */
@@ -47,13 +99,30 @@ public:
         AP_ACTIVE      ///< Access Point is active
     };
 
-    /** Information about a discovered WiFi network */
+    /** Information about a discovered WiFi network (plain data) */
     struct NetworkInfo {
-        String ssid;              ///< Network name
-        int32_t rssi;             ///< Signal strength in dBm
+        char ssid[33];            ///< Network name
+        int8_t rssi;              ///< Signal strength in dBm (strongest AP of the SSID)
+        uint8_t channel;
+        uint8_t bssid[6];         ///< Strongest AP of the SSID
         uint8_t encryptionType;   ///< wifi_auth_mode_t value
     };
 
+    /** Most networks kept from a scan, strongest first */
+    static const uint8_t MAX_SCAN_RESULTS = 24;
+
+    /** Scan results published for other tasks */
+    struct ScanCache {
+        uint32_t updatedAt;       ///< millis() when the last scan finished (0 = never)
+        bool scanning;            ///< A refresh is pending or running
+        bool partial;             ///< Only the channels of interest were scanned (connected)
+        uint8_t count;
+        NetworkInfo networks[MAX_SCAN_RESULTS];
+    };
+
+    /** Age after which readers should ask for a fresh scan */
+    static const unsigned long SCAN_CACHE_TTL_MS = 60000;
+
     /** Access Point configuration */
     struct APConfig {
         String ssid;           ///< AP network name (generated from MAC)
@@ -65,13 +134,27 @@ public:
         IPAddress dhcpEnd;     ///< DHCP range end
     };
 
+    /** Static IPv4 settings; an ip of 0.0.0.0 means DHCP */
+    struct StaticIp {
+        IPAddress ip;
+        IPAddress gateway;
+        IPAddress subnet;
+        IPAddress dns;
+    };
+
+    /** Network credentials, as handed over from the web task */
+    struct Credentials {
+        String ssid;      ///< Network name
+        String password;  ///< Network password
+    };
+
     /** Callback type for state change notifications */
     using StateChangeCallback = std::function<void(State state)>;
 
     WifiManager();
 
     /**
-     * Initialize WiFi subsystem.
+     * Initialize WiFi subsystem and subscribe to WiFi events.
      * @param hostname mDNS hostname (without .local suffix)
      * @return true on success
      */
@@ -82,13 +165,55 @@ public:
 
     /**
      * Connect to a WiFi network (Station mode).
-     * Stops AP mode if active. Non-blocking - use update() to monitor.
+     * Stops AP mode if active. Non-blocking - the attempt starts at once,
+     * or from update() once a current link has dropped.
      * @param ssid Network name
      * @param password Network password
      * @return true if connection attempt started
      */
     bool connect(const String& ssid, const String& password);
 
+    /**
+     * Replace the saved networks. Takes effect from the next connect; a
+     * link to a network no longer listed stays up until it drops.
+     * @param networks Saved networks, most preferred first
+     */
+    void setNetworks(const std::vector<Credentials>& networks);
+
+    /**
+     * Connect to the best saved network in range (see class comment).
+     * With a single saved network, the same as connect() to it.
+     * @return false if no network is saved
+     */
+    bool connectKnown();
+
+    /**
+     * Use a static address instead of DHCP from the next connect on.
+     * @param config Addresses; ip 0.0.0.0 returns to DHCP
+     */
+    void setStaticIp(const StaticIp& config) { _staticIp = config; }
+
+    /**
+     * Apply the "network" section: the power mode takes effect at once
+     * (and survives mode changes), the probe interval from the next check.
+     * @param config Validated network settings
+     */
+    void configure(const NetworkConfig& config);
+
+    /** @return Power save mode in effect */
+    WifiPowerMode getPowerMode() const { return _network.powerMode; }
+
+    /**
+     * Probe the round trip to the gateway under the current power mode.
+     * @param count Echo requests
+     * @param intervalMs Time between requests
+     * @return false if not connected or a probe is already running
+     */
+    bool startProbe(uint16_t count, uint16_t intervalMs);
+
+    /** Round-trip probe, for reading results from any task */
+    const LatencyProbe& probe() const { return _probe; }
+
     /**
      * Disconnect from current network.
      * Does nothing in AP mode.
@@ -97,8 +222,9 @@ public:
 
     /**
      * Start Access Point mode for configuration.
-     * Creates an open hotspot with DHCP server.
-     * @return true if AP started successfully
+     * Creates an open hotspot with DHCP server. The state becomes
+     * AP_ACTIVE from update() once the driver reports the AP started.
+     * @return true if the AP was configured and is starting
      */
     bool startAccessPoint();
 
@@ -110,27 +236,29 @@ public:
 
     /**
      * Process WiFi state machine. Must be called regularly from loop().
-     * Handles connection monitoring, retry logic, and state transitions.
+     * Acts on WiFi events received since the last call, then on timers
+     * (connect timeout, retry backoff, AP reconnection).
      */
     void update();
 
     /**
-     * Start asynchronous network scan.
-     * @return false if scan already in progress
+     * Ask for the scan cache to be refreshed (any task). update() starts
+     * the scan once the device has been idle for SCAN_IDLE_MS; requests
+     * made meanwhile are merged into one scan.
      */
-    bool startScan();
+    void requestScan() { _scanRequested.store(true, std::memory_order_relaxed); }
 
     /**
-     * Check if network scan has completed.
-     * @return true if scan is done (or failed)
+     * Copy the scan cache (any task).
+     * @param out Receives the last results and whether a refresh is pending
      */
-    bool isScanComplete();
+    void readScan(ScanCache& out) const { _scanPublished.load(out); }
 
     /**
-     * Get scan results and clear scan state.
-     * @return Vector of discovered networks, empty if scan not complete
+     * Note device traffic that a scan would disturb (any task), e.g. an
+     * input change or a device command. Scans wait until SCAN_IDLE_MS after it.
      */
-    std::vector<NetworkInfo> getScanResults();
+    void noteActivity() { _lastActivity.store(millis(), std::memory_order_relaxed); }
 
     /** @return Current connection state */
     State getState() const { return _state; }
@@ -141,6 +269,13 @@ public:
     /** @return true if connected to a network (STA mode) */
     bool isConnected() const { return _state == State::CONNECTED; }
 
+    /**
+     * Get the version of the state reported in /api/status.
+     * Bumped on state/mode changes and RSSI moves of RSSI_CHANGE_DB or more.
+     * @return StateVersion of the last change
+     */
+    uint32_t getStateVersion() const { return _stateVersion.get(); }
+
     /**
      * Get current IP address.
      * @return IP as string, or empty if not connected
@@ -169,6 +304,36 @@ public:
     void onStateChange(StateChangeCallback callback);
 
 private:
+    /** Last good link, stored as an NVS blob for the next fast connect */
+    struct LinkCache {
+        uint8_t version;       ///< LINK_CACHE_VERSION
+        uint8_t channel;
+        uint8_t bssid[6];
+        uint8_t leaseReused;   ///< Lease came from the cache, not from DHCP
+        uint32_t ip;           ///< DHCP lease (0 = none, e.g. static IP)
+        uint32_t gateway;
+        uint32_t subnet;
+        uint32_t dns;
+        char ssid[33];
+    };
+
+    /** Saved network in range, in the order connectKnown() tries them */
+    struct Candidate {
+        Credentials network;
+        int score;             ///< RSSI less PRIORITY_BIAS_DB per place in the list
+        int8_t rssi;
+        uint8_t channel;       ///< 0 = not seen in the scan: let the driver find it
+        uint8_t bssid[6];
+    };
+
+    /** WiFi events recorded by onWifiEvent() for update() */
+    enum Event : uint32_t {
+        EVENT_STA_GOT_IP = 1 << 0,
+        EVENT_STA_DISCONNECTED = 1 << 1,
+        EVENT_STA_LOST_IP = 1 << 2,
+        EVENT_AP_STARTED = 1 << 3
+    };
+
     State _state;
     Mode _mode;
     String _hostname;
@@ -180,6 +345,56 @@ private:
     unsigned long _lastRetryTime;
     unsigned long _lastDisconnectCheck;  // Track transient disconnects
 
+    // Set by the WiFi event task, consumed by update()
+    std::atomic<uint32_t> _events;
+    std::atomic<uint8_t> _disconnectReason;
+    wifi_event_id_t _eventHandlerId;
+
+    // connect() while a link is up: WiFi.begin() waits for its disconnect event
+    bool _awaitingDisconnect;
+    unsigned long _disconnectRequestTime;
+
+    // Fast reconnect
+    LinkCache _cache;
+    bool _cacheValid;
+    bool _fastAttempt;        // Current attempt is directed at the cached BSSID/channel
+    bool _leaseReusable;      // Warm restart, lease not yet reused: skip DHCP once
+    bool _leaseInUse;         // Current attempt uses the cached lease
+    bool _leaseRenewing;      // DHCP restarted after connecting on the cached lease
+    unsigned long _attemptStartTime;
+    StaticIp _staticIp;
+
+    // Saved networks and selection among them
+    std::vector<Credentials> _networks;    // Most preferred first
+    std::vector<Candidate> _candidates;    // Ranked by the last selection scan
+    uint8_t _candidateIndex;               // Candidate being tried
+    bool _selecting;                       // Selection scan pending or running
+    String _selectSkip;                    // Network that just failed, left out of the ranking
+    uint8_t _targetChannel;                // AP the next attempt is directed at (0 = none)
+    uint8_t _targetBssid[6];
+
+    // Power mode and round-trip probe
+    NetworkConfig _network;
+    LatencyProbe _probe;
+    unsigned long _lastProbeTime;
+
+    // Scan cache: requests and activity from any task, the rest loop task only
+    std::atomic<bool> _scanRequested;
+    std::atomic<unsigned long> _lastActivity;
+    uint32_t _telnetBytes;                 // Telnet traffic seen by the last idle check
+    ScanCache _scan;
+    Seqlock<ScanCache> _scanPublished;
+    std::vector<NetworkInfo> _scanWork;    // Results merged across the channels of one scan
+    uint8_t _scanChannels[4];              // Channels to scan, 0 = all
+    uint8_t _scanChannelCount;
+    uint8_t _scanStep;                     // Next channel; == count when no scan is in progress
+    bool _scanStepRunning;
+    unsigned long _lastScanStepTime;
+
+    // startAccessPoint() done, AP-started event not yet seen
+    bool _apStarting;
+    unsigned long _apStartTime;
+
     // AP mode reconnection state
     bool _apReconnecting;
     unsigned long _lastApReconnectAttempt;
@@ -189,19 +404,102 @@ private:
     static const int MAX_RETRIES = 2;                        // 2 retries = 3 total attempts
     static const unsigned long BASE_RETRY_DELAY_MS = 5000;   // 5s, 10s delays
     static const unsigned long DISCONNECT_TOLERANCE_MS = 3000; // 3s tolerance for transient disconnects
+    static const unsigned long DISCONNECT_SETTLE_MS = 500;     // Longest wait for a requested disconnect
+    static const unsigned long AP_START_TIMEOUT_MS = 2000;     // Longest wait for the AP-started event
+    static const unsigned long FAST_CONNECT_TIMEOUT_MS = 3000; // Directed attempt before falling back to a scan
+    static const uint8_t LINK_CACHE_VERSION = 1;
+
+    // Selection among saved networks
+    static const int PRIORITY_BIAS_DB = 5;                     // RSSI handicap per place in the list
+    static const unsigned long CANDIDATE_TIMEOUT_MS = 8000;    // Attempt before moving to the next network
 
     // AP mode periodic reconnection to saved network
     static const unsigned long AP_RECONNECT_INTERVAL_MS = 30000;  // 30s between attempts
     static const unsigned long AP_RECONNECT_TIMEOUT_MS = 15000;   // 15s timeout per attempt
 
+    // RSSI drift that counts as a status change
+    static const unsigned long RSSI_CHECK_INTERVAL_MS = 5000;
+    static const int RSSI_CHANGE_DB = 3;
+
+    // Scanning
+    static const unsigned long SCAN_IDLE_MS = 3000;         // Quiet time before a scan starts
+    static const unsigned long SCAN_STEP_GAP_MS = 500;      // Time on the home channel between channels
+    static const uint32_t SCAN_DWELL_CONNECTED_MS = 120;    // Active dwell per channel while connected
+
+    // Periodic probe burst (probeIntervalSec > 0)
+    static const uint16_t PERIODIC_PROBE_COUNT = 5;
+    static const uint16_t PERIODIC_PROBE_INTERVAL_MS = 200;
+
     APConfig _apConfig;
     StateChangeCallback _stateCallback;
 
+    // Change tracking for /api/status
+    StateVersion _stateVersion;
+    int _reportedRssi;
+    unsigned long _lastRssiCheck;
+
+    /** WiFi event task: record the event for update(). */
+    void onWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+
     void setState(State newState);
     void setupMDNS();
     void generateAPConfig();
+    /**
+     * Set the address mode and hostname and start the station attempt for
+     * _ssid, directed at the cached AP if _fastAttempt.
+     */
+    void beginStation();
+
+    /**
+     * Apply the station address mode - static IP, the cached lease for a
+     * fast attempt, or DHCP - and the hostname. Also needed after every
+     * WiFi.mode() change, which resets both.
+     */
+    void applyAddressConfig();
+    /** Give up on the cached AP and start a scanning attempt, or a selection scan. */
+    void fallBackFromFastConnect(bool attemptEnded);
+    /**
+     * Stop AP mode and start a station attempt: to _ssid, or through a
+     * selection scan if select.
+     */
+    void startAttempt(bool select);
+    /**
+     * Start the pending station step - beginStation(), or the selection
+     * scan - now if no attempt is in progress (linkIdle), otherwise once
+     * the driver has dropped it.
+     */
+    void continueStation(bool linkIdle);
+    /** Scan all channels for the saved networks; selectCandidates() follows. */
+    void startSelectScan();
+    /** Rank the saved networks in range and try the best (scanned = results are fresh). */
+    void selectCandidates(bool scanned);
+    void targetCandidate(const Candidate& candidate);
+    void startCandidate(bool linkIdle);
+    /** The current attempt failed: next candidate, a selection scan, or FAILED. */
+    void failOver(bool attemptEnded);
+    /** @return Time the current attempt gets before failOver() */
+    unsigned long attemptTimeoutMs() const;
+    bool isKnown(const String& ssid) const;
+    void loadLinkCache();
+    void saveLinkCache();
+    void onStationConnected(const char* how);
+
+    /**
+     * Start DHCP on a link that came up on the cached lease. That lease is
+     * applied as a static address, so without this it is never renewed.
+     */
+    void renewCachedLease();
+    void onAccessPointStarted();
     void handleRetryLogic();
-    void handleApReconnect();
+    void handleApReconnect(uint32_t events);
+    /** Start, step or finish a cache refresh (from update()). */
+    void updateScan(unsigned long now);
+    bool isIdleForScan(unsigned long now);
+    void startScanStep();
+    void collectScanResults();
+    void finishScan(unsigned long now);
+    /** Stop a running scan before the station connects; the refresh is retried later. */
+    void abortScan();
     unsigned long getRetryDelay(int retryCount);
 };
 
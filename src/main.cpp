@@ -1,13 +1,15 @@
 #include <Arduino.h>
 #include <FastLED.h>
 #include "ConfigManager.h"
+#include "Devices.h"
 #include "Switcher.h"
-#include "SwitcherFactory.h"
 #include "RetroTink.h"
 #include "DenonAvr.h"
 #include "WifiManager.h"
 #include "WebServer.h"
 #include "Logger.h"
+#include "Metrics.h"
+#include "PullOta.h"
 #include "version.h"
 
 // WS2812 RGB LED configuration (loaded from config.json)
@@ -21,11 +23,10 @@ uint8_t ledPin = 21;  // Default for Waveshare ESP32-S3-Zero
 
 // Global instances
 ConfigManager configManager;
-Switcher* switcher = nullptr;
-RetroTink* tink = nullptr;
-DenonAvr* avr = nullptr;
+Devices devices;
 WifiManager wifiManager;
 WebServer webServer;
+PullOta pullOta;
 
 // LED manual control
 bool ledManualMode = false;
@@ -89,11 +90,22 @@ void setup() {
     LOG_RAW("========================================\n");
     LOG_RAW("\n");
 
-    // Initialize configuration manager (LittleFS) - load before hardware init
+    // Each step's duration is exported as tinklink_boot_phase_seconds
+    Metrics& metrics = Metrics::instance();
+    uint32_t phaseStart = micros();
+    auto endPhase = [&phaseStart, &metrics](Metrics::BootPhase phase) {
+        uint32_t now = micros();
+        metrics.recordBootPhase(phase, now - phaseStart);
+        phaseStart = now;
+    };
+
+    // Initialize configuration manager (NVS) - load before hardware init
     LOG_INFO("[1/6] Initializing configuration...");
     if (!configManager.begin()) {
         LOG_ERROR("Failed to initialize configuration manager!");
     }
+    metrics.recordConfigLoad(configManager.isMigrated(), configManager.getLoadTimeUs());
+    endPhase(Metrics::BootPhase::CONFIG);
 
     // Get configurations
     auto hardwareConfig = configManager.getHardwareConfig();
@@ -101,12 +113,11 @@ void setup() {
 
     // Store LED pin from config
     ledPin = hardwareConfig.ledPin;
-    String ledColorOrder = hardwareConfig.ledColorOrder;
 
     // Initialize WS2812 LED using configured pin and color order.
     // FastLED requires compile-time constants for both pin and color order,
     // so we enumerate supported combinations. Add new pins as needed.
-    if (ledColorOrder == "RGB") {
+    if (hardwareConfig.ledColorOrder == LedColorOrder::RGB) {
         switch (ledPin) {
             case 8:  FastLED.addLeds<WS2812, 8, RGB>(leds, NUM_LEDS); break;
             case 21: FastLED.addLeds<WS2812, 21, RGB>(leds, NUM_LEDS); break;
@@ -152,51 +163,49 @@ void setup() {
     LOG_DEBUG("LED Test: Off");
     leds[0] = CRGB::Black;
     FastLED.show();
+    endPhase(Metrics::BootPhase::LED);
 
     // Initialize RetroTINK controller
     LOG_INFO("[2/6] Initializing RetroTINK controller...");
-    tink = new RetroTink();
-    tink->configure(configManager.getRetroTinkConfig());
-    tink->begin();
+    devices.beginTink(configManager.getRetroTinkConfig());
 
     // Load triggers from config
     for (const auto& trigger : configManager.getTriggers()) {
-        tink->addTrigger(trigger);
+        devices.tink()->addTrigger(trigger);
     }
+    endPhase(Metrics::BootPhase::TINK);
 
     // Initialize AVR controller if enabled
     LOG_INFO("[3/6] Initializing AVR controller...");
-    if (configManager.isAvrEnabled()) {
-        avr = new DenonAvr();
-        avr->configure(configManager.getAvrConfig());
-        avr->begin();
-    } else {
-        LOG_INFO("AVR control disabled");
-    }
-
-    // Initialize video switcher
-    auto switcherType = configManager.getSwitcherType();
-    LOG_INFO("[4/6] Initializing %s...", switcherType.c_str());
-    switcher = SwitcherFactory::create(switcherType);
-    if (switcher) {
-        switcher->configure(configManager.getSwitcherConfig());
-        if (!switcher->begin()) {
-            LOG_ERROR("Failed to initialize switcher!");
-        }
-
-        // Connect switcher input changes to RetroTINK and AVR
-        switcher->onInputChange([](int input) {
-            LOG_INFO("Input change detected: %d", input);
-            tink->onSwitcherInputChange(input);
-            if (avr) avr->onInputChange();
-        });
-    } else {
-        LOG_ERROR("Unknown switcher type: %s", switcherType.c_str());
-    }
+    devices.beginAvr(configManager.getAvrConfig());
+    endPhase(Metrics::BootPhase::AVR);
+
+    // Initialize video switcher; input changes drive the RetroTINK and AVR
+    LOG_INFO("[4/6] Initializing %s...", configManager.getSwitcherType());
+    devices.beginSwitcher(configManager.getSwitcherConfig(), [](int input) {
+        LOG_INFO("Input change detected: %d", input);
+        Metrics::instance().recordInputChange();
+        pullOta.noteActivity();
+        wifiManager.noteActivity();
+        devices.tink()->onSwitcherInputChange(input);
+        if (devices.avr()) devices.avr()->onInputChange();
+    });
+    endPhase(Metrics::BootPhase::SWITCHER);
 
     // Initialize WiFi manager
     LOG_INFO("[5/6] Initializing WiFi...");
     wifiManager.begin(wifiConfig.hostname);
+    wifiManager.configure(configManager.getNetworkConfig());
+    if (wifiConfig.ip.length() > 0) {
+        // Validated by ConfigManager
+        WifiManager::StaticIp staticIp;
+        staticIp.ip.fromString(wifiConfig.ip);
+        staticIp.gateway.fromString(wifiConfig.gateway);
+        staticIp.subnet.fromString(wifiConfig.subnet);
+        staticIp.dns.fromString(wifiConfig.dns);
+        wifiManager.setStaticIp(staticIp);
+        LOG_INFO("Static IP: %s", wifiConfig.ip.c_str());
+    }
 
     // Set up WiFi state change callback
     wifiManager.onStateChange([](WifiManager::State state) {
@@ -220,44 +229,57 @@ void setup() {
     });
 
     // Auto-connect if credentials are saved, otherwise start AP mode
+    std::vector<WifiManager::Credentials> networks;
+    for (const auto& network : wifiConfig.networks) {
+        networks.push_back(WifiManager::Credentials{network.ssid, network.password});
+    }
+    wifiManager.setNetworks(networks);
     if (configManager.hasWifiCredentials()) {
-        LOG_INFO("Attempting to connect to saved network: %s", wifiConfig.ssid.c_str());
-        wifiManager.connect(wifiConfig.ssid, wifiConfig.password);
+        LOG_INFO("Attempting to connect to a saved network (%u known)", (unsigned)networks.size());
+        wifiManager.connectKnown();
     } else {
         LOG_INFO("No WiFi credentials saved - starting Access Point mode");
         LOG_INFO("Connect to the AP and configure WiFi via web interface");
         wifiManager.startAccessPoint();
     }
+    endPhase(Metrics::BootPhase::WIFI);
 
     // Initialize web server
     LOG_INFO("[6/6] Starting web server...");
-    webServer.begin(&wifiManager, &configManager, switcher, tink, &avr);
+    webServer.begin(&wifiManager, &configManager, &devices);
     webServer.setLEDCallback(setLEDColor);
 
+    // Pull OTA from a local manifest server (if configured)
+    pullOta.configure(configManager.getOtaConfig());
+    pullOta.begin();
+    webServer.setPullOta(&pullOta);
+    endPhase(Metrics::BootPhase::WEB);
+
     LOG_RAW("\n");
     LOG_RAW("========================================\n");
     LOG_RAW("  Initialization complete!\n");
     LOG_RAW("========================================\n");
     LOG_RAW("\n");
     LOG_INFO("Pin assignments:");
-    if (switcher) {
-        auto switcherConfig = configManager.getSwitcherConfig();
-        LOG_INFO("  Switcher TX:  GPIO%d", switcherConfig["txPin"] | 43);
-        LOG_INFO("  Switcher RX:  GPIO%d", switcherConfig["rxPin"] | 44);
+    if (devices.switcher()) {
+        const SwitcherConfig& switcherConfig = configManager.getSwitcherConfig();
+        LOG_INFO("  Switcher TX:  GPIO%d", switcherConfig.txPin);
+        LOG_INFO("  Switcher RX:  GPIO%d", switcherConfig.rxPin);
     }
-    auto tinkConfig = configManager.getRetroTinkConfig();
-    String tinkMode = tinkConfig["serialMode"] | "usb";
-    if (tinkMode == "uart") {
-        LOG_INFO("  Tink TX:      GPIO%d", tinkConfig["txPin"] | 17);
-        LOG_INFO("  Tink RX:      GPIO%d", tinkConfig["rxPin"] | 18);
+    const TinkConfig& tinkConfig = configManager.getRetroTinkConfig();
+    if (tinkConfig.serialMode == TinkSerialMode::UART) {
+        LOG_INFO("  Tink TX:      GPIO%d", tinkConfig.txPin);
+        LOG_INFO("  Tink RX:      GPIO%d", tinkConfig.rxPin);
     } else {
         LOG_INFO("  USB Host:     GPIO19 (D-) / GPIO20 (D+)");
     }
     LOG_INFO("  RGB LED:      GPIO%d", ledPin);
-    LOG_INFO("RetroTINK serial: %s", tinkMode.c_str());
+    LOG_INFO("RetroTINK serial: %s",
+             TinkConfig::SCHEMA.enumName("serialMode", (uint8_t)tinkConfig.serialMode));
     LOG_INFO("Serial debugging: disabled (use web console or scripts/logs.py)");
-    if (wifiManager.isAPActive()) {
-        LOG_INFO("Web interface: http://%s", wifiManager.getIP().c_str());
+    if (wifiManager.getMode() != WifiManager::Mode::STA) {
+        // The AP may still be starting; its address is fixed
+        LOG_INFO("Web interface: http://%s", wifiManager.getAPConfig().ip.toString().c_str());
     } else {
         String hostname = configManager.getWifiConfig().hostname;
         LOG_INFO("Web interface: http://%s.local", hostname.c_str());
@@ -265,17 +287,24 @@ void setup() {
 }
 
 void loop() {
+    unsigned long loopStart = micros();
+
     // Update WiFi connection state
     wifiManager.update();
 
-    // Process incoming switcher messages
-    if (switcher) switcher->update();
+    // Switcher, RetroTINK and AVR
+    devices.update();
+
+    // Web server housekeeping (device commands and config changes, status snapshot)
+    webServer.update();
 
-    // Process USB Host events and RT4K communication
-    tink->update();
+    // Write settings saved by web handlers once edits stop arriving
+    configManager.update();
 
-    // Process AVR commands and responses
-    if (avr) avr->update();
+    // Pull OTA: only download/apply while the RetroTINK is not in use
+    RT4KPowerState tinkPower = devices.tink()->getPowerState();
+    pullOta.update(tinkPower != RT4KPowerState::ON && tinkPower != RT4KPowerState::WAKING &&
+                   tinkPower != RT4KPowerState::BOOTING);
 
     // Check for manual LED mode timeout
     unsigned long now = millis();
@@ -312,4 +341,6 @@ void loop() {
 
         lastState = currentState;
     }
+
+    Metrics::instance().recordLoop(micros() - loopStart);
 }